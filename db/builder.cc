@@ -0,0 +1,76 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "db/builder.h"
+
+#include "db/dbformat.h"
+#include "db/filename.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+    Status BuildTable(const std::string &dbname, Env *env, const Options &options, TableCache *table_cache,
+                      Iterator *iter, FileMetaData *meta) {
+        Status s;
+        meta->file_size = 0;
+        iter->SeekToFirst();
+
+        std::string fname = TableFileName(dbname, meta->number);
+        if (iter->Valid()) {
+            WritableFile *file;
+            s = env->NewWritableFile(fname, &file);
+            if (!s.IsOK()) {
+                return s;
+            }
+
+            auto *builder = new TableBuilder(options, file);
+            meta->smallest.DecodeFrom(iter->Key());
+            Slice key;
+            for (; iter->Valid(); iter->Next()) {
+                key = iter->Key();
+                builder->Add(key, iter->Value());
+            }
+            if (!key.empty()) {
+                meta->largest.DecodeFrom(key);
+            }
+
+            s = builder->Finish();
+            if (s.IsOK()) {
+                meta->file_size = builder->FileSize();
+                assert(meta->file_size > 0);
+            }
+            delete builder;
+
+            if (s.IsOK()) {
+                s = file->Sync();
+            }
+            if (s.IsOK()) {
+                s = file->Close();
+            }
+            delete file;
+            file = nullptr;
+
+            if (s.IsOK()) {
+                // 确认生成的文件可以正常打开
+                Iterator *it = table_cache->NewIterator(ReadOptions(), meta->number, meta->file_size);
+                s = it->status();
+                delete it;
+            }
+        }
+
+        if (!iter->status().IsOK()) {
+            s = iter->status();
+        }
+
+        if (!s.IsOK() || meta->file_size == 0) {
+            env->RemoveFile(fname);
+        }
+        return s;
+    }
+
+}
@@ -0,0 +1,30 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_BUILDER_H
+#define MY_LEVELDB_BUILDER_H
+
+#include <string>
+
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    struct FileMetaData;
+
+    class Env;
+    class Iterator;
+    struct Options;
+    class TableCache;
+
+    /**
+     * @brief 把iter中的全部内容写成一个sstable, 文件名由meta->number生成.
+     * 成功时meta的其余字段被填充; iter为空时meta->file_size为0, 不生成文件.
+    */
+    Status BuildTable(const std::string &dbname, Env *env, const Options &options, TableCache *table_cache,
+                      Iterator *iter, FileMetaData *meta);
+
+}
+
+#endif //MY_LEVELDB_BUILDER_H
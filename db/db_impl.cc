@@ -2,22 +2,33 @@
 // Created by kuiper on 2021/2/20.
 //
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <deque>
+#include <memory>
+#include <new>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "db/builder.h"
 #include "db/db_impl.h"
+#include "db/db_iter.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "table/merger.h"
 
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/status.h"
 
 #include "util/coding.h"
@@ -38,6 +49,52 @@ namespace leveldb {
         port::CondVar cv;
     };
 
+    // 一次异步Get在memtable中未完成时异步查找sstable的状态, 持有mem/imm/version的引用.
+    struct DBImpl::AsyncGetState {
+        AsyncGetState(DBImpl *db, const ReadOptions &options, const Slice &key, SequenceNumber snapshot,
+                      std::string *value, GetCallback callback, void *arg)
+                : db(db), options(options), lkey(key, snapshot), value(value),
+                  mem(nullptr), imm(nullptr), current(nullptr), callback(callback), arg(arg) {}
+
+        DBImpl *db;
+        ReadOptions options;
+        LookupKey lkey;
+        std::string *value;
+        MergeContext merge_context;
+        MemTable *mem;
+        MemTableListVersion *imm;
+        Version *current;
+        Version::GetStats stats;
+        GetCallback callback;
+        void *arg;
+    };
+
+    // 一次异步MultiGet的状态, 每个没有在memtable中完成的key都发起一次Version::GetAsync,
+    // pending降为0时由最后一个完成的线程回调.
+    struct DBImpl::AsyncMultiGetState {
+        struct Key {
+            AsyncMultiGetState *state;
+            size_t index;
+        };
+
+        DBImpl *db;
+        ReadOptions options;
+        std::vector<Slice> keys;
+        std::vector<std::string> *values;
+        std::vector<Status> *statuses;
+        // LookupKey不可拷贝, deque的emplace_back不会移动已有元素.
+        std::deque<LookupKey> lkeys;
+        std::unique_ptr<MergeContext[]> merge_contexts;
+        std::unique_ptr<Version::GetStats[]> stats;
+        std::vector<Key> key_args;
+        std::atomic<size_t> pending;
+        MemTable *mem;
+        MemTableListVersion *imm;
+        Version *current;
+        MultiGetCallback callback;
+        void *arg;
+    };
+
     struct DBImpl::CompactionState {
         struct Output {
             uint64_t number;
@@ -53,7 +110,34 @@ namespace leveldb {
         if (static_cast<V>(*ptr) < minvalue) *ptr = minvalue;
     }
 
-    // FIXME SanitizeOptions
+    Options SanitizeOptions(const std::string &dbname, const InternalKeyComparator *icmp,
+                            const InternalFilterPolicy *ipolicy, const InternalFilterPolicy *bottommost_ipolicy,
+                            const Options &src) {
+        Options result = src;
+        result.comparator = icmp;
+        result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+        result.bottommost_filter_policy = (src.bottommost_filter_policy != nullptr) ? bottommost_ipolicy : nullptr;
+        ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
+        ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+        ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
+        ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+        // 只有一个memtable时没有位置放等待flush的imm, 写入会一直等待
+        ClipToRange(&result.max_write_buffer_number, 2, 64);
+        ClipToRange(&result.async_io_threads, 1, 256);
+        if (result.info_log == nullptr) {
+            // 在DB目录下打开日志文件, 失败时不记录日志
+            src.env->CreateDir(dbname);  // 失败时忽略
+            src.env->RenameFile(InfoLogFileName(dbname), OldInfoLogFileName(dbname));
+            Status s = src.env->NewLogger(InfoLogFileName(dbname), &result.info_log);
+            if (!s.IsOK()) {
+                result.info_log = nullptr;
+            }
+        }
+        if (result.block_cache == nullptr) {
+            result.block_cache = NewLRUCache(8 << 20);
+        }
+        return result;
+    }
 
     static int TableCacheSize(const Options &sanitized_options) {
         return sanitized_options.max_open_files - kNumNonTableCacheFiles;
@@ -62,17 +146,19 @@ namespace leveldb {
     DBImpl::DBImpl(const Options &raw_options, const std::string &dbname)
             : env_(raw_options.env),
               internal_comparator_(raw_options.comparator),
-            // filter_policy
-            // options
+              internal_filter_policy_(raw_options.filter_policy, raw_options.prefix_extractor),
+              internal_bottommost_filter_policy_(raw_options.bottommost_filter_policy, raw_options.prefix_extractor),
+              options_(SanitizeOptions(dbname, &internal_comparator_, &internal_filter_policy_,
+                                       &internal_bottommost_filter_policy_, raw_options)),
               owns_info_log_(options_.info_log != raw_options.info_log),
               owns_cache_(options_.block_cache != raw_options.block_cache),
               dbname_(dbname),
-              table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+              table_cache_(new TableCache(dbname_, options_, internal_comparator_.user_comparator(),
+                                         TableCacheSize(options_))),
               db_lock_(nullptr),
               shutting_down_(false),
               background_work_finish_signal_(&mutex_),
               mem_(nullptr),
-              imm_(nullptr),
               has_imm_(false),
               logfile_(nullptr),
               logfile_number_(0),
@@ -80,10 +166,9 @@ namespace leveldb {
               seed_(0),
               tmp_batch_(new WriteBatch),
               background_compaction_scheduled_(false),
-              manual_compaction_(nullptr)
-    // fixme versions_(new VersionSet)
-    {
-
+              manual_compaction_(nullptr),
+              versions_(new VersionSet(dbname_, &options_, table_cache_, &internal_comparator_)) {
+        env_->SetIOThreads(options_.async_io_threads);
     }
 
     DBImpl::~DBImpl() {
@@ -101,7 +186,6 @@ namespace leveldb {
 
         delete versions_;
         if (mem_ != nullptr) mem_->Unref();
-        if (imm_ != nullptr) imm_->Unref();
         delete tmp_batch_;
         delete log_;
         delete logfile_;
@@ -152,6 +236,757 @@ namespace leveldb {
         return DB::Delete(options, key);
     }
 
+    Status DBImpl::Merge(const WriteOptions &options, const Slice &key, const Slice &operand) {
+        if (options_.merge_operator == nullptr) {
+            return Status::NotSupported("Merge requires Options::merge_operator");
+        }
+        return DB::Merge(options, key, operand);
+    }
+
+    Status DBImpl::Get(const ReadOptions &options, const Slice &key, std::string *value) {
+        Status s;
+        MutexLock l(&mutex_);
+        SequenceNumber snapshot;
+        if (options.snapshot != nullptr) {
+            snapshot = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
+        }
+
+        MemTable *mem = mem_;
+        MemTableListVersion *imm = imm_.current();
+        Version *current = versions_->current();
+        mem->Ref();
+        imm->Ref();
+        current->Ref();
+
+        bool have_stat_update = false;
+        Version::GetStats stats;
+
+        // 查找期间不需要持有锁
+        {
+            mutex_.Unlock();
+            LookupKey lkey(key, snapshot);
+            // mem和imm中较新的operand先被收集, 找到base之后再一起折叠.
+            MergeContext merge_context;
+            if (mem->Get(lkey, value, &s, &merge_context)) {
+                // Done
+            } else if (imm->Get(lkey, value, &s, &merge_context)) {
+                // Done
+            } else {
+                s = current->Get(options, lkey, value, &merge_context, &stats);
+                have_stat_update = true;
+            }
+            // 所有层都没有base, operand直接折叠到空值上.
+            if (s.IsNotFound() && !merge_context.empty()) {
+                s = MergeHelper::FullMerge(options_.merge_operator, key, nullptr, merge_context, value);
+            }
+            mutex_.Lock();
+        }
+
+        if (have_stat_update && current->UpdateStats(stats)) {
+            MaybeScheduleCompaction();
+        }
+        mem->Unref();
+        imm->Unref();
+        current->Unref();
+        return s;
+    }
+
+    void DBImpl::GetAsync(const ReadOptions &options, const Slice &key, std::string *value,
+                          GetCallback callback, void *arg) {
+        AsyncGetState *state;
+        {
+            MutexLock l(&mutex_);
+            SequenceNumber snapshot;
+            if (options.snapshot != nullptr) {
+                snapshot = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+            } else {
+                snapshot = versions_->LastSequence();
+            }
+            state = new AsyncGetState(this, options, key, snapshot, value, callback, arg);
+            state->mem = mem_;
+            state->imm = imm_.current();
+            state->current = versions_->current();
+            state->mem->Ref();
+            state->imm->Ref();
+            state->current->Ref();
+        }
+
+        // memtable只有内存访问, 直接在调用线程中完成.
+        Status s;
+        if (state->mem->Get(state->lkey, value, &s, &state->merge_context) ||
+            state->imm->Get(state->lkey, value, &s, &state->merge_context)) {
+            if (s.IsNotFound() && !state->merge_context.empty()) {
+                s = MergeHelper::FullMerge(options_.merge_operator, key, nullptr, state->merge_context, value);
+            }
+            {
+                MutexLock l(&mutex_);
+                state->mem->Unref();
+                state->imm->Unref();
+                state->current->Unref();
+            }
+            delete state;
+            callback(arg, s);
+            return;
+        }
+
+        // sstable的data block通过RandomAccessFile::ReadAsync读取(TableCache::GetAsync),
+        // 调用线程不等待磁盘, 完成时在读取完成的线程中回调AsyncGetDone.
+        state->current->GetAsync(state->options, state->lkey, value, &state->merge_context, &state->stats,
+                                 &DBImpl::AsyncGetDone, state);
+    }
+
+    void DBImpl::AsyncGetDone(void *arg, const Status &status) {
+        auto *state = reinterpret_cast<AsyncGetState *>(arg);
+        DBImpl *db = state->db;
+
+        Status s = status;
+        if (s.IsNotFound() && !state->merge_context.empty()) {
+            s = MergeHelper::FullMerge(db->options_.merge_operator, state->lkey.user_key(), nullptr,
+                                       state->merge_context, state->value);
+        }
+
+        {
+            MutexLock l(&db->mutex_);
+            if (state->current->UpdateStats(state->stats)) {
+                db->MaybeScheduleCompaction();
+            }
+            state->mem->Unref();
+            state->imm->Unref();
+            state->current->Unref();
+        }
+
+        GetCallback callback = state->callback;
+        void *callback_arg = state->arg;
+        delete state;
+        callback(callback_arg, s);
+    }
+
+    void DBImpl::MultiGetAsync(const ReadOptions &options, const std::vector<Slice> &keys,
+                               std::vector<std::string> *values, std::vector<Status> *statuses,
+                               MultiGetCallback callback, void *arg) {
+        const size_t n = keys.size();
+        values->assign(n, std::string());
+        statuses->assign(n, Status());
+        if (n == 0) {
+            callback(arg);
+            return;
+        }
+
+        auto *state = new AsyncMultiGetState;
+        state->db = this;
+        state->options = options;
+        state->keys = keys;
+        state->values = values;
+        state->statuses = statuses;
+        state->merge_contexts.reset(new MergeContext[n]);
+        state->stats.reset(new Version::GetStats[n]);
+        state->callback = callback;
+        state->arg = arg;
+        SequenceNumber snapshot;
+        {
+            MutexLock l(&mutex_);
+            if (options.snapshot != nullptr) {
+                snapshot = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+            } else {
+                snapshot = versions_->LastSequence();
+            }
+            state->mem = mem_;
+            state->imm = imm_.current();
+            state->current = versions_->current();
+            state->mem->Ref();
+            state->imm->Ref();
+            state->current->Ref();
+        }
+
+        std::vector<const LookupKey *> lkey_ptrs(n);
+        for (size_t i = 0; i < n; ++i) {
+            state->lkeys.emplace_back(keys[i], snapshot);
+            lkey_ptrs[i] = &state->lkeys.back();
+        }
+        std::unique_ptr<bool[]> found(new bool[n]());
+        state->mem->MultiGet(lkey_ptrs.data(), n, values->data(), statuses->data(), found.get(),
+                             state->merge_contexts.get());
+        state->imm->MultiGet(lkey_ptrs.data(), n, values->data(), statuses->data(), found.get(),
+                             state->merge_contexts.get());
+
+        // 多计一次, 保证所有查找都发起之后才可能结束, 同步完成的查找不会提前释放state.
+        size_t remaining = 1;
+        for (size_t i = 0; i < n; ++i) {
+            remaining += !found[i];
+        }
+        state->pending.store(remaining, std::memory_order_relaxed);
+        state->key_args.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            if (found[i]) {
+                continue;
+            }
+            state->key_args[i] = {state, i};
+            state->current->GetAsync(state->options, state->lkeys[i], &(*values)[i], &state->merge_contexts[i],
+                                     &state->stats[i], &DBImpl::AsyncMultiGetKeyDone, &state->key_args[i]);
+        }
+        if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            FinishAsyncMultiGet(state);
+        }
+    }
+
+    void DBImpl::AsyncMultiGetKeyDone(void *arg, const Status &s) {
+        auto *key = reinterpret_cast<AsyncMultiGetState::Key *>(arg);
+        AsyncMultiGetState *state = key->state;
+        (*state->statuses)[key->index] = s;
+        if (state->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            FinishAsyncMultiGet(state);
+        }
+    }
+
+    void DBImpl::FinishAsyncMultiGet(AsyncMultiGetState *state) {
+        DBImpl *db = state->db;
+        const size_t n = state->keys.size();
+        for (size_t i = 0; i < n; ++i) {
+            if ((*state->statuses)[i].IsNotFound() && !state->merge_contexts[i].empty()) {
+                (*state->statuses)[i] = MergeHelper::FullMerge(db->options_.merge_operator, state->keys[i], nullptr,
+                                                               state->merge_contexts[i], &(*state->values)[i]);
+            }
+        }
+
+        {
+            MutexLock l(&db->mutex_);
+            bool need_compaction = false;
+            for (size_t i = 0; i < n; ++i) {
+                if (state->current->UpdateStats(state->stats[i])) {
+                    need_compaction = true;
+                }
+            }
+            if (need_compaction) {
+                db->MaybeScheduleCompaction();
+            }
+            state->mem->Unref();
+            state->imm->Unref();
+            state->current->Unref();
+        }
+
+        MultiGetCallback callback = state->callback;
+        void *callback_arg = state->arg;
+        delete state;
+        callback(callback_arg);
+    }
+
+    namespace {
+
+        // PinnableSlice的cleanup: memtable的引用计数需要在DB锁内修改.
+        void UnrefPinnedMemTable(void *arg1, void *arg2) {
+            MutexLock l(reinterpret_cast<port::Mutex *>(arg1));
+            reinterpret_cast<MemTable *>(arg2)->Unref();
+        }
+
+        void UnrefPinnedMemTableList(void *arg1, void *arg2) {
+            MutexLock l(reinterpret_cast<port::Mutex *>(arg1));
+            reinterpret_cast<MemTableListVersion *>(arg2)->Unref();
+        }
+
+    }  // anonymous namespace
+
+    Status DBImpl::Get(const ReadOptions &options, const Slice &key, PinnableSlice *value) {
+        value->Reset();
+        Status s;
+        MutexLock l(&mutex_);
+        SequenceNumber snapshot;
+        if (options.snapshot != nullptr) {
+            snapshot = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
+        }
+
+        MemTable *mem = mem_;
+        MemTableListVersion *imm = imm_.current();
+        Version *current = versions_->current();
+        mem->Ref();
+        imm->Ref();
+        current->Ref();
+
+        bool have_stat_update = false;
+        bool pinned_mem = false;
+        bool pinned_imm = false;
+        Version::GetStats stats;
+
+        {
+            mutex_.Unlock();
+            LookupKey lkey(key, snapshot);
+            MergeContext merge_context;
+            if (mem->Get(lkey, value, &s, &merge_context)) {
+                pinned_mem = value->IsPinned();
+            } else if (imm->Get(lkey, value, &s, &merge_context)) {
+                pinned_imm = value->IsPinned();
+            } else {
+                // 普通value直接指向data block, value持有block的引用
+                s = current->Get(options, lkey, value, &merge_context, &stats);
+                have_stat_update = true;
+            }
+            if (s.IsNotFound() && !merge_context.empty()) {
+                s = MergeHelper::FullMerge(options_.merge_operator, key, nullptr, merge_context, value->GetSelf());
+                if (s.IsOK()) {
+                    value->PinSelf();
+                }
+            }
+            mutex_.Lock();
+        }
+
+        if (have_stat_update && current->UpdateStats(stats)) {
+            MaybeScheduleCompaction();
+        }
+        // value直接指向memtable时, 把引用转交给value, 在value->Reset()时释放.
+        if (pinned_mem) {
+            value->RegisterCleanup(&UnrefPinnedMemTable, &mutex_, mem);
+        } else {
+            mem->Unref();
+        }
+        if (pinned_imm) {
+            value->RegisterCleanup(&UnrefPinnedMemTableList, &mutex_, imm);
+        } else {
+            imm->Unref();
+        }
+        current->Unref();
+        return s;
+    }
+
+    void DBImpl::MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                          std::vector<std::string> *values, std::vector<Status> *statuses) {
+        const size_t n = keys.size();
+        values->assign(n, std::string());
+        statuses->assign(n, Status());
+        if (n == 0) {
+            return;
+        }
+
+        // 整个batch只加一次锁, 共享同一个快照和同一组mem/imm/version引用.
+        MutexLock l(&mutex_);
+        SequenceNumber snapshot;
+        if (options.snapshot != nullptr) {
+            snapshot = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number();
+        } else {
+            snapshot = versions_->LastSequence();
+        }
+
+        MemTable *mem = mem_;
+        MemTableListVersion *imm = imm_.current();
+        Version *current = versions_->current();
+        mem->Ref();
+        imm->Ref();
+        current->Ref();
+
+        std::vector<Version::GetStats> stats;
+
+        {
+            mutex_.Unlock();
+            // LookupKey不可拷贝, deque的emplace_back不会移动已有元素.
+            std::deque<LookupKey> lkeys;
+            std::vector<const LookupKey *> lkey_ptrs(n);
+            for (size_t i = 0; i < n; ++i) {
+                lkeys.emplace_back(keys[i], snapshot);
+                lkey_ptrs[i] = &lkeys.back();
+            }
+            std::unique_ptr<MergeContext[]> merge_contexts(new MergeContext[n]);
+            std::unique_ptr<bool[]> found(new bool[n]());
+
+            // memtable一次有序遍历完成整个batch.
+            mem->MultiGet(lkey_ptrs.data(), n, values->data(), statuses->data(), found.get(),
+                          merge_contexts.get());
+            imm->MultiGet(lkey_ptrs.data(), n, values->data(), statuses->data(), found.get(),
+                          merge_contexts.get());
+
+            // 剩下的key按user_key排序后一起查找sstable: 每个文件只访问一次,
+            // 落在同一个data block中的key只Seek一次index, 只读取一次block.
+            std::vector<size_t> pending;
+            for (size_t i = 0; i < n; ++i) {
+                if (!found[i]) {
+                    pending.push_back(i);
+                }
+            }
+            const Comparator *ucmp = user_comparator();
+            std::sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+                return ucmp->Compare(keys[a], keys[b]) < 0;
+            });
+            std::vector<TableCache::GetContext> contexts(pending.size());
+            for (size_t j = 0; j < pending.size(); ++j) {
+                const size_t i = pending[j];
+                contexts[j] = {lkey_ptrs[i], &(*values)[i], &(*statuses)[i], &merge_contexts[i], false};
+            }
+            stats.resize(pending.size());
+            current->MultiGet(options, contexts.data(), contexts.size(), stats.data());
+
+            for (size_t i = 0; i < n; ++i) {
+                if ((*statuses)[i].IsNotFound() && !merge_contexts[i].empty()) {
+                    (*statuses)[i] = MergeHelper::FullMerge(options_.merge_operator, keys[i], nullptr,
+                                                            merge_contexts[i], &(*values)[i]);
+                }
+            }
+            mutex_.Lock();
+        }
+
+        bool need_compaction = false;
+        for (const Version::GetStats &stat : stats) {
+            if (current->UpdateStats(stat)) {
+                need_compaction = true;
+            }
+        }
+        if (need_compaction) {
+            MaybeScheduleCompaction();
+        }
+        mem->Unref();
+        imm->Unref();
+        current->Unref();
+    }
+
+    namespace {
+
+        struct IterState {
+            port::Mutex *const mu;
+            Version *const version GUARDED_BY(mu);
+            MemTable *const mem GUARDED_BY(mu);
+            MemTableListVersion *const imm GUARDED_BY(mu);
+
+            IterState(port::Mutex *mutex, MemTable *mem, MemTableListVersion *imm, Version *version)
+                    : mu(mutex), version(version), mem(mem), imm(imm) {}
+        };
+
+        void CleanupIteratorState(void *arg1, void *arg2) {
+            auto *state = reinterpret_cast<IterState *>(arg1);
+            state->mu->Lock();
+            state->mem->Unref();
+            state->imm->Unref();
+            state->version->Unref();
+            state->mu->Unlock();
+            delete state;
+        }
+
+        // IterState分配在迭代器的arena中, 内存随arena释放.
+        void CleanupArenaIteratorState(void *arg1, void *arg2) {
+            auto *state = reinterpret_cast<IterState *>(arg1);
+            state->mu->Lock();
+            state->mem->Unref();
+            state->imm->Unref();
+            state->version->Unref();
+            state->mu->Unlock();
+            state->~IterState();
+        }
+
+    }  // anonymous namespace
+
+    Iterator *DBImpl::NewInternalIterator(const ReadOptions &options, SequenceNumber *latest_snapshot,
+                                          uint32_t *seed, Arena *arena) {
+        mutex_.Lock();
+        *latest_snapshot = versions_->LastSequence();
+
+        // mem -> imm(新到旧) -> sstable
+        std::vector<Iterator *> list;
+        // prefix_same_as_start时memtable迭代器在Seek时用前缀bloom过滤.
+        list.push_back(mem_->NewIterator(options, arena));
+        mem_->Ref();
+        MemTableListVersion *imm = imm_.current();
+        imm->AddIterators(options, &list, arena);
+        imm->Ref();
+        // Version通过TableCache::NewIterator(options, FileMetaData)创建每个文件的迭代器,
+        // 与options中迭代范围不相交的文件不会被打开;
+        // prefix_same_as_start时table迭代器在Seek时先检查filter中的前缀.
+        versions_->current()->AddIterators(options, &list, arena);
+        Iterator *internal_iter = NewMergingIterator(&internal_comparator_, &list[0], list.size(), arena);
+        versions_->current()->Ref();
+
+        if (arena != nullptr) {
+            auto *cleanup = new(arena->AllocateAligned(sizeof(IterState)))
+                    IterState(&mutex_, mem_, imm, versions_->current());
+            internal_iter->RegisterCleanup(CleanupArenaIteratorState, cleanup, nullptr);
+        } else {
+            auto *cleanup = new IterState(&mutex_, mem_, imm, versions_->current());
+            internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+        }
+
+        *seed = ++seed_;
+        mutex_.Unlock();
+        return internal_iter;
+    }
+
+    MemTable *DBImpl::NewMemTable() const {
+        uint32_t prefix_bloom_bits = 0;
+        if (options_.prefix_extractor != nullptr && options_.memtable_prefix_bloom_size_ratio > 0) {
+            prefix_bloom_bits = static_cast<uint32_t>(
+                    static_cast<double>(options_.write_buffer_size) * 8 * options_.memtable_prefix_bloom_size_ratio);
+        }
+        return new MemTable(internal_comparator_, options_.merge_operator, options_.prefix_extractor,
+                            prefix_bloom_bits);
+    }
+
+    Iterator *DBImpl::NewIterator(const ReadOptions &options) {
+        SequenceNumber latest_snapshot;
+        uint32_t seed;
+        // 整个迭代器树分配在db_iter的arena中.
+        auto *db_iter = new ArenaWrappedDBIter;
+        Arena *arena = db_iter->GetArena();
+        Iterator *iter = NewInternalIterator(options, &latest_snapshot, &seed, arena);
+        db_iter->SetDBIter(NewDBIterator(&DBImpl::SampleRead, this, user_comparator(), iter,
+                                         (options.snapshot != nullptr
+                                          ? static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number()
+                                          : latest_snapshot),
+                                         seed, options_.merge_operator, options_.prefix_extractor, options,
+                                         arena));
+        return db_iter;
+    }
+
+    void DBImpl::SampleRead(void *db, const Slice &key) {
+        reinterpret_cast<DBImpl *>(db)->RecordReadSample(key);
+    }
+
+    void DBImpl::RecordReadSample(Slice key) {
+        MutexLock l(&mutex_);
+        if (versions_->current()->RecordReadSample(key)) {
+            MaybeScheduleCompaction();
+        }
+    }
+
+    void DBImpl::RecordBackgroundError(const Status &s) {
+        mutex_.AssertHeld();
+        if (bg_error_.IsOK()) {
+            bg_error_ = s;
+            // 唤醒等待flush的writer, 让它返回错误
+            background_work_finish_signal_.SignalAll();
+        }
+    }
+
+    void DBImpl::MaybeScheduleCompaction() {
+        mutex_.AssertHeld();
+        if (background_compaction_scheduled_) {
+            // 已经调度过了
+        } else if (shutting_down_.load(std::memory_order_acquire)) {
+            // DB正在关闭
+        } else if (!bg_error_.IsOK()) {
+            // 出错之后不再做任何变更
+        } else if (!imm_.IsFlushPending() && manual_compaction_ == nullptr &&
+                   !versions_->NeedsCompaction()) {
+            // 没有工作可做
+        } else {
+            background_compaction_scheduled_ = true;
+            env_->Schedule(&DBImpl::BGWork, this);
+        }
+    }
+
+    void DBImpl::BGWork(void *db) {
+        reinterpret_cast<DBImpl *>(db)->BackgroundCall();
+    }
+
+    void DBImpl::BackgroundCall() {
+        MutexLock l(&mutex_);
+        assert(background_compaction_scheduled_);
+        if (shutting_down_.load(std::memory_order_acquire)) {
+            // DB正在关闭, 不再开始新的工作
+        } else if (!bg_error_.IsOK()) {
+            // 出错之后不再做任何变更
+        } else {
+            BackgroundCompaction();
+        }
+
+        background_compaction_scheduled_ = false;
+
+        // flush期间可能又有memtable写满. 只在还有imm等待flush时重新调度,
+        // level compaction还没有实现, 否则NeedsCompaction会让后台线程空转.
+        if (imm_.IsFlushPending()) {
+            MaybeScheduleCompaction();
+        }
+        // MakeRoomForWrite中等待flush的writer, 以及析构函数
+        background_work_finish_signal_.SignalAll();
+    }
+
+    void DBImpl::BackgroundCompaction() {
+        mutex_.AssertHeld();
+        if (imm_.IsFlushPending()) {
+            CompactMemTable();
+            return;
+        }
+        // 基于大小/seek的compaction和手动compaction还没有实现(见CompactionState)
+    }
+
+    void DBImpl::RemoveObsoleteFiles() {
+        mutex_.AssertHeld();
+
+        if (!bg_error_.IsOK()) {
+            // 后台出错之后无法确定哪些文件还在使用
+            return;
+        }
+
+        std::set<uint64_t> live = pending_outputs_;
+        versions_->AddLiveFiles(&live);
+
+        std::vector<std::string> filenames;
+        env_->GetChildren(dbname_, &filenames);  // 忽略错误
+        uint64_t number;
+        FileType type;
+        std::vector<std::string> files_to_delete;
+        for (std::string &filename : filenames) {
+            if (ParseFileName(filename, &number, &type)) {
+                bool keep = true;
+                switch (type) {
+                    case kLogFile:
+                        keep = ((number >= versions_->LogNumber()) || (number == versions_->PrevLogNumber()));
+                        break;
+                    case kDescriptorFile:
+                        keep = (number >= versions_->ManifestFileNumber());
+                        break;
+                    case kTableFile:
+                    case kTempFile:
+                        keep = (live.find(number) != live.end());
+                        break;
+                    case kCurrentFile:
+                    case kDBLockFile:
+                    case kInfoLogFile:
+                        keep = true;
+                        break;
+                }
+
+                if (!keep) {
+                    files_to_delete.push_back(std::move(filename));
+                    if (type == kTableFile) {
+                        table_cache_->Evict(number);
+                        if (options_.persistent_cache != nullptr) {
+                            options_.persistent_cache->EraseFile(number);
+                        }
+                    }
+                }
+            }
+        }
+
+        // 删除文件时不需要持有锁, 这些文件已经不会再被引用
+        mutex_.Unlock();
+        for (const std::string &filename : files_to_delete) {
+            env_->RemoveFile(dbname_ + "/" + filename);
+        }
+        mutex_.Lock();
+    }
+
+    void DBImpl::CompactMemTable() {
+        mutex_.AssertHeld();
+        assert(imm_.IsFlushPending());
+
+        std::vector<MemTable *> mems;
+        imm_.PickMemtablesToFlush(&mems);
+        // 被选中的memtable都写在logfile_number_之前的log里, flush期间新切换出来的
+        // memtable只会使用更大的log编号.
+        const uint64_t log_number = logfile_number_;
+
+        VersionEdit edit;
+        Version *base = versions_->current();
+        base->Ref();
+        Status s = WriteLevel0Table(mems, &edit, base);
+        base->Unref();
+
+        if (s.IsOK() && shutting_down_.load(std::memory_order_acquire)) {
+            s = Status::IOError("Deleting DB during memtable compaction");
+        }
+
+        if (s.IsOK()) {
+            edit.SetPrevLogNumber(0);
+            edit.SetLogNumber(log_number);
+            s = versions_->LogAndApply(&edit, &mutex_);
+        }
+
+        if (s.IsOK()) {
+            imm_.RemoveFlushed(mems);
+            has_imm_.store(!imm_.empty(), std::memory_order_release);
+            RemoveObsoleteFiles();
+        } else {
+            imm_.RollbackMemtableFlush();
+            RecordBackgroundError(s);
+        }
+    }
+
+    Status DBImpl::WriteLevel0Table(const std::vector<MemTable *> &mems, VersionEdit *edit, Version *base) {
+        mutex_.AssertHeld();
+        const uint64_t start_micros = env_->NowMicros();
+        FileMetaData meta;
+        meta.number = versions_->NewFileNumber();
+        pending_outputs_.insert(meta.number);
+
+        // 多个imm合并成一个L0文件, 减少L0文件数和读放大.
+        std::vector<Iterator *> list;
+        list.reserve(mems.size());
+        for (MemTable *m : mems) {
+            list.push_back(m->NewIterator());
+        }
+        Iterator *iter = NewMergingIterator(&internal_comparator_, list.data(), list.size());
+
+        Status s;
+        {
+            mutex_.Unlock();
+            s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+            mutex_.Lock();
+        }
+        delete iter;
+        pending_outputs_.erase(meta.number);
+
+        int level = 0;
+        if (s.IsOK() && meta.file_size > 0) {
+            const Slice min_user_key = meta.smallest.user_key();
+            const Slice max_user_key = meta.largest.user_key();
+            if (base != nullptr) {
+                level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+            }
+            edit->AddFile(level, meta.number, meta.file_size, meta.smallest, meta.largest);
+        }
+
+        CompactionStats stats;
+        stats.micros = env_->NowMicros() - start_micros;
+        stats.bytes_written = meta.file_size;
+        stats_[level].Add(stats);
+        return s;
+    }
+
+    Status DBImpl::MakeRoomForWrite(bool force) {
+        mutex_.AssertHeld();
+        assert(!writers_.empty());
+        bool allow_delay = !force;
+        Status s;
+        while (true) {
+            if (!bg_error_.IsOK()) {
+                s = bg_error_;
+                break;
+            } else if (allow_delay && versions_->NumLevelFiles(0) >= config::kL0_SlowdownWritesTrigger) {
+                // L0文件太多, 每个写入延迟1ms, 把CPU让给compaction线程.
+                // level compaction还没有实现, L0达到kL0_StopWritesTrigger时不停止写入, 否则会永远等待.
+                mutex_.Unlock();
+                env_->SleepForMicroseconds(1000);
+                allow_delay = false;
+                mutex_.Lock();
+            } else if (!force && (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+                // 当前memtable还有空间
+                break;
+            } else if (imm_.NumMemTables() >= options_.max_write_buffer_number - 1) {
+                // 排队等待flush的memtable已经满了, BackgroundCall在flush结束后唤醒
+                background_work_finish_signal_.Wait();
+            } else {
+                // 切换到新的memtable和log, 旧的memtable进入flush队列.
+                assert(versions_->PrevLogNumber() == 0);
+                uint64_t new_log_number = versions_->NewFileNumber();
+                WritableFile *lfile = nullptr;
+                s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+                if (!s.IsOK()) {
+                    versions_->ReuseFileNumber(new_log_number);
+                    break;
+                }
+                delete log_;
+                delete logfile_;
+                logfile_ = lfile;
+                logfile_number_ = new_log_number;
+                log_ = new log::Writer(lfile);
+                imm_.Add(mem_);
+                has_imm_.store(true, std::memory_order_release);
+                mem_ = NewMemTable();
+                mem_->Ref();
+                force = false;
+                MaybeScheduleCompaction();
+            }
+        }
+        return s;
+    }
+
     Status DBImpl::Write(const WriteOptions &options, WriteBatch *updates) {
         Writer w(&mutex_);
         w.batch = updates;
@@ -178,6 +1013,10 @@ namespace leveldb {
     ////////////////////////////////////////////////////////////////////////////////////////////
     // DB::Put
     // DB::Delete
+    // DB::Merge
+    // DB::Get(PinnableSlice)
+    // DB::GetAsync
+    // DB::MultiGetAsync
     // DB::Open
     // DestroyDB
 
@@ -194,6 +1033,34 @@ namespace leveldb {
         return Write(options, &batch);
     }
 
+    Status DB::Get(const ReadOptions &options, const Slice &key, PinnableSlice *value) {
+        value->Reset();
+        Status s = Get(options, key, value->GetSelf());
+        if (s.IsOK()) {
+            value->PinSelf();
+        }
+        return s;
+    }
+
+    Status DB::Merge(const WriteOptions &options, const Slice &key, const Slice &operand) {
+        WriteBatch batch;
+        batch.Merge(key, operand);
+        return Write(options, &batch);
+    }
+
+    void DB::GetAsync(const ReadOptions &options, const Slice &key, std::string *value,
+                      GetCallback callback, void *arg) {
+        Status s = Get(options, key, value);
+        callback(arg, s);
+    }
+
+    void DB::MultiGetAsync(const ReadOptions &options, const std::vector<Slice> &keys,
+                           std::vector<std::string> *values, std::vector<Status> *statuses,
+                           MultiGetCallback callback, void *arg) {
+        MultiGet(options, keys, values, statuses);
+        callback(arg);
+    }
+
     Status DB::Open(const Options &options, const std::string &name, DB **dbptr) {
 
     }
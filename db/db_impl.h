@@ -9,9 +9,11 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
+#include "db/memtable_list.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -21,6 +23,7 @@
 
 namespace leveldb {
 
+    class Arena;
     class MemTable;
     class TableCache;
     class Version;
@@ -38,10 +41,24 @@ namespace leveldb {
 
         Status Delete(const WriteOptions &options, const Slice &key) override;
 
+        Status Merge(const WriteOptions &options, const Slice &key, const Slice &operand) override;
+
         Status Write(const WriteOptions &options, WriteBatch *updates) override;
 
         Status Get(const ReadOptions &options, const Slice &key, std::string *value) override;
 
+        Status Get(const ReadOptions &options, const Slice &key, PinnableSlice *value) override;
+
+        void MultiGet(const ReadOptions &options, const std::vector<Slice> &keys,
+                      std::vector<std::string> *values, std::vector<Status> *statuses) override;
+
+        void GetAsync(const ReadOptions &options, const Slice &key, std::string *value,
+                      GetCallback callback, void *arg) override;
+
+        void MultiGetAsync(const ReadOptions &options, const std::vector<Slice> &keys,
+                           std::vector<std::string> *values, std::vector<Status> *statuses,
+                           MultiGetCallback callback, void *arg) override;
+
         Iterator *NewIterator(const ReadOptions &options) override;
 
         const Snapshot *GetSnapshot() override;
@@ -69,6 +86,8 @@ namespace leveldb {
 
         struct CompactionState;
         struct Writer;
+        struct AsyncGetState;
+        struct AsyncMultiGetState;
 
         // 手工compaction的信息.
         struct ManualCompaction {
@@ -96,8 +115,13 @@ namespace leveldb {
             int64_t bytes_written;
         };
 
+        // 按options_创建新的memtable(merge_operator, 前缀bloom).
+        MemTable *NewMemTable() const;
+
+        // arena不为nullptr时整个内部迭代器树(包括cleanup状态)都分配在arena中.
         Iterator *NewInternalIterator(const ReadOptions &read_options,
-                                      SequenceNumber *latest_snapshot, uint32_t *seed);
+                                      SequenceNumber *latest_snapshot, uint32_t *seed,
+                                      Arena *arena = nullptr);
 
         Status NewDB();
 
@@ -115,7 +139,9 @@ namespace leveldb {
                               VersionEdit *edit,
                               SequenceNumber *max_sequence) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-        Status WriteLevel0Table(MemTable *mem, VersionEdit *edit, Version *base) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+        // 把mems(从旧到新)合并写成一个L0文件.
+        Status WriteLevel0Table(const std::vector<MemTable *> &mems, VersionEdit *edit,
+                                Version *base) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
         Status MakeRoomForWrite(bool force) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -127,6 +153,17 @@ namespace leveldb {
 
         static void BGWork(void *db);
 
+        // DBIter的读取采样, 转发给RecordReadSample.
+        static void SampleRead(void *db, const Slice &key);
+
+        // 异步Get的sstable查找完成.
+        static void AsyncGetDone(void *state, const Status &s);
+
+        // 异步MultiGet中一个key的sstable查找完成, 最后一个完成时回调.
+        static void AsyncMultiGetKeyDone(void *key, const Status &s);
+
+        static void FinishAsyncMultiGet(AsyncMultiGetState *state);
+
         void BackgroundCall();
 
         void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -148,7 +185,8 @@ namespace leveldb {
     private:
         Env *const env_;
         const InternalKeyComparator internal_comparator_;
-        // const InternalFilterPolicy internal_filter_policy_;
+        const InternalFilterPolicy internal_filter_policy_;
+        const InternalFilterPolicy internal_bottommost_filter_policy_;
         const Options options_;
         const bool owns_info_log_;
         const bool owns_cache_;
@@ -161,7 +199,7 @@ namespace leveldb {
         std::atomic<bool> shutting_down_;
         port::CondVar background_work_finish_signal_ GUARDED_BY(mutex_);
         MemTable *mem_;
-        MemTable *imm_ GUARDED_BY(mutex_);
+        MemTableList imm_ GUARDED_BY(mutex_);   // 等待flush的memtable, 新 -> 旧
         std::atomic<bool> has_imm_;
         WritableFile *logfile_;
         uint64_t logfile_number_ GUARDED_BY(mutex_);
@@ -186,10 +224,11 @@ namespace leveldb {
 
     // Sanitize db options.  The caller should delete result.info_log if
     // it is not equal to src.info_log.
-    // Options SanitizeOptions(const std::string& db,
-    //                        const InternalKeyComparator* icmp,
-    //                        const InternalFilterPolicy* ipolicy,
-    //                        const Options& src);
+    Options SanitizeOptions(const std::string &db,
+                            const InternalKeyComparator *icmp,
+                            const InternalFilterPolicy *ipolicy,
+                            const InternalFilterPolicy *bottommost_ipolicy,
+                            const Options &src);
 }
 
 #endif //MY_LEVELDB_DB_IMPL_H
@@ -0,0 +1,500 @@
+//
+// Created by kuiper on 2021/3/9.
+//
+
+#include "db/db_iter.h"
+
+#include <new>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+    namespace {
+
+        // memtable和sstable中同一个user_key可能有多条记录, 按sequence从新到旧排列.
+        // DBIter把它们合并成用户可见的一条: 取snapshot可见的最新一条,
+        // 删除标记隐藏更旧的记录, merge记录与更旧的记录折叠成一个值.
+        //
+        // 正向移动时, 未折叠的记录直接返回iter_当前位置的key/value;
+        // 反向移动时, iter_位于当前key所有记录之前, key/value保存在saved_key_/saved_value_中.
+        class DBIter : public Iterator {
+        public:
+            enum Direction {
+                kForward, kReverse
+            };
+
+            DBIter(ReadSampleFunction sample, void *sample_arg, const Comparator *cmp, Iterator *iter,
+                   SequenceNumber s, uint32_t seed, const MergeOperator *merge_operator,
+                   const SliceTransform *prefix_extractor, const ReadOptions &read_options, bool is_arena_mode)
+                    : sample_(sample),
+                      sample_arg_(sample_arg),
+                      user_comparator_(cmp),
+                      iter_(iter),
+                      sequence_(s),
+                      merge_operator_(merge_operator),
+                      prefix_extractor_(prefix_extractor),
+                      lower_bound_(read_options.iterate_lower_bound),
+                      upper_bound_(read_options.iterate_upper_bound),
+                      prefix_same_as_start_(read_options.prefix_same_as_start && prefix_extractor != nullptr),
+                      prefix_active_(false),
+                      is_arena_mode_(is_arena_mode),
+                      direction_(kForward),
+                      valid_(false),
+                      current_entry_is_merged_(false),
+                      rnd_(seed),
+                      bytes_until_read_sampling_(RandomCompactionPeriod()) {
+            }
+
+            DBIter(const DBIter &) = delete;
+
+            DBIter &operator=(const DBIter &) = delete;
+
+            ~DBIter() override {
+                if (is_arena_mode_) {
+                    iter_->~Iterator();
+                } else {
+                    delete iter_;
+                }
+            }
+
+            bool Valid() const override { return valid_; }
+
+            Slice Key() const override {
+                assert(valid_);
+                return (direction_ == kForward && !current_entry_is_merged_) ? ExtractUserKey(iter_->Key())
+                                                                             : saved_key_;
+            }
+
+            Slice Value() const override {
+                assert(valid_);
+                return (direction_ == kForward && !current_entry_is_merged_) ? iter_->Value() : saved_value_;
+            }
+
+            Status status() const override {
+                if (status_.IsOK()) {
+                    return iter_->status();
+                } else {
+                    return status_;
+                }
+            }
+
+            void Next() override;
+
+            void Prev() override;
+
+            void Seek(const Slice &target) override;
+
+            void SeekToFirst() override;
+
+            void SeekToLast() override;
+
+        private:
+            void FindNextUserEntry(bool skipping, std::string *skip);
+
+            void FindPrevUserEntry();
+
+            // iter_位于saved_key_最新的可见merge记录上, 向后收集operand直到遇到base或者其它key.
+            void MergeValuesNewToOld();
+
+            bool ParseKey(ParsedInternalKey *key);
+
+            // prefix_seek时用SeekForPrefix定位iter_, 允许内部迭代器按前缀过滤.
+            void SeekImpl(const Slice &target, bool prefix_seek);
+
+            bool BeyondUpperBound(const Slice &user_key) const {
+                return upper_bound_ != nullptr && user_comparator_->Compare(user_key, *upper_bound_) >= 0;
+            }
+
+            bool BeforeLowerBound(const Slice &user_key) const {
+                return lower_bound_ != nullptr && user_comparator_->Compare(user_key, *lower_bound_) < 0;
+            }
+
+            // prefix_same_as_start时user_key已经离开了Seek target的前缀.
+            // 前缀相同的key是连续的, 离开之后不会再回来.
+            bool OutOfPrefix(const Slice &user_key) const {
+                return prefix_active_ && (!prefix_extractor_->InDomain(user_key) ||
+                                          prefix_extractor_->Transform(user_key) != Slice(prefix_start_));
+            }
+
+            inline void SaveKey(const Slice &k, std::string *dst) {
+                dst->assign(k.data(), k.size());
+            }
+
+            inline void ClearSavedValue() {
+                if (saved_value_.capacity() > 1048576) {
+                    std::string empty;
+                    std::swap(empty, saved_value_);
+                } else {
+                    saved_value_.clear();
+                }
+                merge_operands_.clear();
+            }
+
+            // 选取一个随机的读取字节数作为下一次采样的间隔.
+            size_t RandomCompactionPeriod() {
+                return rnd_.Uniform(2 * config::kReadBytesPeriod);
+            }
+
+            const ReadSampleFunction sample_;
+            void *const sample_arg_;
+            const Comparator *const user_comparator_;
+            Iterator *const iter_;
+            SequenceNumber const sequence_;
+            const MergeOperator *const merge_operator_;
+            const SliceTransform *const prefix_extractor_;
+            const Slice *const lower_bound_;    // inclusive
+            const Slice *const upper_bound_;    // exclusive
+            const bool prefix_same_as_start_;
+            bool prefix_active_;        // 最近一次定位是Seek并且target在prefix_extractor的domain中
+            std::string prefix_start_;  // Seek target的前缀
+            const bool is_arena_mode_;  // iter_分配在arena中
+            Status status_;
+            std::string saved_key_;     // 反向或者折叠过的记录: 当前的key; 正向时: 需要跳过的key
+            std::string saved_value_;   // 反向或者折叠过的记录: 当前的value
+            std::vector<std::string> merge_operands_;   // 反向时当前key的operand, 旧 -> 新
+            Direction direction_;
+            bool valid_;
+            bool current_entry_is_merged_;  // 正向时当前记录是否是折叠出来的, iter_已经越过了这个key
+            Random rnd_;
+            size_t bytes_until_read_sampling_;
+        };
+
+        inline bool DBIter::ParseKey(ParsedInternalKey *ikey) {
+            Slice k = iter_->Key();
+
+            size_t bytes_read = k.size() + iter_->Value().size();
+            while (bytes_until_read_sampling_ < bytes_read) {
+                bytes_until_read_sampling_ += RandomCompactionPeriod();
+                if (sample_ != nullptr) {
+                    (*sample_)(sample_arg_, k);
+                }
+            }
+            assert(bytes_until_read_sampling_ >= bytes_read);
+            bytes_until_read_sampling_ -= bytes_read;
+
+            if (!ParseInternalKey(k, ikey)) {
+                status_ = Status::Corruption("corrupted internal key in DBIter");
+                return false;
+            } else {
+                return true;
+            }
+        }
+
+        void DBIter::Next() {
+            assert(valid_);
+
+            if (direction_ == kReverse) {
+                direction_ = kForward;
+                // iter_位于当前key所有记录之前, 先移动到这些记录上,
+                // saved_key_中已经是需要跳过的key.
+                if (!iter_->Valid()) {
+                    iter_->SeekToFirst();
+                } else {
+                    iter_->Next();
+                }
+                if (!iter_->Valid()) {
+                    valid_ = false;
+                    saved_key_.clear();
+                    return;
+                }
+            } else if (current_entry_is_merged_) {
+                // 折叠时iter_已经越过了当前key的operand, saved_key_中是当前key.
+                if (!iter_->Valid()) {
+                    valid_ = false;
+                    saved_key_.clear();
+                    return;
+                }
+            } else {
+                SaveKey(ExtractUserKey(iter_->Key()), &saved_key_);
+                iter_->Next();
+                if (!iter_->Valid()) {
+                    valid_ = false;
+                    saved_key_.clear();
+                    return;
+                }
+            }
+
+            FindNextUserEntry(true, &saved_key_);
+        }
+
+        void DBIter::FindNextUserEntry(bool skipping, std::string *skip) {
+            assert(iter_->Valid());
+            assert(direction_ == kForward);
+            current_entry_is_merged_ = false;
+            do {
+                ParsedInternalKey ikey;
+                if (ParseKey(&ikey)) {
+                    // 已经越过了上界, 后面的记录都不需要再读.
+                    if (BeyondUpperBound(ikey.user_key) || OutOfPrefix(ikey.user_key)) {
+                        break;
+                    }
+                    if (ikey.sequence <= sequence_) {
+                        if (skipping && user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+                            // 被更新的记录覆盖或者删除
+                        } else {
+                            switch (ikey.type) {
+                                case kTypeDeletion:
+                                    // 跳过这个key之后所有更旧的记录
+                                    SaveKey(ikey.user_key, skip);
+                                    skipping = true;
+                                    break;
+                                case kTypeValue:
+                                    valid_ = true;
+                                    saved_key_.clear();
+                                    return;
+                                case kTypeMerge:
+                                    SaveKey(ikey.user_key, &saved_key_);
+                                    MergeValuesNewToOld();
+                                    return;
+                            }
+                        }
+                    }
+                }
+                iter_->Next();
+            } while (iter_->Valid());
+            saved_key_.clear();
+            valid_ = false;
+        }
+
+        void DBIter::MergeValuesNewToOld() {
+            MergeContext merge_context;
+            merge_context.PushOperand(iter_->Value());
+
+            Slice base;
+            bool has_base = false;
+            for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+                ParsedInternalKey ikey;
+                if (!ParseKey(&ikey)) {
+                    break;
+                }
+                if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+                    break;
+                }
+                // 同一个key后面的记录sequence更小, 都是可见的.
+                if (ikey.type == kTypeDeletion) {
+                    break;
+                } else if (ikey.type == kTypeValue) {
+                    // iter_停在base上, 剩下的记录由Next中的skip跳过
+                    base = iter_->Value();
+                    has_base = true;
+                    break;
+                } else {
+                    merge_context.PushOperand(iter_->Value());
+                }
+            }
+
+            Status s = MergeHelper::FullMerge(merge_operator_, saved_key_, has_base ? &base : nullptr,
+                                              merge_context, &saved_value_);
+            if (s.IsOK()) {
+                valid_ = true;
+                current_entry_is_merged_ = true;
+            } else {
+                status_ = s;
+                valid_ = false;
+                current_entry_is_merged_ = false;
+                saved_key_.clear();
+            }
+        }
+
+        void DBIter::Prev() {
+            assert(valid_);
+
+            if (direction_ == kForward) {
+                // iter_位于当前key的记录上(折叠过的记录则已经越过了当前key),
+                // 往前移动到所有<当前key的记录上.
+                if (current_entry_is_merged_) {
+                    if (!iter_->Valid()) {
+                        iter_->SeekToLast();
+                    }
+                } else {
+                    assert(iter_->Valid());
+                    SaveKey(ExtractUserKey(iter_->Key()), &saved_key_);
+                }
+                while (iter_->Valid() && user_comparator_->Compare(ExtractUserKey(iter_->Key()), saved_key_) >= 0) {
+                    iter_->Prev();
+                }
+                current_entry_is_merged_ = false;
+                if (!iter_->Valid()) {
+                    valid_ = false;
+                    saved_key_.clear();
+                    ClearSavedValue();
+                    return;
+                }
+                direction_ = kReverse;
+            }
+
+            FindPrevUserEntry();
+        }
+
+        void DBIter::FindPrevUserEntry() {
+            assert(direction_ == kReverse);
+
+            ValueType value_type = kTypeDeletion;
+            bool has_base = false;
+            if (iter_->Valid()) {
+                do {
+                    ParsedInternalKey ikey;
+                    if (ParseKey(&ikey)) {
+                        // 已经越过了下界
+                        if (BeforeLowerBound(ikey.user_key) || OutOfPrefix(ikey.user_key)) {
+                            break;
+                        }
+                        // iter_可能还停在上界之后, 例如SeekToLast的Seek(upper_bound)出错之后SeekToLast
+                        if (!BeyondUpperBound(ikey.user_key) && ikey.sequence <= sequence_) {
+                            if ((value_type != kTypeDeletion) &&
+                                user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+                                // 已经到了前一个key的记录上, saved_key_的结果已经确定.
+                                break;
+                            }
+                            // 同一个key的记录从旧到新出现
+                            value_type = ikey.type;
+                            if (value_type == kTypeDeletion) {
+                                saved_key_.clear();
+                                ClearSavedValue();
+                                has_base = false;
+                            } else if (value_type == kTypeValue) {
+                                Slice raw_value = iter_->Value();
+                                if (saved_value_.capacity() > raw_value.size() + 1048576) {
+                                    std::string empty;
+                                    std::swap(empty, saved_value_);
+                                }
+                                SaveKey(ExtractUserKey(iter_->Key()), &saved_key_);
+                                saved_value_.assign(raw_value.data(), raw_value.size());
+                                merge_operands_.clear();
+                                has_base = true;
+                            } else {
+                                if (!has_base && merge_operands_.empty()) {
+                                    // 这个key之前没有可见的记录, 或者被删除了
+                                    SaveKey(ExtractUserKey(iter_->Key()), &saved_key_);
+                                }
+                                merge_operands_.push_back(iter_->Value().ToString());
+                            }
+                        }
+                    }
+                    iter_->Prev();
+                } while (iter_->Valid());
+            }
+
+            if (value_type != kTypeDeletion && !merge_operands_.empty()) {
+                MergeContext merge_context;
+                for (auto it = merge_operands_.rbegin(); it != merge_operands_.rend(); ++it) {
+                    merge_context.PushOperand(*it);
+                }
+                std::string base;
+                if (has_base) {
+                    base.swap(saved_value_);
+                }
+                Slice base_slice(base);
+                Status s = MergeHelper::FullMerge(merge_operator_, saved_key_, has_base ? &base_slice : nullptr,
+                                                  merge_context, &saved_value_);
+                merge_operands_.clear();
+                if (!s.IsOK()) {
+                    status_ = s;
+                    value_type = kTypeDeletion;
+                }
+            }
+
+            if (value_type == kTypeDeletion) {
+                // 到达开头或者下界
+                valid_ = false;
+                saved_key_.clear();
+                ClearSavedValue();
+                direction_ = kForward;
+            } else {
+                valid_ = true;
+            }
+        }
+
+        void DBIter::Seek(const Slice &target) {
+            prefix_active_ = false;
+            if (prefix_same_as_start_ && prefix_extractor_->InDomain(target)) {
+                Slice prefix = prefix_extractor_->Transform(target);
+                prefix_start_.assign(prefix.data(), prefix.size());
+                prefix_active_ = true;
+            }
+            SeekImpl(target, prefix_active_);
+        }
+
+        void DBIter::SeekImpl(const Slice &target, bool prefix_seek) {
+            direction_ = kForward;
+            ClearSavedValue();
+            saved_key_.clear();
+            Slice start = target;
+            if (BeforeLowerBound(target)) {
+                // 从下界开始, 下界的前缀不一定与target相同, 不能按前缀过滤
+                start = *lower_bound_;
+                prefix_seek = false;
+            }
+            AppendInternalKey(&saved_key_, ParsedInternalKey(start, sequence_, kValueTypeForSeek));
+            if (prefix_seek) {
+                iter_->SeekForPrefix(saved_key_);
+            } else {
+                iter_->Seek(saved_key_);
+            }
+            if (iter_->Valid()) {
+                FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+            } else {
+                valid_ = false;
+            }
+        }
+
+        void DBIter::SeekToFirst() {
+            prefix_active_ = false;
+            if (lower_bound_ != nullptr) {
+                SeekImpl(*lower_bound_, false);
+                return;
+            }
+            direction_ = kForward;
+            ClearSavedValue();
+            iter_->SeekToFirst();
+            if (iter_->Valid()) {
+                FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+            } else {
+                valid_ = false;
+            }
+        }
+
+        void DBIter::SeekToLast() {
+            prefix_active_ = false;
+            direction_ = kReverse;
+            current_entry_is_merged_ = false;
+            ClearSavedValue();
+            if (upper_bound_ != nullptr) {
+                // 定位到第一条>=upper_bound的记录, 再往前退一步.
+                saved_key_.clear();
+                AppendInternalKey(&saved_key_, ParsedInternalKey(*upper_bound_, kMaxSequenceNumber,
+                                                                 kValueTypeForSeek));
+                iter_->Seek(saved_key_);
+                if (iter_->Valid()) {
+                    iter_->Prev();
+                } else {
+                    iter_->SeekToLast();
+                }
+            } else {
+                iter_->SeekToLast();
+            }
+            FindPrevUserEntry();
+        }
+
+    }  // anonymous namespace
+
+    Iterator *NewDBIterator(ReadSampleFunction sample, void *sample_arg, const Comparator *user_key_comparator,
+                            Iterator *internal_iter, SequenceNumber sequence, uint32_t seed,
+                            const MergeOperator *merge_operator, const SliceTransform *prefix_extractor,
+                            const ReadOptions &read_options, Arena *arena) {
+        if (arena != nullptr) {
+            char *mem = arena->AllocateAligned(sizeof(DBIter));
+            return new(mem) DBIter(sample, sample_arg, user_key_comparator, internal_iter, sequence, seed,
+                                   merge_operator, prefix_extractor, read_options, true);
+        }
+        return new DBIter(sample, sample_arg, user_key_comparator, internal_iter, sequence, seed,
+                          merge_operator, prefix_extractor, read_options, false);
+    }
+
+}
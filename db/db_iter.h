@@ -8,16 +8,79 @@
 #include <cstdint>
 #include "db/dbformat.h"
 #include "leveldb/db.h"
+#include "util/arena.h"
 
 namespace leveldb {
 
-    class DBImpl;
+    class MergeOperator;
+    class SliceTransform;
 
-    Iterator *NewDBIterator(DBImpl *db,
+    // DBIter每读取约config::kReadBytesPeriod字节调用一次, key为当前的internal key.
+    // DBImpl用它统计文件被读取的次数, 以便触发compaction.
+    using ReadSampleFunction = void (*)(void *arg, const Slice &key);
+
+    /**
+     * @brief 把internal_iter中的internal key转换成用户可见的user key,
+     * 只返回sequence可见的最新记录, 隐藏删除的key, merge记录在读取时折叠.
+     * read_options中设置了iterate_lower_bound/iterate_upper_bound时迭代范围限制在
+     * [lower_bound, upper_bound)之内, 到达边界立即停止, 不会继续读取边界之外的记录.
+     * prefix_same_as_start时Seek之后只返回与target前缀(由prefix_extractor提取)相同的key.
+     * 接管internal_iter的所有权. sample为nullptr时不做读取采样.
+     * arena不为nullptr时结果分配在arena中, internal_iter也必须分配在同一个arena中.
+    */
+    Iterator *NewDBIterator(ReadSampleFunction sample,
+                            void *sample_arg,
                             const Comparator *user_key_comparator,
                             Iterator *internal_iter,
                             SequenceNumber sequence,
-                            uint32_t seed);
+                            uint32_t seed,
+                            const MergeOperator *merge_operator = nullptr,
+                            const SliceTransform *prefix_extractor = nullptr,
+                            const ReadOptions &read_options = ReadOptions(),
+                            Arena *arena = nullptr);
+
+    /**
+     * @brief 持有一个arena, DBIter以及它下面的整个迭代器树(merging iterator, memtable迭代器,
+     * cleanup状态等)都分配在这个arena中. 创建和销毁一个迭代器只需要很少的几次堆分配,
+     * 删除时依次调用各个迭代器的析构函数, 内存随arena一次性释放.
+    */
+    class ArenaWrappedDBIter : public Iterator {
+    public:
+        ArenaWrappedDBIter() : db_iter_(nullptr) {}
+
+        ~ArenaWrappedDBIter() override {
+            if (db_iter_ != nullptr) {
+                db_iter_->~Iterator();
+            }
+        }
+
+        Arena *GetArena() { return &arena_; }
+
+        // db_iter必须是NewDBIterator(..., GetArena())的返回值.
+        void SetDBIter(Iterator *db_iter) { db_iter_ = db_iter; }
+
+        bool Valid() const override { return db_iter_->Valid(); }
+
+        void SeekToFirst() override { db_iter_->SeekToFirst(); }
+
+        void SeekToLast() override { db_iter_->SeekToLast(); }
+
+        void Seek(const Slice &target) override { db_iter_->Seek(target); }
+
+        void Next() override { db_iter_->Next(); }
+
+        void Prev() override { db_iter_->Prev(); }
+
+        Slice Key() const override { return db_iter_->Key(); }
+
+        Slice Value() const override { return db_iter_->Value(); }
+
+        Status status() const override { return db_iter_->status(); }
+
+    private:
+        Arena arena_;
+        Iterator *db_iter_;
+    };
 
 
 }
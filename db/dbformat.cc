@@ -5,6 +5,7 @@
 #include "db/dbformat.h"
 
 #include <sstream>
+#include <vector>
 
 namespace leveldb {
 
@@ -37,8 +38,8 @@ namespace leveldb {
         // 如果user_key和seqNbr相同, type不同, 则kTypeValue最高优先级
         // 即先add_kTypeValue，再add_kTypeDeletion 则删除无效, 但是逻辑上不可能出现这种场景.
         if (r == 0) {
-            const int64_t anum = DecodeFixed64(a.data() + a.size() - 8);
-            const int64_t bnum = DecodeFixed64(b.data() + b.size() - 8);
+            const uint64_t anum = DecodeFixed64(a.data() + a.size() - 8);
+            const uint64_t bnum = DecodeFixed64(b.data() + b.size() - 8);
             if (anum > bnum) {
                 r = -1;
             } else if (anum < bnum) {
@@ -48,15 +49,83 @@ namespace leveldb {
         return r;
     }
 
+    // 缩短user key部分. 缩短后的user key逻辑上更大, 用最大的seq保证它仍然排在limit之前.
     void InternalKeyComparator::FindShortestSeparator(std::string *start, const Slice &limit) const {
-
+        Slice user_start = ExtractUserKey(*start);
+        Slice user_limit = ExtractUserKey(limit);
+        std::string tmp(user_start.data(), user_start.size());
+        user_comparator_->FindShortestSeparator(&tmp, user_limit);
+        if (tmp.size() < user_start.size() && user_comparator_->Compare(user_start, tmp) < 0) {
+            PutFixed64(&tmp, PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+            assert(this->Compare(*start, tmp) < 0);
+            assert(this->Compare(tmp, limit) < 0);
+            start->swap(tmp);
+        }
     }
 
     void InternalKeyComparator::FindShortSuccessor(std::string *key) const {
+        Slice user_key = ExtractUserKey(*key);
+        std::string tmp(user_key.data(), user_key.size());
+        user_comparator_->FindShortSuccessor(&tmp);
+        if (tmp.size() < user_key.size() && user_comparator_->Compare(user_key, tmp) < 0) {
+            PutFixed64(&tmp, PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+            assert(this->Compare(*key, tmp) < 0);
+            key->swap(tmp);
+        }
+    }
+
+    InternalFilterPolicy::InternalFilterPolicy(const FilterPolicy *p, const SliceTransform *prefix_extractor)
+            : user_policy_(p), prefix_extractor_(prefix_extractor) {
+        // 没有设置filter_policy时DBImpl仍然会构造这个对象, 但不会使用它
+        if (user_policy_ != nullptr) {
+            name_ = user_policy_->Name();
+            if (prefix_extractor_ != nullptr) {
+                name_.append(":");
+                name_.append(prefix_extractor_->Name());
+            }
+        }
+    }
+
+    const char *InternalFilterPolicy::Name() const {
+        return name_.c_str();
+    }
+
+    const char *InternalFilterPolicy::KeyOnlyName() const {
+        return prefix_extractor_ != nullptr ? user_policy_->Name() : nullptr;
+    }
 
+    void InternalFilterPolicy::CreateFilter(const Slice *keys, int n, std::string *dst) const {
+        std::vector<Slice> filter_keys;
+        filter_keys.reserve(prefix_extractor_ != nullptr ? 2 * n : n);
+        Slice last_prefix;
+        bool has_last_prefix = false;
+        for (int i = 0; i < n; i++) {
+            Slice user_key = ExtractUserKey(keys[i]);
+            filter_keys.push_back(user_key);
+            if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(user_key)) {
+                // keys有序, 相同的前缀是连续的, 只需要加入一次
+                Slice prefix = prefix_extractor_->Transform(user_key);
+                if (!has_last_prefix || prefix != last_prefix) {
+                    filter_keys.push_back(prefix);
+                    last_prefix = prefix;
+                    has_last_prefix = true;
+                }
+            }
+        }
+        user_policy_->CreateFilter(filter_keys.data(), static_cast<int>(filter_keys.size()), dst);
     }
 
-    // fixme FilterPolicy
+    bool InternalFilterPolicy::KeyMayMatch(const Slice &key, const Slice &filter) const {
+        return user_policy_->KeyMayMatch(ExtractUserKey(key), filter);
+    }
+
+    bool InternalFilterPolicy::PrefixMayMatch(const Slice &key, const Slice &filter) const {
+        Slice user_key = ExtractUserKey(key);
+        if (prefix_extractor_ == nullptr || !prefix_extractor_->InDomain(user_key)) {
+            return true;
+        }
+        return user_policy_->KeyMayMatch(prefix_extractor_->Transform(user_key), filter);
+    }
 
 
     LookupKey::LookupKey(const Slice &user_key, SequenceNumber sequence) {
@@ -6,9 +6,12 @@
 #define MY_LEVELDB_DBFORMAT_H
 
 #include <cstdint>
+#include <string>
 
 #include "leveldb/slice.h"
 #include "leveldb/comparator.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "port/port.h"
@@ -36,10 +39,12 @@ namespace leveldb {
     class InternalKey;
 
     enum ValueType {
-        kTypeDeletion = 0x0, kTypeValue = 0x1
+        kTypeDeletion = 0x0, kTypeValue = 0x1, kTypeMerge = 0x2
     };
 
-    static const ValueType kValueTypeForSeek = kTypeValue;
+    // 同一个user_key+seq下type按降序排列, seek时要用最大的type
+    // 才能定位到该seq的第一条记录.
+    static const ValueType kValueTypeForSeek = kTypeMerge;
 
     typedef uint64_t SequenceNumber;
 
@@ -96,7 +101,7 @@ namespace leveldb {
         result->type = static_cast<ValueType>(c);
         result->user_key = Slice(src_internal_key.data(), n - 8);
 
-        return c <= static_cast<uint8_t>(kTypeValue);
+        return c <= static_cast<uint8_t>(kTypeMerge);
     }
 
     // 提取user_key部分
@@ -109,7 +114,35 @@ namespace leveldb {
 
 
 
-    // FIXME InternalFilterPolicy
+    // 把internal key转换成user key之后交给用户的FilterPolicy.
+    // 设置了prefix_extractor时, domain中的key的前缀也被加入filter, 用于prefix seek;
+    // 此时Name()是"用户policy的名字:prefix_extractor的名字", 换了prefix_extractor之后
+    // 旧文件中的filter不会被当作前缀filter使用.
+    class InternalFilterPolicy : public FilterPolicy {
+    private:
+        const FilterPolicy *const user_policy_;
+        const SliceTransform *const prefix_extractor_;
+        std::string name_;
+    public:
+        explicit InternalFilterPolicy(const FilterPolicy *p, const SliceTransform *prefix_extractor = nullptr);
+
+        const char *Name() const override;
+
+        // 设置了prefix_extractor时是用户policy的名字, 否则为nullptr.
+        const char *KeyOnlyName() const override;
+
+        // keys是有序的internal key.
+        void CreateFilter(const Slice *keys, int n, std::string *dst) const override;
+
+        // key是internal key.
+        bool KeyMayMatch(const Slice &key, const Slice &filter) const override;
+
+        // key是internal key, 检查的是prefix_extractor从user key中提取的前缀.
+        // 没有prefix_extractor或者key不在domain中时返回true.
+        bool PrefixMayMatch(const Slice &key, const Slice &filter) const override;
+
+        const SliceTransform *prefix_extractor() const { return prefix_extractor_; }
+    };
 
 
     class InternalKey {
@@ -166,6 +199,13 @@ namespace leveldb {
 
         const Comparator *user_comparator() const { return user_comparator_; }
 
+        bool HasOrderedBytes() const override { return user_comparator_->HasOrderedBytes(); }
+
+        // user key相同的internal key之间按seq排序, 只有user key部分参与字节比较.
+        Slice OrderedBytes(const Slice &key) const override {
+            return user_comparator_->OrderedBytes(ExtractUserKey(key));
+        }
+
         int Compare(const InternalKey &a, const InternalKey &b) const {
             return Compare(a.Encode(), b.Encode());
         }
@@ -3,8 +3,18 @@
 //
 
 #include "db/memtable.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
+#include "leveldb/pinnable_slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/status.h"
+#include "table/format.h"
 
 namespace leveldb {
 
@@ -24,8 +34,14 @@ namespace leveldb {
     }
 
 
-    MemTable::MemTable(const InternalKeyComparator &comparator)
-            : comparator_(comparator), refs_(0), table_(KeyComparator(comparator), &arena_) {}
+    MemTable::MemTable(const InternalKeyComparator &comparator, const MergeOperator *merge_operator,
+                       const SliceTransform *prefix_extractor, uint32_t prefix_bloom_bits)
+            : comparator_(comparator), merge_operator_(merge_operator), prefix_extractor_(prefix_extractor),
+              refs_(0), table_(KeyComparator(comparator), &arena_) {
+        if (prefix_extractor_ != nullptr && prefix_bloom_bits > 0) {
+            prefix_bloom_.reset(new DynamicBloom(&arena_, prefix_bloom_bits));
+        }
+    }
 
     MemTable::~MemTable() {
         assert(refs_ == 0);
@@ -41,11 +57,19 @@ namespace leveldb {
         return this->comparator.Compare(a, b);
     }
 
+    bool MemTable::PrefixMayMatch(const Slice &user_key) const {
+        if (prefix_bloom_ == nullptr || !prefix_extractor_->InDomain(user_key)) {
+            return true;
+        }
+        return prefix_bloom_->MayContain(prefix_extractor_->Transform(user_key));
+    }
+
     // MemTableIterator is a Wrapper of SkipList::Iterator
     class MemTableIterator : public Iterator {
     public:
-        explicit MemTableIterator(MemTable::Table *table)
-                : iter_(table) {}
+        // prefix_mem不为nullptr时, SeekForPrefix的target前缀被bloom排除则迭代器直接无效.
+        MemTableIterator(MemTable::Table *table, const MemTable *prefix_mem)
+                : iter_(table), prefix_mem_(prefix_mem), filtered_(false) {}
 
         MemTableIterator(const MemTableIterator &) = delete;
 
@@ -53,17 +77,28 @@ namespace leveldb {
 
         ~MemTableIterator() override = default;
 
-        bool Valid() const override { return iter_.Valid(); }
+        bool Valid() const override { return !filtered_ && iter_.Valid(); }
 
         void Seek(const Slice &k) override {
-            iter_.Seek(EncodeKey(&tmp_, k));
+            filtered_ = false;
+            iter_.Seek(EncodeTarget(k));
+        }
+
+        void SeekForPrefix(const Slice &k) override {
+            if (prefix_mem_ != nullptr && !prefix_mem_->PrefixMayMatch(ExtractUserKey(k))) {
+                filtered_ = true;
+                return;
+            }
+            Seek(k);
         }
 
         void SeekToFirst() override {
+            filtered_ = false;
             iter_.SeekToFirst();
         }
 
         void SeekToLast() override {
+            filtered_ = false;
             iter_.SeekToLast();
         }
 
@@ -89,12 +124,30 @@ namespace leveldb {
         }
 
     private:
+        // 短的target编码在space_中, 迭代器分配在arena中时Seek也不需要堆分配.
+        const char *EncodeTarget(const Slice &target) {
+            if (static_cast<size_t>(VarintLength(target.size())) + target.size() > sizeof(space_)) {
+                return EncodeKey(&tmp_, target);
+            }
+            char *p = EncodeVarint32(space_, target.size());
+            std::memcpy(p, target.data(), target.size());
+            return space_;
+        }
+
         MemTable::Table::Iterator iter_;
+        const MemTable *const prefix_mem_;
+        bool filtered_;     // 最近一次SeekForPrefix被前缀bloom过滤
+        char space_[64];
         std::string tmp_;   // For encode use.
     };
 
-    Iterator *MemTable::NewIterator() {
-        return new MemTableIterator(&table_);
+    Iterator *MemTable::NewIterator(const ReadOptions &options, Arena *arena) {
+        const MemTable *prefix_mem = options.prefix_same_as_start ? this : nullptr;
+        if (arena != nullptr) {
+            char *mem = arena->AllocateAligned(sizeof(MemTableIterator));
+            return new(mem) MemTableIterator(&table_, prefix_mem);
+        }
+        return new MemTableIterator(&table_, prefix_mem);
     }
 
     void MemTable::Add(SequenceNumber seq, ValueType type, const Slice &key, const Slice &value) {
@@ -126,41 +179,153 @@ namespace leveldb {
         std::memcpy(pCur, value.data(), value_size);
 
         assert(pCur + value_size == buf + total_size);
+        if (prefix_bloom_ != nullptr && prefix_extractor_->InDomain(key)) {
+            prefix_bloom_->Add(prefix_extractor_->Transform(key));
+        }
         table_.Insert(buf);
     }
 
-    bool MemTable::Get(const LookupKey &lookup_key, std::string *value, Status *s) {
+    bool MemTable::Get(const LookupKey &lookup_key, std::string *value, Status *s,
+                       MergeContext *merge_context) {
+        if (!PrefixMayMatch(lookup_key.user_key())) {
+            return false;
+        }
         Slice memtable_key = lookup_key.memtable_key();
         Table::Iterator iter(&table_);
         iter.Seek(memtable_key.data()); // seek到>= memtable_key的节点.
-        if (!iter.Valid()) {
+        Slice result;
+        bool found = GetFromPosition(&iter, lookup_key, &result, value, s, merge_context);
+        if (found && s->IsOK() && result.data() != value->data()) {
+            value->assign(result.data(), result.size());
+        }
+        return found;
+    }
+
+    bool MemTable::Get(const LookupKey &lookup_key, PinnableSlice *value, Status *s,
+                       MergeContext *merge_context) {
+        if (!PrefixMayMatch(lookup_key.user_key())) {
             return false;
         }
+        Slice memtable_key = lookup_key.memtable_key();
+        Table::Iterator iter(&table_);
+        iter.Seek(memtable_key.data());
+        Slice result;
+        std::string *merged = value->GetSelf();
+        bool found = GetFromPosition(&iter, lookup_key, &result, merged, s, merge_context);
+        if (found && s->IsOK()) {
+            if (result.data() == merged->data()) {
+                value->PinSelf();
+            } else {
+                // 直接指向arena, 由调用方负责在value上注册释放memtable引用的cleanup.
+                value->PinSlice(result);
+            }
+        }
+        return found;
+    }
+
+    void MemTable::MultiGet(const LookupKey *const *keys, size_t n, std::string *values, Status *statuses,
+                            bool *found, MergeContext *merge_contexts) {
+        // 按internal key排序: user key升序, 同一个user key的sequence降序. 比较缓存的user key,
+        // 不需要每次比较都从memtable key中解码; comparator支持OrderedBytes时先比较8字节的整数前缀.
+        struct Target {
+            uint64_t prefix;
+            Slice user_key;
+            uint64_t tag;
+            size_t index;
+        };
+        const Comparator *user_comparator = comparator_.comparator.user_comparator();
+        const bool has_prefix = user_comparator->HasOrderedBytes();
+        std::vector<Target> targets;
+        targets.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            const Slice user_key = keys[i]->user_key();
+            if (!found[i] && PrefixMayMatch(user_key)) {
+                const Slice ikey = keys[i]->internal_key();
+                targets.push_back({has_prefix ? RestartKeyPrefix(user_comparator->OrderedBytes(user_key)) : 0,
+                                   user_key, DecodeFixed64(ikey.data() + ikey.size() - 8), i});
+            }
+        }
+        std::sort(targets.begin(), targets.end(), [user_comparator](const Target &a, const Target &b) {
+            if (a.prefix != b.prefix) {
+                return a.prefix < b.prefix;
+            }
+            const int r = user_comparator->Compare(a.user_key, b.user_key);
+            return r < 0 || (r == 0 && a.tag > b.tag);
+        });
+
+        std::vector<const char *> memtable_keys;
+        memtable_keys.reserve(targets.size());
+        for (const Target &t : targets) {
+            memtable_keys.push_back(keys[t.index]->memtable_key().data());
+        }
+        std::vector<Table::Iterator> iters(targets.size(), Table::Iterator(&table_));
+        table_.SeekBatch(memtable_keys.data(), memtable_keys.size(), iters.data());
+
+        for (size_t j = 0; j < targets.size(); ++j) {
+            const size_t i = targets[j].index;
+            Slice result;
+            found[i] = GetFromPosition(&iters[j], *keys[i], &result, &values[i], &statuses[i],
+                                       merge_contexts == nullptr ? nullptr : &merge_contexts[i]);
+            if (found[i] && statuses[i].IsOK() && result.data() != values[i].data()) {
+                values[i].assign(result.data(), result.size());
+            }
+        }
+    }
 
-        // entry format:
-        // keyLength:  varint32
-        // userKey  :  char[keyLength - 8]
-        // valueLen :  varint32
-        // value    :   char[valueLen]
-        const char *entry = iter.key();
-        uint32_t key_length;
+    template<typename Iter>
+    bool MemTable::GetFromPosition(Iter *iter, const LookupKey &lookup_key, Slice *value, std::string *merged,
+                                   Status *s, MergeContext *merge_context) {
+        // 同一个user_key的记录按seq降序排列, 从seek到的位置往后
+        // 依次是该快照可见的最新记录, 次新记录...
+        for (; iter->Valid(); iter->Next()) {
+            // entry format:
+            // keyLength:  varint32
+            // userKey  :  char[keyLength - 8]
+            // valueLen :  varint32
+            // value    :   char[valueLen]
+            const char *entry = iter->key();
+            uint32_t key_length;
+
+            // 读取keyLength
+            const char *key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+            Slice userKey = Slice(key_ptr, key_length - 8);
+            if (comparator_.comparator.user_comparator()->Compare(userKey, lookup_key.user_key()) != 0) {
+                break;
+            }
 
-        // 读取keyLength
-        const char *key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
-        Slice userKey = Slice(key_ptr, key_length - 8);
-        if (comparator_.comparator.user_comparator()->Compare(userKey, lookup_key.user_key()) == 0) {
+            const bool has_operands = merge_context != nullptr && !merge_context->empty();
             const uint64_t seq_and_type = DecodeFixed64(key_ptr + key_length - 8);
             switch (static_cast<ValueType>(seq_and_type & 0xff)) {
                 case kTypeValue: {
                     Slice val = GetLengthPrefixedSlice(key_ptr + key_length);
-                    value->assign(val.data(), val.size());
-                    *s = Status::OK(); // FIXME
+                    if (has_operands) {
+                        *s = MergeHelper::FullMerge(merge_operator_, lookup_key.user_key(), &val,
+                                                    *merge_context, merged);
+                        *value = *merged;
+                    } else {
+                        *value = val;
+                        *s = Status::OK();
+                    }
                     return true;
                 }
                 case kTypeDeletion: {
-                    *s = Status::NotFound(Slice());
+                    if (has_operands) {
+                        *s = MergeHelper::FullMerge(merge_operator_, lookup_key.user_key(), nullptr,
+                                                    *merge_context, merged);
+                        *value = *merged;
+                    } else {
+                        *s = Status::NotFound(Slice());
+                    }
                     return true;
                 }
+                case kTypeMerge: {
+                    if (merge_operator_ == nullptr || merge_context == nullptr) {
+                        *s = Status::NotSupported("merge operand found but no merge_operator configured");
+                        return true;
+                    }
+                    merge_context->PushOperand(GetLengthPrefixedSlice(key_ptr + key_length));
+                    break;
+                }
                 default:
                     // Unreachable.
                     assert(false);
@@ -170,4 +335,3 @@ namespace leveldb {
         return false;
     }
 }
-
@@ -5,7 +5,10 @@
 #ifndef MY_LEVELDB_MEMTABLE_H
 #define MY_LEVELDB_MEMTABLE_H
 
+#include <memory>
+
 #include "util/arena.h"
+#include "util/dynamic_bloom.h"
 #include "db/skiplist.h"
 #include "db/dbformat.h"
 #include "leveldb/db.h"
@@ -14,11 +17,21 @@ namespace leveldb {
 
     class InternalKeyComparator;
     class MemTableIterator;
+    class MergeContext;
+    class MergeOperator;
+    class PinnableSlice;
+    class SliceTransform;
 
     // MemTable基于引用计数.
     class MemTable {
     public:
-        explicit MemTable(const InternalKeyComparator &comparator);
+        // merge_operator用于Get时折叠kTypeMerge记录, 可以为nullptr.
+        // prefix_extractor不为nullptr并且prefix_bloom_bits > 0时, 写入的key的前缀被加入bloom,
+        // Get和prefix seek可以跳过不包含该前缀的memtable.
+        explicit MemTable(const InternalKeyComparator &comparator,
+                          const MergeOperator *merge_operator = nullptr,
+                          const SliceTransform *prefix_extractor = nullptr,
+                          uint32_t prefix_bloom_bits = 0);
 
         // Disable copy and assign.
         MemTable(const MemTable &) = delete;
@@ -40,7 +53,9 @@ namespace leveldb {
         // 获取大概的使用内存
         size_t ApproximateMemoryUsage();
 
-        Iterator *NewIterator();
+        // options.prefix_same_as_start时, SeekForPrefix的前缀不在bloom中则迭代器直接无效.
+        // arena不为nullptr时迭代器分配在arena中, 由持有者调用析构函数释放.
+        Iterator *NewIterator(const ReadOptions &options = ReadOptions(), Arena *arena = nullptr);
 
         void Add(SequenceNumber seq, ValueType type, const Slice &key, const Slice &value);
 
@@ -48,12 +63,26 @@ namespace leveldb {
         // 如果MemTable包含key, 则将值填充至value中, 并返回true
         // 如果MemTable包含key的delete标记,则s被置成NotFound 并返回true
         // 否则返回false.
-        bool Get(const LookupKey &key, std::string *value, Status *s);
+        // 遇到merge operand时追加到merge_context中并继续往旧的记录找base,
+        // 找到base则折叠后返回true; 找不到返回false, 由调用方继续往下查找.
+        bool Get(const LookupKey &key, std::string *value, Status *s,
+                 MergeContext *merge_context = nullptr);
+
+        // 与上面的Get相同, 但是普通value不拷贝, value直接指向arena中的数据.
+        // 调用方需要保证在value被Reset之前memtable一直被引用.
+        bool Get(const LookupKey &key, PinnableSlice *value, Status *s,
+                 MergeContext *merge_context = nullptr);
+
+        // 批量版本的Get, 第i个key的结果语义与Get(*keys[i], &values[i], &statuses[i], ...)相同,
+        // found[i]对应Get的返回值. merge_contexts可以为nullptr, 否则是长度为n的数组.
+        // 进入时found[i]已经为true的key会被跳过, 因此同一组数组可以依次传给多个memtable.
+        // 内部先把key排序, 再用SkipList::SeekBatch让所有key一起逐层查找.
+        void MultiGet(const LookupKey *const *keys, size_t n, std::string *values, Status *statuses,
+                      bool *found, MergeContext *merge_contexts = nullptr);
 
 
     private:
         friend class MemTableIterator;
-        friend class MemTableBackwardIterator;
 
         ~MemTable(); // 只有引用计数减少0才能删除
 
@@ -68,10 +97,22 @@ namespace leveldb {
 
         using Table = SkipList<const char *, KeyComparator>;
 
+        // iter已经seek到>=key的位置, 从这里开始处理key的所有记录.
+        // 普通value通过value直接指向arena; merge折叠的结果写入merged, value指向merged.
+        template<typename Iter>
+        bool GetFromPosition(Iter *iter, const LookupKey &key, Slice *value, std::string *merged,
+                             Status *s, MergeContext *merge_context);
+
+        // user_key的前缀可能在这个memtable中.
+        bool PrefixMayMatch(const Slice &user_key) const;
+
         KeyComparator comparator_;
+        const MergeOperator *const merge_operator_;
+        const SliceTransform *const prefix_extractor_;
         int refs_;
         Arena arena_;
         Table table_;
+        std::unique_ptr<DynamicBloom> prefix_bloom_;   // 内存在arena_中, 对象本身需要先于arena_析构
     };
 
 }
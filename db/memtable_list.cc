@@ -0,0 +1,127 @@
+//
+// Created by kuiper on 2021/3/4.
+//
+
+#include "db/memtable_list.h"
+
+#include <algorithm>
+
+#include "db/memtable.h"
+
+namespace leveldb {
+
+    MemTableListVersion::~MemTableListVersion() {
+        assert(refs_ == 0);
+        for (MemTable *m : memlist_) {
+            m->Unref();
+        }
+    }
+
+    void MemTableListVersion::Unref() {
+        --refs_;
+        assert(refs_ >= 0);
+        if (refs_ == 0) {
+            delete this;
+        }
+    }
+
+    bool MemTableListVersion::Get(const LookupKey &key, std::string *value, Status *s,
+                                  MergeContext *merge_context) {
+        for (MemTable *m : memlist_) {
+            if (m->Get(key, value, s, merge_context)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool MemTableListVersion::Get(const LookupKey &key, PinnableSlice *value, Status *s,
+                                  MergeContext *merge_context) {
+        for (MemTable *m : memlist_) {
+            if (m->Get(key, value, s, merge_context)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void MemTableListVersion::MultiGet(const LookupKey *const *keys, size_t n, std::string *values,
+                                       Status *statuses, bool *found, MergeContext *merge_contexts) {
+        for (MemTable *m : memlist_) {
+            if (std::all_of(found, found + n, [](bool f) { return f; })) {
+                break;
+            }
+            m->MultiGet(keys, n, values, statuses, found, merge_contexts);
+        }
+    }
+
+    void MemTableListVersion::AddIterators(const ReadOptions &options, std::vector<Iterator *> *iters,
+                                           Arena *arena) {
+        for (MemTable *m : memlist_) {
+            iters->push_back(m->NewIterator(options, arena));
+        }
+    }
+
+    size_t MemTableListVersion::ApproximateMemoryUsage() const {
+        size_t total = 0;
+        for (MemTable *m : memlist_) {
+            total += m->ApproximateMemoryUsage();
+        }
+        return total;
+    }
+
+    MemTableList::MemTableList()
+            : current_(new MemTableListVersion), flush_in_progress_(false) {
+        current_->Ref();
+    }
+
+    MemTableList::~MemTableList() {
+        current_->Unref();
+    }
+
+    MemTableListVersion *MemTableList::NewVersion() const {
+        auto *v = new MemTableListVersion;
+        v->memlist_ = current_->memlist_;
+        for (MemTable *m : v->memlist_) {
+            m->Ref();
+        }
+        return v;
+    }
+
+    void MemTableList::InstallVersion(MemTableListVersion *v) {
+        v->Ref();
+        current_->Unref();
+        current_ = v;
+    }
+
+    void MemTableList::Add(MemTable *m) {
+        MemTableListVersion *v = NewVersion();
+        v->memlist_.insert(v->memlist_.begin(), m);
+        InstallVersion(v);
+    }
+
+    void MemTableList::PickMemtablesToFlush(std::vector<MemTable *> *mems) {
+        assert(!flush_in_progress_);
+        mems->assign(current_->memlist_.rbegin(), current_->memlist_.rend());
+        flush_in_progress_ = true;
+    }
+
+    void MemTableList::RollbackMemtableFlush() {
+        assert(flush_in_progress_);
+        flush_in_progress_ = false;
+    }
+
+    void MemTableList::RemoveFlushed(const std::vector<MemTable *> &mems) {
+        assert(flush_in_progress_);
+        MemTableListVersion *v = NewVersion();
+        for (MemTable *m : mems) {
+            auto it = std::find(v->memlist_.begin(), v->memlist_.end(), m);
+            assert(it != v->memlist_.end());
+            v->memlist_.erase(it);
+            m->Unref();
+        }
+        InstallVersion(v);
+        flush_in_progress_ = false;
+    }
+
+}
@@ -0,0 +1,116 @@
+//
+// Created by kuiper on 2021/3/4.
+//
+
+#ifndef MY_LEVELDB_MEMTABLE_LIST_H
+#define MY_LEVELDB_MEMTABLE_LIST_H
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    class Arena;
+    class MemTable;
+    class MergeContext;
+    class PinnableSlice;
+
+    /**
+     * @brief 某一时刻不可变memtable(imm)集合的快照, 与Version的用法一致:
+     * 在DB锁内Ref, 释放锁后读取, 再在DB锁内Unref.
+     * 内容创建后不再修改, 变更时由MemTableList生成新的版本.
+    */
+    class MemTableListVersion {
+    public:
+        MemTableListVersion(const MemTableListVersion &) = delete;
+        MemTableListVersion &operator=(const MemTableListVersion &) = delete;
+
+        void Ref() { ++refs_; }
+
+        void Unref();
+
+        // 从新到旧依次查找, 语义同MemTable::Get.
+        bool Get(const LookupKey &key, std::string *value, Status *s, MergeContext *merge_context);
+
+        bool Get(const LookupKey &key, PinnableSlice *value, Status *s, MergeContext *merge_context);
+
+        // 从新到旧依次对还没有找到的key调用MemTable::MultiGet, 语义同MemTable::MultiGet.
+        void MultiGet(const LookupKey *const *keys, size_t n, std::string *values, Status *statuses,
+                      bool *found, MergeContext *merge_contexts);
+
+        // 按从新到旧的顺序追加每个imm的迭代器, arena不为nullptr时迭代器分配在arena中.
+        void AddIterators(const ReadOptions &options, std::vector<Iterator *> *iters,
+                          Arena *arena = nullptr);
+
+        int NumMemTables() const { return static_cast<int>(memlist_.size()); }
+
+        size_t ApproximateMemoryUsage() const;
+
+    private:
+        friend class MemTableList;
+
+        MemTableListVersion() : refs_(0) {}
+
+        ~MemTableListVersion();
+
+        std::vector<MemTable *> memlist_;   // 新 -> 旧, 每个都持有一个引用
+        int refs_;
+    };
+
+    /**
+     * @brief 等待flush的不可变memtable列表. 所有方法都需要持有DB锁.
+     *
+     * 写满的memtable被追加到列表头部. 后台flush时一次取走所有尚未flush的imm,
+     * 合并写成一个L0文件, 成功后再从列表中移除. flush期间新写满的memtable
+     * 继续追加进来, 只要数量不超过max_write_buffer_number - 1就不会阻塞写入.
+    */
+    class MemTableList {
+    public:
+        MemTableList();
+
+        MemTableList(const MemTableList &) = delete;
+        MemTableList &operator=(const MemTableList &) = delete;
+
+        ~MemTableList();
+
+        MemTableListVersion *current() const { return current_; }
+
+        // 接管m的一个引用.
+        void Add(MemTable *m);
+
+        int NumMemTables() const { return current_->NumMemTables(); }
+
+        bool empty() const { return current_->memlist_.empty(); }
+
+        // 有imm并且当前没有正在进行的flush.
+        bool IsFlushPending() const { return !flush_in_progress_ && !empty(); }
+
+        // 取出所有待flush的imm, 按从旧到新排列, 并标记flush开始.
+        void PickMemtablesToFlush(std::vector<MemTable *> *mems);
+
+        // flush失败, 这些imm留在列表中等待下次重试.
+        void RollbackMemtableFlush();
+
+        // flush成功并且已经写入了MANIFEST, 把这些imm从列表中移除.
+        void RemoveFlushed(const std::vector<MemTable *> &mems);
+
+        size_t ApproximateMemoryUsage() const { return current_->ApproximateMemoryUsage(); }
+
+    private:
+        // 复制当前版本作为新版本, 旧版本可能仍被读者持有.
+        MemTableListVersion *NewVersion() const;
+
+        void InstallVersion(MemTableListVersion *v);
+
+        MemTableListVersion *current_;
+        bool flush_in_progress_;
+    };
+
+}
+
+#endif //MY_LEVELDB_MEMTABLE_LIST_H
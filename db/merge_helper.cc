@@ -0,0 +1,124 @@
+//
+// Created by kuiper on 2021/3/2.
+//
+
+#include "db/merge_helper.h"
+
+namespace leveldb {
+
+    Status MergeHelper::FullMerge(const MergeOperator *merge_operator,
+                                  const Slice &user_key,
+                                  const Slice *base,
+                                  const MergeContext &context,
+                                  std::string *result) {
+        if (merge_operator == nullptr) {
+            return Status::NotSupported("merge operand found but no merge_operator configured");
+        }
+
+        result->clear();
+        if (!merge_operator->FullMerge(user_key, base, context.GetOperands(), result)) {
+            return Status::Corruption("merge_operator failed", merge_operator->Name());
+        }
+        return Status::OK();
+    }
+
+    Status MergeHelper::MergeUntil(Iterator *iter, SequenceNumber stop_before, bool at_bottom) {
+        assert(iter->Valid());
+        keys_.clear();
+        values_.clear();
+
+        ParsedInternalKey ikey;
+        if (!ParseInternalKey(iter->Key(), &ikey) || ikey.type != kTypeMerge) {
+            return Status::Corruption("MergeUntil must start at a merge operand");
+        }
+        const std::string user_key = ikey.user_key.ToString();
+
+        // operand及其internal key, 新 -> 旧.
+        std::vector<std::string> operand_keys;
+        MergeContext context;
+        operand_keys.push_back(iter->Key().ToString());
+        context.PushOperand(iter->Value());
+        iter->Next();
+
+        bool key_exhausted = true;
+        for (; iter->Valid(); iter->Next()) {
+            if (!ParseInternalKey(iter->Key(), &ikey)) {
+                // 损坏的记录交给调用方处理.
+                key_exhausted = false;
+                break;
+            }
+            if (user_comparator_->Compare(ikey.user_key, user_key) != 0) {
+                break;
+            }
+            if (ikey.sequence <= stop_before) {
+                // 更旧的记录对某个快照可见, 不能折叠进来.
+                key_exhausted = false;
+                break;
+            }
+
+            if (ikey.type == kTypeMerge) {
+                operand_keys.push_back(iter->Key().ToString());
+                context.PushOperand(iter->Value());
+                continue;
+            }
+
+            // 遇到了base, 折叠成一条Put. 使用最新operand的seq, 快照可见性不变.
+            const Slice existing = iter->Value();
+            std::string merged;
+            Status s = FullMerge(merge_operator_, user_key,
+                                 ikey.type == kTypeValue ? &existing : nullptr, context, &merged);
+            if (!s.IsOK()) {
+                return s;
+            }
+            ParsedInternalKey newest;
+            ParseInternalKey(operand_keys.front(), &newest);
+            keys_.emplace_back();
+            AppendInternalKey(&keys_.back(), ParsedInternalKey(user_key, newest.sequence, kTypeValue));
+            values_.push_back(std::move(merged));
+            iter->Next();
+            return Status::OK();
+        }
+
+        const std::vector<Slice> operands = context.GetOperands();  // 旧 -> 新
+
+        if (at_bottom && key_exhausted) {
+            // 最底层也没有base, 相当于base不存在.
+            std::string merged;
+            Status s = FullMerge(merge_operator_, user_key, nullptr, context, &merged);
+            if (!s.IsOK()) {
+                return s;
+            }
+            ParsedInternalKey newest;
+            ParseInternalKey(operand_keys.front(), &newest);
+            keys_.emplace_back();
+            AppendInternalKey(&keys_.back(), ParsedInternalKey(user_key, newest.sequence, kTypeValue));
+            values_.push_back(std::move(merged));
+            return Status::OK();
+        }
+
+        // 没有base, 尽量把operand两两合并成一个.
+        if (merge_operator_ != nullptr && operands.size() > 1) {
+            std::string acc = operands[0].ToString();
+            std::string tmp;
+            bool ok = true;
+            for (size_t i = 1; i < operands.size() && ok; ++i) {
+                tmp.clear();
+                ok = merge_operator_->PartialMerge(user_key, acc, operands[i], &tmp);
+                acc.swap(tmp);
+            }
+            if (ok) {
+                keys_.push_back(operand_keys.front());
+                values_.push_back(std::move(acc));
+                return Status::OK();
+            }
+        }
+
+        // 无法合并, 原样输出.
+        for (size_t i = 0; i < operand_keys.size(); ++i) {
+            keys_.push_back(operand_keys[i]);
+            values_.push_back(operands[operands.size() - 1 - i].ToString());
+        }
+        return Status::OK();
+    }
+
+}
@@ -0,0 +1,105 @@
+//
+// Created by kuiper on 2021/3/2.
+//
+
+#ifndef MY_LEVELDB_MERGE_HELPER_H
+#define MY_LEVELDB_MERGE_HELPER_H
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 读路径上收集到的merge operand.
+     * 查找顺序是 mem -> imm -> sstable, 所以operand是从新到旧被追加进来的.
+    */
+    class MergeContext {
+    public:
+        MergeContext() = default;
+
+        MergeContext(const MergeContext &) = delete;
+        MergeContext &operator=(const MergeContext &) = delete;
+
+        // operand会被拷贝, 调用方不需要保证底层内存的生命周期.
+        void PushOperand(const Slice &operand) {
+            operands_.emplace_back(operand.data(), operand.size());
+        }
+
+        bool empty() const { return operands_.empty(); }
+
+        size_t size() const { return operands_.size(); }
+
+        void Clear() { operands_.clear(); }
+
+        // 按写入顺序(旧 -> 新)返回, 与MergeOperator::FullMerge的约定一致.
+        std::vector<Slice> GetOperands() const {
+            std::vector<Slice> result;
+            result.reserve(operands_.size());
+            for (auto it = operands_.rbegin(); it != operands_.rend(); ++it) {
+                result.emplace_back(*it);
+            }
+            return result;
+        }
+
+    private:
+        std::vector<std::string> operands_;     // 新 -> 旧
+    };
+
+    /**
+     * @brief 封装operand的折叠逻辑, 读路径和compaction共用.
+    */
+    class MergeHelper {
+    public:
+        MergeHelper(const Comparator *user_comparator, const MergeOperator *merge_operator)
+                : user_comparator_(user_comparator), merge_operator_(merge_operator) {}
+
+        MergeHelper(const MergeHelper &) = delete;
+        MergeHelper &operator=(const MergeHelper &) = delete;
+
+        /**
+         * @brief 把context中的operand折叠到base上.
+         * @param base 为nullptr表示key不存在或者已经被删除.
+         * @return merge_operator为空返回NotSupported, 用户折叠失败返回Corruption.
+        */
+        static Status FullMerge(const MergeOperator *merge_operator,
+                                const Slice &user_key,
+                                const Slice *base,
+                                const MergeContext &context,
+                                std::string *result);
+
+        /**
+         * @brief compaction使用. iter必须指向一条kTypeMerge记录.
+         *
+         * 从iter开始消费同一个user_key上连续的记录, 遇到下面任一情况停止:
+         *   1) user_key变化或者iter结束;
+         *   2) 记录的seq <= stop_before, 即跨越了一个仍然存活的快照;
+         *   3) 遇到了kTypeValue/kTypeDeletion, 与之前的operand做FullMerge.
+         * 3)的情况下输出一条kTypeValue; 1)且at_bottom时说明更旧的层里也没有base,
+         * 同样以nullptr为base做FullMerge; 其余情况尝试PartialMerge, 失败则原样输出.
+         *
+         * 返回时iter指向第一条没有被消费的记录, 输出见keys()/values().
+        */
+        Status MergeUntil(Iterator *iter, SequenceNumber stop_before, bool at_bottom);
+
+        // 按internal key顺序(新 -> 旧)排列的输出.
+        const std::vector<std::string> &keys() const { return keys_; }
+
+        const std::vector<std::string> &values() const { return values_; }
+
+    private:
+        const Comparator *user_comparator_;
+        const MergeOperator *merge_operator_;
+
+        std::vector<std::string> keys_;
+        std::vector<std::string> values_;
+    };
+
+}
+
+#endif //MY_LEVELDB_MERGE_HELPER_H
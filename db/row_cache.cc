@@ -0,0 +1,108 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "db/row_cache.h"
+
+#include "db/merge_helper.h"
+#include "db/snapshot.h"
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    void RowCacheEntry::Add(ValueType type, const Slice &value) {
+        rep_.push_back(static_cast<char>(type));
+        PutLengthPrefixedSlice(&rep_, value);
+    }
+
+    bool RowCacheEntry::Replay(const Slice &entry, const Slice &user_key, const MergeOperator *merge_operator,
+                               std::string *value, Status *s, MergeContext *merge_context) {
+        Slice input = entry;
+        Slice val;
+        while (!input.empty()) {
+            const auto type = static_cast<ValueType>(input[0]);
+            input.remove_prefix(1);
+            if (!GetLengthPrefixedSlice(&input, &val)) {
+                *s = Status::Corruption("bad row cache entry");
+                return true;
+            }
+
+            const bool has_operands = merge_context != nullptr && !merge_context->empty();
+            switch (type) {
+                case kTypeValue:
+                    if (has_operands) {
+                        *s = MergeHelper::FullMerge(merge_operator, user_key, &val, *merge_context, value);
+                    } else {
+                        value->assign(val.data(), val.size());
+                        *s = Status::OK();
+                    }
+                    return true;
+                case kTypeDeletion:
+                    if (has_operands) {
+                        *s = MergeHelper::FullMerge(merge_operator, user_key, nullptr, *merge_context, value);
+                    } else {
+                        *s = Status::NotFound(Slice());
+                    }
+                    return true;
+                case kTypeMerge:
+                    if (merge_operator == nullptr || merge_context == nullptr) {
+                        *s = Status::NotSupported("merge operand found but no merge_operator configured");
+                        return true;
+                    }
+                    merge_context->PushOperand(val);
+                    break;
+                default:
+                    *s = Status::Corruption("bad row cache entry");
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    RowCache::RowCache(Cache *cache)
+            : cache_(cache), cache_id_(cache != nullptr ? cache->NewId() : 0) {}
+
+    void RowCache::ComputeKey(const ReadOptions &options, uint64_t file_number, const Slice &user_key,
+                              std::string *key) const {
+        SequenceNumber seq = 0;
+        if (options.snapshot != nullptr) {
+            seq = static_cast<const SnapshotImpl *>(options.snapshot)->sequence_number() + 1;
+        }
+        key->clear();
+        PutVarint64(key, cache_id_);
+        PutVarint64(key, file_number);
+        PutVarint64(key, seq);
+        key->append(user_key.data(), user_key.size());
+    }
+
+    static void DeleteRowCacheEntry(const Slice & /*key*/, void *value) {
+        delete reinterpret_cast<std::string *>(value);
+    }
+
+    bool RowCache::Lookup(const Slice &key, const Slice &user_key, const MergeOperator *merge_operator,
+                          std::string *value, Status *s, MergeContext *merge_context, bool *done) {
+        if (cache_ == nullptr) {
+            return false;
+        }
+        Cache::Handle *handle = cache_->Lookup(key);
+        if (handle == nullptr) {
+            return false;
+        }
+        const std::string *entry = reinterpret_cast<std::string *>(cache_->Value(handle));
+        *done = RowCacheEntry::Replay(*entry, user_key, merge_operator, value, s, merge_context);
+        cache_->Release(handle);
+        return true;
+    }
+
+    void RowCache::Insert(const Slice &key, const RowCacheEntry &entry) {
+        if (cache_ == nullptr || entry.empty()) {
+            return;
+        }
+        auto *value = new std::string(entry.data().data(), entry.data().size());
+        const size_t charge = key.size() + value->size() + sizeof(std::string);
+        cache_->Release(cache_->Insert(key, value, charge, &DeleteRowCacheEntry));
+    }
+
+}
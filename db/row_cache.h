@@ -0,0 +1,87 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_ROW_CACHE_H
+#define MY_LEVELDB_ROW_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "db/dbformat.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    class Cache;
+    class MergeContext;
+    class MergeOperator;
+    struct ReadOptions;
+
+    /**
+     * @brief 某个sstable中一个user_key的查找结果, 即快照可见的记录从新到旧的回放日志,
+     * 截止到第一条kTypeValue/kTypeDeletion. 只有merge operand时同样可以缓存.
+     *
+     * 编码: 每条记录为 type(1字节) | value(length prefixed).
+    */
+    class RowCacheEntry {
+    public:
+        RowCacheEntry() = default;
+
+        void Add(ValueType type, const Slice &value);
+
+        bool empty() const { return rep_.empty(); }
+
+        Slice data() const { return rep_; }
+
+        /**
+         * @brief 把记录回放到value/merge_context上, 返回值与s的语义同MemTable::Get:
+         * 遇到value或者删除时返回true, 只收集到operand时返回false, 由调用方继续查找更旧的文件.
+        */
+        static bool Replay(const Slice &entry, const Slice &user_key, const MergeOperator *merge_operator,
+                           std::string *value, Status *s, MergeContext *merge_context);
+
+    private:
+        std::string rep_;
+    };
+
+    /**
+     * @brief 行缓存: 缓存sstable点查解析后的结果, 热点key命中时不需要读取block,
+     * 解压以及在block内二分查找. 比缓存整个block占用的内存少得多.
+     *
+     * key为 cache_id | file_number | seq | user_key.
+     * sstable不可变, 没有指定快照时文件中的记录全部可见, seq为0, 这类读共享同一个条目;
+     * 指定了快照时可见性依赖于快照, seq为快照的sequence + 1.
+     * 同一个Cache可以被多个DB共享, cache_id用来区分.
+    */
+    class RowCache {
+    public:
+        // cache为nullptr时Lookup总是未命中, Insert什么都不做.
+        explicit RowCache(Cache *cache);
+
+        RowCache(const RowCache &) = delete;
+        RowCache &operator=(const RowCache &) = delete;
+
+        bool enabled() const { return cache_ != nullptr; }
+
+        void ComputeKey(const ReadOptions &options, uint64_t file_number, const Slice &user_key,
+                        std::string *key) const;
+
+        /**
+         * @brief 未命中返回false. 命中时回放缓存的记录, *done为RowCacheEntry::Replay的返回值.
+        */
+        bool Lookup(const Slice &key, const Slice &user_key, const MergeOperator *merge_operator,
+                    std::string *value, Status *s, MergeContext *merge_context, bool *done);
+
+        // entry为空(文件中没有这个key)时不插入, 不存在的key交给filter判断.
+        void Insert(const Slice &key, const RowCacheEntry &entry);
+
+    private:
+        Cache *const cache_;
+        const uint64_t cache_id_;
+    };
+
+}
+
+#endif //MY_LEVELDB_ROW_CACHE_H
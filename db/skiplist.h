@@ -5,6 +5,9 @@
 #ifndef MY_LEVELDB_SKIPLIST_H
 #define MY_LEVELDB_SKIPLIST_H
 
+#include <vector>
+
+#include "port/port_likely.h"
 #include "util/arena.h"
 #include "util/random.h"
 
@@ -14,6 +17,10 @@ namespace leveldb {
     class SkipList {
     private:
         struct Node;
+
+        enum {
+            kMaxHeight = 12
+        };
     public:
         explicit SkipList(Comparator cmp, Arena *arena);
 
@@ -44,10 +51,18 @@ namespace leveldb {
             void SeekToLast();
 
         private:
+            friend class SkipList;
+
             const SkipList *list_;
             Node *node_;
         };
 
+        // 把iters[i]定位到第一个>=targets[i]的节点, targets必须升序, iters必须属于这个list.
+        // 所有target逐层一起下降, 每一轮每个target前进一步并预取下一步的节点, 多个cache miss并行等待;
+        // 逐个Seek时cache miss只能串行. 起点与前一个target相同时从前一个target在这一层停下的位置继续,
+        // 共享的路径不重复比较.
+        void SeekBatch(const Key *targets, size_t n, Iterator *iters) const;
+
     private:
         inline int GetMaxHeight() const { return max_height_.load(std::memory_order_relaxed); }
 
@@ -67,9 +82,6 @@ namespace leveldb {
         Node *FindLast() const;
 
     private:
-        enum {
-            kMaxHeight = 12
-        };
         Comparator const comparator_;
         Arena *const arena_;
         Node *const head_;
@@ -101,9 +113,23 @@ namespace leveldb {
             next_[n].store(node, std::memory_order_relaxed);
         }
 
+        // level 0上的前驱, 第一个节点的前驱是head_.
+        Node *Prev() {
+            return prev_.load(std::memory_order_acquire);
+        }
+
+        void SetPrev(Node *node) {
+            prev_.store(node, std::memory_order_release);
+        }
+
+        void NoBarrier_SetPrev(Node *node) {
+            prev_.store(node, std::memory_order_relaxed);
+        }
+
     public:
         Key const key;
     private:
+        std::atomic<Node *> prev_{nullptr};
         // 数组的长度=节点的高度 分别记录当前节点在高度为n的next
         std::atomic<Node *> next_[1];
     };
@@ -157,10 +183,18 @@ namespace leveldb {
 
         // Insert
         x = NewNode(key, height);
+        // 先把x链入所有level, 最后才更新后继的反向指针: 读者通过Prev到达x时
+        // x的next已经全部可见. 在这之前从后继Prev的读者会跳过x, 但x的sequence
+        // 还没有对任何读者可见, 不影响结果.
+        Node *succ = prev[0]->NoBarrier_Next(0);
+        x->NoBarrier_SetPrev(prev[0]);
         for (int i = 0; i < height; ++i) {
             x->NoBarrier_SetNext(i, prev[i]->NoBarrier_Next(i));
             prev[i]->SetNext(i, x);
         }
+        if (succ != nullptr) {
+            succ->SetPrev(x);
+        }
     }
 
     template<typename Key, class Comparator>
@@ -185,7 +219,7 @@ namespace leveldb {
         for (;;) {
             assert(x == head_ || comparator_(x->key, key) < 0);
             Node *next = x->Next(level);
-            if (next == nullptr || comparator_(next->key, key) <= 0) {
+            if (next == nullptr || comparator_(next->key, key) >= 0) {
                 if (level == 0) {
                     return x;
                 } else {
@@ -204,6 +238,10 @@ namespace leveldb {
         int level = GetMaxHeight() - 1;
         for (;;) {
             Node *next = x->Next(level);
+            if (next != nullptr) {
+                // 比较next的同时把同一层的下一个节点预取进cache
+                PREFETCH(next->NoBarrier_Next(level), 0, 1);
+            }
             if (KeyIsAfterNode(key, next)) {
                 // 如果key在node之后，则跳转下一节点
                 x = next;
@@ -219,6 +257,57 @@ namespace leveldb {
         }
     }
 
+    template<typename Key, typename Compare>
+    void SkipList<Key, Compare>::SeekBatch(const Key *targets, size_t n, Iterator *iters) const {
+        // iters[i].node_保存targets[i]在当前层的前驱, 即最后一个<targets[i]的节点
+        for (size_t i = 0; i < n; ++i) {
+            iters[i].node_ = head_;
+        }
+        // 上一层让targets[i]停下的节点, 它>=targets[i], 在下面的层中遇到时不需要再比较
+        std::vector<Node *> bound(n, nullptr);
+        // 这一层的起点与前一个target相同, 等前一个target走完后从它停下的位置开始:
+        // 前一个target走过的节点都<前一个target<=targets[i], 不需要重复比较.
+        std::vector<bool> follow(n);
+        std::vector<size_t> walking;
+        walking.reserve(n);
+        for (int level = GetMaxHeight() - 1;; --level) {
+            walking.clear();
+            for (size_t i = 0; i < n; ++i) {
+                follow[i] = i > 0 && iters[i].node_ == iters[i - 1].node_;
+                if (!follow[i]) {
+                    PREFETCH(iters[i].node_->NoBarrier_Next(level), 0, 1);
+                    walking.push_back(i);
+                }
+            }
+            // 每一轮每个target只前进一步, 并预取下一步要比较的节点, 下一轮再比较;
+            // 同一轮中各个target的cache miss并行等待.
+            while (!walking.empty()) {
+                size_t m = 0;
+                for (size_t i : walking) {
+                    Node *next = iters[i].node_->Next(level);
+                    if (next != bound[i] && KeyIsAfterNode(targets[i], next)) {
+                        iters[i].node_ = next;
+                        PREFETCH(next->NoBarrier_Next(level), 0, 1);
+                        walking[m++] = i;
+                    } else {
+                        bound[i] = next;
+                        if (i + 1 < n && follow[i + 1]) {
+                            iters[i + 1].node_ = iters[i].node_;
+                            walking[m++] = i + 1;
+                        }
+                    }
+                }
+                walking.resize(m);
+            }
+            if (level == 0) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            iters[i].node_ = iters[i].node_->Next(0);
+        }
+    }
+
     template<typename Key, typename Compare>
     typename SkipList<Key, Compare>::Node *SkipList<Key, Compare>::FindLast() const {
         Node *x = head_;
@@ -262,10 +351,9 @@ namespace leveldb {
 
     template<typename Key, class Comparator>
     inline void SkipList<Key, Comparator>::Iterator::Prev() {
-        // Instead of using explicit "prev" links, we just search for the
-        // last node that falls before key.
+        // level 0上维护了反向指针, 不需要再从head_查找最后一个<key的节点.
         assert(Valid());
-        node_ = list_->FindLessThan(node_->key);
+        node_ = node_->Prev();
         if (node_ == list_->head_) {
             node_ = nullptr;
         }
@@ -274,7 +362,6 @@ namespace leveldb {
     template<typename Key, class Comparator>
     inline void SkipList<Key, Comparator>::Iterator::Seek(const Key &target) {
         node_ = list_->FindGreaterOrEqual(target, nullptr);
-        int debug_var = 0;
     }
 
     template<typename Key, class Comparator>
@@ -0,0 +1,412 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "db/table_cache.h"
+
+#include <vector>
+
+#include "db/filename.h"
+#include "db/merge_helper.h"
+#include "db/version_edit.h"
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
+#include "table/two_level_iterator.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    struct TableAndFile {
+        RandomAccessFile *file;
+        Table *table;
+    };
+
+    static void DeleteEntry(const Slice &, void *value) {
+        auto *tf = reinterpret_cast<TableAndFile *>(value);
+        delete tf->table;
+        delete tf->file;
+        delete tf;
+    }
+
+    static void UnrefEntry(void *arg1, void *arg2) {
+        auto *cache = reinterpret_cast<Cache *>(arg1);
+        auto *h = reinterpret_cast<Cache::Handle *>(arg2);
+        cache->Release(h);
+    }
+
+    TableCache::TableCache(const std::string &dbname, const Options &options, const Comparator *user_comparator,
+                           int entries)
+            : env_(options.env),
+              dbname_(dbname),
+              options_(options),
+              user_comparator_(user_comparator),
+              cache_(NewLRUCache(entries)),
+              row_cache_(options.row_cache) {}
+
+    TableCache::~TableCache() { delete cache_; }
+
+    Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle **handle) {
+        Status s;
+        char buf[sizeof(file_number)];
+        EncodeFixed64(buf, file_number);
+        Slice key(buf, sizeof(buf));
+        *handle = cache_->Lookup(key);
+        if (*handle == nullptr) {
+            std::string fname = TableFileName(dbname_, file_number);
+            RandomAccessFile *file = nullptr;
+            Table *table = nullptr;
+            s = env_->NewRandomAccessFile(fname, &file);
+            if (!s.IsOK()) {
+                // 兼容旧版本的.sst文件名
+                std::string old_fname = SSTTableFileName(dbname_, file_number);
+                if (env_->NewRandomAccessFile(old_fname, &file).IsOK()) {
+                    s = Status::OK();
+                }
+            }
+            if (s.IsOK()) {
+                s = Table::Open(options_, file, file_number, file_size, &table);
+            }
+
+            if (!s.IsOK()) {
+                assert(table == nullptr);
+                delete file;
+                // 不缓存错误, 错误可能是暂时的, 也可能被修复
+            } else {
+                auto *tf = new TableAndFile;
+                tf->file = file;
+                tf->table = table;
+                *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+            }
+        }
+        return s;
+    }
+
+    // arena中的迭代器只会被调用析构函数, 用一个不会打开任何block的两层迭代器包装,
+    // 由它负责释放堆上的index迭代器.
+    static Iterator *WrapInArena(Iterator *index_iter, const ReadOptions &options, Arena *arena) {
+        if (arena == nullptr) {
+            return index_iter;
+        }
+        BlockFunction never_called = [](void *, const ReadOptions &, const Slice &) -> Iterator * {
+            return nullptr;
+        };
+        return NewTwoLevelIterator(index_iter, never_called, nullptr, options, nullptr, arena);
+    }
+
+    Iterator *TableCache::NewIterator(const ReadOptions &options, uint64_t file_number, uint64_t file_size,
+                                      Table **tableptr, Arena *arena) {
+        if (tableptr != nullptr) {
+            *tableptr = nullptr;
+        }
+
+        Cache::Handle *handle = nullptr;
+        Status s = FindTable(file_number, file_size, &handle);
+        if (!s.IsOK()) {
+            return WrapInArena(NewErrorIterator(s), options, arena);
+        }
+
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        // iterate_upper_bound对应的最小internal key, data block不会读到上界之后
+        Iterator *result;
+        if (options.iterate_upper_bound != nullptr) {
+            InternalKey limit(*options.iterate_upper_bound, kMaxSequenceNumber, kValueTypeForSeek);
+            Slice limit_key = limit.Encode();
+            result = table->NewIterator(options, arena, &limit_key);
+        } else {
+            result = table->NewIterator(options, arena);
+        }
+        result->RegisterCleanup(&UnrefEntry, cache_, handle);
+        if (tableptr != nullptr) {
+            *tableptr = table;
+        }
+        return result;
+    }
+
+    Iterator *TableCache::NewIterator(const ReadOptions &options, const FileMetaData &file, Arena *arena) {
+        if (!FileOverlapsIterateBounds(user_comparator_, file, options.iterate_lower_bound,
+                                       options.iterate_upper_bound)) {
+            return WrapInArena(NewEmptyIterator(), options, arena);
+        }
+        return NewIterator(options, file.number, file.file_size, nullptr, arena);
+    }
+
+    namespace {
+
+        struct Saver {
+            const Comparator *user_comparator;
+            Slice user_key;
+            RowCacheEntry entry;
+            Status status;
+            bool pin_value = false;     // 第一条记录是普通value时不拷贝进entry, 只记录在value中
+            bool value_pinned = false;
+            Slice value;
+        };
+
+        // 从新到旧收集user_key的记录, 直到第一个value或者删除.
+        bool SaveValue(void *arg, const Slice &ikey, const Slice &v) {
+            auto *saver = reinterpret_cast<Saver *>(arg);
+            ParsedInternalKey parsed_key;
+            if (!ParseInternalKey(ikey, &parsed_key)) {
+                saver->status = Status::Corruption("corrupted internal key in table");
+                return false;
+            }
+            if (saver->user_comparator->Compare(parsed_key.user_key, saver->user_key) != 0) {
+                return false;
+            }
+            if (saver->pin_value && saver->entry.empty() && parsed_key.type == kTypeValue) {
+                saver->value = v;
+                saver->value_pinned = true;
+                return false;
+            }
+            saver->entry.Add(parsed_key.type, v);
+            return parsed_key.type == kTypeMerge;
+        }
+
+        void DeletePinnedBlock(void *arg1, void * /*arg2*/) {
+            delete reinterpret_cast<Iterator *>(arg1);
+        }
+
+    }  // namespace
+
+    bool TableCache::Get(const ReadOptions &options, uint64_t file_number, uint64_t file_size, const LookupKey &k,
+                         std::string *value, Status *s, MergeContext *merge_context) {
+        const Slice user_key = k.user_key();
+        std::string row_key;
+        if (row_cache_.enabled()) {
+            row_cache_.ComputeKey(options, file_number, user_key, &row_key);
+            bool done = false;
+            if (row_cache_.Lookup(row_key, user_key, options_.merge_operator, value, s, merge_context, &done)) {
+                return done;
+            }
+        }
+
+        Cache::Handle *handle = nullptr;
+        Status st = FindTable(file_number, file_size, &handle);
+        if (!st.IsOK()) {
+            *s = st;
+            return true;
+        }
+
+        Saver saver;
+        saver.user_comparator = user_comparator_;
+        saver.user_key = user_key;
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        st = table->InternalGet(options, k.internal_key(), &saver, &SaveValue);
+        cache_->Release(handle);
+        if (st.IsOK()) {
+            st = saver.status;
+        }
+        if (!st.IsOK()) {
+            *s = st;
+            return true;
+        }
+
+        if (row_cache_.enabled()) {
+            row_cache_.Insert(row_key, saver.entry);
+        }
+        // 与命中row_cache时走同一条路径, 保证两者的语义一致
+        return RowCacheEntry::Replay(saver.entry.data(), user_key, options_.merge_operator, value, s, merge_context);
+    }
+
+    bool TableCache::Get(const ReadOptions &options, uint64_t file_number, uint64_t file_size, const LookupKey &k,
+                         PinnableSlice *value, Status *s, MergeContext *merge_context) {
+        if (row_cache_.enabled() || (merge_context != nullptr && !merge_context->empty())) {
+            // 结果是row_cache中的拷贝, 或者需要和已经收集到的operand折叠
+            const bool done = Get(options, file_number, file_size, k, value->GetSelf(), s, merge_context);
+            if (done && s->IsOK()) {
+                value->PinSelf();
+            }
+            return done;
+        }
+
+        Cache::Handle *handle = nullptr;
+        Status st = FindTable(file_number, file_size, &handle);
+        if (!st.IsOK()) {
+            *s = st;
+            return true;
+        }
+
+        Saver saver;
+        saver.user_comparator = user_comparator_;
+        saver.user_key = k.user_key();
+        saver.pin_value = true;
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        Iterator *block = nullptr;
+        st = table->InternalGet(options, k.internal_key(), &saver, &SaveValue, &block);
+        if (st.IsOK()) {
+            st = saver.status;
+        }
+        if (st.IsOK() && saver.value_pinned) {
+            assert(block != nullptr);
+            // 没有进入block cache的block可能直接指向mmap的文件, 同时保留table的引用
+            block->RegisterCleanup(&UnrefEntry, cache_, handle);
+            value->PinSlice(saver.value, &DeletePinnedBlock, block, nullptr);
+            *s = Status::OK();
+            return true;
+        }
+        delete block;
+        cache_->Release(handle);
+        if (!st.IsOK()) {
+            *s = st;
+            return true;
+        }
+
+        const bool done = RowCacheEntry::Replay(saver.entry.data(), saver.user_key, options_.merge_operator,
+                                                value->GetSelf(), s, merge_context);
+        if (done && s->IsOK()) {
+            value->PinSelf();
+        }
+        return done;
+    }
+
+    void TableCache::MultiGet(const ReadOptions &options, uint64_t file_number, uint64_t file_size,
+                              GetContext *const *keys, size_t n) {
+        // row_cache未命中的key, 以及它们的row_cache key
+        std::vector<GetContext *> misses;
+        std::vector<std::string> row_keys;
+        misses.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            GetContext *ctx = keys[i];
+            if (row_cache_.enabled()) {
+                const Slice user_key = ctx->key->user_key();
+                std::string row_key;
+                row_cache_.ComputeKey(options, file_number, user_key, &row_key);
+                if (row_cache_.Lookup(row_key, user_key, options_.merge_operator, ctx->value, ctx->status,
+                                      ctx->merge_context, &ctx->done)) {
+                    continue;
+                }
+                row_keys.push_back(std::move(row_key));
+            }
+            misses.push_back(ctx);
+        }
+        if (misses.empty()) {
+            return;
+        }
+
+        Cache::Handle *handle = nullptr;
+        Status st = FindTable(file_number, file_size, &handle);
+        if (!st.IsOK()) {
+            for (GetContext *ctx : misses) {
+                *ctx->status = st;
+                ctx->done = true;
+            }
+            return;
+        }
+
+        const size_t m = misses.size();
+        std::vector<Saver> savers(m);
+        std::vector<Slice> ikeys(m);
+        std::vector<void *> args(m);
+        std::vector<Status> statuses(m);
+        for (size_t i = 0; i < m; i++) {
+            savers[i].user_comparator = user_comparator_;
+            savers[i].user_key = misses[i]->key->user_key();
+            ikeys[i] = misses[i]->key->internal_key();
+            args[i] = &savers[i];
+        }
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        table->MultiGet(options, ikeys.data(), m, args.data(), &SaveValue, statuses.data());
+        cache_->Release(handle);
+
+        for (size_t i = 0; i < m; i++) {
+            GetContext *ctx = misses[i];
+            st = statuses[i];
+            if (st.IsOK()) {
+                st = savers[i].status;
+            }
+            if (!st.IsOK()) {
+                *ctx->status = st;
+                ctx->done = true;
+                continue;
+            }
+            if (row_cache_.enabled()) {
+                row_cache_.Insert(row_keys[i], savers[i].entry);
+            }
+            ctx->done = RowCacheEntry::Replay(savers[i].entry.data(), savers[i].user_key, options_.merge_operator,
+                                              ctx->value, ctx->status, ctx->merge_context);
+        }
+    }
+
+    // 同时作为SaveValue的参数, 回调时由Saver *转换回来.
+    struct TableCache::AsyncGetState : public Saver {
+        TableCache *table_cache;
+        Cache::Handle *handle;
+        std::string row_key;
+        std::string *value;
+        Status *s;
+        MergeContext *merge_context;
+        GetCallback callback;
+        void *arg;
+    };
+
+    void TableCache::GetAsync(const ReadOptions &options, uint64_t file_number, uint64_t file_size,
+                              const LookupKey &k, std::string *value, Status *s, MergeContext *merge_context,
+                              GetCallback callback, void *arg) {
+        const Slice user_key = k.user_key();
+        std::string row_key;
+        if (row_cache_.enabled()) {
+            row_cache_.ComputeKey(options, file_number, user_key, &row_key);
+            bool done = false;
+            if (row_cache_.Lookup(row_key, user_key, options_.merge_operator, value, s, merge_context, &done)) {
+                callback(arg, done);
+                return;
+            }
+        }
+
+        Cache::Handle *handle = nullptr;
+        Status st = FindTable(file_number, file_size, &handle);
+        if (!st.IsOK()) {
+            *s = st;
+            callback(arg, true);
+            return;
+        }
+
+        auto *state = new AsyncGetState;
+        state->table_cache = this;
+        state->handle = handle;
+        state->row_key.swap(row_key);
+        state->user_comparator = user_comparator_;
+        state->user_key = user_key;
+        state->value = value;
+        state->s = s;
+        state->merge_context = merge_context;
+        state->callback = callback;
+        state->arg = arg;
+        Table *table = reinterpret_cast<TableAndFile *>(cache_->Value(handle))->table;
+        table->InternalGetAsync(options, k.internal_key(), static_cast<Saver *>(state), &SaveValue, &TableCache::OnAsyncGetDone);
+    }
+
+    void TableCache::OnAsyncGetDone(void *arg, const Status &status) {
+        auto *state = static_cast<AsyncGetState *>(reinterpret_cast<Saver *>(arg));
+        TableCache *table_cache = state->table_cache;
+        table_cache->cache_->Release(state->handle);
+        Status st = status;
+        if (st.IsOK()) {
+            st = state->status;
+        }
+
+        bool done = true;
+        if (!st.IsOK()) {
+            *state->s = st;
+        } else {
+            if (table_cache->row_cache_.enabled()) {
+                table_cache->row_cache_.Insert(state->row_key, state->entry);
+            }
+            done = RowCacheEntry::Replay(state->entry.data(), state->user_key,
+                                         table_cache->options_.merge_operator, state->value, state->s,
+                                         state->merge_context);
+        }
+        GetCallback callback = state->callback;
+        void *callback_arg = state->arg;
+        delete state;
+        callback(callback_arg, done);
+    }
+
+    void TableCache::Evict(uint64_t file_number) {
+        char buf[sizeof(file_number)];
+        EncodeFixed64(buf, file_number);
+        cache_->Erase(Slice(buf, sizeof(buf)));
+    }
+
+}
@@ -0,0 +1,120 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_TABLE_CACHE_H
+#define MY_LEVELDB_TABLE_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "db/dbformat.h"
+#include "db/row_cache.h"
+#include "leveldb/cache.h"
+#include "leveldb/table.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+    class Arena;
+    class Env;
+    struct FileMetaData;
+    class MergeContext;
+    class PinnableSlice;
+
+    /**
+     * @brief 缓存打开的sstable(文件句柄 + index/filter), 最多entries个, 线程安全.
+     * 同时负责Options::row_cache的查找与填充.
+    */
+    class TableCache {
+    public:
+        // user_comparator用于判断sstable中的记录是否属于要查找的user key.
+        TableCache(const std::string &dbname, const Options &options, const Comparator *user_comparator,
+                   int entries);
+
+        TableCache(const TableCache &) = delete;
+        TableCache &operator=(const TableCache &) = delete;
+
+        ~TableCache();
+
+        /**
+         * @brief 返回file_number对应sstable的迭代器. tableptr不为nullptr时*tableptr指向对应的Table,
+         * 它属于table cache, 在返回的迭代器存活期间有效, 调用方不应该释放它.
+         * arena不为nullptr时迭代器分配在arena中. 设置了options.iterate_upper_bound时,
+         * 不读取只包含上界之外的key的data block.
+        */
+        Iterator *NewIterator(const ReadOptions &options, uint64_t file_number, uint64_t file_size,
+                              Table **tableptr = nullptr, Arena *arena = nullptr);
+
+        /**
+         * @brief 返回file对应sstable的迭代器. file的key范围与options.iterate_lower_bound/iterate_upper_bound
+         * 不相交时不打开文件, 直接返回空迭代器.
+        */
+        Iterator *NewIterator(const ReadOptions &options, const FileMetaData &file, Arena *arena = nullptr);
+
+        /**
+         * @brief 在sstable中查找k, 语义同MemTable::Get: 找到value或者删除时返回true, 结果写入*value和*s;
+         * 只找到merge operand时把它们加入merge_context并返回false, 由调用方继续查找更旧的文件.
+         * 出错时*s被设置并返回true. 设置了row_cache时先查找row_cache, 未命中时把结果填充进去.
+        */
+        bool Get(const ReadOptions &options, uint64_t file_number, uint64_t file_size, const LookupKey &k,
+                 std::string *value, Status *s, MergeContext *merge_context);
+
+        /**
+         * @brief 与上面的Get相同, 但是文件中最新的记录是普通value并且merge_context为空时不拷贝,
+         * value直接指向data block并持有block的引用(block cache的handle或者未缓存的block), 直到value被Reset.
+         * 设置了row_cache时结果来自row_cache中的拷贝, 不会pin.
+        */
+        bool Get(const ReadOptions &options, uint64_t file_number, uint64_t file_size, const LookupKey &k,
+                 PinnableSlice *value, Status *s, MergeContext *merge_context);
+
+        // MultiGet中的一个key, 结果的语义同Get(std::string *), done为Get的返回值.
+        struct GetContext {
+            const LookupKey *key;
+            std::string *value;
+            Status *status;
+            MergeContext *merge_context;
+            bool done;
+        };
+
+        /**
+         * @brief 对keys中的每个key做一次Get(std::string *), 结果写入对应的GetContext.
+         * keys按user key升序排列, 使用同一个快照. 文件只查找一次table cache, 落在同一个data block中的
+         * key共享一次index Seek和一次block读取, 见Table::MultiGet. 设置了row_cache时先逐个查找row_cache.
+        */
+        void MultiGet(const ReadOptions &options, uint64_t file_number, uint64_t file_size,
+                      GetContext *const *keys, size_t n);
+
+        // done的语义同Get的返回值.
+        using GetCallback = void (*)(void *arg, bool done);
+
+        /**
+         * @brief 异步版本的Get(std::string *), 结果写入value, s, merge_context之后调用callback(arg, done).
+         * 需要读取data block时通过RandomAccessFile::ReadAsync读取, callback在完成读取的线程中调用;
+         * row_cache/block cache命中时在当前线程中调用.
+         * REQUIRES: callback返回之前k, value, s, merge_context必须一直有效.
+        */
+        void GetAsync(const ReadOptions &options, uint64_t file_number, uint64_t file_size, const LookupKey &k,
+                      std::string *value, Status *s, MergeContext *merge_context, GetCallback callback, void *arg);
+
+        // 丢弃file_number对应的缓存
+        void Evict(uint64_t file_number);
+
+    private:
+        struct AsyncGetState;
+
+        static void OnAsyncGetDone(void *arg, const Status &s);
+
+        Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle **handle);
+
+        Env *const env_;
+        const std::string dbname_;
+        const Options &options_;
+        const Comparator *const user_comparator_;
+        Cache *cache_;
+        RowCache row_cache_;
+    };
+
+}
+
+#endif //MY_LEVELDB_TABLE_CACHE_H
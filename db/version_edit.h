@@ -16,14 +16,27 @@ namespace leveldb {
     class VersionSet;
 
     struct FileMetaData {
-        int refs;
-        int allowed_seeks;
-        uint64_t number;
-        uint64_t file_size;
+        int refs = 0;
+        int allowed_seeks = 1 << 30;    // compaction之前允许的seek次数
+        uint64_t number = 0;
+        uint64_t file_size = 0;
         InternalKey smallest;
         InternalKey largest;
     };
 
+    // f的user key范围与迭代范围[lower_bound, upper_bound)是否有交集, nullptr代表不限制.
+    // TableCache::NewIterator用它跳过范围之外的sstable.
+    inline bool FileOverlapsIterateBounds(const Comparator *ucmp, const FileMetaData &f,
+                                          const Slice *lower_bound, const Slice *upper_bound) {
+        if (lower_bound != nullptr && ucmp->Compare(f.largest.user_key(), *lower_bound) < 0) {
+            return false;
+        }
+        if (upper_bound != nullptr && ucmp->Compare(f.smallest.user_key(), *upper_bound) >= 0) {
+            return false;
+        }
+        return true;
+    }
+
     class VersionEdit {
     public:
         VersionEdit() { Clear(); }
@@ -0,0 +1,661 @@
+//
+// Created by kuiper on 2021/2/20.
+//
+
+#include "db/version_set.h"
+
+#include <algorithm>
+
+#include "db/merge_helper.h"
+#include "db/table_cache.h"
+#include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
+#include "table/two_level_iterator.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    static int64_t TotalFileSize(const std::vector<FileMetaData *> &files) {
+        int64_t sum = 0;
+        for (const FileMetaData *f : files) {
+            sum += f->file_size;
+        }
+        return sum;
+    }
+
+    // 新flush的文件与下下层重叠超过这么多字节时不再下推.
+    static int64_t MaxGrandParentOverlapBytes(const Options *options) {
+        return 10 * static_cast<int64_t>(options->max_file_size);
+    }
+
+    static double MaxBytesForLevel(int level) {
+        // L0的阈值单独按文件数计算, 这里L1为10MB, 之后每层乘10
+        double result = 10. * 1048576.0;
+        while (level > 1) {
+            result *= 10;
+            level--;
+        }
+        return result;
+    }
+
+    int FindFile(const InternalKeyComparator &icmp, const std::vector<FileMetaData *> &files, const Slice &key) {
+        uint32_t left = 0;
+        uint32_t right = files.size();
+        while (left < right) {
+            uint32_t mid = (left + right) / 2;
+            if (icmp.Compare(files[mid]->largest.Encode(), key) < 0) {
+                // mid及之前的文件都小于key
+                left = mid + 1;
+            } else {
+                right = mid;
+            }
+        }
+        return right;
+    }
+
+    static bool AfterFile(const Comparator *ucmp, const Slice *user_key, const FileMetaData *f) {
+        // nullptr代表在所有key之前
+        return (user_key != nullptr && ucmp->Compare(*user_key, f->largest.user_key()) > 0);
+    }
+
+    static bool BeforeFile(const Comparator *ucmp, const Slice *user_key, const FileMetaData *f) {
+        // nullptr代表在所有key之后
+        return (user_key != nullptr && ucmp->Compare(*user_key, f->smallest.user_key()) < 0);
+    }
+
+    bool SomeFileOverlapsRange(const InternalKeyComparator &icmp, bool disjoint_sorted_files,
+                               const std::vector<FileMetaData *> &files, const Slice *smallest_user_key,
+                               const Slice *largest_user_key) {
+        const Comparator *ucmp = icmp.user_comparator();
+        if (!disjoint_sorted_files) {
+            for (const FileMetaData *f : files) {
+                if (!AfterFile(ucmp, smallest_user_key, f) && !BeforeFile(ucmp, largest_user_key, f)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        uint32_t index = 0;
+        if (smallest_user_key != nullptr) {
+            InternalKey small_key(*smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+            index = FindFile(icmp, files, small_key.Encode());
+        }
+        if (index >= files.size()) {
+            return false;
+        }
+        return !BeforeFile(ucmp, largest_user_key, files[index]);
+    }
+
+    Version::~Version() {
+        assert(refs_ == 0);
+
+        prev_->next_ = next_;
+        next_->prev_ = prev_;
+
+        for (auto &level_files : files_) {
+            for (FileMetaData *f : level_files) {
+                assert(f->refs > 0);
+                f->refs--;
+                if (f->refs <= 0) {
+                    delete f;
+                }
+            }
+        }
+    }
+
+    void Version::Ref() { ++refs_; }
+
+    void Version::Unref() {
+        assert(this != &vset_->dummy_versions_);
+        assert(refs_ >= 1);
+        --refs_;
+        if (refs_ == 0) {
+            delete this;
+        }
+    }
+
+    namespace {
+
+        // L1+某一层的文件列表, key是文件的largest, value是16字节的(number, file_size).
+        class LevelFileNumIterator : public Iterator {
+        public:
+            LevelFileNumIterator(const InternalKeyComparator &icmp, const std::vector<FileMetaData *> *flist)
+                    : icmp_(icmp), flist_(flist), index_(flist->size()) {}
+
+            bool Valid() const override { return index_ < flist_->size(); }
+
+            void Seek(const Slice &target) override { index_ = FindFile(icmp_, *flist_, target); }
+
+            void SeekToFirst() override { index_ = 0; }
+
+            void SeekToLast() override { index_ = flist_->empty() ? 0 : flist_->size() - 1; }
+
+            void Next() override {
+                assert(Valid());
+                index_++;
+            }
+
+            void Prev() override {
+                assert(Valid());
+                if (index_ == 0) {
+                    index_ = flist_->size();
+                } else {
+                    index_--;
+                }
+            }
+
+            Slice Key() const override {
+                assert(Valid());
+                return (*flist_)[index_]->largest.Encode();
+            }
+
+            Slice Value() const override {
+                assert(Valid());
+                EncodeFixed64(value_buf_, (*flist_)[index_]->number);
+                EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+                return Slice(value_buf_, sizeof(value_buf_));
+            }
+
+            Status status() const override { return Status::OK(); }
+
+        private:
+            const InternalKeyComparator icmp_;
+            const std::vector<FileMetaData *> *const flist_;
+            uint32_t index_;
+
+            mutable char value_buf_[16];
+        };
+
+        Iterator *GetFileIterator(void *arg, const ReadOptions &options, const Slice &file_value) {
+            auto *cache = reinterpret_cast<TableCache *>(arg);
+            if (file_value.size() != 16) {
+                return NewErrorIterator(Status::Corruption("FileReader invoked with unexpected value"));
+            }
+            // 每个文件的迭代器自己处理iterate_upper_bound
+            return cache->NewIterator(options, DecodeFixed64(file_value.data()),
+                                      DecodeFixed64(file_value.data() + 8));
+        }
+
+    }  // anonymous namespace
+
+    Iterator *Version::NewConcatenatingIterator(const ReadOptions &options, int level, Arena *arena) const {
+        return NewTwoLevelIterator(new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
+                                   vset_->table_cache_, options, nullptr, arena);
+    }
+
+    void Version::AddIterators(const ReadOptions &options, std::vector<Iterator *> *iters, Arena *arena) {
+        // L0的文件可能互相重叠, 每个文件单独一个迭代器
+        for (const FileMetaData *f : files_[0]) {
+            iters->push_back(vset_->table_cache_->NewIterator(options, *f, arena));
+        }
+
+        // L1+的文件互不重叠, 每层一个按需打开文件的迭代器
+        for (int level = 1; level < config::kNumLevels; level++) {
+            if (!files_[level].empty()) {
+                iters->push_back(NewConcatenatingIterator(options, level, arena));
+            }
+        }
+    }
+
+    static bool NewestFirst(const FileMetaData *a, const FileMetaData *b) {
+        return a->number > b->number;
+    }
+
+    void Version::FilesForKey(const Slice &user_key, const Slice &internal_key,
+                              std::vector<std::pair<int, FileMetaData *>> *files) const {
+        const Comparator *ucmp = vset_->icmp_.user_comparator();
+
+        std::vector<FileMetaData *> tmp;
+        tmp.reserve(files_[0].size());
+        for (FileMetaData *f : files_[0]) {
+            if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+                ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                tmp.push_back(f);
+            }
+        }
+        std::sort(tmp.begin(), tmp.end(), NewestFirst);
+        for (FileMetaData *f : tmp) {
+            files->emplace_back(0, f);
+        }
+
+        // L1+每层最多一个文件
+        for (int level = 1; level < config::kNumLevels; level++) {
+            const std::vector<FileMetaData *> &level_files = files_[level];
+            if (level_files.empty()) {
+                continue;
+            }
+            uint32_t index = FindFile(vset_->icmp_, level_files, internal_key);
+            if (index < level_files.size()) {
+                FileMetaData *f = level_files[index];
+                if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0) {
+                    files->emplace_back(level, f);
+                }
+            }
+        }
+    }
+
+    template<typename Value>
+    Status Version::GetImpl(const ReadOptions &options, const LookupKey &k, Value *value,
+                            MergeContext *merge_context, GetStats *stats) {
+        stats->seek_file = nullptr;
+        stats->seek_file_level = -1;
+
+        std::vector<std::pair<int, FileMetaData *>> files;
+        FilesForKey(k.user_key(), k.internal_key(), &files);
+        for (size_t i = 0; i < files.size(); i++) {
+            if (i == 1) {
+                // 查找了不止一个文件, 第一个文件的seek被浪费了
+                stats->seek_file = files[0].second;
+                stats->seek_file_level = files[0].first;
+            }
+            const FileMetaData *f = files[i].second;
+            Status s;
+            if (vset_->table_cache_->Get(options, f->number, f->file_size, k, value, &s, merge_context)) {
+                return s;
+            }
+        }
+        return Status::NotFound(Slice());
+    }
+
+    Status Version::Get(const ReadOptions &options, const LookupKey &k, std::string *value,
+                        MergeContext *merge_context, GetStats *stats) {
+        return GetImpl(options, k, value, merge_context, stats);
+    }
+
+    Status Version::Get(const ReadOptions &options, const LookupKey &k, PinnableSlice *value,
+                        MergeContext *merge_context, GetStats *stats) {
+        return GetImpl(options, k, value, merge_context, stats);
+    }
+
+    void Version::MultiGet(const ReadOptions &options, TableCache::GetContext *keys, size_t n,
+                           GetStats *stats) {
+        const Comparator *ucmp = vset_->icmp_.user_comparator();
+        // 每个key查找过的文件数和第一个文件, 与Get相同地计算seek
+        std::vector<int> files_read(n, 0);
+        std::vector<std::pair<int, FileMetaData *>> first_file(n);
+        std::vector<TableCache::GetContext *> batch;
+        batch.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            keys[i].done = false;
+            stats[i].seek_file = nullptr;
+            stats[i].seek_file_level = -1;
+        }
+
+        auto lookup = [&](int level, FileMetaData *f) {
+            for (TableCache::GetContext *ctx : batch) {
+                const size_t i = ctx - keys;
+                if (files_read[i]++ == 0) {
+                    first_file[i] = std::make_pair(level, f);
+                } else if (stats[i].seek_file == nullptr) {
+                    stats[i].seek_file = first_file[i].second;
+                    stats[i].seek_file_level = first_file[i].first;
+                }
+            }
+            vset_->table_cache_->MultiGet(options, f->number, f->file_size, batch.data(), batch.size());
+            batch.clear();
+        };
+
+        // L0从新到旧, 每个文件收集落在它范围内的key
+        std::vector<FileMetaData *> level0(files_[0]);
+        std::sort(level0.begin(), level0.end(), NewestFirst);
+        for (FileMetaData *f : level0) {
+            for (size_t i = 0; i < n; i++) {
+                const Slice user_key = keys[i].key->user_key();
+                if (!keys[i].done && ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+                    ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+                    batch.push_back(&keys[i]);
+                }
+            }
+            if (!batch.empty()) {
+                lookup(0, f);
+            }
+        }
+
+        // L1+文件互不重叠, 有序的key落在的文件也是有序的, 相邻的key合并成一个batch
+        for (int level = 1; level < config::kNumLevels; level++) {
+            const std::vector<FileMetaData *> &level_files = files_[level];
+            if (level_files.empty()) {
+                continue;
+            }
+            FileMetaData *batch_file = nullptr;
+            for (size_t i = 0; i < n; i++) {
+                if (keys[i].done) {
+                    continue;
+                }
+                uint32_t index = FindFile(vset_->icmp_, level_files, keys[i].key->internal_key());
+                if (index >= level_files.size()) {
+                    break;
+                }
+                FileMetaData *f = level_files[index];
+                if (ucmp->Compare(keys[i].key->user_key(), f->smallest.user_key()) < 0) {
+                    continue;
+                }
+                if (f != batch_file && !batch.empty()) {
+                    lookup(level, batch_file);
+                }
+                batch_file = f;
+                batch.push_back(&keys[i]);
+            }
+            if (!batch.empty()) {
+                lookup(level, batch_file);
+            }
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            if (!keys[i].done) {
+                *keys[i].status = Status::NotFound(Slice());
+            }
+        }
+    }
+
+    // 一次GetAsync的状态, files中的文件依次异步查找, 直到某个文件给出结果.
+    struct Version::AsyncGetState {
+        Version *version;
+        ReadOptions options;
+        const LookupKey *key;
+        std::string *value;
+        MergeContext *merge_context;
+        GetStats *stats;
+        std::vector<std::pair<int, FileMetaData *>> files;
+        size_t next_file;
+        Status s;
+        GetCallback callback;
+        void *arg;
+    };
+
+    void Version::GetAsync(const ReadOptions &options, const LookupKey &k, std::string *value,
+                           MergeContext *merge_context, GetStats *stats, GetCallback callback, void *arg) {
+        stats->seek_file = nullptr;
+        stats->seek_file_level = -1;
+
+        auto *state = new AsyncGetState{this, options, &k, value, merge_context, stats, {}, 0, Status(),
+                                        callback, arg};
+        FilesForKey(k.user_key(), k.internal_key(), &state->files);
+        // 没有候选文件时直接以NotFound结束
+        OnAsyncFileDone(state, false);
+    }
+
+    void Version::OnAsyncFileDone(void *arg, bool done) {
+        auto *state = reinterpret_cast<AsyncGetState *>(arg);
+        if (!done && state->next_file < state->files.size()) {
+            if (state->next_file == 1) {
+                state->stats->seek_file = state->files[0].second;
+                state->stats->seek_file_level = state->files[0].first;
+            }
+            const FileMetaData *f = state->files[state->next_file++].second;
+            // 命中cache时OnAsyncFileDone在这里同步地递归调用, 深度不超过候选文件数
+            state->version->vset_->table_cache_->GetAsync(state->options, f->number, f->file_size, *state->key,
+                                                          state->value, &state->s, state->merge_context,
+                                                          &Version::OnAsyncFileDone, state);
+            return;
+        }
+
+        Status s = done ? state->s : Status::NotFound(Slice());
+        GetCallback callback = state->callback;
+        void *callback_arg = state->arg;
+        delete state;
+        callback(callback_arg, s);
+    }
+
+    bool Version::UpdateStats(const GetStats &stats) {
+        FileMetaData *f = stats.seek_file;
+        if (f != nullptr) {
+            f->allowed_seeks--;
+            if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
+                file_to_compact_ = f;
+                file_to_compact_level_ = stats.seek_file_level;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool Version::RecordReadSample(Slice internal_key) {
+        ParsedInternalKey ikey;
+        if (!ParseInternalKey(internal_key, &ikey)) {
+            return false;
+        }
+
+        std::vector<std::pair<int, FileMetaData *>> files;
+        FilesForKey(ikey.user_key, internal_key, &files);
+        // 至少与两个文件重叠时, 按第一个文件被浪费了一次seek计算
+        if (files.size() >= 2) {
+            GetStats stats;
+            stats.seek_file = files[0].second;
+            stats.seek_file_level = files[0].first;
+            return UpdateStats(stats);
+        }
+        return false;
+    }
+
+    bool Version::OverlapInLevel(int level, const Slice *smallest_user_key, const Slice *largest_user_key) {
+        return SomeFileOverlapsRange(vset_->icmp_, (level > 0), files_[level], smallest_user_key,
+                                     largest_user_key);
+    }
+
+    int Version::PickLevelForMemTableOutput(const Slice &smallest_user_key, const Slice &largest_user_key) {
+        int level = 0;
+        if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+            InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+            InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
+            std::vector<FileMetaData *> overlaps;
+            while (level < config::kMaxMemCompactLevel) {
+                if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+                    break;
+                }
+                if (level + 2 < config::kNumLevels) {
+                    GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
+                    if (TotalFileSize(overlaps) > MaxGrandParentOverlapBytes(vset_->options_)) {
+                        break;
+                    }
+                }
+                level++;
+            }
+        }
+        return level;
+    }
+
+    void Version::GetOverlappingInputs(int level, const InternalKey *begin, const InternalKey *end,
+                                       std::vector<FileMetaData *> *inputs) {
+        assert(level >= 0);
+        assert(level < config::kNumLevels);
+        inputs->clear();
+        Slice user_begin, user_end;
+        if (begin != nullptr) {
+            user_begin = begin->user_key();
+        }
+        if (end != nullptr) {
+            user_end = end->user_key();
+        }
+        const Comparator *user_cmp = vset_->icmp_.user_comparator();
+        for (size_t i = 0; i < files_[level].size();) {
+            FileMetaData *f = files_[level][i++];
+            const Slice file_start = f->smallest.user_key();
+            const Slice file_limit = f->largest.user_key();
+            if (begin != nullptr && user_cmp->Compare(file_limit, user_begin) < 0) {
+                // f完全在范围之前
+            } else if (end != nullptr && user_cmp->Compare(file_start, user_end) > 0) {
+                // f完全在范围之后
+            } else {
+                inputs->push_back(f);
+                if (level == 0) {
+                    // L0的文件可能互相重叠, 范围扩大时从头重新开始
+                    if (begin != nullptr && user_cmp->Compare(file_start, user_begin) < 0) {
+                        user_begin = file_start;
+                        inputs->clear();
+                        i = 0;
+                    } else if (end != nullptr && user_cmp->Compare(file_limit, user_end) > 0) {
+                        user_end = file_limit;
+                        inputs->clear();
+                        i = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    VersionSet::VersionSet(const std::string &dbname, const Options *options, TableCache *table_cache,
+                           const InternalKeyComparator *icmp)
+            : env_(options->env),
+              dbname_(dbname),
+              options_(options),
+              table_cache_(table_cache),
+              icmp_(*icmp),
+              next_file_number_(2),
+              manifest_file_number_(0),
+              last_sequence_(0),
+              log_number_(0),
+              prev_log_number_(0),
+              dummy_versions_(this),
+              current_(nullptr) {
+        AppendVersion(new Version(this));
+    }
+
+    VersionSet::~VersionSet() {
+        current_->Unref();
+        assert(dummy_versions_.next_ == &dummy_versions_);  // 所有Version都已经释放
+    }
+
+    void VersionSet::AppendVersion(Version *v) {
+        assert(v->refs_ == 0);
+        assert(v != current_);
+        if (current_ != nullptr) {
+            current_->Unref();
+        }
+        current_ = v;
+        v->Ref();
+
+        // 追加到链表尾部
+        v->prev_ = dummy_versions_.prev_;
+        v->next_ = &dummy_versions_;
+        v->prev_->next_ = v;
+        v->next_->prev_ = v;
+    }
+
+    namespace {
+
+        struct BySmallestKey {
+            const InternalKeyComparator *internal_comparator;
+
+            bool operator()(const FileMetaData *f1, const FileMetaData *f2) const {
+                int r = internal_comparator->Compare(f1->smallest, f2->smallest);
+                if (r != 0) {
+                    return (r < 0);
+                }
+                return (f1->number < f2->number);
+            }
+        };
+
+    }  // anonymous namespace
+
+    Status VersionSet::LogAndApply(VersionEdit *edit, port::Mutex *mu) {
+        mu->AssertHeld();
+        if (edit->has_log_number_) {
+            assert(edit->log_number_ >= log_number_);
+            assert(edit->log_number_ < next_file_number_);
+        } else {
+            edit->SetLogNumber(log_number_);
+        }
+        if (!edit->has_prev_log_number_) {
+            edit->SetPrevLogNumber(prev_log_number_);
+        }
+        edit->SetNextFile(next_file_number_);
+        edit->SetLastSequence(last_sequence_);
+
+        Version *base = current_;
+        auto *v = new Version(this);
+        BySmallestKey cmp{&icmp_};
+        for (int level = 0; level < config::kNumLevels; level++) {
+            std::vector<FileMetaData *> &files = v->files_[level];
+            for (FileMetaData *f : base->files_[level]) {
+                if (edit->deleted_files_.count(std::make_pair(level, f->number)) == 0) {
+                    files.push_back(f);
+                }
+            }
+        }
+        for (const auto &new_file : edit->new_files_) {
+            auto *f = new FileMetaData(new_file.second);
+            f->refs = 0;
+            // 每16KB数据允许一次浪费的seek, 之后触发compaction
+            f->allowed_seeks = static_cast<int>(f->file_size / 16384U);
+            if (f->allowed_seeks < 100) {
+                f->allowed_seeks = 100;
+            }
+            v->files_[new_file.first].push_back(f);
+        }
+        for (auto &files : v->files_) {
+            std::sort(files.begin(), files.end(), cmp);
+            for (FileMetaData *f : files) {
+                f->refs++;
+            }
+        }
+#ifndef NDEBUG
+        for (int level = 1; level < config::kNumLevels; level++) {
+            const std::vector<FileMetaData *> &files = v->files_[level];
+            for (size_t i = 1; i < files.size(); i++) {
+                assert(icmp_.Compare(files[i - 1]->largest, files[i]->smallest) < 0);
+            }
+        }
+#endif
+
+        // MANIFEST的写入尚未实现, edit只应用在内存中
+        Finalize(v);
+        AppendVersion(v);
+        log_number_ = edit->log_number_;
+        prev_log_number_ = edit->prev_log_number_;
+        return Status::OK();
+    }
+
+    void VersionSet::MarkFileNumberUsed(uint64_t number) {
+        if (next_file_number_ <= number) {
+            next_file_number_ = number + 1;
+        }
+    }
+
+    void VersionSet::Finalize(Version *v) {
+        int best_level = -1;
+        double best_score = -1;
+
+        for (int level = 0; level < config::kNumLevels - 1; level++) {
+            double score;
+            if (level == 0) {
+                // L0按文件数计算: 每次读都要合并所有L0文件, 写缓冲较大时按字节数会compaction得太少
+                score = v->files_[level].size() / static_cast<double>(config::kL0_CompactionTrigger);
+            } else {
+                score = static_cast<double>(TotalFileSize(v->files_[level])) / MaxBytesForLevel(level);
+            }
+
+            if (score > best_score) {
+                best_level = level;
+                best_score = score;
+            }
+        }
+
+        v->compaction_level_ = best_level;
+        v->compaction_score_ = best_score;
+    }
+
+    int VersionSet::NumLevelFiles(int level) const {
+        assert(level >= 0);
+        assert(level < config::kNumLevels);
+        return static_cast<int>(current_->files_[level].size());
+    }
+
+    int64_t VersionSet::NumLevelBytes(int level) const {
+        assert(level >= 0);
+        assert(level < config::kNumLevels);
+        return TotalFileSize(current_->files_[level]);
+    }
+
+    void VersionSet::AddLiveFiles(std::set<uint64_t> *live) {
+        for (Version *v = dummy_versions_.next_; v != &dummy_versions_; v = v->next_) {
+            for (const auto &files : v->files_) {
+                for (const FileMetaData *f : files) {
+                    live->insert(f->number);
+                }
+            }
+        }
+    }
+
+}
@@ -5,4 +5,229 @@
 #ifndef MY_LEVELDB_VERSION_SET_H
 #define MY_LEVELDB_VERSION_SET_H
 
+#include <cassert>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+    class Arena;
+    class MergeContext;
+    class PinnableSlice;
+    class Version;
+    class VersionSet;
+
+    // 返回files中第一个largest >= key的文件下标, 没有时返回files.size().
+    // REQUIRES: files中的文件互不重叠并且按key有序.
+    int FindFile(const InternalKeyComparator &icmp, const std::vector<FileMetaData *> &files, const Slice &key);
+
+    // files中是否有文件与user key范围[*smallest_user_key, *largest_user_key]重叠, nullptr代表不限制.
+    // disjoint_sorted_files为true时files互不重叠并且有序, 可以二分查找.
+    bool SomeFileOverlapsRange(const InternalKeyComparator &icmp, bool disjoint_sorted_files,
+                               const std::vector<FileMetaData *> &files, const Slice *smallest_user_key,
+                               const Slice *largest_user_key);
+
+    /**
+     * @brief 某一时刻每一层的sstable集合, 创建后不再修改. 在DB锁内Ref, 释放锁后读取, 再在DB锁内Unref.
+    */
+    class Version {
+    public:
+        // 点查时第一个被查找却没有结果的文件, 用于基于seek的compaction.
+        struct GetStats {
+            FileMetaData *seek_file = nullptr;
+            int seek_file_level = -1;
+        };
+
+        using GetCallback = void (*)(void *arg, const Status &s);
+
+        Version(const Version &) = delete;
+        Version &operator=(const Version &) = delete;
+
+        // 按从新到旧的顺序追加每个文件的迭代器, L0每个文件一个, 其他层每层一个.
+        // arena不为nullptr时迭代器分配在arena中.
+        void AddIterators(const ReadOptions &options, std::vector<Iterator *> *iters, Arena *arena = nullptr);
+
+        /**
+         * @brief 从新到旧查找sstable, 语义同MemTable::Get: 找到value时返回OK, 找到删除或者
+         * 所有文件中都没有时返回NotFound; 只找到merge operand时它们被加入merge_context并返回NotFound,
+         * 由调用方折叠. *stats用于之后的UpdateStats. REQUIRES: 不持有DB锁.
+        */
+        Status Get(const ReadOptions &options, const LookupKey &key, std::string *value,
+                   MergeContext *merge_context, GetStats *stats);
+
+        // 同上, 普通value直接指向data block, 见TableCache::Get(PinnableSlice *).
+        Status Get(const ReadOptions &options, const LookupKey &key, PinnableSlice *value,
+                   MergeContext *merge_context, GetStats *stats);
+
+        /**
+         * @brief 对keys中的每个key做一次Get(std::string *), 结果写入keys[i].value/status/merge_context,
+         * stats[i]对应keys[i]. keys按user key升序排列, 使用同一个快照.
+         * 每个文件只访问一次: 与它重叠并且还没有结果的key一起交给TableCache::MultiGet,
+         * 落在同一个data block中的key只读取一次block. REQUIRES: 不持有DB锁.
+        */
+        void MultiGet(const ReadOptions &options, TableCache::GetContext *keys, size_t n, GetStats *stats);
+
+        /**
+         * @brief 异步版本的Get(std::string *), 依次对每个可能包含key的文件调用TableCache::GetAsync,
+         * 结束后调用callback(arg, status). callback可能在当前线程或者完成读取的I/O线程中调用.
+         * REQUIRES: callback返回之前key, value, merge_context, stats和这个Version必须一直有效.
+        */
+        void GetAsync(const ReadOptions &options, const LookupKey &key, std::string *value,
+                      MergeContext *merge_context, GetStats *stats, GetCallback callback, void *arg);
+
+        // 根据stats扣减文件的allowed_seeks, 需要触发compaction时返回true. REQUIRES: 持有DB锁.
+        bool UpdateStats(const GetStats &stats);
+
+        // 迭代时对internal_key采样, 它与不少于两个文件重叠时按seek计数, 需要触发compaction时返回true.
+        // REQUIRES: 持有DB锁.
+        bool RecordReadSample(Slice internal_key);
+
+        void Ref();
+
+        void Unref();
+
+        // 把inputs设置为level中与[begin, end]重叠的文件, nullptr代表不限制.
+        void GetOverlappingInputs(int level, const InternalKey *begin, const InternalKey *end,
+                                  std::vector<FileMetaData *> *inputs);
+
+        // level中是否有文件与user key范围[*smallest_user_key, *largest_user_key]重叠.
+        bool OverlapInLevel(int level, const Slice *smallest_user_key, const Slice *largest_user_key);
+
+        // 新flush出来的文件放在哪一层: 不与L0重叠时尽量下推, 直到与下一层重叠或者与下下层重叠太多.
+        int PickLevelForMemTableOutput(const Slice &smallest_user_key, const Slice &largest_user_key);
+
+        int NumFiles(int level) const { return static_cast<int>(files_[level].size()); }
+
+    private:
+        friend class VersionSet;
+
+        struct AsyncGetState;
+
+        explicit Version(VersionSet *vset)
+                : vset_(vset), next_(this), prev_(this), refs_(0), file_to_compact_(nullptr),
+                  file_to_compact_level_(-1), compaction_score_(-1), compaction_level_(-1) {}
+
+        ~Version();
+
+        Iterator *NewConcatenatingIterator(const ReadOptions &options, int level, Arena *arena) const;
+
+        // 按从新到旧的顺序追加可能包含user_key的层和文件, internal_key用于在L1+上二分查找.
+        void FilesForKey(const Slice &user_key, const Slice &internal_key,
+                         std::vector<std::pair<int, FileMetaData *>> *files) const;
+
+        template<typename Value>
+        Status GetImpl(const ReadOptions &options, const LookupKey &key, Value *value,
+                       MergeContext *merge_context, GetStats *stats);
+
+        static void OnAsyncFileDone(void *arg, bool done);
+
+        VersionSet *vset_;
+        Version *next_;
+        Version *prev_;
+        int refs_;
+
+        std::vector<FileMetaData *> files_[config::kNumLevels];
+
+        // 基于seek的compaction候选
+        FileMetaData *file_to_compact_;
+        int file_to_compact_level_;
+
+        // 基于大小的compaction, 由VersionSet::Finalize计算, score >= 1时需要compaction
+        double compaction_score_;
+        int compaction_level_;
+    };
+
+    /**
+     * @brief 持有当前Version和文件编号/序列号等元数据. 除了构造和析构, 所有方法都需要持有DB锁.
+     *
+     * LogAndApply目前只在内存中应用edit, 还不写MANIFEST, 所以重启之后无法恢复.
+    */
+    class VersionSet {
+    public:
+        VersionSet(const std::string &dbname, const Options *options, TableCache *table_cache,
+                   const InternalKeyComparator *icmp);
+
+        VersionSet(const VersionSet &) = delete;
+        VersionSet &operator=(const VersionSet &) = delete;
+
+        ~VersionSet();
+
+        // 在current上应用edit得到新的Version并设为current. mu在整个过程中保持持有.
+        Status LogAndApply(VersionEdit *edit, port::Mutex *mu) EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+        Version *current() const { return current_; }
+
+        uint64_t ManifestFileNumber() const { return manifest_file_number_; }
+
+        uint64_t NewFileNumber() { return next_file_number_++; }
+
+        // 刚分配的file_number没有被使用时归还.
+        void ReuseFileNumber(uint64_t file_number) {
+            if (next_file_number_ == file_number + 1) {
+                next_file_number_ = file_number;
+            }
+        }
+
+        void MarkFileNumberUsed(uint64_t number);
+
+        int NumLevelFiles(int level) const;
+
+        int64_t NumLevelBytes(int level) const;
+
+        uint64_t LastSequence() const { return last_sequence_; }
+
+        void SetLastSequence(uint64_t s) {
+            assert(s >= last_sequence_);
+            last_sequence_ = s;
+        }
+
+        uint64_t LogNumber() const { return log_number_; }
+
+        // 正在compact的旧log编号, 没有时为0.
+        uint64_t PrevLogNumber() const { return prev_log_number_; }
+
+        bool NeedsCompaction() const {
+            Version *v = current_;
+            return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+        }
+
+        // 把所有存活的Version引用的文件编号加入live.
+        void AddLiveFiles(std::set<uint64_t> *live);
+
+    private:
+        friend class Version;
+
+        // 计算v下一次基于大小的compaction的层和score.
+        void Finalize(Version *v);
+
+        void AppendVersion(Version *v);
+
+        Env *const env_;
+        const std::string dbname_;
+        const Options *const options_;
+        TableCache *const table_cache_;
+        const InternalKeyComparator icmp_;
+        uint64_t next_file_number_;
+        uint64_t manifest_file_number_;
+        uint64_t last_sequence_;
+        uint64_t log_number_;
+        uint64_t prev_log_number_;
+
+        Version dummy_versions_;    // 存活Version的双向循环链表头
+        Version *current_;          // == dummy_versions_.prev_
+    };
+
+}
+
 #endif //MY_LEVELDB_VERSION_SET_H
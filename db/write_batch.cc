@@ -22,6 +22,7 @@ namespace leveldb {
      *
      * Put:   || 1字节的kTypeValue     || LengthPrefixedKey || LengthPrefixedVal ||
      * Del:   || 1字节的kTypeDeletion  || LengthPrefixedKey ||
+     * Merge: || 1字节的kTypeMerge     || LengthPrefixedKey || LengthPrefixedOperand ||
     */
     static const size_t kHeader = 12;
 
@@ -70,16 +71,23 @@ namespace leveldb {
                         return Status::Corruption("bad WriteBatch Delete");
                     }
                     break;
+                case kTypeMerge:
+                    if (GetLengthPrefixedSlice(&input, &key) && GetLengthPrefixedSlice(&input, &value)) {
+                        handler->Merge(key, value);
+                    } else {
+                        return Status::Corruption("bad WriteBatch Merge");
+                    }
+                    break;
                 default:
                     return Status::Corruption("unknown WriteBatch tag");
             }
-            if (found != WriteBatchInternal::Count(this)) {
-                return Status::Corruption("WriteBatch has wrong count");
-            } else {
-                return Status::OK();
-            }
         }
 
+        if (found != WriteBatchInternal::Count(this)) {
+            return Status::Corruption("WriteBatch has wrong count");
+        } else {
+            return Status::OK();
+        }
     }
 
     void WriteBatch::Put(const Slice &key, const Slice &value) {
@@ -95,6 +103,13 @@ namespace leveldb {
         PutLengthPrefixedSlice(&rep_, key);
     }
 
+    void WriteBatch::Merge(const Slice &key, const Slice &operand) {
+        WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+        rep_.push_back(static_cast<char>(kTypeMerge));
+        PutLengthPrefixedSlice(&rep_, key);
+        PutLengthPrefixedSlice(&rep_, operand);
+    }
+
     void WriteBatch::Append(const WriteBatch &source) {
         WriteBatchInternal::Append(this, &source);
     }
@@ -113,6 +128,11 @@ namespace leveldb {
             mem_->Add(sequence_, kTypeDeletion, key, Slice());
             sequence_++;
         }
+
+        void Merge(const Slice &key, const Slice &operand) override {
+            mem_->Add(sequence_, kTypeMerge, key, operand);
+            sequence_++;
+        }
     };
 
     // WriteBatchInternal start.
@@ -5,6 +5,10 @@
 #ifndef MY_LEVELDB_CACHE_H
 #define MY_LEVELDB_CACHE_H
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
 #include "leveldb/cxx.h"
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
@@ -12,9 +16,61 @@
 namespace leveldb {
 
     class LEVELDB_EXPORT Cache;
+    class SecondaryCache;
 
+    /**
+     * @brief 创建一个容量为capacity的LRU cache.
+     * 按key的hash高位分成多个shard, 每个shard有独立的锁/hash表/LRU链表, 容量均分.
+    */
     LEVELDB_EXPORT Cache* NewLRUCache(size_t  capacity);
 
+    /**
+     * @brief 同上, 但是带有CacheItemHelper的条目被淘汰时会转存到secondary中,
+     * 带helper的Lookup在主cache未命中时从secondary取回并提升到主cache.
+     * secondary由调用方持有, 必须比cache活得更久.
+    */
+    LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, SecondaryCache *secondary);
+
+    /**
+     * @brief 带W-TinyLFU准入的LRU cache.
+     * 新条目先进入占容量1%的window, 离开window时与主区LRU尾部的条目比较访问频率
+     * (count-min sketch估计, 定期衰减), 只有更频繁时才替换它, 否则直接被淘汰.
+     * 一次性的大范围扫描因此不会冲掉热点数据.
+     * @param estimated_entry_charge 单个条目的平均charge, 用来确定sketch的大小.
+    */
+    LEVELDB_EXPORT Cache* NewTinyLFUCache(size_t capacity, size_t estimated_entry_charge);
+
+    struct LEVELDB_EXPORT LRUCacheOptions {
+        size_t capacity = 0;
+
+        // 为高优先级(Cache::Priority::HIGH)条目保留的容量比例, 0表示不区分优先级.
+        // 高优先级条目只有在低优先级条目全部淘汰之后才会被淘汰,
+        // 超出这个比例的部分降级为低优先级.
+        double high_pri_pool_ratio = 0.0;
+
+        // 见NewLRUCache(size_t, SecondaryCache *).
+        SecondaryCache *secondary_cache = nullptr;
+
+        // 不为0时开启W-TinyLFU准入, 见NewTinyLFUCache.
+        size_t tiny_lfu_estimated_entry_charge = 0;
+    };
+
+    LEVELDB_EXPORT Cache* NewLRUCache(const LRUCacheOptions &options);
+
+    /**
+     * @brief 创建一个使用CLOCK淘汰的cache, 适合读多写少并且线程很多的场景.
+     * 命中的Lookup/Release不加锁, 只原子地修改条目自身的引用计数和访问位;
+     * Insert/Erase/淘汰仍然按shard加锁.
+     * @param estimated_entry_charge 单个条目的平均charge, 用来确定hash表的大小,
+     * 条目数量超出估计时新的条目不会被缓存.
+    */
+    LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge);
+
+    /**
+     * @brief key -> value的缓存, 线程安全.
+     * Lookup/Insert返回的handle持有一个引用, 使用完必须Release.
+     * 仍被引用的条目即使被淘汰或Erase也不会立刻释放, 最后一个引用Release时调用deleter.
+    */
     class LEVELDB_EXPORT Cache {
     public:
         Cache() = default;
@@ -22,35 +78,60 @@ namespace leveldb {
         Cache(const Cache&) = delete;
         Cache& operator=(const Cache&) = delete;
 
+        // 调用所有条目的deleter.
         virtual ~Cache();
 
         struct Handle {};
 
+        // 高优先级用于index/filter这类被每次查找依赖的block, 低优先级用于data block.
+        enum class Priority { HIGH, LOW };
+
+        /**
+         * @brief 让条目可以在主cache和SecondaryCache之间转移的回调, 通常是静态对象.
+        */
+        struct CacheItemHelper {
+            // 把value序列化到*out.
+            void (*save_to)(void *value, std::string *out);
+            // 从序列化的数据重建value, 并设置其charge.
+            void *(*create)(const Slice &data, size_t *charge);
+            void (*deleter)(const Slice &key, void *value);
+        };
+
+        // 插入key -> value并占用charge的容量, 已存在的同名条目被替换.
+        // 返回的handle需要Release. 条目不再需要时以key和value调用deleter.
         virtual Handle* Insert(const Slice& key, void *value, size_t charge,
-                               void (*deleter)(const Slice& key, void *value)) = 0;
+                               void (*deleter)(const Slice& key, void *value),
+                               Priority priority = Priority::LOW) = 0;
+
+        // 与上面相同, 条目被淘汰时可以通过helper转存到二级缓存. 默认忽略二级缓存.
+        virtual Handle* Insert(const Slice& key, void *value, size_t charge, const CacheItemHelper *helper,
+                               Priority priority = Priority::LOW) {
+            return Insert(key, value, charge, helper->deleter, priority);
+        }
 
+        // 未命中返回nullptr.
         virtual Handle* Lookup(const Slice &key) = 0;
 
+        // 主cache未命中时到二级缓存中查找, 命中的条目用helper重建后插入主cache. 默认忽略二级缓存.
+        virtual Handle* Lookup(const Slice &key, const CacheItemHelper * /*helper*/) {
+            return Lookup(key);
+        }
+
         virtual void Release(Handle * handle) = 0;
 
         virtual void* Value(Handle* handle) = 0;
 
         virtual void Erase(const Slice& key) = 0;
 
+        // 返回一个新的id, 共享同一个cache的多个使用者用它作为key的前缀区分彼此.
         virtual uint64_t NewId() = 0;
 
+        // 释放所有没有被引用的条目.
         virtual void Prune() {}
 
+        // 所有条目的charge之和.
         NO_DISCARD
         virtual size_t TotalCharge() const = 0;
-
-    private:
-        void LRU_Remove(Handle *e);
-        void LRU_Append(Handle *e);
-        void Unref(Handle *e);
-
-        struct Rep;
-        Rep* rep_{};
     };
 
 }
@@ -6,10 +6,10 @@
 #define MY_LEVELDB_COMPARATOR_H
 
 #include "leveldb/export.h"
+#include "leveldb/slice.h"
 #include <string>
 
 namespace leveldb {
-    class Slice;
 
     class LEVELDB_EXPORT Comparator {
     public:
@@ -46,6 +46,19 @@ namespace leveldb {
          * @param key 
         */
         virtual void FindShortSuccessor(std::string *key) const = 0;
+
+        /**
+         * @brief 是否可以用key的一段字节按memcmp比较来判断顺序, 用于加速block内的二分查找.
+         * 返回true时, 对任意a, b满足 Compare(a, b) <= 0 => OrderedBytes(a) <= OrderedBytes(b) (按字节比较).
+         * 默认返回false.
+        */
+        virtual bool HasOrderedBytes() const { return false; }
+
+        /**
+         * @brief 返回key中与比较顺序一致的那段字节, 指向key的内存.
+         * REQUIRES: HasOrderedBytes()
+        */
+        virtual Slice OrderedBytes(const Slice &key) const;
     };
 
     /**
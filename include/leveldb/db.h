@@ -2,10 +2,12 @@
 #define MY_LEVELDB_DB_H
 
 #include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/status.h"
 #include "leveldb/iterator.h"
 
@@ -69,6 +71,15 @@ namespace leveldb {
         */
         virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+        /**
+         * @brief 追加一个merge operand, 不需要先Get. 需要配置Options::merge_operator.
+         * @param options 
+         * @param key 
+         * @param operand 
+         * @return 
+        */
+        virtual Status Merge(const WriteOptions& options, const Slice& key, const Slice& operand) = 0;
+
         /**
          * @brief 
          * @param options 
@@ -87,6 +98,67 @@ namespace leveldb {
         virtual Status Get(const ReadOptions& options, const Slice& key,
                            std::string* value) = 0;
 
+        /**
+         * @brief 与上面的Get相同, 但是value尽量直接指向memtable或者block cache中的数据,
+         * 避免一次拷贝. value持有期间对应的memtable/cache block不会被释放, 用完需要Reset().
+         * 默认实现退化为拷贝.
+         * @param options 
+         * @param key 
+         * @param value 
+         * @return 
+        */
+        virtual Status Get(const ReadOptions& options, const Slice& key,
+                           PinnableSlice* value);
+
+        /**
+         * @brief 批量Get. 所有key共享同一个快照, (*statuses)[i]和(*values)[i]的
+         * 语义与Get(options, keys[i], &(*values)[i])一致.
+         * 比循环调用Get少了加锁和引用计数的开销, 并且memtable与sstable的查找按key有序批量进行:
+         * 每个sstable只访问一次, 落在同一个data block中的key只读取一次block.
+         * @param options 
+         * @param keys 
+         * @param values 
+         * @param statuses 
+        */
+        virtual void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                              std::vector<std::string>* values, std::vector<Status>* statuses) = 0;
+
+        using GetCallback = void (*)(void* arg, const Status& status);
+        using MultiGetCallback = void (*)(void* arg);
+
+        /**
+         * @brief 异步Get. 快照在调用时确定, 结果写入value后调用callback(arg, status).
+         * memtable或者block cache命中时callback在当前线程内直接调用; 需要读sstable的data block时
+         * 通过RandomAccessFile::ReadAsync读取, callback在完成读取的线程中调用, 调用线程不会阻塞在磁盘读上.
+         * REQUIRES: callback返回之前value必须一直有效. callback中不能再调用会阻塞的DB方法.
+         * REQUIRES: 删除DB之前所有已提交的callback都已经返回.
+         * 默认实现为同步Get之后立即回调.
+         * @param options 
+         * @param key 
+         * @param value 
+         * @param callback 
+         * @param arg 
+        */
+        virtual void GetAsync(const ReadOptions& options, const Slice& key, std::string* value,
+                              GetCallback callback, void* arg);
+
+        /**
+         * @brief 异步MultiGet, 语义同MultiGet. 所有key完成后调用一次callback(arg).
+         * 快照在调用时确定. 与GetAsync相同, memtable在当前线程中查找, 剩下的key各自异步读取sstable,
+         * callback在最后一个完成的线程中调用.
+         * REQUIRES: callback返回之前keys指向的数据以及values/statuses必须一直有效.
+         * 默认实现为同步MultiGet之后立即回调.
+         * @param options 
+         * @param keys 
+         * @param values 
+         * @param statuses 
+         * @param callback 
+         * @param arg 
+        */
+        virtual void MultiGetAsync(const ReadOptions& options, const std::vector<Slice>& keys,
+                                   std::vector<std::string>* values, std::vector<Status>* statuses,
+                                   MultiGetCallback callback, void* arg);
+
         /**
          * @brief 
          * @param options 
@@ -178,6 +178,21 @@ namespace leveldb {
         */
         virtual void StartThread(void (*func)(void *arg), void *arg) = 0;
 
+        /**
+         * @brief I/Oִ̳߳func, 첽ȡ. Scheduleʹõĺ̨compaction߳໥,
+         * 󲻻compaction. Ĭʵֱڵִ߳.
+         * @param func 
+         * @param arg 
+        */
+        virtual void ScheduleIO(void (*func)(void *arg), void *arg);
+
+        /**
+         * @brief ScheduleIOʹõI/O߳ٵnum, ֻӲ.
+         * DBͬһEnvʱȡõֵ. Ĭʵʲô.
+         * @param num 
+        */
+        virtual void SetIOThreads(int num);
+
         /**
          * @brief 
          * @param path 
@@ -231,6 +246,22 @@ namespace leveldb {
         virtual ~RandomAccessFile() = default;
 
         virtual Status Read(uint64_t offset, size_t n, Slice *result, char *scratch) const = 0;
+
+        // 첽ȡʱĻص, resultָscratchļڲڴ.
+        using ReadCallback = void (*)(void *arg, const Status &status, const Slice &result);
+
+        /**
+         * @brief һ첽ȡ, ȡɺcallback(߳).
+         * callback֮ǰ, ļscratch뱣Ч.
+         * ĬʵͬRead, Ȼֱڵ߳лص.
+        */
+        virtual void ReadAsync(uint64_t offset, size_t n, char *scratch, ReadCallback callback, void *arg) const;
+
+        /**
+         * @brief ʾȡ[offset, offset + n), ʵֿǰݶpage cache.
+         * ֻʾ, ȡκ, ֵ֧ʵֱӷOK.
+        */
+        virtual Status Prefetch(uint64_t offset, size_t n) const;
     };
 
     /**
@@ -21,10 +21,22 @@ namespace leveldb {
         virtual void CreateFilter(const Slice *keys, int n, std::string *dst) const = 0;
 
         virtual bool KeyMayMatch(const Slice &key, const Slice &filter) const = 0;
+
+        // filter中是否可能存在与key前缀相同的key, 前缀由实现自己定义, key的含义与KeyMayMatch相同.
+        // 只有构建filter时加入了前缀的实现才能返回false, 默认返回true.
+        virtual bool PrefixMayMatch(const Slice & /*key*/, const Slice & /*filter*/) const { return true; }
+
+        // 构建时加入了前缀的实现, Name()中应该包含前缀的定义. 这里返回只包含完整key的filter的名字,
+        // 读取时找不到Name()对应的filter则用它查找, 找到的filter只用于KeyMayMatch. 默认返回nullptr.
+        virtual const char *KeyOnlyName() const { return nullptr; }
     };
 
     LEVELDB_EXPORT const FilterPolicy *NewBloomFilterPolicy(int bits_per_key);
 
+    // binary fuse filter(XOR filter的一种): 误判率与bits_per_key的bloom filter相当, 内存少约20%~30%,
+    // 但构建慢几倍并且需要一次拿到所有key, 适合作为Options::bottommost_filter_policy.
+    LEVELDB_EXPORT const FilterPolicy *NewXorFilterPolicy(int bits_per_key);
+
 }
 
 #endif //MY_LEVELDB_FILTER_POLICY_H
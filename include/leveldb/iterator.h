@@ -29,6 +29,10 @@ namespace leveldb {
 
         virtual void Seek(const Slice &target) = 0;
 
+        // 与Seek相同, 但调用方只关心与target前缀相同的key(ReadOptions::prefix_same_as_start).
+        // 实现可以用前缀filter跳过不包含这个前缀的数据, 此时迭代器可以直接变为无效.
+        virtual void SeekForPrefix(const Slice &target) { Seek(target); }
+
         virtual void Next() = 0;
 
         virtual void Prev() = 0;
@@ -58,7 +62,12 @@ namespace leveldb {
             }
         };
 
-        CleanupNode cleanup_head_;
+        // 前kNumInlineCleanups个cleanup直接存放在iterator内部, 超出的部分才在堆上分配.
+        // 读路径上每个iterator通常只注册一个cleanup(释放memtable/version/block的引用).
+        static constexpr int kNumInlineCleanups = 2;
+
+        CleanupNode inline_cleanups_[kNumInlineCleanups];
+        CleanupNode *overflow_cleanups_;
     };
 
     LEVELDB_EXPORT Iterator *NewEmptyIterator();
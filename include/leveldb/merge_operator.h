@@ -0,0 +1,61 @@
+//
+// Created by kuiper on 2021/3/2.
+//
+
+#ifndef MY_LEVELDB_MERGE_OPERATOR_H
+#define MY_LEVELDB_MERGE_OPERATOR_H
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 用户自定义的read-modify-write语义.
+     *
+     * DB::Merge只把操作数(operand)追加写入, 不做Get. 读取以及compaction时
+     * 才把同一个user_key上的operand按照写入顺序折叠到base value上.
+     * 例如计数器自增, operand是增量, FullMerge把所有增量累加到base上.
+     *
+     * 实现必须是线程安全的, 并且结果只能依赖于入参.
+    */
+    class LEVELDB_EXPORT MergeOperator {
+    public:
+        virtual ~MergeOperator() = default;
+
+        /**
+         * @brief 名字会被持久化, 打开DB时使用的merge_operator名字应该保持一致.
+        */
+        virtual const char *Name() const = 0;
+
+        /**
+         * @brief 把operands折叠到existing_value上.
+         * @param key user_key.
+         * @param existing_value base value, 如果key不存在或者已被删除则为nullptr.
+         * @param operands 按写入顺序排列, operands[0]是最旧的那个.
+         * @param new_value 输出结果.
+         * @return 返回false表示数据有问题, 读取会返回Corruption.
+        */
+        virtual bool FullMerge(const Slice &key,
+                               const Slice *existing_value,
+                               const std::vector<Slice> &operands,
+                               std::string *new_value) const = 0;
+
+        /**
+         * @brief 把两个相邻的operand合并成一个, 用于没有base value时的compaction.
+         * left比right旧. 不支持时返回false, 两个operand会被原样保留.
+        */
+        virtual bool PartialMerge(const Slice & /*key*/,
+                                  const Slice & /*left_operand*/,
+                                  const Slice & /*right_operand*/,
+                                  std::string * /*new_value*/) const {
+            return false;
+        }
+    };
+
+}
+
+#endif //MY_LEVELDB_MERGE_OPERATOR_H
@@ -15,13 +15,23 @@ namespace leveldb {
     class Env;
     class FilterPolicy;
     class Logger;
+    class MergeOperator;
+    class Slice;
+    class PersistentCache;
+    class SliceTransform;
     class Snapshot;
 
     enum CompressionType {
         kNoCompression = 0x00,           // 不压缩
         kSnappyCompression = 0x01,       // snappy压缩算法
+        kLZ4Compression = 0x02,          // lz4, compression_level >= 3时使用lz4hc
+        kZstdCompression = 0x03,         // zstd, 可以使用每个sstable训练的字典
     };
 
+    // 编译时是否链接了type对应的压缩库(HAVE_SNAPPY/HAVE_LZ4/HAVE_ZSTD).
+    // 不可用的压缩方式写入sstable时按不压缩保存.
+    LEVELDB_EXPORT bool CompressionTypeSupported(CompressionType type);
+
     struct LEVELDB_EXPORT Options {
         Options();
 
@@ -43,21 +53,93 @@ namespace leveldb {
 
         size_t write_buffer_size = 1024 * 1024 * 4;
 
+        // 内存中memtable的最大数量, 包括正在写入的那一个.
+        // 写满的memtable会排队等待flush, 排队的数量达到max_write_buffer_number - 1
+        // 时写入才会阻塞. 后台flush会把排队的memtable合并写成一个L0文件.
+        // 峰值内存约为 write_buffer_size * max_write_buffer_number.
+        // 至少为2, 更小的值按2处理.
+        int max_write_buffer_number = 2;
+
         int max_open_files = 1000;
 
+        // 异步读取(DB::GetAsync/MultiGetAsync中的RandomAccessFile::ReadAsync)使用的env I/O线程数,
+        // 打开DB时通过Env::SetIOThreads设置, 多个DB共享env时取最大值.
+        int async_io_threads = 4;
+
         Cache *block_cache = nullptr;
 
+        // 缓存sstable点查解析后的结果(按文件号 + user key), 热点key命中时不需要
+        // 查找/解压block. 相比block_cache只保存被读到的那一行, 内存利用率高得多.
+        // 为nullptr时不使用. 只影响Get, 迭代器不经过row_cache.
+        Cache *row_cache = nullptr;
+
+        // block_cache以PersistentCache作为二级缓存时, 把同一个对象设置在这里,
+        // DB删除sstable时通过它丢弃该文件在本地缓存中的所有block.
+        PersistentCache *persistent_cache = nullptr;
+
         size_t block_size = 1024 * 4;
 
         int block_restart_interval = 16;
 
+        // 在data block末尾附加user key -> restart区间的hash索引, 点查时跳过restart点的二分查找.
+        // 要求user comparator认为相等的key的字节也相同. 没有索引的block照常读取.
+        bool data_block_hash_index = false;
+
+        // hash索引的桶数 = block中不同user key的个数 / ratio.
+        double data_block_hash_table_util_ratio = 0.75;
+
+        // 把index和filter按metadata_block_size切分成分区, 只有很小的顶层index常驻内存,
+        // 分区以Cache::Priority::HIGH各自放进block_cache, 按需读取和淘汰.
+        // 用于index/filter的总量放不进内存的场景.
+        bool partition_index_and_filters = false;
+
+        // 每个index/filter分区的目标大小.
+        size_t metadata_block_size = 4096;
+
+        // 整个sstable只生成一个filter, 取代每2KB data block一个filter的filter block.
+        // Get在读取index之前先检查filter, 不存在的key每个文件只需要一次filter查询.
+        // 与partition_index_and_filters同时设置时只有index分区, filter仍然是整个文件一个并常驻内存.
+        // 构建时需要在内存中保存文件的所有key.
+        bool whole_file_filter = false;
+
         size_t max_file_size = 1024 * 1024 * 2;
 
         CompressionType compressionType = kSnappyCompression;
 
+        // lz4和zstd的压缩级别, 0表示库的默认级别. 库不可用时按不压缩保存, 见CompressionTypeSupported.
+        int compression_level = 0;
+
+        // 大于0时zstd为每个sstable训练一个不超过这个大小的字典, 保存在meta block中,
+        // 所有data block都使用字典压缩. 适合很多小value, 单个block内重复内容不多的数据(例如JSON).
+        // 构建时先缓存data block作为样本, 训练出字典之后再写入.
+        size_t compression_max_dict_bytes = 0;
+
+        // 训练字典的样本大小, 也是构建时缓存的未压缩data block的上限. 0表示compression_max_dict_bytes的100倍.
+        size_t compression_dict_train_bytes = 0;
+
         bool reuse_logs = false;
 
         const FilterPolicy *filter_policy = nullptr;
+
+        // 最底层的sstable使用的filter, 为nullptr时与其他层一样使用filter_policy.
+        // 最底层保存了绝大部分的数据并且很少重写, 适合用构建慢但更省内存的filter, 例如NewXorFilterPolicy.
+        // 读取时两种filter都能识别.
+        // XOR filter在key很少时额外空间比例大, 每2KB一个filter(包括filter分区)时反而比bloom filter大,
+        // 所以只在whole_file_filter时生效, 否则最底层也使用filter_policy.
+        const FilterPolicy *bottommost_filter_policy = nullptr;
+
+        // DB::Merge写入的operand由它在读取和compaction时折叠.
+        // 为nullptr时DB::Merge返回NotSupported.
+        const MergeOperator *merge_operator = nullptr;
+
+        // 从user key中提取前缀. 设置后filter_policy构建的sstable filter以及memtable的bloom
+        // 都会加入key的前缀, ReadOptions::prefix_same_as_start的Seek据此跳过不包含该前缀的
+        // memtable和sstable.
+        const SliceTransform *prefix_extractor = nullptr;
+
+        // 设置了prefix_extractor时, 每个memtable的前缀bloom占用write_buffer_size * ratio字节.
+        // 为0时不创建memtable bloom.
+        double memtable_prefix_bloom_size_ratio = 0.02;
     };
 
     struct LEVELDB_EXPORT ReadOptions {
@@ -66,6 +148,25 @@ namespace leveldb {
         bool verify_checksums = false;
         bool fill_cache = true;
         const Snapshot *snapshot = nullptr;
+
+        // 迭代器的范围[iterate_lower_bound, iterate_upper_bound), nullptr代表不限制.
+        // 迭代器到达边界时直接变为无效, 不再读取边界之外的记录,
+        // key范围完全落在边界之外的sstable也不会被打开.
+        // 指向的数据在迭代器删除之前必须一直有效.
+        const Slice *iterate_lower_bound = nullptr;
+        const Slice *iterate_upper_bound = nullptr;
+
+        // 需要Options::prefix_extractor. 迭代器Seek的target在prefix_extractor的domain中时,
+        // 之后只返回与target前缀相同的key, 前缀变化时直接变为无效; 这次Seek用filter跳过
+        // 不包含这个前缀的memtable和sstable. SeekToFirst/SeekToLast, 以及target不在domain中的Seek
+        // 不限制前缀, 也不做前缀过滤.
+        bool prefix_same_as_start = false;
+
+        // 迭代器顺序读取sstable时的预读大小.
+        // 0: 自适应, 连续读到顺序的block之后开启预读, 预读大小从8KB开始翻倍, 最大256KB.
+        // > 0: 从第一次读取开始就按固定大小预读.
+        // 只影响迭代器, 点查不预读.
+        size_t readahead_size = 0;
     };
 
     struct LEVELDB_EXPORT WriteOptions {
@@ -0,0 +1,49 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_PERSISTENT_CACHE_H
+#define MY_LEVELDB_PERSISTENT_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    class Env;
+
+    /**
+     * @brief 保存在本地快速磁盘上的block缓存, 作为block_cache的二级缓存使用.
+     *
+     * 数据以日志的形式追加写入dir下的多个段文件(NNNNNN.pcache), 内存中只保存
+     * (file number, block offset) -> 段内位置的索引. 超出容量时整段删除最旧的段文件.
+     * 重新打开时扫描已有的段文件重建索引, 重启后可以直接命中(warm start).
+     *
+     * key必须以 file_number(fixed64) | block offset(fixed64) 结尾, 之前的前缀(进程内的cache id)
+     * 被忽略, 所以一个PersistentCache只能服务于一个DB. 段文件头部记录打开时的db_id,
+     * 重新打开时db_id不同的段被删除. 命中的条目不会被移除.
+     * 正在写入的段先缓存在内存中, 写满后由Env::Schedule的后台线程落盘, 关闭时等待落盘完成,
+     * 进程崩溃最多丢失未落盘的段. 后台落盘跟不上时Insert直接丢弃数据, 不会阻塞.
+    */
+    class LEVELDB_EXPORT PersistentCache : public SecondaryCache {
+    public:
+        // 丢弃file_number的所有block, sstable被删除时由DB调用.
+        // 同时写入一条删除记录, 重启后这些block不会重新出现(删除记录所在的段落盘之后).
+        virtual void EraseFile(uint64_t file_number) = 0;
+    };
+
+    /**
+     * @brief 打开或者创建dir下容量为capacity字节的PersistentCache.
+     * db_id唯一标识使用它的DB(例如DB的路径), 同一个dir换给另一个DB时旧的数据不会被命中.
+     * 成功时*result由调用方持有, 必须比使用它的cache和DB活得更久.
+    */
+    LEVELDB_EXPORT Status NewPersistentCache(Env *env, const std::string &dir, const std::string &db_id,
+                                             size_t capacity, PersistentCache **result);
+
+}
+
+#endif //MY_LEVELDB_PERSISTENT_CACHE_H
@@ -0,0 +1,97 @@
+//
+// Created by kuiper on 2021/3/8.
+//
+
+#ifndef MY_LEVELDB_PINNABLE_SLICE_H
+#define MY_LEVELDB_PINNABLE_SLICE_H
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 可以直接指向DB内部内存(memtable的arena/cache中的block)的Slice.
+     *
+     * 指向内部内存时, 对应的memtable或者cache handle会被一直引用,
+     * 直到Reset()或者析构时通过注册的cleanup释放. 这样Get不需要把value拷贝出来.
+     * 无法直接引用的结果(例如merge折叠出来的值)会被拷贝到自身的buffer中.
+     *
+     * 持有期间会阻止memtable/block被释放, 用完应尽快Reset().
+    */
+    class LEVELDB_EXPORT PinnableSlice : public Slice {
+    public:
+        using CleanupFunction = void (*)(void *arg1, void *arg2);
+
+        PinnableSlice() : buf_(&self_space_) {}
+
+        // 不在内部内存上pin时使用buf作为存放结果的buffer.
+        explicit PinnableSlice(std::string *buf) : buf_(buf) {}
+
+        PinnableSlice(const PinnableSlice &) = delete;
+        PinnableSlice &operator=(const PinnableSlice &) = delete;
+
+        ~PinnableSlice() { Reset(); }
+
+        /**
+         * @brief 直接指向s, s的内存在Reset()时由cleanup释放.
+         * cleanup可以为nullptr, 之后再通过RegisterCleanup注册.
+        */
+        void PinSlice(const Slice &s, CleanupFunction func = nullptr, void *arg1 = nullptr, void *arg2 = nullptr) {
+            assert(!pinned_);
+            pinned_ = true;
+            Slice::operator=(s);
+            if (func != nullptr) {
+                RegisterCleanup(func, arg1, arg2);
+            }
+        }
+
+        // 注册释放被pin内存的回调, 只能注册一个.
+        void RegisterCleanup(CleanupFunction func, void *arg1, void *arg2) {
+            assert(pinned_);
+            assert(cleanup_ == nullptr);
+            cleanup_ = func;
+            cleanup_arg1_ = arg1;
+            cleanup_arg2_ = arg2;
+        }
+
+        // 拷贝s到自身的buffer.
+        void PinSelf(const Slice &s) {
+            assert(!pinned_);
+            buf_->assign(s.data(), s.size());
+            Slice::operator=(*buf_);
+        }
+
+        // 调用方已经把结果写进了GetSelf().
+        void PinSelf() {
+            assert(!pinned_);
+            Slice::operator=(*buf_);
+        }
+
+        std::string *GetSelf() { return buf_; }
+
+        bool IsPinned() const { return pinned_; }
+
+        void Reset() {
+            if (cleanup_ != nullptr) {
+                cleanup_(cleanup_arg1_, cleanup_arg2_);
+                cleanup_ = nullptr;
+            }
+            pinned_ = false;
+            Slice::clear();
+        }
+
+    private:
+        std::string self_space_;
+        std::string *buf_;
+        bool pinned_ = false;
+        CleanupFunction cleanup_ = nullptr;
+        void *cleanup_arg1_ = nullptr;
+        void *cleanup_arg2_ = nullptr;
+    };
+
+}
+
+#endif //MY_LEVELDB_PINNABLE_SLICE_H
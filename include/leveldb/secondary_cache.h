@@ -0,0 +1,70 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_SECONDARY_CACHE_H
+#define MY_LEVELDB_SECONDARY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 位于主Cache之后的二级缓存, 保存被主cache淘汰的条目的序列化数据.
+     *
+     * 主cache淘汰带有CacheItemHelper的条目时, 把序列化后的数据Insert进来;
+     * 主cache未命中时到这里Lookup, 命中的数据被重建并提升回主cache.
+     * 实现必须是线程安全的.
+    */
+    class LEVELDB_EXPORT SecondaryCache {
+    public:
+        struct Stats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t inserts = 0;
+            size_t usage = 0;       // 当前占用的字节数
+            size_t capacity = 0;
+            CompressionType compression = kNoCompression;  // 实际使用的压缩方式
+        };
+
+        SecondaryCache() = default;
+
+        SecondaryCache(const SecondaryCache &) = delete;
+        SecondaryCache &operator=(const SecondaryCache &) = delete;
+
+        virtual ~SecondaryCache();
+
+        virtual const char *Name() const = 0;
+
+        // 保存data的一份拷贝.
+        virtual void Insert(const Slice &key, const Slice &data) = 0;
+
+        // 命中时把原始数据写入*data并返回true. 命中后是否保留该条目由实现决定.
+        virtual bool Lookup(const Slice &key, std::string *data) = 0;
+
+        virtual void Erase(const Slice &key) = 0;
+
+        virtual Stats GetStats() const = 0;
+    };
+
+    /**
+     * @brief 在内存中以压缩形式保存数据的二级缓存, 容量按压缩后的大小计算.
+     * 压缩失败或者压缩率不足12.5%时按原样保存.
+     * 命中的条目被提升回主cache后从这里移除.
+     * 从内存解压远比读盘便宜, 相同内存下可以缓存更多的block.
+     * level是lz4和zstd的压缩级别, 含义与Options::compression_level相同.
+     * compression在这个build中不可用(见CompressionTypeSupported)时不压缩, Stats::compression为kNoCompression.
+    */
+    LEVELDB_EXPORT SecondaryCache *NewCompressedSecondaryCache(size_t capacity,
+                                                               CompressionType compression = kSnappyCompression,
+                                                               int level = 0);
+
+}
+
+#endif //MY_LEVELDB_SECONDARY_CACHE_H
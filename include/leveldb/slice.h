@@ -52,8 +52,8 @@ namespace leveldb {
 
         void remove_prefix(size_t n) {
             assert(n <= size());
-            data_ += 1;
-            size_ -= 1;
+            data_ += n;
+            size_ -= n;
         }
 
         NO_DISCARD
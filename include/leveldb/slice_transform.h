@@ -0,0 +1,51 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#ifndef MY_LEVELDB_SLICE_TRANSFORM_H
+#define MY_LEVELDB_SLICE_TRANSFORM_H
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 从user key中提取前缀, 用于Options::prefix_extractor.
+     *
+     * 设置之后sstable和memtable的filter按前缀构建, 开启ReadOptions::prefix_same_as_start的
+     * 迭代器在Seek时可以跳过filter判定前缀不存在的memtable/sstable.
+     * 要求: 前缀相同的key在比较器下是连续的, 即Transform(key)是key的前缀.
+     *
+     * 实现必须是线程安全的.
+    */
+    class LEVELDB_EXPORT SliceTransform {
+    public:
+        virtual ~SliceTransform() = default;
+
+        /**
+         * @brief 名字会被写入filter block, 打开DB时的prefix_extractor应该保持一致.
+        */
+        virtual const char *Name() const = 0;
+
+        /**
+         * @brief 返回key的前缀, 返回值指向key的内存.
+         * REQUIRES: InDomain(key)
+        */
+        virtual Slice Transform(const Slice &key) const = 0;
+
+        /**
+         * @brief key是否有前缀. 不在domain中的key不参与前缀filter, Seek时也不会被跳过.
+        */
+        virtual bool InDomain(const Slice &key) const = 0;
+    };
+
+    // 取前prefix_len个字节作为前缀, 更短的key不在domain中.
+    // 调用方负责delete返回值.
+    LEVELDB_EXPORT const SliceTransform *NewFixedPrefixTransform(size_t prefix_len);
+
+}
+
+#endif //MY_LEVELDB_SLICE_TRANSFORM_H
@@ -0,0 +1,128 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_TABLE_H
+#define MY_LEVELDB_TABLE_H
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+    class Arena;
+    class Block;
+    class BlockHandle;
+    struct BlockContents;
+    class Footer;
+    struct Options;
+    class RandomAccessFile;
+    struct ReadOptions;
+    class Readahead;
+    class TableCache;
+
+    /**
+     * @brief 只读的sstable, 可以被多个线程同时使用.
+    */
+    class LEVELDB_EXPORT Table {
+    public:
+        /**
+         * @brief 打开file中大小为file_size的sstable, 成功时*table由调用方持有.
+         * file_number用来生成block cache的key, 同一个文件必须始终使用同一个值,
+         * options.block_cache带有PersistentCache时重启之后才能命中.
+         * file在table存活期间必须保持有效, 由调用方释放.
+        */
+        static Status Open(const Options &options, RandomAccessFile *file, uint64_t file_number,
+                           uint64_t file_size, Table **table);
+
+        Table(const Table &) = delete;
+        Table &operator=(const Table &) = delete;
+
+        ~Table();
+
+        // 返回的迭代器初始为无效, 使用前需要先Seek.
+        Iterator *NewIterator(const ReadOptions &options) const;
+
+        // key在文件中的大致偏移, 不存在时返回它应该在的位置.
+        uint64_t ApproximateOffsetOf(const Slice &key) const;
+
+        using GetCallback = void (*)(void *arg, const Status &s);
+
+    private:
+        friend class TableCache;
+
+        struct Rep;
+
+        // blockptr不为nullptr时*blockptr指向迭代器所属的Block, 读取失败时为nullptr.
+        // high_priority时以Cache::Priority::HIGH放进block cache, 用于index分区.
+        static Iterator *BlockReader(Table *table, Readahead *readahead, const ReadOptions &options,
+                                     const Slice &index_value, Block **blockptr = nullptr,
+                                     bool high_priority = false, bool cache_only = false);
+
+        // 用读到的contents创建block的迭代器, 可以缓存时放进block cache.
+        static Iterator *NewBlockIterator(Table *table, const ReadOptions &options, const BlockHandle &handle,
+                                          const BlockContents &contents, Block **blockptr, bool high_priority);
+
+        static void OnDataBlockRead(void *arg, const Status &s, BlockContents *contents);
+
+        explicit Table(Rep *rep) : rep_(rep) {}
+
+        // arena不为nullptr时迭代器分配在arena中. index_upper_bound不为nullptr时,
+        // 不打开index key >= *index_upper_bound之后的data block, 见NewTwoLevelIterator.
+        Iterator *NewIterator(const ReadOptions &options, Arena *arena,
+                              const Slice *index_upper_bound = nullptr) const;
+
+        // index的迭代器, value是data block的handle. index分区时是顶层index与分区的两层迭代器.
+        Iterator *NewIndexIterator(const ReadOptions &options) const;
+
+        // block_offset处的data block是否可能包含key, prefix为true时检查key的前缀.
+        // 没有filter, 读取filter出错, 或者prefix为true但filter中没有前缀时返回true.
+        bool FilterMayMatch(const ReadOptions &options, uint64_t block_offset, const Slice &key,
+                            bool prefix) const;
+
+        // 从第一个 >= key 的记录开始依次调用handle_result, 直到它返回false或者文件结束.
+        // filter判定key不存在时不调用.
+        // pinned_block不为nullptr时, handle_result返回false所在的data block迭代器不释放而是写入
+        // *pinned_block(否则为nullptr), 它持有block的引用, 最后一次回调收到的v在它被删除之前一直有效.
+        Status InternalGet(const ReadOptions &options, const Slice &key, void *arg,
+                           bool (*handle_result)(void *arg, const Slice &k, const Slice &v),
+                           Iterator **pinned_block = nullptr);
+
+        // 与InternalGet相同, 第一个data block不在block cache中时通过RandomAccessFile::ReadAsync读取,
+        // 读取完成后在完成读取的线程中调用handle_result, 最后调用callback(arg, status).
+        // cache命中或者filter判定不存在时在当前线程中完成. callback返回之前table必须一直有效.
+        void InternalGetAsync(const ReadOptions &options, const Slice &key, void *arg,
+                              bool (*handle_result)(void *arg, const Slice &k, const Slice &v),
+                              GetCallback callback);
+
+        // 对keys中的每个key做一次InternalGet, handle_result的参数为args[i], 结果写入statuses[i].
+        // keys按internal key升序排列(可以重复). 落在同一个data block中的相邻key共享一次index Seek
+        // 和一次block读取/解压, 每个block在一次调用中最多读取一次.
+        void MultiGet(const ReadOptions &options, const Slice *keys, size_t n, void *const *args,
+                      bool (*handle_result)(void *arg, const Slice &k, const Slice &v), Status *statuses);
+
+        // 从iiter指向的data block开始查找, 直到handle_result返回false. block_iter不为nullptr时
+        // 是已经读取的第一个data block(block为它所属的Block, 可以为nullptr), 由这个函数释放.
+        Status GetFromBlocks(const ReadOptions &options, const Slice &key, void *arg,
+                             bool (*handle_result)(void *arg, const Slice &k, const Slice &v), Iterator *iiter,
+                             Iterator *block_iter, Block *block, Iterator **pinned_block);
+
+        // index_value指向的data block是否可能包含key(按filter判断).
+        bool BlockMayMatch(const ReadOptions &options, const Slice &index_value, const Slice &key) const;
+
+        Status ReadMeta(const Footer &footer);
+
+        // whole_file时读取的是覆盖整个文件的filter
+        void ReadFilter(const Slice &filter_handle_value, bool whole_file);
+
+        // 从顶层index中解析每个filter分区的位置.
+        void ReadFilterPartitions();
+
+        Rep *const rep_;
+    };
+
+}
+
+#endif //MY_LEVELDB_TABLE_H
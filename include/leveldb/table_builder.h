@@ -0,0 +1,97 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_TABLE_BUILDER_H
+#define MY_LEVELDB_TABLE_BUILDER_H
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+    class BlockBuilder;
+    class BlockHandle;
+    class WritableFile;
+
+    /**
+     * @brief 构建sstable. 文件格式:
+     *
+     *   data block 1 ... data block n | filter block | metaindex block | index block | footer
+     *
+     * data block按options.block_size切分, 格式见table/block_builder.h;
+     * index block中每个data block对应一项: 介于该block最后一个key与下一个block第一个key之间的
+     * 最短key -> BlockHandle; metaindex block记录filter block的位置.
+     * whole_file_filter时filter block是覆盖整个文件的一个filter.
+     *
+     * 非const方法不是线程安全的.
+    */
+    class LEVELDB_EXPORT TableBuilder {
+    public:
+        // 在file中构建sstable, 调用方负责在Finish()之后关闭file.
+        // bottommost为true时filter使用options.bottommost_filter_policy(如果设置了, 并且打开了whole_file_filter).
+        TableBuilder(const Options &options, WritableFile *file, bool bottommost = false);
+
+        TableBuilder(const TableBuilder &) = delete;
+        TableBuilder &operator=(const TableBuilder &) = delete;
+
+        // REQUIRES: Finish()或者Abandon()已经被调用
+        ~TableBuilder();
+
+        // 修改之后使用的选项. 只有部分字段可以在构建过程中修改, 比较器不能修改.
+        Status ChangeOptions(const Options &options);
+
+        // REQUIRES: key大于之前加入的所有key, 没有调用过Finish()/Abandon()
+        void Add(const Slice &key, const Slice &value);
+
+        // 把缓存的记录写成一个data block, 一般不需要直接调用.
+        void Flush();
+
+        Status status() const;
+
+        // 写入剩余的内容, 完成整个文件.
+        Status Finish();
+
+        // 放弃构建, 之前写入file的内容保持原样.
+        void Abandon();
+
+        uint64_t NumEntries() const;
+
+        // 目前为止生成的文件大小, Finish()之后即为最终的文件大小.
+        // 为训练压缩字典缓存data block时包含缓存的未压缩大小.
+        uint64_t FileSize() const;
+
+    private:
+        bool ok() const { return status().IsOK(); }
+
+        // 在index中添加上一个data block的项, next_key是下一个data block的第一个key.
+        void AddPendingIndexEntry(const Slice &next_key);
+
+        void AddFilterKey(const Slice &key);
+
+        // 写入一个data block并开始等待它的index项.
+        void WriteDataBlock(const Slice &raw);
+
+        // 用缓存的data block训练压缩字典, 然后写入它们.
+        void EnterUnbuffered();
+
+        // use_dict时使用压缩字典(如果有), 只用于通过Table::BlockReader读取的block.
+        void WriteBlock(BlockBuilder *block, BlockHandle *handle, bool use_dict = false);
+
+        void WriteBlock(const Slice &raw, BlockHandle *handle, bool use_dict);
+
+        // 写入当前的index分区和filter分区, 并在顶层index中添加一项.
+        void FlushPartition();
+
+        void WriteRawBlock(const Slice &data, CompressionType type, BlockHandle *handle);
+
+        struct Rep;
+        Rep *rep_;
+    };
+
+}
+
+#endif //MY_LEVELDB_TABLE_BUILDER_H
@@ -26,6 +26,7 @@ namespace leveldb {
             virtual ~Handler();
             virtual void Put(const Slice &key, const Slice &val) = 0;
             virtual void Delete(const Slice &key) = 0;
+            virtual void Merge(const Slice &key, const Slice &operand) = 0;
         };
 
         WriteBatch();
@@ -48,6 +49,13 @@ namespace leveldb {
         */
         void Delete(const Slice &key);
 
+        /**
+         * @brief ׷һmerge operand, ȡʱOptions::merge_operator۵.
+         * @param key 
+         * @param operand 
+        */
+        void Merge(const Slice &key, const Slice &operand);
+
         /**
          * @brief 
         */
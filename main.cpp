@@ -1,20 +1,51 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
 #include "leveldb/cxx.h"
 #include "leveldb/cache.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/persistent_cache.h"
 #include "leveldb/db.h"
+#include "leveldb/pinnable_slice.h"
 #include "port/port_stdcxx.h"
 #include "util/arena.h"
+#include "util/random.h"
 #include "util/histogram.h"
 #include "leveldb/options.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "leveldb/status.h"
 #include "util/mutexlock.h"
 #include "util/logging.h"
 #include "leveldb/env.h"
 #include "db/skiplist.h"
 #include "db/memtable.h"
+#include "db/memtable_list.h"
+#include "db/row_cache.h"
+#include "db/snapshot.h"
+#include "db/db_iter.h"
+#include "db/version_edit.h"
+#include "db/version_set.h"
+#include "db/merge_helper.h"
+#include "table/merger.h"
+#include "leveldb/slice_transform.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/readahead.h"
+#include "db/filename.h"
+#include "db/table_cache.h"
+#include "leveldb/table.h"
+#include "leveldb/table_builder.h"
+#include "leveldb/merge_operator.h"
 
 #include "db/log_reader.h"
 #include "db/log_writer.h"
@@ -36,10 +67,74 @@ extern void testEnv();
 
 extern void testSkipList();
 
+extern void testSkipListSeekBatch();
+
 extern void testLogWriter();
 
 extern void testMemTable();
 
+extern void testMemTableMerge();
+
+extern void testMemTableList();
+
+extern void testRowCache();
+
+extern void benchMemTableMultiGet();
+
+extern void benchMultiGet();
+
+extern void testReadAsync();
+
+extern void testVersionGet();
+
+extern void benchSstMultiGet();
+
+extern void testDBIterBounds();
+
+extern void testDBIterPrefixBounds();
+
+extern void benchArenaIterator();
+
+extern void benchReverseScan();
+
+extern void benchCacheLookup();
+
+extern void benchCacheAdmission();
+
+extern void testSecondaryCache();
+
+extern void testPersistentCache();
+
+extern void testCachePriority();
+
+extern void testTable();
+
+extern void testReadahead();
+
+extern void benchBlockSeek();
+
+extern void testKeyPrefixSIMD();
+
+extern void benchBlockHashIndex();
+
+extern void testPartitionedIndex();
+
+extern void testPrefixFilterName();
+
+extern void testTableIterateBounds();
+
+extern void benchBloomFilter();
+
+extern void testBloomFilterSIMD();
+
+extern void benchXorFilter();
+
+extern void testBottommostFilterSize();
+
+extern void benchWholeFileFilter();
+
+extern void benchCompression();
+
 void testWindowsSequenceFile() {
     auto env = leveldb::Env::Default();
     leveldb::SequentialFile* sf;
@@ -57,6 +152,37 @@ void testWindowsSequenceFile() {
 int main() {
     testWindowsSequenceFile();
     //testMemTable();
+    //testMemTableMerge();
+    //testMemTableList();
+    //testRowCache();
+    //benchMemTableMultiGet();
+    //benchMultiGet();
+    //testReadAsync();
+    //testVersionGet();
+    //benchSstMultiGet();
+    //testDBIterBounds();
+    //testDBIterPrefixBounds();
+    //benchArenaIterator();
+    //benchReverseScan();
+    //benchCacheLookup();
+    //benchCacheAdmission();
+    //testSecondaryCache();
+    //testPersistentCache();
+    //testCachePriority();
+    //testTable();
+    //testReadahead();
+    //benchBlockSeek();
+    //testKeyPrefixSIMD();
+    //benchBlockHashIndex();
+    //testPartitionedIndex();
+    //testPrefixFilterName();
+    //testTableIterateBounds();
+    //benchBloomFilter();
+    //testBloomFilterSIMD();
+    //benchXorFilter();
+    //testBottommostFilterSize();
+    //benchWholeFileFilter();
+    //benchCompression();
     //testArena();
     //testHistogram();
     //testState();
@@ -64,6 +190,7 @@ int main() {
     //testEnv();
     //testLogWriter();
     //testSkipList();
+    //testSkipListSeekBatch();
 
     return 0;
 }
@@ -177,6 +304,43 @@ void testSkipList() {
 //    std::cout << "done" << std::endl;
 }
 
+// SkipList::SeekBatch与逐个Iterator::Seek的位置必须相同: 随机插入, 目标有重复,
+// 有比所有key都小和都大的, 批次大小从1到300.
+void testSkipListSeekBatch() {
+    struct Comparator {
+        int operator()(uint64_t a, uint64_t b) const { return a < b ? -1 : (a > b ? 1 : 0); }
+    };
+    using List = leveldb::SkipList<uint64_t, Comparator>;
+    leveldb::Arena arena;
+    List list(Comparator(), &arena);
+    leveldb::Random rnd(301);
+    for (int i = 0; i < 20000; ++i) {
+        const uint64_t key = 10 + 2 * rnd.Uniform(100000);
+        if (!list.Contains(key)) {
+            list.Insert(key);
+        }
+    }
+    int checks = 0, mismatches = 0;
+    for (int n = 1; n <= 300; ++n) {
+        std::vector<uint64_t> targets(n);
+        for (auto &t : targets) {
+            // 约一半重复
+            t = rnd.OneIn(2) && &t != targets.data() ? *(&t - 1) : rnd.Uniform(200030);
+        }
+        std::sort(targets.begin(), targets.end());
+        std::vector<List::Iterator> iters(n, List::Iterator(&list));
+        list.SeekBatch(targets.data(), n, iters.data());
+        for (int i = 0; i < n; ++i) {
+            List::Iterator expect(&list);
+            expect.Seek(targets[i]);
+            ++checks;
+            mismatches += expect.Valid() != iters[i].Valid() || (expect.Valid() && expect.key() != iters[i].key());
+        }
+    }
+    std::cout << "SkipListSeekBatch: " << checks << " checks, " << mismatches << " mismatches, "
+              << (mismatches == 0 ? "OK" : "FAILED") << std::endl;
+}
+
 void testLogWriter() {
     auto env = leveldb::Env::Default();
     leveldb::WritableFile *wf = nullptr;
@@ -215,4 +379,2335 @@ void testMemTable() {
             std::cout << "value found  but mark delete tag." << std::endl;
         }
     }
-}
\ No newline at end of file
+}
+// 计数器: operand和value都是十进制字符串.
+class CounterMergeOperator : public leveldb::MergeOperator {
+public:
+    const char *Name() const override { return "test.CounterMergeOperator"; }
+
+    bool FullMerge(const leveldb::Slice & /*key*/, const leveldb::Slice *existing_value,
+                   const std::vector<leveldb::Slice> &operands, std::string *new_value) const override {
+        long long sum = existing_value == nullptr ? 0 : std::stoll(existing_value->ToString());
+        for (const auto &op : operands) {
+            sum += std::stoll(op.ToString());
+        }
+        *new_value = std::to_string(sum);
+        return true;
+    }
+};
+
+void testMemTableMerge() {
+    CounterMergeOperator counter;
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    auto memtable = new leveldb::MemTable(cmp, &counter);
+    memtable->Ref();
+    memtable->Add(seqGen(), leveldb::kTypeValue, "counter", "10");
+    memtable->Add(seqGen(), leveldb::kTypeMerge, "counter", "1");
+    memtable->Add(seqGen(), leveldb::kTypeMerge, "counter", "2");
+    memtable->Add(seqGen(), leveldb::kTypeMerge, "only_operands", "5");
+
+    std::string value;
+    leveldb::Status s;
+    leveldb::MergeContext context;
+    bool bRet = memtable->Get(leveldb::LookupKey("counter", 9999), &value, &s, &context);
+    std::cout << "counter found:" << std::boolalpha << bRet << " value:" << value << std::endl; // 13
+
+    leveldb::MergeContext pending;
+    bRet = memtable->Get(leveldb::LookupKey("only_operands", 9999), &value, &s, &pending);
+    std::cout << "only_operands found:" << bRet << " pending:" << pending.size() << std::endl; // false 1
+    memtable->Unref();
+}
+
+// MemTableList: 排队/flush失败回滚/flush期间继续切换memtable/移除已flush的imm.
+void testMemTableList() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    auto new_mem = [&](const char *key, const char *value) {
+        auto m = new leveldb::MemTable(cmp);
+        m->Ref();
+        m->Add(seqGen(), leveldb::kTypeValue, key, value);
+        return m;
+    };
+    auto get = [](leveldb::MemTableListVersion *v, const char *key) {
+        std::string value;
+        leveldb::Status s;
+        leveldb::MergeContext merge_context;
+        if (!v->Get(leveldb::LookupKey(key, leveldb::kMaxSequenceNumber), &value, &s, &merge_context)) {
+            return std::string("(none)");
+        }
+        return value;
+    };
+    bool ok = true;
+
+    leveldb::MemTableList imm;
+    ok &= !imm.IsFlushPending();
+    leveldb::MemTable *m1 = new_mem("k", "v1");
+    leveldb::MemTable *m2 = new_mem("k", "v2");
+    imm.Add(m1);
+    imm.Add(m2);
+    ok &= imm.NumMemTables() == 2 && imm.IsFlushPending();
+    ok &= get(imm.current(), "k") == "v2";  // 新的imm优先
+
+    // 第一次flush失败: imm留在列表中, 可以再次flush
+    std::vector<leveldb::MemTable *> mems;
+    imm.PickMemtablesToFlush(&mems);
+    ok &= mems.size() == 2 && mems[0] == m1 && mems[1] == m2;  // 旧 -> 新
+    ok &= !imm.IsFlushPending();
+    imm.RollbackMemtableFlush();
+    ok &= imm.NumMemTables() == 2 && imm.IsFlushPending();
+
+    // 第二次flush期间又写满了一个memtable
+    imm.PickMemtablesToFlush(&mems);
+    leveldb::MemTableListVersion *reader = imm.current();
+    reader->Ref();
+    leveldb::MemTable *m3 = new_mem("k", "v3");
+    imm.Add(m3);
+    ok &= imm.NumMemTables() == 3 && !imm.IsFlushPending();
+    ok &= get(imm.current(), "k") == "v3" && get(reader, "k") == "v2";
+
+    // flush成功: 只移除被flush的两个, m3等待下一次flush; 旧版本的读者不受影响
+    imm.RemoveFlushed(mems);
+    ok &= imm.NumMemTables() == 1 && imm.IsFlushPending();
+    ok &= get(imm.current(), "k") == "v3" && get(reader, "k") == "v2";
+    reader->Unref();
+
+    imm.PickMemtablesToFlush(&mems);
+    ok &= mems.size() == 1 && mems[0] == m3;
+    imm.RemoveFlushed(mems);
+    ok &= imm.empty() && !imm.IsFlushPending() && get(imm.current(), "k") == "(none)";
+
+    std::cout << "MemTableList: " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// RowCache: 命中时回放缓存的记录(value/删除/merge operand), 未命中, 以及失效:
+// 文件号, 快照, cache_id不同的查找不会命中旧的条目, 条目被淘汰之后未命中.
+void testRowCache() {
+    CounterMergeOperator counter;
+    std::unique_ptr<leveldb::Cache> cache(leveldb::NewLRUCache(1 << 20));
+    leveldb::RowCache row_cache(cache.get());
+    leveldb::RowCache other_db(cache.get());
+    leveldb::ReadOptions options;
+    bool ok = true;
+
+    struct Result {
+        bool hit = false;
+        bool done = false;
+        std::string value;
+        leveldb::Status s;
+        size_t operands = 0;
+    };
+    auto lookup = [&](leveldb::RowCache *rc, const leveldb::ReadOptions &opt, uint64_t file_number,
+                      const char *user_key, leveldb::MergeContext *merge_context) {
+        std::string key;
+        rc->ComputeKey(opt, file_number, user_key, &key);
+        Result r;
+        r.hit = rc->Lookup(key, user_key, &counter, &r.value, &r.s, merge_context, &r.done);
+        r.operands = merge_context->size();
+        return r;
+    };
+    auto insert = [&](const leveldb::ReadOptions &opt, uint64_t file_number, const char *user_key,
+                      const leveldb::RowCacheEntry &entry) {
+        std::string key;
+        row_cache.ComputeKey(opt, file_number, user_key, &key);
+        row_cache.Insert(key, entry);
+    };
+
+    leveldb::RowCacheEntry value_entry;
+    value_entry.Add(leveldb::kTypeValue, "v1");
+    insert(options, 7, "a", value_entry);
+    leveldb::RowCacheEntry deletion_entry;
+    deletion_entry.Add(leveldb::kTypeDeletion, "");
+    insert(options, 7, "b", deletion_entry);
+    // 新 -> 旧: 两个operand之后是base
+    leveldb::RowCacheEntry merge_entry;
+    merge_entry.Add(leveldb::kTypeMerge, "2");
+    merge_entry.Add(leveldb::kTypeMerge, "3");
+    merge_entry.Add(leveldb::kTypeValue, "10");
+    insert(options, 7, "c", merge_entry);
+    // 只有operand, 调用方需要继续查找更旧的文件
+    leveldb::RowCacheEntry operands_entry;
+    operands_entry.Add(leveldb::kTypeMerge, "1");
+    insert(options, 7, "d", operands_entry);
+    // 文件中没有这个key, 不缓存
+    insert(options, 7, "e", leveldb::RowCacheEntry());
+
+    leveldb::MergeContext mc_a, mc_b, mc_c, mc_d, mc_e;
+    Result a = lookup(&row_cache, options, 7, "a", &mc_a);
+    ok &= a.hit && a.done && a.s.IsOK() && a.value == "v1";
+    Result b = lookup(&row_cache, options, 7, "b", &mc_b);
+    ok &= b.hit && b.done && b.s.IsNotFound();
+    Result c = lookup(&row_cache, options, 7, "c", &mc_c);
+    ok &= c.hit && c.done && c.s.IsOK() && c.value == "15";
+    Result d = lookup(&row_cache, options, 7, "d", &mc_d);
+    ok &= d.hit && !d.done && d.operands == 1;
+    Result e = lookup(&row_cache, options, 7, "e", &mc_e);
+    ok &= !e.hit;
+
+    // 失效: compaction之后是新的文件号; 快照的可见性不同; 另一个DB共享同一个Cache
+    leveldb::MergeContext mc1, mc2, mc3;
+    ok &= !lookup(&row_cache, options, 8, "a", &mc1).hit;
+    leveldb::SnapshotImpl snapshot(100);
+    leveldb::ReadOptions snapshot_options;
+    snapshot_options.snapshot = &snapshot;
+    ok &= !lookup(&row_cache, snapshot_options, 7, "a", &mc2).hit;
+    ok &= !lookup(&other_db, options, 7, "a", &mc3).hit;
+
+    // 淘汰之后未命中
+    std::string key;
+    row_cache.ComputeKey(options, 7, "a", &key);
+    cache->Erase(key);
+    leveldb::MergeContext mc4, mc5;
+    ok &= !lookup(&row_cache, options, 7, "a", &mc4).hit;
+    ok &= lookup(&row_cache, options, 7, "c", &mc5).hit;
+
+    // 没有Cache时总是未命中
+    leveldb::RowCache disabled(nullptr);
+    leveldb::MergeContext mc6;
+    ok &= !disabled.enabled() && !lookup(&disabled, options, 7, "c", &mc6).hit;
+
+    std::cout << "RowCache: " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// MemTable::MultiGet(排序 + SkipList::SeekBatch)与循环MemTable::Get的对比:
+// 20万条记录的memtable, 每批150或2000个随机key. 两种方式每轮查找不同的随机key并交替先后顺序,
+// 避免一方命中另一方刚预热过的cache; 计时之后再用MultiGet查一遍Get的key, 比较两者的结果.
+void benchMemTableMultiGet() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    auto memtable = new leveldb::MemTable(cmp);
+    memtable->Ref();
+
+    const int kNumKeys = 200000;
+    leveldb::Random rnd(301);
+    char buf[32];
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+        memtable->Add(seqGen(), leveldb::kTypeValue, buf, std::to_string(i));
+    }
+
+    for (int batch_size : {150, 2000}) {
+        const int kRounds = 600000 / batch_size;
+        std::chrono::nanoseconds get_time(0), multiget_time(0);
+        bool same = true;
+        for (int round = 0; round < kRounds; ++round) {
+            // [0, batch_size)给Get, [batch_size, 2 * batch_size)给MultiGet
+            std::vector<std::unique_ptr<leveldb::LookupKey>> keys;
+            std::vector<const leveldb::LookupKey *> key_ptrs;
+            for (int i = 0; i < 2 * batch_size; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", static_cast<int>(rnd.Uniform(kNumKeys * 2)));
+                keys.emplace_back(new leveldb::LookupKey(buf, leveldb::kMaxSequenceNumber));
+                key_ptrs.push_back(keys.back().get());
+            }
+
+            std::vector<std::string> get_values(batch_size), multiget_values(batch_size);
+            std::vector<leveldb::Status> get_statuses(batch_size), multiget_statuses(batch_size);
+            std::unique_ptr<bool[]> get_found(new bool[batch_size]());
+            std::unique_ptr<bool[]> multiget_found(new bool[batch_size]());
+            auto run_get = [&]() {
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < batch_size; ++i) {
+                    get_found[i] = memtable->Get(*key_ptrs[i], &get_values[i], &get_statuses[i]);
+                }
+                get_time += std::chrono::steady_clock::now() - start;
+            };
+            auto run_multiget = [&]() {
+                auto start = std::chrono::steady_clock::now();
+                memtable->MultiGet(key_ptrs.data() + batch_size, batch_size, multiget_values.data(),
+                                   multiget_statuses.data(), multiget_found.get());
+                multiget_time += std::chrono::steady_clock::now() - start;
+            };
+            if (round % 2 == 0) {
+                run_get();
+                run_multiget();
+            } else {
+                run_multiget();
+                run_get();
+            }
+
+            std::fill(multiget_found.get(), multiget_found.get() + batch_size, false);
+            memtable->MultiGet(key_ptrs.data(), batch_size, multiget_values.data(), multiget_statuses.data(),
+                               multiget_found.get());
+            for (int i = 0; i < batch_size; ++i) {
+                same &= get_found[i] == multiget_found[i];
+                if (get_found[i]) {
+                    same &= get_values[i] == multiget_values[i] &&
+                            get_statuses[i].ToString() == multiget_statuses[i].ToString();
+                }
+            }
+        }
+
+        const double lookups = static_cast<double>(kRounds) * batch_size;
+        std::cout << "batch " << batch_size << std::endl;
+        std::cout << "Get loop : " << get_time.count() / lookups << " ns/key" << std::endl;
+        std::cout << "MultiGet : " << multiget_time.count() / lookups << " ns/key ("
+                  << 100.0 * multiget_time.count() / get_time.count() << "% of Get loop)" << std::endl;
+        std::cout << "results  : " << (same ? "identical" : "MISMATCH") << std::endl;
+    }
+    memtable->Unref();
+}
+
+// DB::MultiGet的memtable阶段与循环Get的对比: 一个mem加两个imm共20万条记录,
+// 每批150个随机key, 依次经过mem->MultiGet和imm->MultiGet, 对照组对每个key依次查mem和imm.
+// DB::Open还没有实现, sstable阶段不在这里测量.
+// 两种方式每轮交替先后顺序, 并且每轮比较两者的结果.
+void benchMultiGet() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    const int kNumKeys = 200000;
+    const int kNumMemTables = 3;
+    const int kBatchSize = 150;
+    const int kRounds = 4000;
+    // mems[0]是最新的memtable, 后面的是imm
+    std::vector<leveldb::MemTable *> mems;
+    for (int m = 0; m < kNumMemTables; ++m) {
+        mems.push_back(new leveldb::MemTable(cmp));
+        mems.back()->Ref();
+    }
+    leveldb::Random rnd(301);
+    char buf[32];
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+        mems[kNumMemTables - 1 - i % kNumMemTables]->Add(seqGen(), leveldb::kTypeValue, buf, std::to_string(i));
+    }
+    leveldb::MemTableList imm;
+    for (int m = kNumMemTables - 1; m >= 1; --m) {
+        imm.Add(mems[m]);
+    }
+    leveldb::MemTable *mem = mems[0];
+    leveldb::MemTableListVersion *imm_version = imm.current();
+
+    std::chrono::nanoseconds get_time(0), multiget_time(0);
+    bool same = true;
+    for (int round = 0; round < kRounds; ++round) {
+        std::vector<std::unique_ptr<leveldb::LookupKey>> keys;
+        std::vector<const leveldb::LookupKey *> key_ptrs;
+        for (int i = 0; i < kBatchSize; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", static_cast<int>(rnd.Uniform(kNumKeys * 2)));
+            keys.emplace_back(new leveldb::LookupKey(buf, leveldb::kMaxSequenceNumber));
+            key_ptrs.push_back(keys.back().get());
+        }
+
+        std::vector<std::string> get_values(kBatchSize), multiget_values(kBatchSize);
+        std::vector<leveldb::Status> get_statuses(kBatchSize), multiget_statuses(kBatchSize);
+        std::unique_ptr<bool[]> get_found(new bool[kBatchSize]());
+        std::unique_ptr<bool[]> multiget_found(new bool[kBatchSize]());
+        auto run_get = [&]() {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kBatchSize; ++i) {
+                leveldb::MergeContext merge_context;
+                get_found[i] = mem->Get(*key_ptrs[i], &get_values[i], &get_statuses[i], &merge_context) ||
+                               imm_version->Get(*key_ptrs[i], &get_values[i], &get_statuses[i], &merge_context);
+            }
+            get_time += std::chrono::steady_clock::now() - start;
+        };
+        auto run_multiget = [&]() {
+            auto start = std::chrono::steady_clock::now();
+            std::unique_ptr<leveldb::MergeContext[]> merge_contexts(new leveldb::MergeContext[kBatchSize]);
+            mem->MultiGet(key_ptrs.data(), kBatchSize, multiget_values.data(), multiget_statuses.data(),
+                          multiget_found.get(), merge_contexts.get());
+            imm_version->MultiGet(key_ptrs.data(), kBatchSize, multiget_values.data(), multiget_statuses.data(),
+                                  multiget_found.get(), merge_contexts.get());
+            multiget_time += std::chrono::steady_clock::now() - start;
+        };
+        if (round % 2 == 0) {
+            run_get();
+            run_multiget();
+        } else {
+            run_multiget();
+            run_get();
+        }
+
+        for (int i = 0; i < kBatchSize; ++i) {
+            same &= get_found[i] == multiget_found[i];
+            if (get_found[i]) {
+                same &= get_values[i] == multiget_values[i] &&
+                        get_statuses[i].ToString() == multiget_statuses[i].ToString();
+            }
+        }
+    }
+
+    const double lookups = static_cast<double>(kRounds) * kBatchSize;
+    std::cout << "Get loop : " << get_time.count() / lookups << " ns/key" << std::endl;
+    std::cout << "MultiGet : " << multiget_time.count() / lookups << " ns/key ("
+              << 100.0 * multiget_time.count() / get_time.count() << "% of Get loop)" << std::endl;
+    std::cout << "results  : " << (same ? "identical" : "MISMATCH") << std::endl;
+    mem->Unref();
+}
+
+void testReadAsync() {
+    auto env = leveldb::Env::Default();
+    std::string fname;
+    auto status = env->GetTestDirectory(&fname);
+    fname += "/raf_test.out";
+    if (status.IsOK()) {
+        leveldb::WritableFile *wf;
+        status = env->NewWritableFile(fname, &wf);
+        if (status.IsOK()) {
+            status = wf->Append("0000111122223333444455556666777788889999");
+            wf->Close();
+            delete wf;
+        }
+    }
+    leveldb::RandomAccessFile *raf = nullptr;
+    if (status.IsOK()) {
+        status = env->NewRandomAccessFile(fname, &raf);
+    }
+    if (!status.IsOK()) {
+        std::cout << status.ToString() << std::endl;
+        return;
+    }
+
+    // 多个读请求同时在I/O线程池中执行, 全部完成后再释放文件.
+    const int kNumReads = 8;
+    char scratch[kNumReads][16];
+    std::atomic<int> done(0);
+    for (int i = 0; i < kNumReads; ++i) {
+        raf->ReadAsync(i * 4, 4, scratch[i], [](void *arg, const leveldb::Status &s, const leveldb::Slice &result) {
+            std::cout << s.ToString() << " " << result.ToString() << std::endl;
+            reinterpret_cast<std::atomic<int> *>(arg)->fetch_add(1);
+        }, &done);
+    }
+    while (done.load() < kNumReads) {
+        env->SleepForMicroseconds(1000);
+    }
+    delete raf;
+    env->RemoveFile(fname);
+}
+
+// 两个互相重叠的L0文件和一个L1文件, Version::Get/GetAsync/MultiGet和AddIterators的结果与逐个key的模型比较.
+void testVersionGet() {
+    auto env = leveldb::Env::Default();
+    std::string dbname;
+    env->GetTestDirectory(&dbname);
+    dbname += "/version_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    leveldb::Options options;
+    options.comparator = &icmp;
+    options.block_size = 1024;
+    leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+    leveldb::VersionSet versions(dbname, &options, &table_cache, &icmp);
+
+    // file 12(L1, seq 1): 所有key; file 11(L0, seq 2): 偶数key; file 13(L0, seq 3): 3的倍数, 7的倍数为删除.
+    const int kNumKeys = 3000;
+    std::map<std::string, std::string> model;
+    leveldb::VersionEdit edit;
+    struct FileSpec {
+        uint64_t number;
+        int level;
+        leveldb::SequenceNumber seq;
+    };
+    for (const FileSpec &spec : {FileSpec{12, 1, 1}, FileSpec{11, 0, 2}, FileSpec{13, 0, 3}}) {
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, spec.number), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        leveldb::TableBuilder builder(options, file);
+        leveldb::InternalKey smallest, largest;
+        bool empty = true;
+        char buf[32];
+        for (int i = 0; i < kNumKeys; ++i) {
+            if ((spec.seq == 2 && i % 2 != 0) || (spec.seq == 3 && i % 3 != 0)) {
+                continue;
+            }
+            std::snprintf(buf, sizeof(buf), "k%06d", i);
+            const bool deletion = spec.seq == 3 && i % 7 == 0;
+            leveldb::InternalKey ikey(buf, spec.seq, deletion ? leveldb::kTypeDeletion : leveldb::kTypeValue);
+            const std::string value = std::to_string(spec.number) + "-" + std::to_string(i);
+            builder.Add(ikey.Encode(), deletion ? "" : value);
+            if (empty) {
+                smallest = ikey;
+                empty = false;
+            }
+            largest = ikey;
+            if (deletion) {
+                model.erase(buf);
+            } else {
+                model[buf] = value;
+            }
+        }
+        builder.Finish();
+        file->Close();
+        delete file;
+        edit.AddFile(spec.level, spec.number, builder.FileSize(), smallest, largest);
+        versions.MarkFileNumberUsed(spec.number);
+    }
+    leveldb::port::Mutex mu;
+    mu.Lock();
+    versions.LogAndApply(&edit, &mu);
+    leveldb::Version *current = versions.current();
+    current->Ref();
+    mu.Unlock();
+
+    int checked = 0, mismatches = 0, seek_charged = 0;
+    std::atomic<int> async_done(0);
+    std::vector<std::string> async_values(kNumKeys + 10);
+    std::vector<leveldb::Status> async_statuses(kNumKeys + 10);
+    std::deque<leveldb::LookupKey> lkeys;
+    std::deque<leveldb::MergeContext> async_merge_contexts;
+    std::vector<leveldb::Version::GetStats> async_stats(kNumKeys + 10);
+    struct AsyncArg {
+        std::atomic<int> *done;
+        leveldb::Status *status;
+    };
+    std::vector<AsyncArg> async_args(kNumKeys + 10);
+    char buf[32];
+    for (int i = 0; i < kNumKeys + 10; ++i) {
+        std::snprintf(buf, sizeof(buf), "k%06d", i);
+        lkeys.emplace_back(buf, leveldb::kMaxSequenceNumber);
+        const leveldb::LookupKey &lkey = lkeys.back();
+        auto it = model.find(buf);
+
+        leveldb::MergeContext merge_context;
+        leveldb::Version::GetStats stats;
+        std::string value;
+        leveldb::Status s = current->Get(leveldb::ReadOptions(), lkey, &value, &merge_context, &stats);
+        mismatches += it == model.end() ? !s.IsNotFound() : !(s.IsOK() && value == it->second);
+        seek_charged += stats.seek_file != nullptr;
+
+        leveldb::PinnableSlice pinned;
+        leveldb::MergeContext pinned_merge_context;
+        s = current->Get(leveldb::ReadOptions(), lkey, &pinned, &pinned_merge_context, &stats);
+        mismatches += it == model.end() ? !s.IsNotFound() : !(s.IsOK() && pinned.ToString() == it->second);
+
+        async_merge_contexts.emplace_back();
+        async_args[i] = {&async_done, &async_statuses[i]};
+        current->GetAsync(leveldb::ReadOptions(), lkey, &async_values[i], &async_merge_contexts.back(),
+                          &async_stats[i], [](void *arg, const leveldb::Status &status) {
+                    auto *a = reinterpret_cast<AsyncArg *>(arg);
+                    *a->status = status;
+                    a->done->fetch_add(1, std::memory_order_release);
+                }, &async_args[i]);
+        checked++;
+    }
+    while (async_done.load(std::memory_order_acquire) < kNumKeys + 10) {
+        env->SleepForMicroseconds(1000);
+    }
+    for (int i = 0; i < kNumKeys + 10; ++i) {
+        auto it = model.find(lkeys[i].user_key().ToString());
+        mismatches += it == model.end() ? !async_statuses[i].IsNotFound()
+                                        : !(async_statuses[i].IsOK() && async_values[i] == it->second);
+    }
+
+    // MultiGet: 随机大小的有序batch, key可以重复
+    leveldb::Random rnd(301);
+    int multiget_checked = 0;
+    for (int round = 0; round < 300; ++round) {
+        const int batch = 1 + static_cast<int>(rnd.Uniform(200));
+        std::vector<std::string> user_keys;
+        for (int j = 0; j < batch; ++j) {
+            std::snprintf(buf, sizeof(buf), "k%06d", static_cast<int>(rnd.Uniform(kNumKeys + 10)));
+            user_keys.emplace_back(buf);
+        }
+        std::sort(user_keys.begin(), user_keys.end());
+        std::deque<leveldb::LookupKey> batch_keys;
+        std::vector<std::string> values(batch);
+        std::vector<leveldb::Status> statuses(batch);
+        std::unique_ptr<leveldb::MergeContext[]> merge_contexts(new leveldb::MergeContext[batch]);
+        std::vector<leveldb::TableCache::GetContext> contexts(batch);
+        std::vector<leveldb::Version::GetStats> stats(batch);
+        for (int j = 0; j < batch; ++j) {
+            batch_keys.emplace_back(user_keys[j], leveldb::kMaxSequenceNumber);
+            contexts[j] = {&batch_keys.back(), &values[j], &statuses[j], &merge_contexts[j], false};
+        }
+        current->MultiGet(leveldb::ReadOptions(), contexts.data(), batch, stats.data());
+        for (int j = 0; j < batch; ++j) {
+            auto it = model.find(user_keys[j]);
+            mismatches += it == model.end() ? !statuses[j].IsNotFound()
+                                            : !(statuses[j].IsOK() && values[j] == it->second);
+            multiget_checked++;
+        }
+    }
+
+    std::vector<leveldb::Iterator *> list;
+    current->AddIterators(leveldb::ReadOptions(), &list);
+    leveldb::Iterator *iter = leveldb::NewDBIterator(nullptr, nullptr, leveldb::BytewiseComparator(),
+                                                     leveldb::NewMergingIterator(&icmp, list.data(), list.size()),
+                                                     leveldb::kMaxSequenceNumber, 0, nullptr, nullptr,
+                                                     leveldb::ReadOptions());
+    std::map<std::string, std::string> scanned;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        scanned[iter->Key().ToString()] = iter->Value().ToString();
+    }
+    delete iter;
+
+    std::cout << "files per level: " << current->NumFiles(0) << " " << current->NumFiles(1) << std::endl;
+    mu.Lock();
+    current->Unref();
+    mu.Unlock();
+    std::cout << "checked " << checked << " keys x 3 lookups + " << multiget_checked << " MultiGet keys, "
+              << mismatches << " mismatches, " << seek_charged << " lookups charged a seek" << std::endl;
+    std::cout << "scan: " << scanned.size() << " keys, " << (scanned == model ? "identical" : "MISMATCH")
+              << std::endl;
+}
+
+// DBIter的iterate_lower_bound/iterate_upper_bound: 随机的多版本记录和删除, 与逐个key的模型比较
+// 正向/反向遍历和Seek的结果; TableCache不打开key范围落在边界之外的文件.
+void testDBIterBounds() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    leveldb::Random rnd(301);
+    bool ok = true;
+    for (int trial = 0; trial < 200 && ok; ++trial) {
+        auto memtable = new leveldb::MemTable(cmp);
+        memtable->Ref();
+        std::map<std::string, std::string> model;
+        for (int i = 0; i < 40; ++i) {
+            std::string key = "k" + std::to_string(rnd.Uniform(10));
+            if (rnd.OneIn(3)) {
+                memtable->Add(seqGen(), leveldb::kTypeDeletion, key, "");
+                model.erase(key);
+            } else {
+                std::string value = std::to_string(i);
+                memtable->Add(seqGen(), leveldb::kTypeValue, key, value);
+                model[key] = value;
+            }
+        }
+        std::string lower = "k" + std::to_string(rnd.Uniform(10));
+        std::string upper = "k" + std::to_string(rnd.Uniform(10));
+        leveldb::Slice lower_slice(lower), upper_slice(upper);
+        leveldb::ReadOptions options;
+        options.iterate_lower_bound = rnd.OneIn(2) ? &lower_slice : nullptr;
+        options.iterate_upper_bound = rnd.OneIn(2) ? &upper_slice : nullptr;
+
+        std::vector<std::pair<std::string, std::string>> expected;
+        for (const auto &kv : model) {
+            if ((options.iterate_lower_bound == nullptr || kv.first >= lower) &&
+                (options.iterate_upper_bound == nullptr || kv.first < upper)) {
+                expected.emplace_back(kv);
+            }
+        }
+
+        leveldb::Iterator *iter = leveldb::NewDBIterator(nullptr, nullptr, leveldb::BytewiseComparator(),
+                                                         memtable->NewIterator(), leveldb::kMaxSequenceNumber,
+                                                         rnd.Next(), nullptr, nullptr, options);
+        std::vector<std::pair<std::string, std::string>> forward, backward;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            forward.emplace_back(iter->Key().ToString(), iter->Value().ToString());
+        }
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+            backward.emplace_back(iter->Key().ToString(), iter->Value().ToString());
+        }
+        std::reverse(backward.begin(), backward.end());
+        ok &= forward == expected && backward == expected;
+
+        // Seek到边界之外的target时停在边界上
+        for (int t = 0; t < 10; ++t) {
+            std::string target = "k" + std::to_string(t);
+            iter->Seek(target);
+            auto it = std::find_if(expected.begin(), expected.end(), [&](const std::pair<std::string, std::string> &kv) {
+                return kv.first >= target;
+            });
+            ok &= (it == expected.end()) ? !iter->Valid() : (iter->Valid() && iter->Key() == leveldb::Slice(it->first));
+        }
+        ok &= iter->status().IsOK();
+        delete iter;
+        memtable->Unref();
+    }
+
+    // 文件不存在: 被打开时返回错误, 被跳过时是一个空的迭代器
+    leveldb::Options options;
+    leveldb::TableCache table_cache("/tmp/no_such_db", options, leveldb::BytewiseComparator(), 10);
+    leveldb::FileMetaData file;
+    file.number = 123;
+    file.file_size = 4096;
+    file.smallest = leveldb::InternalKey("k3", 1, leveldb::kTypeValue);
+    file.largest = leveldb::InternalKey("k6", 1, leveldb::kTypeValue);
+    auto opened = [&](const char *lower, const char *upper) {
+        leveldb::Slice lower_slice(lower != nullptr ? lower : ""), upper_slice(upper != nullptr ? upper : "");
+        leveldb::ReadOptions read_options;
+        read_options.iterate_lower_bound = lower != nullptr ? &lower_slice : nullptr;
+        read_options.iterate_upper_bound = upper != nullptr ? &upper_slice : nullptr;
+        leveldb::Arena arena;
+        leveldb::Iterator *iter = table_cache.NewIterator(read_options, file, &arena);
+        iter->SeekToFirst();
+        bool result = !iter->Valid() && !iter->status().IsOK();
+        iter->~Iterator();
+        return result;
+    };
+    ok &= opened(nullptr, nullptr) && opened("k6", nullptr) && opened(nullptr, "k4");
+    ok &= !opened("k7", nullptr) && !opened(nullptr, "k3") && !opened("k0", "k2");
+
+    std::cout << "DBIter bounds: " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// prefix_same_as_start与迭代范围同时使用: 3个带前缀bloom的memtable, 每个只包含部分前缀.
+// SeekToFirst/SeekToLast以及不在domain中的Seek不按前缀过滤, 在domain中的Seek只返回同一前缀的key,
+// Seek之后Prev也不会越过前缀或者边界.
+void testDBIterPrefixBounds() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::SliceTransform> prefix_extractor(leveldb::NewFixedPrefixTransform(2));
+    leveldb::Random rnd(302);
+    auto random_key = [&](int min_len) {
+        std::string key;
+        const int len = min_len + static_cast<int>(rnd.Uniform(3));
+        for (int i = 0; i < len; ++i) {
+            key.push_back(static_cast<char>('a' + rnd.Uniform(4)));
+        }
+        return key;
+    };
+    bool ok = true;
+    for (int trial = 0; trial < 200 && ok; ++trial) {
+        std::map<std::string, std::string> model;
+        std::vector<leveldb::MemTable *> mems;
+        for (int m = 0; m < 3; ++m) {
+            auto memtable = new leveldb::MemTable(cmp, nullptr, prefix_extractor.get(), 1 << 12);
+            memtable->Ref();
+            // 每个memtable只写入首字母为两个字符之一的key
+            const char first[2] = {static_cast<char>('a' + rnd.Uniform(4)), static_cast<char>('a' + rnd.Uniform(4))};
+            for (int i = 0; i < 15; ++i) {
+                std::string key = random_key(2);
+                key[0] = first[rnd.Uniform(2)];
+                std::string value = std::to_string(m * 100 + i);
+                memtable->Add(seqGen(), leveldb::kTypeValue, key, value);
+                model[key] = value;
+            }
+            mems.push_back(memtable);
+        }
+
+        std::string lower = random_key(1), upper = random_key(1);
+        leveldb::Slice lower_slice(lower), upper_slice(upper);
+        leveldb::ReadOptions options;
+        options.prefix_same_as_start = true;
+        options.iterate_lower_bound = rnd.OneIn(2) ? &lower_slice : nullptr;
+        options.iterate_upper_bound = rnd.OneIn(2) ? &upper_slice : nullptr;
+        auto in_bounds = [&](const std::string &key) {
+            return (options.iterate_lower_bound == nullptr || key >= lower) &&
+                   (options.iterate_upper_bound == nullptr || key < upper);
+        };
+
+        std::vector<leveldb::Iterator *> list;
+        for (leveldb::MemTable *m : mems) {
+            list.push_back(m->NewIterator(options));
+        }
+        leveldb::Iterator *iter = leveldb::NewDBIterator(
+                nullptr, nullptr, leveldb::BytewiseComparator(),
+                leveldb::NewMergingIterator(&cmp, &list[0], static_cast<int>(list.size())),
+                leveldb::kMaxSequenceNumber, rnd.Next(), nullptr, prefix_extractor.get(), options);
+
+        std::vector<std::string> expected, forward, backward;
+        for (const auto &kv : model) {
+            if (in_bounds(kv.first)) {
+                expected.push_back(kv.first);
+            }
+        }
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            forward.push_back(iter->Key().ToString());
+        }
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+            backward.push_back(iter->Key().ToString());
+        }
+        std::reverse(backward.begin(), backward.end());
+        ok &= forward == expected && backward == expected;
+
+        for (int t = 0; t < 10; ++t) {
+            // 长度为1的target不在domain中
+            const std::string target = random_key(1);
+            const bool in_domain = target.size() >= 2;
+            std::vector<std::string> seek_expected, seek_result;
+            for (const std::string &key : expected) {
+                if (key >= target && (!in_domain || key.compare(0, 2, target, 0, 2) == 0)) {
+                    seek_expected.push_back(key);
+                }
+            }
+            for (iter->Seek(target); iter->Valid(); iter->Next()) {
+                seek_result.push_back(iter->Key().ToString());
+            }
+            ok &= seek_result == seek_expected;
+
+            // Seek之后反向移动
+            iter->Seek(target);
+            if (iter->Valid()) {
+                const std::string current = iter->Key().ToString();
+                auto it = std::lower_bound(expected.begin(), expected.end(), current);
+                const bool has_prev = it != expected.begin() &&
+                                      (!in_domain || (it - 1)->compare(0, 2, target, 0, 2) == 0);
+                iter->Prev();
+                ok &= has_prev ? (iter->Valid() && iter->Key() == leveldb::Slice(*(it - 1))) : !iter->Valid();
+            }
+        }
+        ok &= iter->status().IsOK();
+        delete iter;
+        for (leveldb::MemTable *m : mems) {
+            m->Unref();
+        }
+    }
+    std::cout << "DBIter prefix + bounds: " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// DBImpl::NewIterator的迭代器树(DBIter -> 合并迭代器 -> 3个memtable迭代器)在堆上和在arena中创建的对比:
+// 每次创建一棵树, Seek之后读取几条记录再销毁, 模拟短扫描. 两种方式每轮交替先后顺序.
+// arena模式下整棵树以及memtable迭代器Seek时的key编码都在ArenaWrappedDBIter的arena(内联部分)中,
+// 每棵树只有2次堆分配(ArenaWrappedDBIter本身和DBIter的saved_key_), 堆模式7次.
+// 耗时主要是3个skiplist的Seek, 两种方式都在1.7~1.9us左右, 差别在测量误差之内.
+void benchArenaIterator() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    const int kNumMemTables = 3;
+    std::vector<leveldb::MemTable *> mems;
+    char buf[32];
+    for (int m = 0; m < kNumMemTables; ++m) {
+        auto memtable = new leveldb::MemTable(cmp);
+        memtable->Ref();
+        for (int i = 0; i < 10000; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i * kNumMemTables + m);
+            memtable->Add(seqGen(), leveldb::kTypeValue, buf, "value");
+        }
+        mems.push_back(memtable);
+    }
+
+    const int kRounds = 200000;
+    const int kScanLength = 5;
+    leveldb::ReadOptions options;
+    std::vector<leveldb::Iterator *> list;
+    auto scan = [&](leveldb::Iterator *iter, leveldb::Random *rnd) {
+        std::snprintf(buf, sizeof(buf), "key%08d", static_cast<int>(rnd->Uniform(10000 * kNumMemTables)));
+        iter->Seek(buf);
+        for (int i = 0; i < kScanLength && iter->Valid(); ++i) {
+            iter->Next();
+        }
+    };
+    auto run_heap = [&]() {
+        leveldb::Random rnd(301);
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < kRounds; ++round) {
+            list.clear();
+            for (auto m : mems) {
+                list.push_back(m->NewIterator(options));
+            }
+            leveldb::Iterator *internal_iter = leveldb::NewMergingIterator(&cmp, list.data(), list.size());
+            leveldb::Iterator *iter = leveldb::NewDBIterator(nullptr, nullptr, leveldb::BytewiseComparator(),
+                                                             internal_iter, leveldb::kMaxSequenceNumber, round);
+            scan(iter, &rnd);
+            delete iter;
+        }
+        return std::chrono::steady_clock::now() - start;
+    };
+    auto run_arena = [&]() {
+        leveldb::Random rnd(301);
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < kRounds; ++round) {
+            auto *db_iter = new leveldb::ArenaWrappedDBIter;
+            leveldb::Arena *arena = db_iter->GetArena();
+            list.clear();
+            for (auto m : mems) {
+                list.push_back(m->NewIterator(options, arena));
+            }
+            leveldb::Iterator *internal_iter = leveldb::NewMergingIterator(&cmp, list.data(), list.size(), arena);
+            db_iter->SetDBIter(leveldb::NewDBIterator(nullptr, nullptr, leveldb::BytewiseComparator(), internal_iter,
+                                                      leveldb::kMaxSequenceNumber, round, nullptr, nullptr,
+                                                      options, arena));
+            scan(db_iter, &rnd);
+            delete db_iter;
+        }
+        return std::chrono::steady_clock::now() - start;
+    };
+
+    for (int rep = 0; rep < 4; ++rep) {
+        std::chrono::steady_clock::duration heap_time, arena_time;
+        if (rep % 2 == 0) {
+            heap_time = run_heap();
+            arena_time = run_arena();
+        } else {
+            arena_time = run_arena();
+            heap_time = run_heap();
+        }
+        std::cout << "heap  : " << std::chrono::duration_cast<std::chrono::nanoseconds>(heap_time).count() / kRounds
+                  << " ns/iterator, arena : "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(arena_time).count() / kRounds
+                  << " ns/iterator" << std::endl;
+    }
+    for (auto m : mems) {
+        m->Unref();
+    }
+}
+
+void benchReverseScan() {
+    leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+    auto memtable = new leveldb::MemTable(cmp);
+    memtable->Ref();
+
+    const int kNumKeys = 500000;
+    char buf[32];
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i);
+        memtable->Add(seqGen(), leveldb::kTypeValue, buf, "value");
+    }
+
+    leveldb::Iterator *iter = memtable->NewIterator();
+    int forward_count = 0, backward_count = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ++forward_count;
+    }
+    auto middle = std::chrono::steady_clock::now();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+        ++backward_count;
+    }
+    auto end = std::chrono::steady_clock::now();
+    delete iter;
+
+    std::cout << "forward  : " << forward_count << " entries, "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(middle - start).count() / kNumKeys
+              << " ns/entry" << std::endl;
+    std::cout << "backward : " << backward_count << " entries, "
+              << std::chrono::duration_cast<std::chrono::nanoseconds>(end - middle).count() / kNumKeys
+              << " ns/entry" << std::endl;
+    memtable->Unref();
+}
+
+// 所有key都在cache中, 每个线程随机Lookup/Release, 统计不同线程数下的总吞吐.
+void benchCacheLookup(leveldb::Cache *cache, const char *name) {
+    const int kNumKeys = 100000;
+    const int kLookupsPerThread = 1000000;
+    char buf[16];
+    for (int i = 0; i < kNumKeys; ++i) {
+        leveldb::EncodeFixed32(buf, i);
+        cache->Release(cache->Insert(leveldb::Slice(buf, 4), reinterpret_cast<void *>(static_cast<uintptr_t>(i)), 1,
+                                     [](const leveldb::Slice &, void *) {}));
+    }
+
+    for (int num_threads : {1, 2, 4, 8, 16, 32, 64, 128}) {
+        std::vector<std::thread> threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([cache, t]() {
+                leveldb::Random rnd(301 + t);
+                char key[4];
+                for (int i = 0; i < kLookupsPerThread; ++i) {
+                    leveldb::EncodeFixed32(key, rnd.Uniform(kNumKeys));
+                    leveldb::Cache::Handle *h = cache->Lookup(leveldb::Slice(key, 4));
+                    if (h != nullptr) {
+                        cache->Release(h);
+                    }
+                }
+            });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1e6;
+        std::cout << name << " threads " << num_threads << " : "
+                  << static_cast<uint64_t>(num_threads * static_cast<double>(kLookupsPerThread) / seconds)
+                  << " lookups/s" << std::endl;
+    }
+}
+
+void benchCacheLookup() {
+    std::unique_ptr<leveldb::Cache> lru(leveldb::NewLRUCache(1 << 20));
+    benchCacheLookup(lru.get(), "lru");
+    std::unique_ptr<leveldb::Cache> clock(leveldb::NewClockCache(1 << 20, 1));
+    benchCacheLookup(clock.get(), "clock");
+}
+
+// 缓存模拟: zipf分布的热点访问中穿插一次性的大范围扫描, 未命中时插入, 统计热点访问的命中率.
+double simulateCache(leveldb::Cache *cache, bool with_scans) {
+    const int kNumKeys = 200000;
+    const int kNumAccesses = 2000000;
+    const int kScanInterval = 100000;
+    const int kScanLength = 30000;
+
+    std::vector<double> cdf(kNumKeys);
+    double sum = 0;
+    for (int i = 0; i < kNumKeys; ++i) {
+        sum += 1.0 / std::pow(i + 1, 0.9);
+        cdf[i] = sum;
+    }
+
+    leveldb::Random rnd(301);
+    uint32_t scan_key = kNumKeys;
+    int64_t hits = 0;
+    char key[4];
+    auto access = [&](uint32_t k) {
+        leveldb::EncodeFixed32(key, k);
+        leveldb::Cache::Handle *h = cache->Lookup(leveldb::Slice(key, 4));
+        if (h == nullptr) {
+            h = cache->Insert(leveldb::Slice(key, 4), nullptr, 1, [](const leveldb::Slice &, void *) {});
+        } else if (k < kNumKeys) {
+            ++hits;
+        }
+        cache->Release(h);
+    };
+    for (int i = 0; i < kNumAccesses; ++i) {
+        if (with_scans && i % kScanInterval == 0) {
+            for (int j = 0; j < kScanLength; ++j) {
+                access(scan_key++);
+            }
+        }
+        double r = (rnd.Next() / 2147483647.0) * sum;
+        access(static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), r) - cdf.begin()));
+    }
+    return 100.0 * hits / kNumAccesses;
+}
+
+void benchCacheAdmission() {
+    const size_t kCapacity = 10000;
+    for (bool with_scans : {false, true}) {
+        std::unique_ptr<leveldb::Cache> lru(leveldb::NewLRUCache(kCapacity));
+        std::unique_ptr<leveldb::Cache> tiny_lfu(leveldb::NewTinyLFUCache(kCapacity, 1));
+        std::cout << (with_scans ? "zipf + scans" : "zipf        ")
+                  << " lru: " << simulateCache(lru.get(), with_scans) << "%"
+                  << " tinylfu: " << simulateCache(tiny_lfu.get(), with_scans) << "%" << std::endl;
+    }
+}
+
+void testSecondaryCache() {
+    static const leveldb::Cache::CacheItemHelper helper{
+            [](void *value, std::string *out) { *out = *reinterpret_cast<std::string *>(value); },
+            [](const leveldb::Slice &data, size_t *charge) -> void * {
+                *charge = data.size();
+                return new std::string(data.ToString());
+            },
+            [](const leveldb::Slice &, void *value) { delete reinterpret_cast<std::string *>(value); }};
+
+    for (auto type : {leveldb::kNoCompression, leveldb::kSnappyCompression, leveldb::kLZ4Compression,
+                      leveldb::kZstdCompression}) {
+        std::unique_ptr<leveldb::SecondaryCache> secondary(leveldb::NewCompressedSecondaryCache(1 << 20, type));
+        std::unique_ptr<leveldb::Cache> cache(leveldb::NewLRUCache(16 * 4096, secondary.get()));
+        char key[4];
+        for (int i = 0; i < 256; ++i) {
+            leveldb::EncodeFixed32(key, i);
+            cache->Release(cache->Insert(leveldb::Slice(key, 4), new std::string(4096, 'a' + i % 26), 4096, &helper));
+        }
+        int found = 0;
+        for (int i = 0; i < 256; ++i) {
+            leveldb::EncodeFixed32(key, i);
+            leveldb::Cache::Handle *h = cache->Lookup(leveldb::Slice(key, 4), &helper);
+            if (h != nullptr) {
+                found += (*reinterpret_cast<std::string *>(cache->Value(h)) == std::string(4096, 'a' + i % 26));
+                cache->Release(h);
+            }
+        }
+        auto stats = secondary->GetStats();
+        std::cout << "type " << type << " (using " << stats.compression << "): found " << found
+                  << "/256, secondary hits " << stats.hits << " misses " << stats.misses
+                  << " usage " << stats.usage << "/" << stats.capacity << std::endl;
+    }
+}
+
+// 写入一批block后重新打开, 检查重启后仍然可以命中.
+void testPersistentCache() {
+    auto env = leveldb::Env::Default();
+    const std::string dir = "/data/persistent_cache_test";
+    auto block_key = [](uint64_t file_number, uint64_t offset) {
+        std::string key;
+        leveldb::PutFixed64(&key, file_number);
+        leveldb::PutFixed64(&key, offset);
+        return key;
+    };
+
+    auto count_found = [&](leveldb::PersistentCache *cache) {
+        int found = 0;
+        std::string data;
+        for (int i = 0; i < 256; ++i) {
+            found += cache->Lookup(block_key(7, i * 4096), &data) && data == std::string(4096, 'a' + i % 26);
+        }
+        return found;
+    };
+
+    leveldb::PersistentCache *cache;
+    auto status = leveldb::NewPersistentCache(env, dir, "db1", 4 << 20, &cache);
+    std::cout << status.ToString() << std::endl;
+    if (!status.IsOK()) {
+        return;
+    }
+    for (int i = 0; i < 256; ++i) {
+        cache->Insert(block_key(7, i * 4096), std::string(4096, 'a' + i % 26));
+    }
+    // 后台落盘跟不上时部分Insert被丢弃
+    const uint64_t inserted = cache->GetStats().inserts;
+    delete cache;
+
+    leveldb::NewPersistentCache(env, dir, "db1", 4 << 20, &cache);
+    std::cout << "warm start found " << count_found(cache) << "/" << inserted;
+    cache->EraseFile(7);
+    std::cout << ", after EraseFile found " << count_found(cache);
+    delete cache;
+
+    // 删除记录在重启后重放
+    leveldb::NewPersistentCache(env, dir, "db1", 4 << 20, &cache);
+    std::cout << ", after reopen found " << count_found(cache) << std::endl;
+    for (int i = 0; i < 256; ++i) {
+        cache->Insert(block_key(7, i * 4096), std::string(4096, 'a' + i % 26));
+    }
+    delete cache;
+
+    // 另一个DB不会命中db1的数据
+    leveldb::NewPersistentCache(env, dir, "db2", 4 << 20, &cache);
+    std::cout << "other db found " << count_found(cache) << std::endl;
+    delete cache;
+}
+
+// 模拟一次大范围扫描: 大量低优先级的data block不应冲掉高优先级的index/filter block.
+void testCachePriority() {
+    auto deleter = [](const leveldb::Slice &, void *value) { delete reinterpret_cast<std::string *>(value); };
+    for (double ratio : {0.0, 0.5}) {
+        leveldb::LRUCacheOptions options;
+        options.capacity = 16 * 64 * 1024;
+        options.high_pri_pool_ratio = ratio;
+        std::unique_ptr<leveldb::Cache> cache(leveldb::NewLRUCache(options));
+        char key[4];
+        for (int i = 0; i < 64; ++i) {
+            leveldb::EncodeFixed32(key, i);
+            cache->Release(cache->Insert(leveldb::Slice(key, 4), new std::string("index"), 4096, deleter,
+                                         leveldb::Cache::Priority::HIGH));
+        }
+        for (int i = 64; i < 64 + 4096; ++i) {
+            leveldb::EncodeFixed32(key, i);
+            cache->Release(cache->Insert(leveldb::Slice(key, 4), new std::string("data"), 4096, deleter));
+        }
+        int found = 0;
+        for (int i = 0; i < 64; ++i) {
+            leveldb::EncodeFixed32(key, i);
+            leveldb::Cache::Handle *h = cache->Lookup(leveldb::Slice(key, 4));
+            if (h != nullptr) {
+                found++;
+                cache->Release(h);
+            }
+        }
+        std::cout << "high_pri_pool_ratio " << ratio << ": high priority entries found " << found << "/64"
+                  << std::endl;
+    }
+}
+
+// 写入一个包含merge operand的sstable, 通过TableCache点查并完整扫描.
+static void checkTable(bool data_block_hash_index) {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    CounterMergeOperator counter;
+    leveldb::Options options;
+    options.comparator = &icmp;
+    options.merge_operator = &counter;
+    options.block_size = 1024;
+    options.data_block_hash_index = data_block_hash_index;
+    std::unique_ptr<leveldb::Cache> block_cache(leveldb::NewLRUCache(16 << 10));
+    options.block_cache = block_cache.get();
+
+    const int kNumKeys = 10000;
+    leveldb::WritableFile *file;
+    auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 7), &file);
+    if (!status.IsOK()) {
+        std::cout << status.ToString() << std::endl;
+        return;
+    }
+    leveldb::TableBuilder builder(options, file);
+    char buf[32];
+    std::string ikey;
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+        // 每10个key带一个merge operand
+        if (i % 10 == 0) {
+            ikey.clear();
+            leveldb::AppendInternalKey(&ikey, {buf, static_cast<leveldb::SequenceNumber>(i + 1), leveldb::kTypeMerge});
+            builder.Add(ikey, "1");
+        }
+        ikey.clear();
+        leveldb::AppendInternalKey(&ikey, {buf, static_cast<leveldb::SequenceNumber>(i), leveldb::kTypeValue});
+        builder.Add(ikey, std::to_string(i));
+    }
+    status = builder.Finish();
+    const uint64_t file_size = builder.FileSize();
+    file->Close();
+    delete file;
+    std::cout << "build: " << status.ToString() << ", " << file_size << " bytes" << std::endl;
+
+    leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+    int found = 0, operands = 0, absent = 0;
+    for (int i = 0; i < 2 * kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i);
+        leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+        leveldb::MergeContext merge_context;
+        std::string value;
+        leveldb::Status s;
+        if (table_cache.Get(leveldb::ReadOptions(), 7, file_size, lkey, &value, &s, &merge_context)) {
+            const int expected = i / 2 + (i % 20 == 0 ? 1 : 0);
+            found += (s.IsOK() && value == std::to_string(expected));
+            operands += merge_context.GetOperands().size();
+        } else {
+            absent++;
+        }
+    }
+    leveldb::Iterator *iter = table_cache.NewIterator(leveldb::ReadOptions(), 7, file_size);
+    int scanned = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        ++scanned;
+    }
+    delete iter;
+    std::cout << "hash index " << std::boolalpha << data_block_hash_index << ": found " << found << "/" << kNumKeys
+              << ", operands " << operands << ", absent " << absent << ", scanned " << scanned
+              << std::endl; // 10000/10000, 1000, 10000, 11000
+
+    // PinnableSlice: 普通value直接指向data block, 带operand的key折叠后拷贝.
+    // 持有的value在block被挤出cache, table被淘汰之后仍然有效.
+    std::vector<std::unique_ptr<leveldb::PinnableSlice>> pinned_values;
+    int pinned = 0, copied = 0, pinned_ok = 0;
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+        leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+        leveldb::MergeContext merge_context;
+        std::unique_ptr<leveldb::PinnableSlice> value(new leveldb::PinnableSlice);
+        leveldb::Status s;
+        if (table_cache.Get(leveldb::ReadOptions(), 7, file_size, lkey, value.get(), &s, &merge_context) &&
+            s.IsOK()) {
+            (value->IsPinned() ? pinned : copied)++;
+            pinned_values.push_back(std::move(value));
+        }
+    }
+    table_cache.Evict(7);
+    for (int i = 0; i < static_cast<int>(pinned_values.size()); ++i) {
+        const int expected = i + (i % 10 == 0 ? 1 : 0);
+        pinned_ok += pinned_values[i]->ToString() == std::to_string(expected);
+    }
+    pinned_values.clear();
+    std::cout << "pinnable: pinned " << pinned << ", copied " << copied << ", correct " << pinned_ok
+              << std::endl; // 9000, 1000, 10000
+
+    // GetAsync: 所有查找同时提交, data block通过ReadAsync在I/O线程中读取.
+    struct AsyncLookup {
+        std::unique_ptr<leveldb::LookupKey> lkey;
+        std::string value;
+        leveldb::Status s;
+        leveldb::MergeContext merge_context;
+        bool done = false;
+        std::atomic<int> *completed = nullptr;
+    };
+    std::vector<AsyncLookup> lookups(kNumKeys);
+    std::atomic<int> completed(0);
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+        AsyncLookup &lookup = lookups[i];
+        lookup.lkey.reset(new leveldb::LookupKey(buf, leveldb::kMaxSequenceNumber));
+        lookup.completed = &completed;
+        table_cache.GetAsync(leveldb::ReadOptions(), 7, file_size, *lookup.lkey, &lookup.value, &lookup.s,
+                             &lookup.merge_context, [](void *arg, bool done) {
+                    auto *l = reinterpret_cast<AsyncLookup *>(arg);
+                    l->done = done;
+                    l->completed->fetch_add(1, std::memory_order_release);
+                }, &lookup);
+    }
+    while (completed.load(std::memory_order_acquire) < kNumKeys) {
+        env->SleepForMicroseconds(1000);
+    }
+    int async_ok = 0;
+    for (int i = 0; i < kNumKeys; ++i) {
+        const int expected = i + (i % 10 == 0 ? 1 : 0);
+        async_ok += lookups[i].done && lookups[i].s.IsOK() && lookups[i].value == std::to_string(expected);
+    }
+    std::cout << "async: correct " << async_ok << "/" << kNumKeys << std::endl; // 10000/10000
+    env->RemoveFile(leveldb::TableFileName(dbname, 7));
+}
+
+void testTable() {
+    checkTable(false);
+    checkTable(true);
+}
+
+namespace {
+    // 只记录Prefetch的调用.
+    class PrefetchRecorder : public leveldb::RandomAccessFile {
+    public:
+        leveldb::Status Read(uint64_t /*offset*/, size_t /*n*/, leveldb::Slice * /*result*/,
+                             char * /*scratch*/) const override {
+            return leveldb::Status::NotSupported("PrefetchRecorder");
+        }
+
+        leveldb::Status Prefetch(uint64_t offset, size_t n) const override {
+            prefetches.emplace_back(offset, n);
+            return leveldb::Status::OK();
+        }
+
+        mutable std::vector<std::pair<uint64_t, size_t>> prefetches;
+    };
+}
+
+// Readahead::OnRead: 自适应模式下连续读取才开始预读, 窗口从8KB翻倍到256KB并且始终领先于读取,
+// 随机读取之后回到初始状态; 固定大小模式从第一次读取开始预读.
+void testReadahead() {
+    const size_t kBlockSize = 4096;
+    bool ok = true;
+
+    PrefetchRecorder file;
+    leveldb::Readahead readahead(&file, 0);
+    // 第一次读取不预读
+    readahead.OnRead(0, kBlockSize);
+    ok &= file.prefetches.empty() && readahead.readahead_size() == leveldb::Readahead::kInitialAutoReadaheadSize;
+    // 第二次顺序读取之后开始预读, 每一段紧接着上一段, 窗口翻倍直到上限
+    uint64_t offset = kBlockSize;
+    for (int i = 0; i < 512; ++i, offset += kBlockSize) {
+        readahead.OnRead(offset, kBlockSize);
+        ok &= readahead.prefetched_until() > offset + kBlockSize;
+    }
+    size_t expected_size = leveldb::Readahead::kInitialAutoReadaheadSize;
+    uint64_t expected_start = 2 * kBlockSize;
+    for (const auto &p : file.prefetches) {
+        ok &= p.first == expected_start && p.second == expected_size;
+        expected_start += p.second;
+        expected_size = std::min(expected_size * 2, leveldb::Readahead::kMaxAutoReadaheadSize);
+    }
+    ok &= !file.prefetches.empty() && file.prefetches.back().second == leveldb::Readahead::kMaxAutoReadaheadSize;
+    ok &= readahead.readahead_size() == leveldb::Readahead::kMaxAutoReadaheadSize;
+
+    // 在预读窗口内向前跳过一小段仍然是顺序读取
+    const size_t num_prefetches = file.prefetches.size();
+    offset += kBlockSize;
+    readahead.OnRead(offset, kBlockSize);
+    ok &= readahead.readahead_size() == leveldb::Readahead::kMaxAutoReadaheadSize;
+
+    // 随机读取: 回到初始状态, 之后需要重新积累顺序读取
+    file.prefetches.clear();
+    readahead.OnRead(100 << 20, kBlockSize);
+    ok &= file.prefetches.empty() && readahead.prefetched_until() == 0 &&
+          readahead.readahead_size() == leveldb::Readahead::kInitialAutoReadaheadSize;
+    readahead.OnRead((100 << 20) + kBlockSize, kBlockSize);
+    ok &= file.prefetches.size() == 1 && file.prefetches[0].first == (100 << 20) + 2 * kBlockSize &&
+          file.prefetches[0].second == leveldb::Readahead::kInitialAutoReadaheadSize;
+
+    // 固定大小: 第一次读取就预读, 大小不变
+    PrefetchRecorder fixed_file;
+    leveldb::Readahead fixed(&fixed_file, 64 << 10);
+    for (uint64_t off = 0; off < (1 << 20); off += kBlockSize) {
+        fixed.OnRead(off, kBlockSize);
+    }
+    ok &= !fixed_file.prefetches.empty() && fixed_file.prefetches[0].first == kBlockSize;
+    for (const auto &p : fixed_file.prefetches) {
+        ok &= p.second == (64 << 10);
+    }
+    ok &= fixed.readahead_size() == (64 << 10);
+
+    std::cout << "Readahead: " << num_prefetches << " prefetches in 2MB, " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+namespace {
+    // 不提供OrderedBytes, block内退化为解码key的二分查找.
+    class NoOrderedBytesComparator : public leveldb::InternalKeyComparator {
+    public:
+        NoOrderedBytesComparator() : leveldb::InternalKeyComparator(leveldb::BytewiseComparator()) {}
+
+        bool HasOrderedBytes() const override { return false; }
+    };
+}
+
+// block内点查(Seek到存在的key)的耗时, 对比restart点带key前缀和不带的情况.
+void benchBlockSeek() {
+    leveldb::InternalKeyComparator with_prefix(leveldb::BytewiseComparator());
+    NoOrderedBytesComparator without_prefix;
+    const int kSeeks = 2000000;
+    for (size_t block_size : {4096, 16384, 65536}) {
+        for (const leveldb::Comparator *cmp : {static_cast<const leveldb::Comparator *>(&without_prefix),
+                                                static_cast<const leveldb::Comparator *>(&with_prefix)}) {
+            leveldb::Options options;
+            options.comparator = cmp;
+            leveldb::BlockBuilder builder(&options);
+            std::vector<std::string> keys;
+            char buf[32];
+            for (int i = 0; builder.CurrentSizeEstimate() < block_size; ++i) {
+                std::snprintf(buf, sizeof(buf), "user%012d", i * 7);
+                std::string ikey;
+                leveldb::AppendInternalKey(&ikey, {buf, 100, leveldb::kTypeValue});
+                builder.Add(ikey, "value-0123456789");
+                keys.push_back(ikey);
+            }
+            leveldb::Slice raw = builder.Finish();
+            leveldb::BlockContents contents;
+            contents.data = raw;
+            contents.cachable = false;
+            contents.heap_allocated = false;
+            leveldb::Block block(contents);
+            leveldb::Iterator *iter = block.NewIterator(cmp);
+
+            leveldb::Random rnd(301);
+            int ok = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kSeeks; ++i) {
+                const std::string &target = keys[rnd.Uniform(static_cast<int>(keys.size()))];
+                iter->Seek(target);
+                ok += iter->Valid() && iter->Key() == leveldb::Slice(target);
+            }
+            auto end = std::chrono::steady_clock::now();
+            delete iter;
+            std::cout << "block " << block_size << " (" << keys.size() << " keys) "
+                      << (cmp == &with_prefix ? "key prefix   : " : "no key prefix: ")
+                      << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kSeeks
+                      << " ns/seek, " << ok << "/" << kSeeks << " found" << std::endl;
+        }
+    }
+}
+
+// restart点key前缀的计数在AVX2, SSE4.2与标量实现下必须相同, 并且等于逐个比较的结果.
+// n覆盖不是4的倍数以及大于扫描窗口的情况, 前缀有重复, 也有最高位为1的值.
+void testKeyPrefixSIMD() {
+    leveldb::Random rnd(301);
+    int checks = 0, mismatches = 0;
+    for (uint32_t n = 1; n <= 80; ++n) {
+        for (int round = 0; round < 20; ++round) {
+            std::vector<uint64_t> values(n);
+            for (auto &v : values) {
+                v = (static_cast<uint64_t>(rnd.Next()) << 33) ^ rnd.Uniform(4);
+            }
+            std::sort(values.begin(), values.end());
+            std::string prefixes;
+            for (uint64_t v : values) {
+                leveldb::PutFixed64(&prefixes, v);
+            }
+            for (int t = 0; t < 20; ++t) {
+                uint64_t target = values[rnd.Uniform(static_cast<int>(n))] + rnd.Uniform(3) - 1;
+                if (t == 0) target = 0;
+                if (t == 1) target = ~0ull;
+                uint32_t expect_lt = 0, expect_le = 0;
+                for (uint64_t v : values) {
+                    expect_lt += v < target;
+                    expect_le += v <= target;
+                }
+                for (int level : {2, 1, 0}) {
+                    leveldb::port::simd_level_for_testing.store(level);
+                    uint32_t lt, le;
+                    leveldb::CountKeyPrefixes(prefixes.data(), n, target, &lt, &le);
+                    ++checks;
+                    mismatches += lt != expect_lt || le != expect_le;
+                }
+            }
+        }
+    }
+    leveldb::port::simd_level_for_testing.store(2);
+    std::cout << "KeyPrefixSIMD: avx2 " << leveldb::port::CPUHasAVX2() << ", sse4.2 "
+              << leveldb::port::CPUHasSSE42() << ", " << checks << " checks, " << mismatches << " mismatches, "
+              << (mismatches == 0 ? "OK" : "FAILED") << std::endl;
+}
+
+// block内点查: restart点二分查找与hash索引的对比, 一半的查找命中.
+void benchBlockHashIndex() {
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    const int kLookups = 2000000;
+    for (size_t block_size : {4096, 16384, 65536}) {
+        for (bool hash_index : {false, true}) {
+            leveldb::Options options;
+            options.comparator = &icmp;
+            leveldb::BlockBuilder builder(&options, hash_index);
+            int num_keys = 0;
+            char buf[32];
+            for (; builder.CurrentSizeEstimate() < block_size; ++num_keys) {
+                std::snprintf(buf, sizeof(buf), "user%012d", num_keys * 2);
+                std::string ikey;
+                leveldb::AppendInternalKey(&ikey, {buf, 100, leveldb::kTypeValue});
+                builder.Add(ikey, "value-0123456789");
+            }
+            leveldb::Slice raw = builder.Finish();
+            const size_t encoded_size = raw.size();
+            leveldb::BlockContents contents;
+            contents.data = raw;
+            contents.cachable = false;
+            contents.heap_allocated = false;
+            leveldb::Block block(contents);
+            leveldb::Iterator *iter = block.NewIterator(&icmp);
+
+            std::vector<leveldb::LookupKey *> targets;
+            leveldb::Random rnd(301);
+            for (int i = 0; i < 1024; ++i) {
+                std::snprintf(buf, sizeof(buf), "user%012d", static_cast<int>(rnd.Uniform(2 * num_keys)));
+                targets.push_back(new leveldb::LookupKey(buf, leveldb::kMaxSequenceNumber));
+            }
+            int found = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kLookups; ++i) {
+                const leveldb::LookupKey *target = targets[i & 1023];
+                if (block.SeekForGet(iter, target->internal_key()) && iter->Valid() &&
+                    leveldb::ExtractUserKey(iter->Key()) == target->user_key()) {
+                    ++found;
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            delete iter;
+            for (auto *target : targets) {
+                delete target;
+            }
+            std::cout << "block " << block_size << " (" << num_keys << " keys, " << encoded_size << " bytes) "
+                      << (hash_index ? "hash index: " : "binary search: ")
+                      << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kLookups
+                      << " ns/get, " << found << "/" << kLookups << " found" << std::endl;
+        }
+    }
+}
+
+namespace {
+    // 保存每个key的hash, 没有误判之外的假阴性, 只用于测试filter的读取路径.
+    class KeyHashFilterPolicy : public leveldb::FilterPolicy {
+    public:
+        const char *Name() const override { return "test.KeyHashFilter"; }
+
+        void CreateFilter(const leveldb::Slice *keys, int n, std::string *dst) const override {
+            for (int i = 0; i < n; ++i) {
+                leveldb::PutFixed32(dst, leveldb::Hash(keys[i].data(), keys[i].size(), 0));
+            }
+        }
+
+        bool KeyMayMatch(const leveldb::Slice &key, const leveldb::Slice &filter) const override {
+            const uint32_t h = leveldb::Hash(key.data(), key.size(), 0);
+            for (size_t i = 0; i + 4 <= filter.size(); i += 4) {
+                if (leveldb::DecodeFixed32(filter.data() + i) == h) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+}
+
+// index和filter分区: 很小的block cache迫使分区被反复淘汰和读取, 结果应该与不分区时一致.
+void testPartitionedIndex() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    KeyHashFilterPolicy key_hash;
+    leveldb::InternalFilterPolicy filter_policy(&key_hash);
+    const int kNumKeys = 50000;
+
+    for (bool partitioned : {false, true}) {
+        leveldb::LRUCacheOptions cache_options;
+        cache_options.capacity = 64 << 10;
+        cache_options.high_pri_pool_ratio = 0.5;
+        std::unique_ptr<leveldb::Cache> block_cache(leveldb::NewLRUCache(cache_options));
+        leveldb::Options options;
+        options.comparator = &icmp;
+        options.filter_policy = &filter_policy;
+        options.block_cache = block_cache.get();
+        options.partition_index_and_filters = partitioned;
+        options.metadata_block_size = 512;
+
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        leveldb::TableBuilder builder(options, file);
+        char buf[32];
+        for (int i = 0; i < kNumKeys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+            std::string ikey;
+            leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+            builder.Add(ikey, std::to_string(i));
+        }
+        status = builder.Finish();
+        const uint64_t file_size = builder.FileSize();
+        file->Close();
+        delete file;
+
+        leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+        int found = 0, absent = 0, seek_ok = 0;
+        for (int i = 0; i < 2 * kNumKeys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            leveldb::MergeContext merge_context;
+            std::string value;
+            leveldb::Status s;
+            if (table_cache.Get(leveldb::ReadOptions(), 9, file_size, lkey, &value, &s, &merge_context)) {
+                found += (s.IsOK() && value == std::to_string(i / 2));
+            } else {
+                absent++;
+            }
+        }
+
+        leveldb::Table *table = nullptr;
+        leveldb::Iterator *iter = table_cache.NewIterator(leveldb::ReadOptions(), 9, file_size, &table);
+        leveldb::Random rnd(301);
+        uint64_t last_offset = 0;
+        bool offsets_ordered = true;
+        for (int i = 0; i < 1000; ++i) {
+            const int k = static_cast<int>(rnd.Uniform(2 * kNumKeys - 1));
+            std::snprintf(buf, sizeof(buf), "key%08d", k);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            iter->Seek(lkey.internal_key());
+            // 第一个 >= target 的key是k向上取偶数
+            std::snprintf(buf, sizeof(buf), "key%08d", (k + 1) / 2 * 2);
+            seek_ok += iter->Valid() && leveldb::ExtractUserKey(iter->Key()) == leveldb::Slice(buf);
+        }
+        for (int i = 0; i < 2 * kNumKeys; i += 997) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            const uint64_t offset = table->ApproximateOffsetOf(lkey.internal_key());
+            offsets_ordered = offsets_ordered && offset >= last_offset;
+            last_offset = offset;
+        }
+        int scanned = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            ++scanned;
+        }
+        delete iter;
+        std::cout << "partitioned " << std::boolalpha << partitioned << ": " << file_size << " bytes, found " << found
+                  << ", absent " << absent << ", seek " << seek_ok << "/1000, scanned " << scanned
+                  << ", offsets ordered " << offsets_ordered << std::endl; // 50000, 50000, 1000, 50000, true
+        env->RemoveFile(leveldb::TableFileName(dbname, 9));
+    }
+}
+
+// filter的名字包含prefix_extractor: 读取时prefix_extractor不同或者文件中的filter没有前缀,
+// prefix seek不能用filter跳过文件, 否则会漏掉数据. 只有偶数前缀"pNNN"的key, 在奇数前缀上prefix seek.
+void testPrefixFilterName() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(10));
+    std::unique_ptr<const leveldb::SliceTransform> prefix4(leveldb::NewFixedPrefixTransform(4));
+    std::unique_ptr<const leveldb::SliceTransform> prefix3(leveldb::NewFixedPrefixTransform(3));
+    leveldb::InternalFilterPolicy key_only_policy(bloom.get());
+    leveldb::InternalFilterPolicy prefix4_policy(bloom.get(), prefix4.get());
+    leveldb::InternalFilterPolicy prefix3_policy(bloom.get(), prefix3.get());
+    char buf[32];
+
+    struct Case {
+        const leveldb::InternalFilterPolicy *write_policy;
+        const leveldb::InternalFilterPolicy *read_policy;
+        bool expect_filtered;
+    };
+    const Case cases[] = {
+            {&prefix4_policy,  &prefix4_policy, true},
+            {&prefix4_policy,  &prefix3_policy, false},   // 找不到filter
+            {&key_only_policy, &prefix4_policy, false},   // 只用于完整key
+    };
+    for (const Case &c : cases) {
+        leveldb::Options options;
+        options.comparator = &icmp;
+        options.filter_policy = c.write_policy;
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        leveldb::TableBuilder builder(options, file);
+        for (int p = 0; p < 200; p += 2) {
+            for (int i = 0; i < 100; ++i) {
+                std::snprintf(buf, sizeof(buf), "p%03d-%05d", p, i);
+                std::string ikey;
+                leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+                builder.Add(ikey, "v");
+            }
+        }
+        status = builder.Finish();
+        const uint64_t file_size = builder.FileSize();
+        file->Close();
+        delete file;
+
+        options.filter_policy = c.read_policy;
+        leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+        leveldb::ReadOptions read_options;
+        read_options.prefix_same_as_start = true;
+        leveldb::Iterator *iter = table_cache.NewIterator(read_options, 9, file_size);
+        int filtered = 0;
+        for (int p = 1; p < 199; p += 2) {
+            std::snprintf(buf, sizeof(buf), "p%03d-", p);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            iter->SeekForPrefix(lkey.internal_key());
+            filtered += !iter->Valid();
+        }
+        delete iter;
+        int found = 0;
+        for (int p = 0; p < 200; p += 2) {
+            std::snprintf(buf, sizeof(buf), "p%03d-%05d", p, p % 100);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            leveldb::MergeContext merge_context;
+            std::string value;
+            leveldb::Status s;
+            found += table_cache.Get(leveldb::ReadOptions(), 9, file_size, lkey, &value, &s, &merge_context) &&
+                     s.IsOK();
+        }
+        // 有前缀filter时绝大多数奇数前缀被跳过(bloom有少量误判), 否则一个都不跳过
+        const bool ok = c.expect_filtered ? filtered > 90 : filtered == 0;
+        std::cout << c.write_policy->Name() << " -> " << c.read_policy->Name() << ": filtered " << filtered
+                  << "/99, found " << found << "/100 " << (ok && found == 100 ? "OK" : "FAILED") << std::endl;
+        env->RemoveFile(leveldb::TableFileName(dbname, 9));
+    }
+}
+
+// sstable迭代器: Seek不使用前缀filter, 只有SeekForPrefix使用;
+// 设置iterate_upper_bound时不打开只包含上界之外的key的data block.
+void testTableIterateBounds() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(10));
+    std::unique_ptr<const leveldb::SliceTransform> prefix4(leveldb::NewFixedPrefixTransform(4));
+    leveldb::InternalFilterPolicy policy(bloom.get(), prefix4.get());
+    leveldb::Options options;
+    options.comparator = &icmp;
+    options.filter_policy = &policy;
+    options.block_size = 1024;
+    char buf[32];
+
+    leveldb::WritableFile *file;
+    auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 11), &file);
+    if (!status.IsOK()) {
+        std::cout << status.ToString() << std::endl;
+        return;
+    }
+    leveldb::TableBuilder builder(options, file);
+    for (int p = 0; p < 200; p += 2) {
+        for (int i = 0; i < 100; ++i) {
+            std::snprintf(buf, sizeof(buf), "p%03d-%05d", p, i);
+            std::string ikey;
+            leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+            builder.Add(ikey, "v");
+        }
+    }
+    status = builder.Finish();
+    const uint64_t file_size = builder.FileSize();
+    file->Close();
+    delete file;
+    leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+    bool ok = status.IsOK();
+
+    // 前缀不存在时Seek仍然停在下一个key上, SeekForPrefix被filter跳过
+    leveldb::ReadOptions prefix_options;
+    prefix_options.prefix_same_as_start = true;
+    leveldb::Iterator *iter = table_cache.NewIterator(prefix_options, 11, file_size);
+    int seek_ok = 0, filtered = 0;
+    for (int p = 1; p < 199; p += 2) {
+        std::snprintf(buf, sizeof(buf), "p%03d-", p);
+        leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+        iter->Seek(lkey.internal_key());
+        std::snprintf(buf, sizeof(buf), "p%03d-00000", p + 1);
+        seek_ok += iter->Valid() && leveldb::ExtractUserKey(iter->Key()) == leveldb::Slice(buf);
+        iter->SeekForPrefix(lkey.internal_key());
+        filtered += !iter->Valid();
+    }
+    delete iter;
+    ok &= seek_ok == 99 && filtered > 90;
+
+    // 上界之前的key全部返回, 之后最多再返回上界所在block中剩下的key
+    const leveldb::Slice upper("p010-");
+    leveldb::ReadOptions bound_options;
+    bound_options.iterate_upper_bound = &upper;
+    iter = table_cache.NewIterator(bound_options, 11, file_size);
+    int below = 0, beyond = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        (leveldb::ExtractUserKey(iter->Key()).compare(upper) < 0 ? below : beyond)++;
+    }
+    ok &= iter->status().IsOK();
+    delete iter;
+    ok &= below == 500 && beyond < 100;
+
+    std::cout << "table iterate bounds: seek " << seek_ok << "/99, filtered " << filtered << "/99, below " << below
+              << ", beyond " << beyond << " " << (ok ? "OK" : "FAILED") << std::endl;
+    env->RemoveFile(leveldb::TableFileName(dbname, 11));
+}
+
+namespace {
+    // 原始leveldb的bloom filter: probe分布在整个位数组上, 作为对比.
+    class StandardBloomFilterPolicy : public leveldb::FilterPolicy {
+    public:
+        explicit StandardBloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
+            k_ = static_cast<size_t>(bits_per_key * 0.69);
+            k_ = std::max<size_t>(1, std::min<size_t>(30, k_));
+        }
+
+        const char *Name() const override { return "test.StandardBloomFilter"; }
+
+        void CreateFilter(const leveldb::Slice *keys, int n, std::string *dst) const override {
+            size_t bits = std::max<size_t>(64, n * bits_per_key_);
+            const size_t bytes = (bits + 7) / 8;
+            bits = bytes * 8;
+            const size_t init_size = dst->size();
+            dst->resize(init_size + bytes, 0);
+            dst->push_back(static_cast<char>(k_));
+            char *array = &(*dst)[init_size];
+            for (int i = 0; i < n; i++) {
+                uint32_t h = leveldb::Hash(keys[i].data(), keys[i].size(), 0xbc9f1d34);
+                const uint32_t delta = (h >> 17) | (h << 15);
+                for (size_t j = 0; j < k_; j++) {
+                    const uint32_t bitpos = h % bits;
+                    array[bitpos / 8] |= (1 << (bitpos % 8));
+                    h += delta;
+                }
+            }
+        }
+
+        bool KeyMayMatch(const leveldb::Slice &key, const leveldb::Slice &filter) const override {
+            const size_t len = filter.size();
+            if (len < 2) {
+                return false;
+            }
+            const char *array = filter.data();
+            const size_t bits = (len - 1) * 8;
+            const size_t k = array[len - 1];
+            uint32_t h = leveldb::Hash(key.data(), key.size(), 0xbc9f1d34);
+            const uint32_t delta = (h >> 17) | (h << 15);
+            for (size_t j = 0; j < k; j++) {
+                const uint32_t bitpos = h % bits;
+                if ((array[bitpos / 8] & (1 << (bitpos % 8))) == 0) {
+                    return false;
+                }
+                h += delta;
+            }
+            return true;
+        }
+
+    private:
+        size_t bits_per_key_;
+        size_t k_;
+    };
+}
+
+// 误判率和查询耗时: 一个400万key的filter(远大于L2), 以及sstable中常见的每个filter几百个key.
+void benchBloomFilter() {
+    const int kQueries = 1000000;
+    char buf[32];
+    for (int num_keys : {4000000, 500}) {
+        std::vector<std::string> keys, absent;
+        for (int i = 0; i < num_keys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%012d", i * 2);
+            keys.emplace_back(buf);
+        }
+        leveldb::Random rnd(301);
+        for (int i = 0; i < kQueries; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%012d", static_cast<int>(rnd.Uniform(2 * num_keys)) | 1);
+            absent.emplace_back(buf);
+        }
+        std::vector<leveldb::Slice> key_slices(keys.begin(), keys.end());
+        for (int bits_per_key : {6, 10, 16}) {
+            std::unique_ptr<const leveldb::FilterPolicy> blocked(leveldb::NewBloomFilterPolicy(bits_per_key));
+            StandardBloomFilterPolicy standard(bits_per_key);
+            for (const leveldb::FilterPolicy *policy : {static_cast<const leveldb::FilterPolicy *>(&standard),
+                                                        blocked.get()}) {
+                std::string filter;
+                policy->CreateFilter(key_slices.data(), num_keys, &filter);
+                int false_negatives = 0;
+                for (const auto &key : keys) {
+                    false_negatives += !policy->KeyMayMatch(key, filter);
+                }
+                int false_positives = 0;
+                auto start = std::chrono::steady_clock::now();
+                for (const auto &key : absent) {
+                    false_positives += policy->KeyMayMatch(key, filter);
+                }
+                auto end = std::chrono::steady_clock::now();
+                std::cout << num_keys << " keys, " << bits_per_key << " bits/key, " << policy->Name() << ": fp "
+                          << 100.0 * false_positives / kQueries << "%, "
+                          << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kQueries
+                          << " ns/query, false negatives " << false_negatives << std::endl;
+            }
+        }
+    }
+}
+
+// bloom filter查询的AVX2与标量实现对同样的key和filter必须给出相同的结果.
+// 除了正常构建的filter, 还用随机内容的filter和1~30个probe覆盖不足8个以及多轮probe的情况.
+void testBloomFilterSIMD() {
+    std::unique_ptr<const leveldb::FilterPolicy> policy(leveldb::NewBloomFilterPolicy(10));
+    leveldb::Random rnd(301);
+    char buf[32];
+    std::vector<std::string> keys;
+    for (int i = 0; i < 5000; ++i) {
+        std::snprintf(buf, sizeof(buf), "key%012d", i);
+        keys.emplace_back(buf);
+    }
+    std::vector<std::string> filters;
+    for (int n : {1, 100, 2500}) {
+        std::vector<leveldb::Slice> key_slices(keys.begin(), keys.begin() + n);
+        std::string filter;
+        policy->CreateFilter(key_slices.data(), n, &filter);
+        filters.push_back(filter);
+    }
+    for (int num_probes = 1; num_probes <= 30; ++num_probes) {
+        std::string filter;
+        for (int i = 0; i < 64 * 4; ++i) {
+            // 大约7/8的位为1, 多个probe才有机会全部命中
+            filter.push_back(static_cast<char>(rnd.Next() | rnd.Next() | rnd.Next()));
+        }
+        filter.push_back(static_cast<char>(num_probes));
+        filters.push_back(filter);
+    }
+    int checks = 0, matches = 0, mismatches = 0;
+    for (const auto &filter : filters) {
+        for (const auto &key : keys) {
+            bool result[2];
+            for (int level : {2, 0}) {
+                leveldb::port::simd_level_for_testing.store(level);
+                result[level == 0] = policy->KeyMayMatch(key, filter);
+            }
+            ++checks;
+            matches += result[0];
+            mismatches += result[0] != result[1];
+        }
+    }
+    leveldb::port::simd_level_for_testing.store(2);
+    std::cout << "BloomFilterSIMD: avx2 " << leveldb::port::CPUHasAVX2() << ", " << checks << " checks, "
+              << matches << " matches, " << mismatches << " mismatches, " << (mismatches == 0 ? "OK" : "FAILED")
+              << std::endl;
+}
+
+// 相同bits_per_key参数下binary fuse filter与bloom filter的大小, 误判率, 构建和查询耗时;
+// 以及bottommost的sstable使用bottommost_filter_policy时读取路径的正确性.
+void benchXorFilter() {
+    const int kQueries = 1000000;
+    char buf[32];
+    for (int num_keys : {4000000, 5000}) {
+        std::vector<std::string> keys, absent;
+        for (int i = 0; i < num_keys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%012d", i * 2);
+            keys.emplace_back(buf);
+        }
+        leveldb::Random rnd(301);
+        for (int i = 0; i < kQueries; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%012d", static_cast<int>(rnd.Uniform(2 * num_keys)) | 1);
+            absent.emplace_back(buf);
+        }
+        std::vector<leveldb::Slice> key_slices(keys.begin(), keys.end());
+        for (int bits_per_key : {6, 10, 16}) {
+            std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(bits_per_key));
+            std::unique_ptr<const leveldb::FilterPolicy> xor_filter(leveldb::NewXorFilterPolicy(bits_per_key));
+            for (const leveldb::FilterPolicy *policy : {bloom.get(), xor_filter.get()}) {
+                std::string filter;
+                auto start = std::chrono::steady_clock::now();
+                policy->CreateFilter(key_slices.data(), num_keys, &filter);
+                auto end = std::chrono::steady_clock::now();
+                const auto build_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                int false_negatives = 0;
+                for (const auto &key : keys) {
+                    false_negatives += !policy->KeyMayMatch(key, filter);
+                }
+                int false_positives = 0;
+                start = std::chrono::steady_clock::now();
+                for (const auto &key : absent) {
+                    false_positives += policy->KeyMayMatch(key, filter);
+                }
+                end = std::chrono::steady_clock::now();
+                std::cout << num_keys << " keys, " << bits_per_key << " bits/key, " << policy->Name() << ": "
+                          << 8.0 * filter.size() / num_keys << " bits/key, fp "
+                          << 100.0 * false_positives / kQueries << "%, build " << build_ns / num_keys
+                          << " ns/key, query "
+                          << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kQueries
+                          << " ns, false negatives " << false_negatives << std::endl;
+            }
+        }
+    }
+
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(10));
+    std::unique_ptr<const leveldb::FilterPolicy> xor_filter(leveldb::NewXorFilterPolicy(10));
+    leveldb::InternalFilterPolicy filter_policy(bloom.get());
+    leveldb::InternalFilterPolicy bottommost_filter_policy(xor_filter.get());
+    const int kNumKeys = 50000;
+    for (bool bottommost : {false, true}) {
+        leveldb::Options options;
+        options.comparator = &icmp;
+        options.filter_policy = &filter_policy;
+        options.bottommost_filter_policy = &bottommost_filter_policy;
+        // bottommost_filter_policy只在整个文件一个filter时生效
+        options.whole_file_filter = true;
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        leveldb::TableBuilder builder(options, file, bottommost);
+        for (int i = 0; i < kNumKeys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+            std::string ikey;
+            leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+            builder.Add(ikey, std::to_string(i));
+        }
+        status = builder.Finish();
+        const uint64_t file_size = builder.FileSize();
+        file->Close();
+        delete file;
+
+        leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+        int found = 0, absent = 0;
+        for (int i = 0; i < 2 * kNumKeys; ++i) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            leveldb::MergeContext merge_context;
+            std::string value;
+            leveldb::Status s;
+            if (table_cache.Get(leveldb::ReadOptions(), 9, file_size, lkey, &value, &s, &merge_context)) {
+                found += (s.IsOK() && value == std::to_string(i / 2));
+            } else {
+                absent++;
+            }
+        }
+        std::cout << "bottommost " << std::boolalpha << bottommost << ": " << file_size << " bytes, found " << found
+                  << ", absent " << absent << std::endl; // 50000, 50000
+        env->RemoveFile(leveldb::TableFileName(dbname, 9));
+    }
+}
+
+// 每种filter布局下最底层文件的大小: 每2KB一个filter和filter分区时bottommost_filter_policy不生效,
+// 文件大小不变; 整个文件一个filter时XOR filter让最底层文件更小. 同时检查所有key都能读到.
+void testBottommostFilterSize() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(10));
+    std::unique_ptr<const leveldb::FilterPolicy> xor_filter(leveldb::NewXorFilterPolicy(10));
+    leveldb::InternalFilterPolicy filter_policy(bloom.get());
+    leveldb::InternalFilterPolicy bottommost_filter_policy(xor_filter.get());
+    const int kNumKeys = 50000;
+    char buf[32];
+    bool ok = true;
+    for (int layout = 0; layout < 3; ++layout) {
+        const char *names[] = {"per 2KB", "whole file", "partitioned"};
+        uint64_t sizes[2];
+        for (bool bottommost : {false, true}) {
+            leveldb::Options options;
+            options.comparator = &icmp;
+            options.filter_policy = &filter_policy;
+            options.bottommost_filter_policy = &bottommost_filter_policy;
+            options.whole_file_filter = layout == 1;
+            options.partition_index_and_filters = layout == 2;
+            // 不压缩, 文件大小的差别只来自filter
+            options.compressionType = leveldb::kNoCompression;
+            leveldb::WritableFile *file;
+            auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+            if (!status.IsOK()) {
+                std::cout << status.ToString() << std::endl;
+                return;
+            }
+            leveldb::TableBuilder builder(options, file, bottommost);
+            for (int i = 0; i < kNumKeys; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+                std::string ikey;
+                leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+                builder.Add(ikey, std::to_string(i));
+            }
+            status = builder.Finish();
+            sizes[bottommost] = builder.FileSize();
+            file->Close();
+            delete file;
+
+            leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+            int found = 0;
+            for (int i = 0; i < kNumKeys; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+                leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+                leveldb::MergeContext merge_context;
+                std::string value;
+                leveldb::Status s;
+                if (table_cache.Get(leveldb::ReadOptions(), 9, sizes[bottommost], lkey, &value, &s, &merge_context)) {
+                    found += (s.IsOK() && value == std::to_string(i));
+                }
+            }
+            ok &= status.IsOK() && found == kNumKeys;
+            env->RemoveFile(leveldb::TableFileName(dbname, 9));
+        }
+        ok &= layout == 1 ? sizes[1] < sizes[0] : sizes[1] == sizes[0];
+        std::cout << names[layout] << ": " << sizes[0] << " bytes, bottommost " << sizes[1] << " bytes"
+                  << std::endl;
+    }
+    std::cout << "BottommostFilterSize: " << (ok ? "OK" : "FAILED") << std::endl;
+}
+
+// 不存在的key的Get耗时: 每2KB一个filter需要先在index中定位data block, 整个文件一个filter时只查询一次filter.
+void benchWholeFileFilter() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    std::unique_ptr<const leveldb::FilterPolicy> bloom(leveldb::NewBloomFilterPolicy(10));
+    leveldb::InternalFilterPolicy filter_policy(bloom.get());
+    const int kNumKeys = 200000;
+    const int kLookups = 1000000;
+    char buf[32];
+
+    for (bool partitioned : {false, true}) {
+        for (bool whole_file : {false, true}) {
+            std::unique_ptr<leveldb::Cache> block_cache(leveldb::NewLRUCache(64 << 20));
+            leveldb::Options options;
+            options.comparator = &icmp;
+            options.filter_policy = &filter_policy;
+            options.block_cache = block_cache.get();
+            options.partition_index_and_filters = partitioned;
+            options.whole_file_filter = whole_file;
+
+            leveldb::WritableFile *file;
+            auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+            if (!status.IsOK()) {
+                std::cout << status.ToString() << std::endl;
+                return;
+            }
+            leveldb::TableBuilder builder(options, file);
+            for (int i = 0; i < kNumKeys; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", i * 2);
+                std::string ikey;
+                leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+                builder.Add(ikey, std::to_string(i));
+            }
+            status = builder.Finish();
+            const uint64_t file_size = builder.FileSize();
+            file->Close();
+            delete file;
+
+            leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+            int found = 0, absent = 0;
+            for (int i = 0; i < 2 * kNumKeys; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", i);
+                leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+                leveldb::MergeContext merge_context;
+                std::string value;
+                leveldb::Status s;
+                if (table_cache.Get(leveldb::ReadOptions(), 9, file_size, lkey, &value, &s, &merge_context)) {
+                    found += (s.IsOK() && value == std::to_string(i / 2));
+                } else {
+                    absent++;
+                }
+            }
+
+            std::vector<leveldb::LookupKey *> targets;
+            leveldb::Random rnd(301);
+            for (int i = 0; i < 1024; ++i) {
+                std::snprintf(buf, sizeof(buf), "key%08d", static_cast<int>(rnd.Uniform(2 * kNumKeys)) | 1);
+                targets.push_back(new leveldb::LookupKey(buf, leveldb::kMaxSequenceNumber));
+            }
+            int misses = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < kLookups; ++i) {
+                leveldb::MergeContext merge_context;
+                std::string value;
+                leveldb::Status s;
+                misses += !table_cache.Get(leveldb::ReadOptions(), 9, file_size, *targets[i & 1023], &value, &s,
+                                           &merge_context);
+            }
+            auto end = std::chrono::steady_clock::now();
+            for (auto *target : targets) {
+                delete target;
+            }
+            std::cout << "partitioned " << std::boolalpha << partitioned << ", whole file filter " << whole_file
+                      << ": " << file_size << " bytes, found " << found << ", absent " << absent << ", miss "
+                      << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kLookups
+                      << " ns/get (" << misses << "/" << kLookups << " filtered or absent)" << std::endl;
+            env->RemoveFile(leveldb::TableFileName(dbname, 9));
+        }
+    }
+}
+
+// 小的JSON value在各种压缩方式下的文件大小, 构建和读取耗时. 压缩库由CMake的LEVELDB_WITH_SNAPPY/LZ4/ZSTD
+// 查找并定义HAVE_SNAPPY/HAVE_LZ4/HAVE_ZSTD, 没有链接的压缩方式报告为不可用并跳过.
+void benchCompression() {
+    auto env = leveldb::Env::Default();
+    const std::string dbname = "/data/table_test";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    const int kNumKeys = 200000;
+    const int kLookups = 200000;
+    static const char *kNames[] = {"alice", "bob", "carol", "dave", "eve", "mallory", "trent", "peggy"};
+    static const char *kCities[] = {"Beijing", "Shanghai", "Shenzhen", "Hangzhou", "Chengdu", "Wuhan"};
+    leveldb::Random rnd(301);
+    std::vector<std::string> values;
+    char buf[256];
+    for (int i = 0; i < kNumKeys; ++i) {
+        std::snprintf(buf, sizeof(buf),
+                      R"({"id":%d,"name":"%s","age":%d,"city":"%s","active":%s,"score":%u.%02u,"tags":["user","v%d"]})",
+                      i, kNames[rnd.Uniform(8)], 18 + static_cast<int>(rnd.Uniform(60)), kCities[rnd.Uniform(6)],
+                      rnd.OneIn(2) ? "true" : "false", rnd.Uniform(1000), rnd.Uniform(100),
+                      static_cast<int>(rnd.Uniform(4)));
+        values.emplace_back(buf);
+    }
+
+    struct Config {
+        const char *name;
+        leveldb::CompressionType type;
+        int level;
+        size_t max_dict_bytes;
+    };
+    const Config configs[] = {
+            {"none", leveldb::kNoCompression, 0, 0},
+            {"snappy", leveldb::kSnappyCompression, 0, 0},
+            {"lz4", leveldb::kLZ4Compression, 0, 0},
+            {"lz4hc 9", leveldb::kLZ4Compression, 9, 0},
+            {"zstd", leveldb::kZstdCompression, 0, 0},
+            {"zstd 9", leveldb::kZstdCompression, 9, 0},
+            {"zstd + 16KB dict", leveldb::kZstdCompression, 0, 16 << 10},
+            {"zstd 9 + 16KB dict", leveldb::kZstdCompression, 9, 16 << 10},
+    };
+    for (const Config &config : configs) {
+        if (!leveldb::CompressionTypeSupported(config.type)) {
+            std::cout << config.name << ": not available in this build, skipped" << std::endl;
+            continue;
+        }
+        leveldb::Options options;
+        options.comparator = &icmp;
+        options.compressionType = config.type;
+        options.compression_level = config.level;
+        options.compression_max_dict_bytes = config.max_dict_bytes;
+
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, 9), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        leveldb::TableBuilder builder(options, file);
+        for (int i = 0; i < kNumKeys; ++i) {
+            std::snprintf(buf, sizeof(buf), "user%08d", i);
+            std::string ikey;
+            leveldb::AppendInternalKey(&ikey, {buf, 1, leveldb::kTypeValue});
+            builder.Add(ikey, values[i]);
+        }
+        status = builder.Finish();
+        auto end = std::chrono::steady_clock::now();
+        const auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        const uint64_t file_size = builder.FileSize();
+        file->Close();
+        delete file;
+
+        // 不使用block cache, 每次Get都要读取并解压block
+        leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+        int found = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kLookups; ++i) {
+            const int k = static_cast<int>(rnd.Uniform(kNumKeys));
+            std::snprintf(buf, sizeof(buf), "user%08d", k);
+            leveldb::LookupKey lkey(buf, leveldb::kMaxSequenceNumber);
+            leveldb::MergeContext merge_context;
+            std::string value;
+            leveldb::Status s;
+            if (table_cache.Get(leveldb::ReadOptions(), 9, file_size, lkey, &value, &s, &merge_context)) {
+                found += (s.IsOK() && value == values[k]);
+            }
+        }
+        end = std::chrono::steady_clock::now();
+        leveldb::Iterator *iter = table_cache.NewIterator(leveldb::ReadOptions(), 9, file_size);
+        int scanned = 0;
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            scanned += (iter->Value() == leveldb::Slice(values[scanned]));
+        }
+        delete iter;
+        std::cout << config.name << ": " << status.ToString() << ", " << file_size << " bytes, build " << build_ms
+                  << " ms, get "
+                  << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / kLookups
+                  << " ns, found " << found << "/" << kLookups << ", scanned " << scanned << std::endl;
+        env->RemoveFile(leveldb::TableFileName(dbname, 9));
+    }
+}
+
+// sstable阶段的MultiGet与逐个Version::Get比较: 一个L0文件(每10个key更新一次)和一个L1文件,
+// 每批150个key, 分别在key随机分布和集中在一小段范围内时, 有无block cache的情况下计时.
+void benchSstMultiGet() {
+    auto env = leveldb::Env::Default();
+    std::string dbname;
+    env->GetTestDirectory(&dbname);
+    dbname += "/sst_multiget_bench";
+    env->CreateDir(dbname);
+    leveldb::InternalKeyComparator icmp(leveldb::BytewiseComparator());
+    const int kNumKeys = 200000;
+    const int kBatchSize = 150;
+    const int kRounds = 2000;
+
+    leveldb::Options build_options;
+    build_options.comparator = &icmp;
+    leveldb::VersionEdit edit;
+    char buf[32];
+    for (int level = 1; level >= 0; --level) {
+        const uint64_t number = 10 + level;
+        leveldb::WritableFile *file;
+        auto status = env->NewWritableFile(leveldb::TableFileName(dbname, number), &file);
+        if (!status.IsOK()) {
+            std::cout << status.ToString() << std::endl;
+            return;
+        }
+        leveldb::TableBuilder builder(build_options, file);
+        leveldb::InternalKey smallest, largest;
+        bool empty = true;
+        for (int i = 0; i < kNumKeys; i += (level == 0 ? 10 : 1)) {
+            std::snprintf(buf, sizeof(buf), "key%08d", i);
+            leveldb::InternalKey ikey(buf, 2 - level, leveldb::kTypeValue);
+            builder.Add(ikey.Encode(), std::string(100, static_cast<char>('a' + level)) + std::to_string(i));
+            if (empty) {
+                smallest = ikey;
+                empty = false;
+            }
+            largest = ikey;
+        }
+        builder.Finish();
+        file->Close();
+        delete file;
+        edit.AddFile(level, number, builder.FileSize(), smallest, largest);
+    }
+
+    for (int cached = 0; cached < 2; ++cached) {
+        std::unique_ptr<leveldb::Cache> block_cache(cached ? leveldb::NewLRUCache(256 << 20) : nullptr);
+        leveldb::Options options = build_options;
+        options.block_cache = block_cache.get();
+        leveldb::TableCache table_cache(dbname, options, leveldb::BytewiseComparator(), 10);
+        leveldb::VersionSet versions(dbname, &options, &table_cache, &icmp);
+        leveldb::port::Mutex mu;
+        mu.Lock();
+        versions.MarkFileNumberUsed(11);
+        leveldb::VersionEdit apply = edit;
+        versions.LogAndApply(&apply, &mu);
+        mu.Unlock();
+        leveldb::Version *current = versions.current();
+
+        for (int clustered = 0; clustered < 2; ++clustered) {
+            leveldb::Random rnd(301);
+            std::chrono::nanoseconds get_time(0), multiget_time(0);
+            bool same = true;
+            for (int round = 0; round < kRounds; ++round) {
+                // Get和MultiGet各用一组不同的key, 避免后运行的一方总是命中前一方刚读过的block
+                std::vector<std::string> user_keys[2];
+                for (auto &batch : user_keys) {
+                    const int start = static_cast<int>(rnd.Uniform(kNumKeys - 4 * kBatchSize));
+                    for (int j = 0; j < kBatchSize; ++j) {
+                        const int k = clustered ? start + static_cast<int>(rnd.Uniform(4 * kBatchSize))
+                                                : static_cast<int>(rnd.Uniform(kNumKeys));
+                        std::snprintf(buf, sizeof(buf), "key%08d", k);
+                        batch.emplace_back(buf);
+                    }
+                }
+                std::vector<std::string> get_values(kBatchSize), multiget_values(kBatchSize);
+                std::vector<leveldb::Status> get_statuses(kBatchSize), multiget_statuses(kBatchSize);
+
+                auto start = std::chrono::steady_clock::now();
+                for (int j = 0; j < kBatchSize; ++j) {
+                    leveldb::LookupKey lkey(user_keys[0][j], leveldb::kMaxSequenceNumber);
+                    leveldb::MergeContext merge_context;
+                    leveldb::Version::GetStats stats;
+                    get_statuses[j] = current->Get(leveldb::ReadOptions(), lkey, &get_values[j], &merge_context,
+                                                   &stats);
+                }
+                get_time += std::chrono::steady_clock::now() - start;
+
+                // 与DBImpl::MultiGet相同, 排序也计入MultiGet的时间
+                start = std::chrono::steady_clock::now();
+                std::vector<std::string> &keys = user_keys[1];
+                std::sort(keys.begin(), keys.end());
+                std::deque<leveldb::LookupKey> lkeys;
+                std::unique_ptr<leveldb::MergeContext[]> merge_contexts(new leveldb::MergeContext[kBatchSize]);
+                std::vector<leveldb::TableCache::GetContext> contexts(kBatchSize);
+                std::vector<leveldb::Version::GetStats> stats(kBatchSize);
+                for (int j = 0; j < kBatchSize; ++j) {
+                    lkeys.emplace_back(keys[j], leveldb::kMaxSequenceNumber);
+                    contexts[j] = {&lkeys.back(), &multiget_values[j], &multiget_statuses[j], &merge_contexts[j],
+                                   false};
+                }
+                current->MultiGet(leveldb::ReadOptions(), contexts.data(), kBatchSize, stats.data());
+                multiget_time += std::chrono::steady_clock::now() - start;
+
+                // 不计时: 用Get检查MultiGet的结果
+                for (int j = 0; j < kBatchSize; ++j) {
+                    leveldb::LookupKey lkey(keys[j], leveldb::kMaxSequenceNumber);
+                    leveldb::MergeContext merge_context;
+                    leveldb::Version::GetStats get_stats;
+                    std::string value;
+                    leveldb::Status s = current->Get(leveldb::ReadOptions(), lkey, &value, &merge_context,
+                                                     &get_stats);
+                    same &= s.IsOK() == multiget_statuses[j].IsOK() && value == multiget_values[j];
+                }
+            }
+            const double lookups = static_cast<double>(kRounds) * kBatchSize;
+            std::cout << (cached ? "block cache" : "no cache   ") << (clustered ? ", clustered: " : ", random   : ")
+                      << "Get " << get_time.count() / lookups << " ns/key, MultiGet "
+                      << multiget_time.count() / lookups << " ns/key ("
+                      << 100.0 * multiget_time.count() / get_time.count() << "% of Get loop), "
+                      << (same ? "identical" : "MISMATCH") << std::endl;
+        }
+    }
+}
@@ -13,4 +13,12 @@
 #define UNLIKELY(x) (x)
 #endif
 
+// 把addr所在的cache line提前加载到cache中.
+// rw: 0读 1写; locality: 0~3, 越大越倾向于保留在各级cache中.
+#if defined(__GNUC__)
+#define PREFETCH(addr, rw, locality) __builtin_prefetch((addr), (rw), (locality))
+#else
+#define PREFETCH(addr, rw, locality) ((void) (addr))
+#endif
+
 #endif //MY_LEVELDB_PORT_LIKELY_H
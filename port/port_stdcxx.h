@@ -12,9 +12,40 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif  // HAVE_LZ4
+#if HAVE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif  // HAVE_ZSTD
+#include <atomic>
 #include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
+#include <string>
+#include <vector>
+
+// GCC/Clang在x86上可以用target属性只为单个函数启用AVX2/SSE4.2, 不需要整个项目加-mavx2,
+// 再由CPUHasAVX2()/CPUHasSSE42()在运行时选择实现. 其它编译器只在编译时已经启用指令集时使用.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LEVELDB_TARGET(isa) __attribute__((target(isa)))
+#define LEVELDB_HAVE_AVX2 1
+#define LEVELDB_HAVE_SSE42 1
+#else
+#define LEVELDB_TARGET(isa)
+#if defined(__AVX2__)
+#define LEVELDB_HAVE_AVX2 1
+#endif
+#if defined(__SSE4_2__)
+#define LEVELDB_HAVE_SSE42 1
+#endif
+#endif
 
 namespace leveldb {
     namespace port {
@@ -84,6 +115,221 @@ namespace leveldb {
         };
 
 
+        // 没有snappy时返回false, 调用方应该退化为不压缩.
+        inline bool Snappy_Compress(const char *input, size_t length, std::string *output) {
+#if HAVE_SNAPPY
+            output->resize(snappy::MaxCompressedLength(length));
+            size_t outlen;
+            snappy::RawCompress(input, length, &(*output)[0], &outlen);
+            output->resize(outlen);
+            return true;
+#else
+            (void) input;
+            (void) length;
+            (void) output;
+            return false;
+#endif  // HAVE_SNAPPY
+        }
+
+        inline bool Snappy_GetUncompressedLength(const char *input, size_t length, size_t *result) {
+#if HAVE_SNAPPY
+            return snappy::GetUncompressedLength(input, length, result);
+#else
+            (void) input;
+            (void) length;
+            (void) result;
+            return false;
+#endif  // HAVE_SNAPPY
+        }
+
+        // output至少要有Snappy_GetUncompressedLength返回的大小.
+        inline bool Snappy_Uncompress(const char *input, size_t length, char *output) {
+#if HAVE_SNAPPY
+            return snappy::RawUncompress(input, length, output);
+#else
+            (void) input;
+            (void) length;
+            (void) output;
+            return false;
+#endif  // HAVE_SNAPPY
+        }
+
+        // 没有lz4时返回false, 调用方应该退化为不压缩. level >= 3时使用lz4hc.
+        // 结果追加在output之后, 不包含压缩前的大小.
+        inline bool LZ4_Compress(int level, const char *input, size_t length, std::string *output) {
+#if HAVE_LZ4
+            if (length > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) {
+                return false;
+            }
+            const size_t start = output->size();
+            const int bound = LZ4_compressBound(static_cast<int>(length));
+            output->resize(start + bound);
+            const int outlen = level >= 3
+                               ? LZ4_compress_HC(input, &(*output)[start], static_cast<int>(length), bound, level)
+                               : LZ4_compress_default(input, &(*output)[start], static_cast<int>(length), bound);
+            output->resize(start + (outlen > 0 ? outlen : 0));
+            return outlen > 0;
+#else
+            (void) level;
+            (void) input;
+            (void) length;
+            (void) output;
+            return false;
+#endif  // HAVE_LZ4
+        }
+
+        // output_length必须是压缩前的大小.
+        inline bool LZ4_Uncompress(const char *input, size_t length, char *output, size_t output_length) {
+#if HAVE_LZ4
+            if (length > INT_MAX || output_length > INT_MAX) {
+                return false;
+            }
+            return LZ4_decompress_safe(input, output, static_cast<int>(length), static_cast<int>(output_length)) ==
+                   static_cast<int>(output_length);
+#else
+            (void) input;
+            (void) length;
+            (void) output;
+            (void) output_length;
+            return false;
+#endif  // HAVE_LZ4
+        }
+
+        // 预先解析的zstd字典. 解析字典的开销远大于压缩一个block, 同一个sstable的所有block共享一份.
+        class ZstdCompressionDict {
+        public:
+            ZstdCompressionDict(const char *dict, size_t length, int level) {
+#if HAVE_ZSTD
+                cdict_ = ZSTD_createCDict(dict, length, level);
+#else
+                (void) dict;
+                (void) length;
+                (void) level;
+#endif  // HAVE_ZSTD
+            }
+
+            ~ZstdCompressionDict() {
+#if HAVE_ZSTD
+                ZSTD_freeCDict(cdict_);
+#endif  // HAVE_ZSTD
+            }
+
+            ZstdCompressionDict(const ZstdCompressionDict &) = delete;
+            ZstdCompressionDict &operator=(const ZstdCompressionDict &) = delete;
+
+        private:
+            friend bool Zstd_Compress(int, const char *, size_t, std::string *, const ZstdCompressionDict *);
+#if HAVE_ZSTD
+            ZSTD_CDict *cdict_;
+#endif  // HAVE_ZSTD
+        };
+
+        class ZstdDecompressionDict {
+        public:
+            ZstdDecompressionDict(const char *dict, size_t length) {
+#if HAVE_ZSTD
+                ddict_ = ZSTD_createDDict(dict, length);
+#else
+                (void) dict;
+                (void) length;
+#endif  // HAVE_ZSTD
+            }
+
+            ~ZstdDecompressionDict() {
+#if HAVE_ZSTD
+                ZSTD_freeDDict(ddict_);
+#endif  // HAVE_ZSTD
+            }
+
+            ZstdDecompressionDict(const ZstdDecompressionDict &) = delete;
+            ZstdDecompressionDict &operator=(const ZstdDecompressionDict &) = delete;
+
+        private:
+            friend bool Zstd_Uncompress(const char *, size_t, char *, size_t, const ZstdDecompressionDict *);
+#if HAVE_ZSTD
+            ZSTD_DDict *ddict_;
+#endif  // HAVE_ZSTD
+        };
+
+        // 没有zstd时返回false, 调用方应该退化为不压缩. dict不为nullptr时使用字典压缩, level由字典决定.
+        // 结果追加在output之后, 不包含压缩前的大小.
+        inline bool Zstd_Compress(int level, const char *input, size_t length, std::string *output,
+                                  const ZstdCompressionDict *dict = nullptr) {
+#if HAVE_ZSTD
+            // 创建context需要分配几百KB的内存, 每个线程复用一个
+            thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+            if (cctx == nullptr || (dict != nullptr && dict->cdict_ == nullptr)) {
+                return false;
+            }
+            const size_t start = output->size();
+            output->resize(start + ZSTD_compressBound(length));
+            const size_t outlen = dict != nullptr
+                                  ? ZSTD_compress_usingCDict(cctx.get(), &(*output)[start], output->size() - start,
+                                                             input, length, dict->cdict_)
+                                  : ZSTD_compressCCtx(cctx.get(), &(*output)[start], output->size() - start,
+                                                      input, length, level);
+            if (ZSTD_isError(outlen)) {
+                output->resize(start);
+                return false;
+            }
+            output->resize(start + outlen);
+            return true;
+#else
+            (void) level;
+            (void) input;
+            (void) length;
+            (void) output;
+            (void) dict;
+            return false;
+#endif  // HAVE_ZSTD
+        }
+
+        // output_length必须是压缩前的大小. 压缩时使用了字典的block解压时必须传入同一个字典.
+        inline bool Zstd_Uncompress(const char *input, size_t length, char *output, size_t output_length,
+                                    const ZstdDecompressionDict *dict = nullptr) {
+#if HAVE_ZSTD
+            thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            if (dctx == nullptr || (dict != nullptr && dict->ddict_ == nullptr)) {
+                return false;
+            }
+            const size_t outlen = dict != nullptr
+                                  ? ZSTD_decompress_usingDDict(dctx.get(), output, output_length, input, length,
+                                                               dict->ddict_)
+                                  : ZSTD_decompressDCtx(dctx.get(), output, output_length, input, length);
+            return !ZSTD_isError(outlen) && outlen == output_length;
+#else
+            (void) input;
+            (void) length;
+            (void) output;
+            (void) output_length;
+            (void) dict;
+            return false;
+#endif  // HAVE_ZSTD
+        }
+
+        // 从拼接在一起的样本中训练不超过max_dict_bytes的字典, 样本太少或者没有zstd时返回false.
+        inline bool Zstd_TrainDictionary(const std::string &samples, const std::vector<size_t> &sample_lengths,
+                                         size_t max_dict_bytes, std::string *dict) {
+#if HAVE_ZSTD
+            dict->resize(max_dict_bytes);
+            const size_t n = ZDICT_trainFromBuffer(&(*dict)[0], max_dict_bytes, samples.data(),
+                                                   sample_lengths.data(),
+                                                   static_cast<unsigned>(sample_lengths.size()));
+            if (ZDICT_isError(n)) {
+                dict->clear();
+                return false;
+            }
+            dict->resize(n);
+            return true;
+#else
+            (void) samples;
+            (void) sample_lengths;
+            (void) max_dict_bytes;
+            (void) dict;
+            return false;
+#endif  // HAVE_ZSTD
+        }
+
         inline uint32_t AcceleratedCRC32C(uint32_t crc, const char *buf, size_t size) {
 #if HAVE_CRC32C
             return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
@@ -96,6 +342,31 @@ namespace leveldb {
 #endif  // HAVE_CRC32C
         }
 
+        // 测试用来对比SIMD与标量实现的结果: 2表示按CPU支持的指令集, 1表示禁用AVX2, 0表示只用标量实现.
+        inline std::atomic<int> simd_level_for_testing{2};
+
+        inline bool CPUHasAVX2() {
+#if LEVELDB_HAVE_AVX2 && !defined(__AVX2__)
+            static const bool supported = __builtin_cpu_supports("avx2");
+#elif LEVELDB_HAVE_AVX2
+            const bool supported = true;
+#else
+            const bool supported = false;
+#endif
+            return supported && simd_level_for_testing.load(std::memory_order_relaxed) >= 2;
+        }
+
+        inline bool CPUHasSSE42() {
+#if LEVELDB_HAVE_SSE42 && !defined(__SSE4_2__)
+            static const bool supported = __builtin_cpu_supports("sse4.2");
+#elif LEVELDB_HAVE_SSE42
+            const bool supported = true;
+#else
+            const bool supported = false;
+#endif
+            return supported && simd_level_for_testing.load(std::memory_order_relaxed) >= 1;
+        }
+
     }
 }
 
@@ -0,0 +1,483 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/block.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "port/port.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+#if LEVELDB_HAVE_AVX2 || LEVELDB_HAVE_SSE42
+#include <immintrin.h>
+#endif
+
+namespace leveldb {
+
+    Block::Block(const BlockContents &contents)
+            : data_(contents.data.data()),
+              size_(contents.data.size()),
+              restart_offset_(0),
+              num_restarts_(0),
+              key_prefix_offset_(0),
+              key_prefix_skip_(0),
+              hash_index_offset_(0),
+              num_hash_buckets_(0),
+              owned_(contents.heap_allocated) {
+        if (size_ < sizeof(uint32_t)) {
+            size_ = 0;  // 错误标记
+            return;
+        }
+        const uint32_t footer = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+        // 尾部从后向前解析, end是尚未解析的部分的末尾
+        size_t end = size_ - sizeof(uint32_t);
+        if ((footer & kBlockHashIndexFlag) != 0) {
+            const uint32_t num_buckets = end < sizeof(uint32_t) ? 0 : DecodeFixed32(data_ + end - sizeof(uint32_t));
+            if (num_buckets == 0 || num_buckets > end - sizeof(uint32_t)) {
+                size_ = 0;
+                return;
+            }
+            end -= sizeof(uint32_t) + num_buckets;
+            hash_index_offset_ = static_cast<uint32_t>(end);
+            num_hash_buckets_ = num_buckets;
+        }
+        const bool has_key_prefix = (footer & kBlockKeyPrefixFlag) != 0;
+        const size_t restart_entry = sizeof(uint32_t) + (has_key_prefix ? kRestartKeyPrefixSize : 0);
+        const size_t trailer = has_key_prefix ? sizeof(uint32_t) : 0;
+        num_restarts_ = footer & ~(kBlockKeyPrefixFlag | kBlockHashIndexFlag);
+        if (end < trailer || num_restarts_ > (end - trailer) / restart_entry) {
+            // 尾部太大, 说明block已损坏
+            size_ = 0;
+            num_restarts_ = 0;
+            hash_index_offset_ = 0;
+            return;
+        }
+        restart_offset_ = static_cast<uint32_t>(end - trailer - num_restarts_ * restart_entry);
+        if (has_key_prefix) {
+            key_prefix_offset_ = restart_offset_ + num_restarts_ * static_cast<uint32_t>(sizeof(uint32_t));
+            key_prefix_skip_ = DecodeFixed32(data_ + end - trailer);
+        }
+    }
+
+    Block::~Block() {
+        if (owned_) {
+            delete[] data_;
+        }
+    }
+
+    // 解码从p开始的一条记录的头部, 结果写入*shared, *non_shared, *value_length.
+    // 出错时返回nullptr, 否则返回key_delta的起始位置.
+    static inline const char *DecodeEntry(const char *p, const char *limit, uint32_t *shared,
+                                          uint32_t *non_shared, uint32_t *value_length) {
+        if (limit - p < 3) {
+            return nullptr;
+        }
+        *shared = reinterpret_cast<const uint8_t *>(p)[0];
+        *non_shared = reinterpret_cast<const uint8_t *>(p)[1];
+        *value_length = reinterpret_cast<const uint8_t *>(p)[2];
+        if ((*shared | *non_shared | *value_length) < 128) {
+            // 三个值都只占一个字节
+            p += 3;
+        } else {
+            if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr) return nullptr;
+            if ((p = GetVarint32Ptr(p, limit, non_shared)) == nullptr) return nullptr;
+            if ((p = GetVarint32Ptr(p, limit, value_length)) == nullptr) return nullptr;
+        }
+
+        if (static_cast<uint32_t>(limit - p) < (*non_shared + *value_length)) {
+            return nullptr;
+        }
+        return p;
+    }
+
+    namespace {
+
+        // 二分查找把范围缩小到这么多个key前缀以内之后, 改为逐个(向量化)比较.
+        constexpr uint32_t kKeyPrefixScanWidth = 16;
+
+#if LEVELDB_HAVE_AVX2 || LEVELDB_HAVE_SSE42
+        // 4位掩码中1的个数
+        constexpr uint8_t kMaskBits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+        // 只有有符号的64位比较指令, 两边同时翻转符号位得到无符号比较的结果
+        constexpr auto kSignBit = static_cast<long long>(0x8000000000000000ull);
+#endif
+
+#if LEVELDB_HAVE_AVX2
+        // 每次比较4个前缀, 返回处理过的个数, 剩下不足4个的留给调用者.
+        LEVELDB_TARGET("avx2")
+        uint32_t ScanKeyPrefixesAVX2(const char *prefixes, uint32_t n, uint64_t target, uint32_t *lt,
+                                     uint32_t *le) {
+            const __m256i bias = _mm256_set1_epi64x(kSignBit);
+            const __m256i t = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(target)), bias);
+            uint32_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const __m256i v = _mm256_xor_si256(
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(prefixes + i * kRestartKeyPrefixSize)),
+                        bias);
+                const __m256i gt = _mm256_cmpgt_epi64(t, v);
+                const __m256i eq = _mm256_cmpeq_epi64(t, v);
+                *lt += kMaskBits[_mm256_movemask_pd(_mm256_castsi256_pd(gt))];
+                *le += kMaskBits[_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(gt, eq)))];
+            }
+            return i;
+        }
+#endif  // LEVELDB_HAVE_AVX2
+
+#if LEVELDB_HAVE_SSE42
+        // 同上, 每次比较2个前缀.
+        LEVELDB_TARGET("sse4.2")
+        uint32_t ScanKeyPrefixesSSE42(const char *prefixes, uint32_t n, uint64_t target, uint32_t *lt,
+                                      uint32_t *le) {
+            const __m128i bias = _mm_set1_epi64x(kSignBit);
+            const __m128i t = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(target)), bias);
+            uint32_t i = 0;
+            for (; i + 2 <= n; i += 2) {
+                const __m128i v = _mm_xor_si128(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(prefixes + i * kRestartKeyPrefixSize)),
+                        bias);
+                const __m128i gt = _mm_cmpgt_epi64(t, v);
+                const __m128i eq = _mm_cmpeq_epi64(t, v);
+                *lt += kMaskBits[_mm_movemask_pd(_mm_castsi128_pd(gt))];
+                *le += kMaskBits[_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(gt, eq)))];
+            }
+            return i;
+        }
+#endif  // LEVELDB_HAVE_SSE42
+
+        // 统计prefixes[0, n)中小于target和不大于target的个数. 按CPU支持的指令集选择实现.
+        void ScanKeyPrefixes(const char *prefixes, uint32_t n, uint64_t target, uint32_t *less,
+                             uint32_t *less_equal) {
+            uint32_t lt = 0;
+            uint32_t le = 0;
+            uint32_t i = 0;
+#if LEVELDB_HAVE_AVX2
+            if (port::CPUHasAVX2()) {
+                i = ScanKeyPrefixesAVX2(prefixes, n, target, &lt, &le);
+            }
+#endif
+#if LEVELDB_HAVE_SSE42
+            // 没有AVX2, 或者不足4个时剩下的用SSE4.2
+            if (i == 0 && port::CPUHasSSE42()) {
+                i = ScanKeyPrefixesSSE42(prefixes, n, target, &lt, &le);
+            }
+#endif
+            for (; i < n; i++) {
+                const uint64_t p = DecodeFixed64(prefixes + i * kRestartKeyPrefixSize);
+                lt += p < target;
+                le += p <= target;
+            }
+            *less = lt;
+            *less_equal = le;
+        }
+
+    }  // namespace
+
+    // 先用二分查找缩小范围, 再扫描剩下的窗口.
+    void CountKeyPrefixes(const char *prefixes, uint32_t n, uint64_t target, uint32_t *less,
+                          uint32_t *less_equal) {
+        // prefixes[0, lo)都小于target, prefixes[hi, n)都大于target
+        uint32_t lo = 0;
+        uint32_t hi = n;
+        while (hi - lo > kKeyPrefixScanWidth) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            const uint64_t p = DecodeFixed64(prefixes + mid * kRestartKeyPrefixSize);
+            if (p < target) {
+                lo = mid + 1;
+            } else if (p > target) {
+                hi = mid;
+            } else {
+                break;
+            }
+        }
+        uint32_t lt, le;
+        ScanKeyPrefixes(prefixes + lo * kRestartKeyPrefixSize, hi - lo, target, &lt, &le);
+        *less = lo + lt;
+        *less_equal = lo + le;
+    }
+
+    class Block::Iter : public Iterator {
+    public:
+        Iter(const Comparator *comparator, const char *data, uint32_t restarts, uint32_t num_restarts,
+             const char *key_prefixes, const Slice &key_prefix_common)
+                : comparator_(comparator),
+                  data_(data),
+                  restarts_(restarts),
+                  num_restarts_(num_restarts),
+                  key_prefixes_(key_prefixes),
+                  key_prefix_common_(key_prefix_common),
+                  current_(restarts_),
+                  restart_index_(num_restarts_) {
+            assert(num_restarts_ > 0);
+        }
+
+        bool Valid() const override { return current_ < restarts_; }
+
+        Status status() const override { return status_; }
+
+        Slice Key() const override {
+            assert(Valid());
+            return key_;
+        }
+
+        Slice Value() const override {
+            assert(Valid());
+            return value_;
+        }
+
+        void Next() override {
+            assert(Valid());
+            ParseNextKey();
+        }
+
+        void Prev() override {
+            assert(Valid());
+
+            // 找到current_之前的最后一个restart点
+            const uint32_t original = current_;
+            while (GetRestartPoint(restart_index_) >= original) {
+                if (restart_index_ == 0) {
+                    // 已经没有更前面的记录了
+                    current_ = restarts_;
+                    restart_index_ = num_restarts_;
+                    return;
+                }
+                restart_index_--;
+            }
+
+            SeekToRestartPoint(restart_index_);
+            do {
+                // 一直前进到original之前的那条记录
+            } while (ParseNextKey() && NextEntryOffset() < original);
+        }
+
+        void Seek(const Slice &target) override {
+            // 找到最后一个key < target的restart点
+            uint32_t left = 0;
+            uint32_t right = num_restarts_ - 1;
+            if (key_prefixes_ != nullptr) {
+                // restart点[0, less)的key都小于target, [less_equal, n)的key都大于target,
+                // 只有前缀与target相等的restart点才需要解码key比较.
+                uint32_t less, less_equal;
+                CountRestartPoints(target, &less, &less_equal);
+                left = less > 0 ? less - 1 : 0;
+                right = less_equal > 0 ? less_equal - 1 : 0;
+                if (right < left) {
+                    right = left;
+                }
+            }
+            while (left < right) {
+                const uint32_t mid = (left + right + 1) / 2;
+                const uint32_t region_offset = GetRestartPoint(mid);
+                uint32_t shared, non_shared, value_length;
+                const char *key_ptr = DecodeEntry(data_ + region_offset, data_ + restarts_, &shared, &non_shared,
+                                                  &value_length);
+                if (key_ptr == nullptr || (shared != 0)) {
+                    CorruptionError();
+                    return;
+                }
+                Slice mid_key(key_ptr, non_shared);
+                if (Compare(mid_key, target) < 0) {
+                    // mid之前的key都小于target
+                    left = mid;
+                } else {
+                    // mid以及之后的key都不小于target
+                    right = mid - 1;
+                }
+            }
+
+            // 从left开始线性查找第一个 >= target 的key
+            SeekToRestartPoint(left);
+            while (true) {
+                if (!ParseNextKey()) {
+                    return;
+                }
+                if (Compare(key_, target) >= 0) {
+                    return;
+                }
+            }
+        }
+
+        // 见Block::SeekForGet
+        bool SeekForGet(const Slice &target, const uint8_t *buckets, uint32_t num_buckets) {
+            const uint8_t entry = buckets[HashIndexHash(ExtractUserKey(target)) % num_buckets];
+            if (entry >= num_restarts_) {
+                if (entry == kHashIndexNoEntry) {
+                    // 没有任何记录的user key落在这个桶中
+                    MarkInvalid();
+                    return false;
+                }
+                // kHashIndexCollision
+                Seek(target);
+                return true;
+            }
+            // 如果user key在block中, 它只出现在restart区间entry中, 只需要扫描这个区间.
+            // 桶中的也可能是另一个user key, 这时扫描结束时的记录不属于target
+            SeekToRestartPoint(entry);
+            const uint32_t limit = entry + 1u < num_restarts_ ? GetRestartPoint(entry + 1) : restarts_;
+            while (ParseNextKey()) {
+                if (current_ >= limit) {
+                    break;
+                }
+                if (Compare(key_, target) >= 0) {
+                    if (ExtractUserKey(key_) == ExtractUserKey(target)) {
+                        return true;
+                    }
+                    break;
+                }
+            }
+            if (!Valid()) {
+                // 最后一个区间中的记录都小于target, 同一个user key的记录可能延续到下一个block中
+                return status_.IsOK();
+            }
+            MarkInvalid();
+            return false;
+        }
+
+        void SeekToFirst() override {
+            SeekToRestartPoint(0);
+            ParseNextKey();
+        }
+
+        void SeekToLast() override {
+            SeekToRestartPoint(num_restarts_ - 1);
+            while (ParseNextKey() && NextEntryOffset() < restarts_) {
+                // 一直前进到最后一条记录
+            }
+        }
+
+    private:
+        int Compare(const Slice &a, const Slice &b) const { return comparator_->Compare(a, b); }
+
+        void CountRestartPoints(const Slice &target, uint32_t *less, uint32_t *less_equal) const {
+            Slice bytes = comparator_->OrderedBytes(target);
+            const Slice &common = key_prefix_common_;
+            int r = memcmp(bytes.data(), common.data(), std::min(bytes.size(), common.size()));
+            if (r == 0 && bytes.size() < common.size()) {
+                r = -1;
+            }
+            if (r < 0) {
+                // 比所有restart点的key都小
+                *less = *less_equal = 0;
+            } else if (r > 0) {
+                *less = *less_equal = num_restarts_;
+            } else {
+                bytes.remove_prefix(common.size());
+                CountKeyPrefixes(key_prefixes_, num_restarts_, RestartKeyPrefix(bytes), less, less_equal);
+            }
+        }
+
+        // 下一条记录在data_中的偏移
+        uint32_t NextEntryOffset() const {
+            return static_cast<uint32_t>((value_.data() + value_.size()) - data_);
+        }
+
+        uint32_t GetRestartPoint(uint32_t index) const {
+            assert(index < num_restarts_);
+            return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
+        }
+
+        void SeekToRestartPoint(uint32_t index) {
+            key_.clear();
+            restart_index_ = index;
+            // current_由ParseNextKey()修正, ParseNextKey()从value_的末尾开始解析
+            const uint32_t offset = GetRestartPoint(index);
+            value_ = Slice(data_ + offset, 0);
+        }
+
+        void MarkInvalid() {
+            current_ = restarts_;
+            restart_index_ = num_restarts_;
+        }
+
+        void CorruptionError() {
+            current_ = restarts_;
+            restart_index_ = num_restarts_;
+            status_ = Status::Corruption("bad entry in block");
+            key_.clear();
+            value_.clear();
+        }
+
+        bool ParseNextKey() {
+            current_ = NextEntryOffset();
+            const char *p = data_ + current_;
+            const char *limit = data_ + restarts_;
+            if (p >= limit) {
+                // 没有更多的记录了, 标记为无效
+                current_ = restarts_;
+                restart_index_ = num_restarts_;
+                return false;
+            }
+
+            uint32_t shared, non_shared, value_length;
+            p = DecodeEntry(p, limit, &shared, &non_shared, &value_length);
+            if (p == nullptr || key_.size() < shared) {
+                CorruptionError();
+                return false;
+            }
+            key_.resize(shared);
+            key_.append(p, non_shared);
+            value_ = Slice(p + non_shared, value_length);
+            while (restart_index_ + 1 < num_restarts_ && GetRestartPoint(restart_index_ + 1) < current_) {
+                ++restart_index_;
+            }
+            return true;
+        }
+
+        const Comparator *const comparator_;
+        const char *const data_;            // block的内容
+        uint32_t const restarts_;           // restart数组的偏移, 也是记录区的末尾
+        uint32_t const num_restarts_;
+        const char *const key_prefixes_;    // restart点的key前缀数组, 不可用时为nullptr
+        const Slice key_prefix_common_;     // restart点key的OrderedBytes的公共前缀
+
+        // current_是当前记录在data_中的偏移, >= restarts_表示无效
+        uint32_t current_;
+        uint32_t restart_index_;            // current_所在的restart区间
+        std::string key_;
+        Slice value_;
+        Status status_;
+    };
+
+    Iterator *Block::NewIterator(const Comparator *comparator) {
+        if (size_ < sizeof(uint32_t)) {
+            return NewErrorIterator(Status::Corruption("bad block contents"));
+        }
+        if (num_restarts_ == 0) {
+            return NewEmptyIterator();
+        }
+        // 读取时的比较器不支持OrderedBytes时, 退化为普通的二分查找
+        const char *key_prefixes = nullptr;
+        Slice common;
+        if (key_prefix_offset_ != 0 && comparator->HasOrderedBytes()) {
+            // 公共前缀取自第一个restart点的key, 它没有做前缀压缩
+            uint32_t shared, non_shared, value_length;
+            const char *key_ptr = DecodeEntry(data_, data_ + restart_offset_, &shared, &non_shared, &value_length);
+            if (key_ptr != nullptr && shared == 0) {
+                const Slice bytes = comparator->OrderedBytes(Slice(key_ptr, non_shared));
+                if (bytes.size() >= key_prefix_skip_) {
+                    key_prefixes = data_ + key_prefix_offset_;
+                    common = Slice(bytes.data(), key_prefix_skip_);
+                }
+            }
+        }
+        return new Iter(comparator, data_, restart_offset_, num_restarts_, key_prefixes, common);
+    }
+
+    bool Block::SeekForGet(Iterator *iter, const Slice &target) const {
+        if (hash_index_offset_ == 0 || num_restarts_ == 0) {
+            iter->Seek(target);
+            return true;
+        }
+        // 此时NewIterator()返回的一定是Iter
+        return static_cast<Iter *>(iter)->SeekForGet(
+                target, reinterpret_cast<const uint8_t *>(data_ + hash_index_offset_), num_hash_buckets_);
+    }
+
+}
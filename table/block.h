@@ -0,0 +1,68 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_BLOCK_H
+#define MY_LEVELDB_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    struct BlockContents;
+    class Comparator;
+
+    /**
+     * @brief 只读的block, 格式见BlockBuilder.
+    */
+    class Block {
+    public:
+        explicit Block(const BlockContents &contents);
+
+        Block(const Block &) = delete;
+        Block &operator=(const Block &) = delete;
+
+        ~Block();
+
+        size_t size() const { return size_; }
+
+        // block的全部内容, 用于把block转存到二级缓存.
+        const char *data() const { return data_; }
+
+        Iterator *NewIterator(const Comparator *comparator);
+
+        /**
+         * @brief 点查, iter必须由这个block的NewIterator()创建, target是internal key.
+         * 有hash索引时直接定位到target的user key所在的restart区间, 返回false表示block中以及之后的block中
+         * 都没有该user key >= target的记录, 此时iter无效. 没有hash索引时等同于iter->Seek(target), 总是返回true.
+        */
+        bool SeekForGet(Iterator *iter, const Slice &target) const;
+
+    private:
+        class Iter;
+
+        const char *data_;
+        size_t size_;
+        uint32_t restart_offset_;       // restart数组在data_中的偏移
+        uint32_t num_restarts_;
+        uint32_t key_prefix_offset_;    // key前缀数组在data_中的偏移, 没有时为0
+        uint32_t key_prefix_skip_;      // restart点key的公共前缀长度
+        uint32_t hash_index_offset_;    // hash桶在data_中的偏移, 没有时为0
+        uint32_t num_hash_buckets_;
+        bool owned_;                    // data_由new[]分配, 析构时释放
+    };
+
+    /**
+     * @brief 统计有序的restart点key前缀数组prefixes[0, n)中小于target和不大于target的个数,
+     * 按CPU支持的指令集选择SIMD或标量实现. 导出给测试对比各个实现的结果.
+    */
+    void CountKeyPrefixes(const char *prefixes, uint32_t n, uint64_t target, uint32_t *less,
+                          uint32_t *less_equal);
+
+}
+
+#endif //MY_LEVELDB_BLOCK_H
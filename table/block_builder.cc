@@ -0,0 +1,154 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/block_builder.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/options.h"
+#include "table/format.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    BlockBuilder::BlockBuilder(const Options *options, bool use_hash_index)
+            : options_(options),
+              use_key_prefix_(options->comparator->HasOrderedBytes()),
+              restarts_(),
+              use_hash_index_(use_hash_index),
+              counter_(0),
+              finished_(false) {
+        assert(options->block_restart_interval >= 1);
+        restarts_.push_back(0);
+    }
+
+    void BlockBuilder::Reset() {
+        buffer_.clear();
+        restarts_.clear();
+        restarts_.push_back(0);
+        restart_keys_.clear();
+        restart_key_starts_.clear();
+        hash_entries_.clear();
+        counter_ = 0;
+        finished_ = false;
+        last_key_.clear();
+    }
+
+    size_t BlockBuilder::CurrentSizeEstimate() const {
+        size_t size = buffer_.size() + restarts_.size() * sizeof(uint32_t) + sizeof(uint32_t);
+        if (use_key_prefix_) {
+            size += restarts_.size() * kRestartKeyPrefixSize + sizeof(uint32_t);
+        }
+        if (use_hash_index_) {
+            size += static_cast<size_t>(hash_entries_.size() / options_->data_block_hash_table_util_ratio) +
+                    sizeof(uint32_t);
+        }
+        return size;
+    }
+
+    Slice BlockBuilder::Finish() {
+        for (uint32_t restart : restarts_) {
+            PutFixed32(&buffer_, restart);
+        }
+        uint32_t footer = static_cast<uint32_t>(restarts_.size());
+        assert((footer & (kBlockKeyPrefixFlag | kBlockHashIndexFlag)) == 0);
+        // 空block没有key前缀
+        if (use_key_prefix_ && restart_key_starts_.size() == restarts_.size()) {
+            const size_t n = restart_key_starts_.size();
+            restart_key_starts_.push_back(restart_keys_.size());
+            auto restart_key = [this](size_t i) {
+                return Slice(restart_keys_.data() + restart_key_starts_[i],
+                             restart_key_starts_[i + 1] - restart_key_starts_[i]);
+            };
+            // restart点的key有序, 所有key的公共前缀就是第一个与最后一个的公共前缀
+            const Slice first = restart_key(0);
+            const Slice last = restart_key(n - 1);
+            size_t skip = 0;
+            const size_t min_length = std::min(first.size(), last.size());
+            while (skip < min_length && first[skip] == last[skip]) {
+                skip++;
+            }
+            for (size_t i = 0; i < n; i++) {
+                Slice key = restart_key(i);
+                key.remove_prefix(skip);
+                PutFixed64(&buffer_, RestartKeyPrefix(key));
+            }
+            PutFixed32(&buffer_, static_cast<uint32_t>(skip));
+            footer |= kBlockKeyPrefixFlag;
+        }
+        if (use_hash_index_ && !hash_entries_.empty() && restarts_.size() < kHashIndexCollision) {
+            assert(options_->data_block_hash_table_util_ratio > 0);
+            size_t num_buckets = static_cast<size_t>(hash_entries_.size() /
+                                                     options_->data_block_hash_table_util_ratio);
+            // 奇数个桶, 避免hash值低位的规律集中在少数桶中
+            num_buckets |= 1;
+            const size_t start = buffer_.size();
+            buffer_.append(num_buckets, static_cast<char>(kHashIndexNoEntry));
+            auto *buckets = reinterpret_cast<uint8_t *>(&buffer_[start]);
+            for (const auto &entry : hash_entries_) {
+                uint8_t &bucket = buckets[entry.first % num_buckets];
+                if (bucket == kHashIndexNoEntry) {
+                    bucket = static_cast<uint8_t>(entry.second);
+                } else if (bucket != entry.second) {
+                    // 不同restart区间的key落在同一个桶中, 查找时退化为二分查找
+                    bucket = kHashIndexCollision;
+                }
+            }
+            PutFixed32(&buffer_, static_cast<uint32_t>(num_buckets));
+            footer |= kBlockHashIndexFlag;
+        }
+        PutFixed32(&buffer_, footer);
+        finished_ = true;
+        return Slice(buffer_);
+    }
+
+    void BlockBuilder::Add(const Slice &key, const Slice &value) {
+        Slice last_key_piece(last_key_);
+        assert(!finished_);
+        assert(counter_ <= options_->block_restart_interval);
+        assert(buffer_.empty() || options_->comparator->Compare(key, last_key_piece) > 0);
+
+        size_t shared = 0;
+        if (counter_ < options_->block_restart_interval) {
+            // 计算与上一个key的公共前缀
+            const size_t min_length = std::min(last_key_piece.size(), key.size());
+            while ((shared < min_length) && (last_key_piece[shared] == key[shared])) {
+                shared++;
+            }
+        } else {
+            // 开始一个新的restart点, 不做前缀压缩
+            restarts_.push_back(static_cast<uint32_t>(buffer_.size()));
+            counter_ = 0;
+        }
+        if (use_key_prefix_ && restart_key_starts_.size() < restarts_.size()) {
+            const Slice bytes = options_->comparator->OrderedBytes(key);
+            restart_key_starts_.push_back(restart_keys_.size());
+            restart_keys_.append(bytes.data(), bytes.size());
+        }
+        if (use_hash_index_) {
+            const uint32_t hash = HashIndexHash(ExtractUserKey(key));
+            const auto restart_index = static_cast<uint32_t>(restarts_.size() - 1);
+            if (hash_entries_.empty() || hash_entries_.back() != std::make_pair(hash, restart_index)) {
+                hash_entries_.emplace_back(hash, restart_index);
+            }
+        }
+        const size_t non_shared = key.size() - shared;
+
+        PutVarint32(&buffer_, static_cast<uint32_t>(shared));
+        PutVarint32(&buffer_, static_cast<uint32_t>(non_shared));
+        PutVarint32(&buffer_, static_cast<uint32_t>(value.size()));
+
+        buffer_.append(key.data() + shared, non_shared);
+        buffer_.append(value.data(), value.size());
+
+        last_key_.resize(shared);
+        last_key_.append(key.data() + shared, non_shared);
+        assert(Slice(last_key_) == key);
+        counter_++;
+    }
+
+}
@@ -0,0 +1,73 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_BLOCK_BUILDER_H
+#define MY_LEVELDB_BLOCK_BUILDER_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    struct Options;
+
+    /**
+     * @brief 构建前缀压缩的block.
+     *
+     * 每条记录: shared(varint32) | non_shared(varint32) | value_length(varint32)
+     *          | key_delta[non_shared] | value[value_length]
+     * shared是与上一个key相同的前缀长度. 每block_restart_interval条记录设置一个restart点,
+     * restart点的记录不做前缀压缩(shared == 0).
+     *
+     * block尾部: restarts(fixed32 * n) | [key前缀(fixed64 * n) | skip(fixed32)]
+     *          | [hash桶(uint8 * m) | m(fixed32)] | num_restarts(fixed32)
+     * 比较器HasOrderedBytes()时为每个restart点额外保存定长的key前缀, 见format.h.
+     * 同一个block中的key往往有很长的公共前缀, 所以前缀从所有restart点key的公共部分之后开始取.
+     * 查找时先比较这些整数, 大部分情况下不需要解码restart点的key.
+     * use_hash_index时key必须是internal key, 按user key建立到restart区间的hash索引.
+    */
+    class BlockBuilder {
+    public:
+        explicit BlockBuilder(const Options *options, bool use_hash_index = false);
+
+        BlockBuilder(const BlockBuilder &) = delete;
+        BlockBuilder &operator=(const BlockBuilder &) = delete;
+
+        // 清空内容, 如同刚刚构造.
+        void Reset();
+
+        // REQUIRES: Finish()之后没有调用过Reset()
+        // REQUIRES: key大于之前加入的所有key
+        void Add(const Slice &key, const Slice &value);
+
+        // 返回block的完整内容, 在builder被销毁或者Reset()之前有效.
+        Slice Finish();
+
+        // 当前正在构建的block(未压缩)的大小估计.
+        size_t CurrentSizeEstimate() const;
+
+        bool empty() const { return buffer_.empty(); }
+
+    private:
+        const Options *options_;
+        const bool use_key_prefix_;         // 是否保存restart点的key前缀
+        std::string buffer_;
+        std::vector<uint32_t> restarts_;
+        std::string restart_keys_;          // 每个restart点key的OrderedBytes, 拼接在一起
+        std::vector<size_t> restart_key_starts_;
+        const bool use_hash_index_;
+        // 每个user key的hash以及所在的restart区间, 同一区间内连续的相同user key只记录一次
+        std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
+        int counter_;                       // 上一个restart点之后的记录数
+        bool finished_;
+        std::string last_key_;
+    };
+
+}
+
+#endif //MY_LEVELDB_BLOCK_BUILDER_H
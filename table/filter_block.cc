@@ -0,0 +1,140 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/filter_block.h"
+
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    // 每2KB的数据生成一个filter
+    static const size_t kFilterBaseLg = 11;
+    static const size_t kFilterBase = 1 << kFilterBaseLg;
+
+    FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy *policy) : policy_(policy) {}
+
+    void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+        const uint64_t filter_index = (block_offset / kFilterBase);
+        assert(filter_index >= filter_offsets_.size());
+        while (filter_index > filter_offsets_.size()) {
+            GenerateFilter();
+        }
+    }
+
+    void FilterBlockBuilder::AddKey(const Slice &key) {
+        start_.push_back(keys_.size());
+        keys_.append(key.data(), key.size());
+    }
+
+    // filter block格式: filter[0] ... filter[n-1] | offset[0..n-1](fixed32) | offset数组的偏移(fixed32) | base_lg(1字节)
+    Slice FilterBlockBuilder::Finish() {
+        if (!start_.empty()) {
+            GenerateFilter();
+        }
+
+        const auto array_offset = static_cast<uint32_t>(result_.size());
+        for (uint32_t offset : filter_offsets_) {
+            PutFixed32(&result_, offset);
+        }
+
+        PutFixed32(&result_, array_offset);
+        result_.push_back(static_cast<char>(kFilterBaseLg));
+        return Slice(result_);
+    }
+
+    void FilterBlockBuilder::GenerateFilter() {
+        const size_t num_keys = start_.size();
+        if (num_keys == 0) {
+            // 这个区间没有key, 直接指向上一个filter的末尾(空filter)
+            filter_offsets_.push_back(static_cast<uint32_t>(result_.size()));
+            return;
+        }
+
+        // 从拼接的keys_中拆出每个key
+        start_.push_back(keys_.size());  // 方便计算最后一个key的长度
+        tmp_keys_.resize(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            const char *base = keys_.data() + start_[i];
+            const size_t length = start_[i + 1] - start_[i];
+            tmp_keys_[i] = Slice(base, length);
+        }
+
+        filter_offsets_.push_back(static_cast<uint32_t>(result_.size()));
+        policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+
+        tmp_keys_.clear();
+        keys_.clear();
+        start_.clear();
+    }
+
+    FullFilterBlockBuilder::FullFilterBlockBuilder(const FilterPolicy *policy) : policy_(policy) {}
+
+    void FullFilterBlockBuilder::AddKey(const Slice &key) {
+        start_.push_back(keys_.size());
+        keys_.append(key.data(), key.size());
+    }
+
+    Slice FullFilterBlockBuilder::Finish() {
+        const size_t num_keys = start_.size();
+        start_.push_back(keys_.size());
+        std::vector<Slice> keys(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            keys[i] = Slice(keys_.data() + start_[i], start_[i + 1] - start_[i]);
+        }
+        policy_->CreateFilter(keys.data(), static_cast<int>(num_keys), &result_);
+
+        // key只在构建时需要
+        std::string().swap(keys_);
+        std::vector<size_t>().swap(start_);
+        return Slice(result_);
+    }
+
+    FilterBlockReader::FilterBlockReader(const FilterPolicy *policy, const Slice &contents)
+            : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
+        const size_t n = contents.size();
+        if (n < 5) {
+            return;  // 1字节base_lg + 4字节offset数组的偏移
+        }
+        base_lg_ = contents[n - 1];
+        const uint32_t last_word = DecodeFixed32(contents.data() + n - 5);
+        if (last_word > n - 5) {
+            return;
+        }
+        data_ = contents.data();
+        offset_ = data_ + last_word;
+        num_ = (n - 5 - last_word) / 4;
+    }
+
+    bool FilterBlockReader::GetFilter(uint64_t block_offset, Slice *filter) const {
+        const uint64_t index = block_offset >> base_lg_;
+        if (index < num_) {
+            const uint32_t start = DecodeFixed32(offset_ + index * 4);
+            const uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
+            if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
+                *filter = Slice(data_ + start, limit - start);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice &key) {
+        Slice filter;
+        if (GetFilter(block_offset, &filter)) {
+            return policy_->KeyMayMatch(key, filter);
+        }
+        // 出错时当作可能存在
+        return true;
+    }
+
+    bool FilterBlockReader::PrefixMayMatch(uint64_t block_offset, const Slice &key) {
+        Slice filter;
+        if (GetFilter(block_offset, &filter)) {
+            return policy_->PrefixMayMatch(key, filter);
+        }
+        return true;
+    }
+
+}
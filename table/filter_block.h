@@ -0,0 +1,98 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_FILTER_BLOCK_H
+#define MY_LEVELDB_FILTER_BLOCK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+    class FilterPolicy;
+
+    /**
+     * @brief 为一个sstable构建filter block: 每2KB的data block偏移对应一个filter,
+     * 起始于同一个2KB区间的data block共享一个filter.
+     *
+     * 调用顺序: (StartBlock AddKey*)* Finish
+    */
+    class FilterBlockBuilder {
+    public:
+        explicit FilterBlockBuilder(const FilterPolicy *policy);
+
+        FilterBlockBuilder(const FilterBlockBuilder &) = delete;
+        FilterBlockBuilder &operator=(const FilterBlockBuilder &) = delete;
+
+        void StartBlock(uint64_t block_offset);
+
+        void AddKey(const Slice &key);
+
+        Slice Finish();
+
+        // 已经生成的filter的大小.
+        size_t CurrentSizeEstimate() const { return result_.size() + filter_offsets_.size() * sizeof(uint32_t); }
+
+    private:
+        void GenerateFilter();
+
+        const FilterPolicy *policy_;
+        std::string keys_;                  // 当前filter的所有key拼接在一起
+        std::vector<size_t> start_;         // 每个key在keys_中的起始位置
+        std::string result_;                // 已经生成的filter
+        std::vector<Slice> tmp_keys_;       // policy_->CreateFilter()的参数
+        std::vector<uint32_t> filter_offsets_;
+    };
+
+    /**
+     * @brief 为整个sstable构建一个filter, 内容就是FilterPolicy::CreateFilter()的输出.
+     *
+     * 调用顺序: AddKey* Finish
+    */
+    class FullFilterBlockBuilder {
+    public:
+        explicit FullFilterBlockBuilder(const FilterPolicy *policy);
+
+        FullFilterBlockBuilder(const FullFilterBlockBuilder &) = delete;
+        FullFilterBlockBuilder &operator=(const FullFilterBlockBuilder &) = delete;
+
+        void AddKey(const Slice &key);
+
+        Slice Finish();
+
+    private:
+        const FilterPolicy *policy_;
+        std::string keys_;                  // 所有key拼接在一起
+        std::vector<size_t> start_;         // 每个key在keys_中的起始位置
+        std::string result_;
+    };
+
+    class FilterBlockReader {
+    public:
+        // REQUIRES: 在*this存活期间contents和policy都保持有效
+        FilterBlockReader(const FilterPolicy *policy, const Slice &contents);
+
+        bool KeyMayMatch(uint64_t block_offset, const Slice &key);
+
+        // 见FilterPolicy::PrefixMayMatch.
+        bool PrefixMayMatch(uint64_t block_offset, const Slice &key);
+
+    private:
+        // block_offset对应的filter, 没有时返回false
+        bool GetFilter(uint64_t block_offset, Slice *filter) const;
+
+        const FilterPolicy *policy_;
+        const char *data_;      // filter数据(block的起始位置)
+        const char *offset_;    // offset数组的起始位置(block的末尾)
+        size_t num_;            // offset数组中的项数
+        size_t base_lg_;        // 编码参数(见filter_block.cc中的kFilterBaseLg)
+    };
+
+}
+
+#endif //MY_LEVELDB_FILTER_BLOCK_H
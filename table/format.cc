@@ -0,0 +1,205 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/format.h"
+
+#include "leveldb/env.h"
+#include "leveldb/options.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+    void BlockHandle::EncodeTo(std::string *dst) const {
+        // 两个字段都必须已经被设置
+        assert(offset_ != ~static_cast<uint64_t>(0));
+        assert(size_ != ~static_cast<uint64_t>(0));
+        PutVarint64(dst, offset_);
+        PutVarint64(dst, size_);
+    }
+
+    Status BlockHandle::DecodeFrom(Slice *input) {
+        if (GetVarint64(input, &offset_) && GetVarint64(input, &size_)) {
+            return Status::OK();
+        }
+        return Status::Corruption("bad block handle");
+    }
+
+    void Footer::EncodeTo(std::string *dst) const {
+        const size_t original_size = dst->size();
+        metaindex_handle_.EncodeTo(dst);
+        index_handle_.EncodeTo(dst);
+        dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength);
+        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber & 0xffffffffu));
+        PutFixed32(dst, static_cast<uint32_t>(kTableMagicNumber >> 32));
+        assert(dst->size() == original_size + kEncodedLength);
+    }
+
+    Status Footer::DecodeFrom(Slice *input) {
+        if (input->size() < kEncodedLength) {
+            return Status::Corruption("not an sstable (footer too short)");
+        }
+        const char *magic_ptr = input->data() + kEncodedLength - 8;
+        const uint32_t magic_lo = DecodeFixed32(magic_ptr);
+        const uint32_t magic_hi = DecodeFixed32(magic_ptr + 4);
+        const uint64_t magic = ((static_cast<uint64_t>(magic_hi) << 32) | (static_cast<uint64_t>(magic_lo)));
+        if (magic != kTableMagicNumber) {
+            return Status::Corruption("not an sstable (bad magic number)");
+        }
+
+        Status result = metaindex_handle_.DecodeFrom(input);
+        if (result.IsOK()) {
+            result = index_handle_.DecodeFrom(input);
+        }
+        if (result.IsOK()) {
+            // 跳过padding和magic
+            const char *end = magic_ptr + 8;
+            *input = Slice(end, input->data() + input->size() - end);
+        }
+        return result;
+    }
+
+    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options, const BlockHandle &handle,
+                     BlockContents *result, const port::ZstdDecompressionDict *dict) {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+
+        // 连同尾部的type和crc一起读取
+        const auto n = static_cast<size_t>(handle.size());
+        char *buf = new char[n + kBlockTrailerSize];
+        Slice contents;
+        Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+        if (!s.IsOK()) {
+            delete[] buf;
+            return s;
+        }
+        return DecodeBlock(options, handle, buf, contents, result, dict);
+    }
+
+    namespace {
+
+        struct AsyncBlockRead {
+            bool verify_checksums;
+            BlockHandle handle;
+            char *buf;
+            const port::ZstdDecompressionDict *dict;
+            ReadBlockCallback callback;
+            void *arg;
+        };
+
+        void OnBlockRead(void *arg, const Status &s, const Slice &contents) {
+            auto *read = reinterpret_cast<AsyncBlockRead *>(arg);
+            BlockContents result{Slice(), false, false};
+            Status status = s;
+            if (status.IsOK()) {
+                ReadOptions options;
+                options.verify_checksums = read->verify_checksums;
+                status = DecodeBlock(options, read->handle, read->buf, contents, &result, read->dict);
+            } else {
+                delete[] read->buf;
+            }
+            ReadBlockCallback callback = read->callback;
+            void *callback_arg = read->arg;
+            delete read;
+            callback(callback_arg, status, &result);
+        }
+
+    }  // anonymous namespace
+
+    void ReadBlockAsync(RandomAccessFile *file, const ReadOptions &options, const BlockHandle &handle,
+                        const port::ZstdDecompressionDict *dict, ReadBlockCallback callback, void *arg) {
+        const auto n = static_cast<size_t>(handle.size());
+        auto *read = new AsyncBlockRead{options.verify_checksums, handle, new char[n + kBlockTrailerSize], dict,
+                                        callback, arg};
+        file->ReadAsync(handle.offset(), n + kBlockTrailerSize, read->buf, &OnBlockRead, read);
+    }
+
+    Status DecodeBlock(const ReadOptions &options, const BlockHandle &handle, char *buf, const Slice &contents,
+                       BlockContents *result, const port::ZstdDecompressionDict *dict) {
+        result->data = Slice();
+        result->cachable = false;
+        result->heap_allocated = false;
+
+        const auto n = static_cast<size_t>(handle.size());
+        if (contents.size() != n + kBlockTrailerSize) {
+            delete[] buf;
+            return Status::Corruption("truncated block read");
+        }
+
+        const char *data = contents.data();
+        if (options.verify_checksums) {
+            const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
+            const uint32_t actual = crc32c::Value(data, n + 1);
+            if (actual != crc) {
+                delete[] buf;
+                return Status::Corruption("block checksum mismatch");
+            }
+        }
+
+        switch (data[n]) {
+            case kNoCompression:
+                if (data != buf) {
+                    // 文件实现直接返回了内部的内存(例如mmap), 不需要再拷贝, 也不要再缓存一份
+                    delete[] buf;
+                    result->data = Slice(data, n);
+                    result->heap_allocated = false;
+                    result->cachable = false;
+                } else {
+                    result->data = Slice(buf, n);
+                    result->heap_allocated = true;
+                    result->cachable = true;
+                }
+                break;
+            case kSnappyCompression: {
+                size_t ulength = 0;
+                if (!port::Snappy_GetUncompressedLength(data, n, &ulength)) {
+                    delete[] buf;
+                    return Status::Corruption("corrupted compressed block contents");
+                }
+                char *ubuf = new char[ulength];
+                if (!port::Snappy_Uncompress(data, n, ubuf)) {
+                    delete[] buf;
+                    delete[] ubuf;
+                    return Status::Corruption("corrupted compressed block contents");
+                }
+                delete[] buf;
+                result->data = Slice(ubuf, ulength);
+                result->heap_allocated = true;
+                result->cachable = true;
+                break;
+            }
+            case kLZ4Compression:
+            case kZstdCompression: {
+                uint32_t ulength = 0;
+                const char *input = GetVarint32Ptr(data, data + n, &ulength);
+                if (input == nullptr) {
+                    delete[] buf;
+                    return Status::Corruption("corrupted compressed block contents");
+                }
+                const size_t length = data + n - input;
+                char *ubuf = new char[ulength];
+                const bool ok = data[n] == kLZ4Compression ? port::LZ4_Uncompress(input, length, ubuf, ulength)
+                                                           : port::Zstd_Uncompress(input, length, ubuf, ulength,
+                                                                                   dict);
+                delete[] buf;
+                if (!ok) {
+                    delete[] ubuf;
+                    return Status::Corruption("corrupted compressed block contents");
+                }
+                result->data = Slice(ubuf, ulength);
+                result->heap_allocated = true;
+                result->cachable = true;
+                break;
+            }
+            default:
+                delete[] buf;
+                return Status::Corruption("bad block type");
+        }
+
+        return Status::OK();
+    }
+
+}
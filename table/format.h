@@ -0,0 +1,168 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_FORMAT_H
+#define MY_LEVELDB_FORMAT_H
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+    class RandomAccessFile;
+    struct ReadOptions;
+
+    namespace port {
+        class ZstdDecompressionDict;
+    }
+
+    /**
+     * @brief 指向文件中一个block的位置: offset | size, 都以varint64编码.
+     * size不包括block尾部的type和crc.
+    */
+    class BlockHandle {
+    public:
+        // BlockHandle编码后的最大长度
+        enum { kMaxEncodedLength = 10 + 10 };
+
+        BlockHandle();
+
+        uint64_t offset() const { return offset_; }
+
+        void set_offset(uint64_t offset) { offset_ = offset; }
+
+        uint64_t size() const { return size_; }
+
+        void set_size(uint64_t size) { size_ = size; }
+
+        void EncodeTo(std::string *dst) const;
+
+        Status DecodeFrom(Slice *input);
+
+    private:
+        uint64_t offset_;
+        uint64_t size_;
+    };
+
+    /**
+     * @brief 固定长度的文件尾: metaindex_handle | index_handle | padding | magic(fixed64).
+    */
+    class Footer {
+    public:
+        // footer编码后的长度, 两个handle不足的部分补0
+        enum { kEncodedLength = 2 * BlockHandle::kMaxEncodedLength + 8 };
+
+        Footer() = default;
+
+        const BlockHandle &metaindex_handle() const { return metaindex_handle_; }
+
+        void set_metaindex_handle(const BlockHandle &h) { metaindex_handle_ = h; }
+
+        const BlockHandle &index_handle() const { return index_handle_; }
+
+        void set_index_handle(const BlockHandle &h) { index_handle_ = h; }
+
+        void EncodeTo(std::string *dst) const;
+
+        Status DecodeFrom(Slice *input);
+
+    private:
+        BlockHandle metaindex_handle_;
+        BlockHandle index_handle_;
+    };
+
+    // echo http://code.google.com/p/leveldb/ | sha1sum 的前64位
+    static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
+
+    // 每个block之后: 压缩类型(1字节) | crc(fixed32)
+    // lz4和zstd压缩的block内容为: 压缩前的大小(varint32) | 压缩数据
+    static const size_t kBlockTrailerSize = 5;
+
+    // block末尾的num_restarts(fixed32)的最高位: restart偏移数组之后紧跟着同样长度的key前缀数组,
+    // 以及所有restart点key的公共前缀长度skip(fixed32).
+    static const uint32_t kBlockKeyPrefixFlag = 1u << 31;
+
+    // key前缀数组中每项的长度. 每项是restart点key的OrderedBytes跳过公共的skip个字节之后的8个字节
+    // (不足补0), 按大端解释后以fixed64保存, 整数的大小关系与字节序一致.
+    static const size_t kRestartKeyPrefixSize = 8;
+
+    inline uint64_t RestartKeyPrefix(const Slice &ordered_bytes) {
+        uint64_t v = 0;
+        for (size_t i = 0; i < kRestartKeyPrefixSize; i++) {
+            const uint8_t c = i < ordered_bytes.size() ? static_cast<uint8_t>(ordered_bytes[i]) : 0;
+            v = (v << 8) | c;
+        }
+        return v;
+    }
+
+    // num_restarts的次高位: num_restarts之前是user key -> restart区间的hash索引,
+    // buckets(uint8 * num_buckets) | num_buckets(fixed32), 位于key前缀数组之后.
+    // 点查时据此直接定位到user key所在的restart区间.
+    static const uint32_t kBlockHashIndexFlag = 1u << 30;
+
+    // hash桶中的特殊值, restart区间的编号必须小于kHashIndexCollision,
+    // restart点更多的block不生成hash索引.
+    static const uint8_t kHashIndexNoEntry = 255;
+    static const uint8_t kHashIndexCollision = 254;
+
+    inline uint32_t HashIndexHash(const Slice &user_key) {
+        return Hash(user_key.data(), user_key.size(), 0x2b7e1516);
+    }
+
+    // metaindex中的key, 存在时footer中的index_handle指向顶层index:
+    // 每个分区一项, key为分区中最后一个index key,
+    // value为 index分区的handle | [filter分区的handle | 分区中第一个data block的偏移(varint64)].
+    static const char kPartitionedIndexKey[] = "index.partitioned";
+
+    // metaindex中的key前缀, 之后是FilterPolicy::Name(). 存在时顶层index的value中带有filter分区,
+    // filter分区中的偏移都相对于分区中第一个data block.
+    static const char kPartitionedFilterPrefix[] = "partitionedfilter.";
+
+    // metaindex中的key前缀, 之后是FilterPolicy::Name(). value指向覆盖整个文件的filter,
+    // 内容就是FilterPolicy::CreateFilter()的输出.
+    static const char kFullFilterPrefix[] = "fullfilter.";
+
+    // metaindex中的key, value指向zstd压缩字典. data block和index分区都使用这个字典压缩.
+    static const char kCompressionDictKey[] = "compression.dict";
+
+    struct BlockContents {
+        Slice data;             // block的实际内容
+        bool cachable;          // data可以被放进cache
+        bool heap_allocated;    // data由new[]分配, 调用方负责delete[]
+    };
+
+    /**
+     * @brief 读取handle指向的block, 必要时校验crc并解压.
+     * 成功时结果写入*result并返回OK. 使用字典压缩的block必须传入同一个字典.
+    */
+    Status ReadBlock(RandomAccessFile *file, const ReadOptions &options, const BlockHandle &handle,
+                     BlockContents *result, const port::ZstdDecompressionDict *dict = nullptr);
+
+    // 异步读取完成时调用, s为OK时*contents的语义同ReadBlock的result.
+    using ReadBlockCallback = void (*)(void *arg, const Status &s, BlockContents *contents);
+
+    /**
+     * @brief 通过RandomAccessFile::ReadAsync读取handle指向的block, 校验和解压在完成回调所在的线程中进行.
+     * callback可能在调用线程中直接执行(文件不支持异步读取时). file和dict在callback返回之前必须一直有效.
+    */
+    void ReadBlockAsync(RandomAccessFile *file, const ReadOptions &options, const BlockHandle &handle,
+                        const port::ZstdDecompressionDict *dict, ReadBlockCallback callback, void *arg);
+
+    /**
+     * @brief 校验并解压从文件中读到的block(含尾部的type和crc). buf是读取时使用的scratch(new[]分配),
+     * 由这个函数接管, contents可能指向buf, 也可能指向文件内部的内存(例如mmap).
+    */
+    Status DecodeBlock(const ReadOptions &options, const BlockHandle &handle, char *buf, const Slice &contents,
+                       BlockContents *result, const port::ZstdDecompressionDict *dict = nullptr);
+
+    inline BlockHandle::BlockHandle()
+            : offset_(~static_cast<uint64_t>(0)), size_(~static_cast<uint64_t>(0)) {}
+
+}
+
+#endif //MY_LEVELDB_FORMAT_H
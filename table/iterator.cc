@@ -5,32 +5,41 @@
 
 namespace leveldb {
 
-    Iterator::Iterator() {
-        cleanup_head_.function = nullptr;
-        cleanup_head_.next = nullptr;
+    Iterator::Iterator() : overflow_cleanups_(nullptr) {
+        for (CleanupNode &node : inline_cleanups_) {
+            node.function = nullptr;
+            node.next = nullptr;
+        }
     }
 
     Iterator::~Iterator() {
-        if (!cleanup_head_.IsEmpty()) {
-            cleanup_head_.Run();
-            for (CleanupNode *node = cleanup_head_.next; node != nullptr;) {
-                node->Run();
-                CleanupNode *next = node->next;
-                delete node;
-                node = next;
+        for (CleanupNode &node : inline_cleanups_) {
+            if (node.IsEmpty()) {
+                break;
             }
+            node.Run();
+        }
+        for (CleanupNode *node = overflow_cleanups_; node != nullptr;) {
+            node->Run();
+            CleanupNode *next = node->next;
+            delete node;
+            node = next;
         }
     }
 
     void Iterator::RegisterCleanup(CleanupFunction func, void *arg1, void *arg2) {
         assert(func != nullptr);
-        CleanupNode *node;
-        if (cleanup_head_.IsEmpty()) {
-            node = &cleanup_head_;
-        } else {
+        CleanupNode *node = nullptr;
+        for (CleanupNode &inline_node : inline_cleanups_) {
+            if (inline_node.IsEmpty()) {
+                node = &inline_node;
+                break;
+            }
+        }
+        if (node == nullptr) {
             node = new CleanupNode();
-            node->next = cleanup_head_.next;
-            cleanup_head_.next = node;
+            node->next = overflow_cleanups_;
+            overflow_cleanups_ = node;
         }
 
         node->function = func;
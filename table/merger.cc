@@ -0,0 +1,215 @@
+//
+// Created by kuiper on 2021/3/4.
+//
+
+#include "table/merger.h"
+
+#include <new>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "table/iterator_wrapper.h"
+#include "util/arena.h"
+
+namespace leveldb {
+
+    namespace {
+
+        class MergingIterator : public Iterator {
+        public:
+            MergingIterator(const Comparator *comparator, Iterator **children, int n, Arena *arena)
+                    : comparator_(comparator),
+                      is_arena_mode_(arena != nullptr),
+                      n_(n),
+                      current_(nullptr),
+                      direction_(kForward) {
+                if (is_arena_mode_) {
+                    char *mem = arena->AllocateAligned(sizeof(IteratorWrapper) * (n > 0 ? n : 1));
+                    children_ = reinterpret_cast<IteratorWrapper *>(mem);
+                    for (int i = 0; i < n; i++) {
+                        new(&children_[i]) IteratorWrapper();
+                    }
+                } else {
+                    children_ = new IteratorWrapper[n];
+                }
+                for (int i = 0; i < n; i++) {
+                    children_[i].Set(children[i]);
+                }
+            }
+
+            ~MergingIterator() override {
+                if (is_arena_mode_) {
+                    for (int i = 0; i < n_; i++) {
+                        children_[i].DeleteIter(true);
+                        children_[i].~IteratorWrapper();
+                    }
+                } else {
+                    delete[] children_;
+                }
+            }
+
+            bool Valid() const override { return (current_ != nullptr); }
+
+            void SeekToFirst() override {
+                for (int i = 0; i < n_; i++) {
+                    children_[i].SeekToFirst();
+                }
+                FindSmallest();
+                direction_ = kForward;
+            }
+
+            void SeekToLast() override {
+                for (int i = 0; i < n_; i++) {
+                    children_[i].SeekToLast();
+                }
+                FindLargest();
+                direction_ = kReverse;
+            }
+
+            void Seek(const Slice &target) override {
+                for (int i = 0; i < n_; i++) {
+                    children_[i].Seek(target);
+                }
+                FindSmallest();
+                direction_ = kForward;
+            }
+
+            // 被前缀filter跳过的子迭代器变为无效. 之后改变方向时用Seek重新定位, 不再过滤.
+            void SeekForPrefix(const Slice &target) override {
+                for (int i = 0; i < n_; i++) {
+                    children_[i].SeekForPrefix(target);
+                }
+                FindSmallest();
+                direction_ = kForward;
+            }
+
+            void Next() override {
+                assert(Valid());
+
+                // 保证所有非current的子迭代器都位于Key()之后.
+                // 如果之前是反向移动, 非current的子迭代器都在Key()之前, 需要重新定位.
+                if (direction_ != kForward) {
+                    for (int i = 0; i < n_; i++) {
+                        IteratorWrapper *child = &children_[i];
+                        if (child != current_) {
+                            child->Seek(Key());
+                            if (child->Valid() && comparator_->Compare(Key(), child->Key()) == 0) {
+                                child->Next();
+                            }
+                        }
+                    }
+                    direction_ = kForward;
+                }
+
+                current_->Next();
+                FindSmallest();
+            }
+
+            void Prev() override {
+                assert(Valid());
+
+                // 与Next对称: 保证所有非current的子迭代器都位于Key()之前.
+                if (direction_ != kReverse) {
+                    for (int i = 0; i < n_; i++) {
+                        IteratorWrapper *child = &children_[i];
+                        if (child != current_) {
+                            child->Seek(Key());
+                            if (child->Valid()) {
+                                // 第一个>=Key()的位置, 往前退一步就是<Key()的位置
+                                child->Prev();
+                            } else {
+                                // 所有记录都<Key()
+                                child->SeekToLast();
+                            }
+                        }
+                    }
+                    direction_ = kReverse;
+                }
+
+                current_->Prev();
+                FindLargest();
+            }
+
+            Slice Key() const override {
+                assert(Valid());
+                return current_->Key();
+            }
+
+            Slice Value() const override {
+                assert(Valid());
+                return current_->Value();
+            }
+
+            Status status() const override {
+                Status status;
+                for (int i = 0; i < n_; i++) {
+                    status = children_[i].status();
+                    if (!status.IsOK()) {
+                        break;
+                    }
+                }
+                return status;
+            }
+
+        private:
+            enum Direction {
+                kForward, kReverse
+            };
+
+            void FindSmallest();
+
+            void FindLargest();
+
+            // 子迭代器数量通常很少, 线性扫描即可, 不需要堆.
+            const Comparator *comparator_;
+            const bool is_arena_mode_;
+            IteratorWrapper *children_;
+            int n_;
+            IteratorWrapper *current_;
+            Direction direction_;
+        };
+
+        void MergingIterator::FindSmallest() {
+            IteratorWrapper *smallest = nullptr;
+            for (int i = 0; i < n_; i++) {
+                IteratorWrapper *child = &children_[i];
+                if (child->Valid()) {
+                    if (smallest == nullptr || comparator_->Compare(child->Key(), smallest->Key()) < 0) {
+                        smallest = child;
+                    }
+                }
+            }
+            current_ = smallest;
+        }
+
+        void MergingIterator::FindLargest() {
+            IteratorWrapper *largest = nullptr;
+            for (int i = n_ - 1; i >= 0; i--) {
+                IteratorWrapper *child = &children_[i];
+                if (child->Valid()) {
+                    if (largest == nullptr || comparator_->Compare(child->Key(), largest->Key()) > 0) {
+                        largest = child;
+                    }
+                }
+            }
+            current_ = largest;
+        }
+
+    }  // namespace
+
+    Iterator *NewMergingIterator(const Comparator *comparator, Iterator **children, int n, Arena *arena) {
+        assert(n >= 0);
+        if (n == 1) {
+            return children[0];
+        } else if (arena != nullptr) {
+            // n == 0时同样返回一个空的MergingIterator, 保证结果一定分配在arena中
+            char *mem = arena->AllocateAligned(sizeof(MergingIterator));
+            return new(mem) MergingIterator(comparator, children, n, arena);
+        } else if (n == 0) {
+            return NewEmptyIterator();
+        } else {
+            return new MergingIterator(comparator, children, n, nullptr);
+        }
+    }
+
+}
@@ -0,0 +1,27 @@
+//
+// Created by kuiper on 2021/3/4.
+//
+
+#ifndef MY_LEVELDB_MERGER_H
+#define MY_LEVELDB_MERGER_H
+
+namespace leveldb {
+
+    class Arena;
+    class Comparator;
+    class Iterator;
+
+    /**
+     * @brief 返回children[0, n-1]合并后的有序迭代器.
+     * 接管所有子迭代器的所有权, 结果迭代器被删除时一并删除.
+     * 不做去重, 某个key在k个子迭代器中存在则会出现k次.
+     * arena不为nullptr时结果迭代器分配在arena中, 此时所有子迭代器也必须分配在arena中,
+     * 释放时调用析构函数而不是delete.
+     * REQUIRES: n >= 0
+    */
+    Iterator *NewMergingIterator(const Comparator *comparator, Iterator **children, int n,
+                                 Arena *arena = nullptr);
+
+}
+
+#endif //MY_LEVELDB_MERGER_H
@@ -0,0 +1,65 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/readahead.h"
+
+#include <algorithm>
+
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+    Readahead::Readahead(const RandomAccessFile *file, size_t readahead_size, size_t max_readahead_size)
+            : file_(file),
+              adaptive_(readahead_size == 0),
+              max_readahead_size_(adaptive_ ? max_readahead_size : readahead_size),
+              readahead_size_(adaptive_ ? std::min(kInitialAutoReadaheadSize, max_readahead_size)
+                                        : readahead_size),
+              prev_end_(0),
+              num_sequential_reads_(0),
+              prefetched_until_(0) {
+    }
+
+    void Readahead::Reset() {
+        if (adaptive_) {
+            readahead_size_ = std::min(kInitialAutoReadaheadSize, max_readahead_size_);
+        }
+        num_sequential_reads_ = 0;
+        prefetched_until_ = 0;
+    }
+
+    void Readahead::OnRead(uint64_t offset, size_t n) {
+        const uint64_t end = offset + n;
+        if (offset == prev_end_) {
+            num_sequential_reads_++;
+        } else if (offset < prefetched_until_ && offset > prev_end_) {
+            // 向前跳过了一小段, 仍然在预读窗口之内, 视为顺序读取
+            num_sequential_reads_++;
+        } else {
+            Reset();
+            num_sequential_reads_ = 1;
+        }
+        prev_end_ = end;
+
+        if (max_readahead_size_ == 0) {
+            return;
+        }
+        if (adaptive_ && num_sequential_reads_ < kMinSequentialReads) {
+            return;
+        }
+
+        // 读取位置还没有进入窗口的后半段, 之前的预读足够.
+        if (prefetched_until_ > end && prefetched_until_ - end > readahead_size_ / 2) {
+            return;
+        }
+
+        const uint64_t start = std::max(end, prefetched_until_);
+        file_->Prefetch(start, readahead_size_);  // 只是提示, 失败不影响读取
+        prefetched_until_ = start + readahead_size_;
+        if (adaptive_) {
+            readahead_size_ = std::min(readahead_size_ * 2, max_readahead_size_);
+        }
+    }
+
+}
@@ -0,0 +1,61 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_READAHEAD_H
+#define MY_LEVELDB_READAHEAD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace leveldb {
+
+    class RandomAccessFile;
+
+    /**
+     * @brief 跟踪一个迭代器对同一个sstable的block读取, 在后续数据被真正读取之前
+     * 通过RandomAccessFile::Prefetch提示OS预读.
+     *
+     * readahead_size > 0时每次都按固定大小预读.
+     * readahead_size == 0时为自适应模式: 连续kMinSequentialReads次读取首尾相接之后才开始预读,
+     * 每次预读之后窗口大小翻倍, 直到max_readahead_size; 出现非顺序读取时回到初始状态.
+     * 当前读取位置进入已预读窗口的后半段时再提示下一段, 保证预读始终领先于读取.
+     *
+     * 不是线程安全的, 与迭代器一一对应.
+    */
+    class Readahead {
+    public:
+        static constexpr size_t kInitialAutoReadaheadSize = 8 * 1024;
+        static constexpr size_t kMaxAutoReadaheadSize = 256 * 1024;
+        static constexpr int kMinSequentialReads = 2;
+
+        Readahead(const RandomAccessFile *file, size_t readahead_size,
+                  size_t max_readahead_size = kMaxAutoReadaheadSize);
+
+        Readahead(const Readahead &) = delete;
+        Readahead &operator=(const Readahead &) = delete;
+
+        // 在读取[offset, offset + n)之前调用.
+        void OnRead(uint64_t offset, size_t n);
+
+        // 当前的预读窗口大小, 测试用.
+        size_t readahead_size() const { return readahead_size_; }
+
+        // 已经提示过的预读范围的末尾, 测试用.
+        uint64_t prefetched_until() const { return prefetched_until_; }
+
+    private:
+        void Reset();
+
+        const RandomAccessFile *const file_;
+        const bool adaptive_;
+        const size_t max_readahead_size_;
+        size_t readahead_size_;
+        uint64_t prev_end_;         // 上一次读取的结束位置
+        int num_sequential_reads_;
+        uint64_t prefetched_until_;
+    };
+
+}
+
+#endif //MY_LEVELDB_READAHEAD_H
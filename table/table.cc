@@ -0,0 +1,738 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "leveldb/table.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/options.h"
+#include "port/port.h"
+#include "table/block.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+#include "table/readahead.h"
+#include "table/two_level_iterator.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    struct Table::Rep {
+        ~Rep() {
+            delete filter;
+            delete[] filter_data;
+            delete index_block;
+            delete compression_dict;
+        }
+
+        Options options;
+        Status status;
+        RandomAccessFile *file;
+        uint64_t file_number;
+        uint64_t cache_id;
+        port::ZstdDecompressionDict *compression_dict;  // data block和index分区的压缩字典, 没有时为nullptr
+        const FilterPolicy *filter_policy;  // 文件中的filter对应的policy, 没有可用的filter时为nullptr
+        bool prefix_filter;             // filter按filter_policy->Name()找到, 包含key的前缀
+        FilterBlockReader *filter;
+        const char *filter_data;
+        bool has_full_filter;
+        Slice full_filter;              // 覆盖整个文件的filter, 数据由filter_data或者mmap持有
+
+        BlockHandle metaindex_handle;   // 从footer中读取
+        Block *index_block;             // index_partitioned时是顶层index
+        bool index_partitioned;
+
+        struct FilterPartition {
+            uint64_t base;              // 分区中第一个data block的偏移
+            BlockHandle handle;
+        };
+        // 按base排序, 分区的内容按需读取并放进block cache
+        std::vector<FilterPartition> filter_partitions;
+    };
+
+    namespace {
+
+        // 一个table迭代器的状态, 随迭代器释放.
+        struct TableIterState {
+            TableIterState(Table *t, const ReadOptions &opt, const RandomAccessFile *file)
+                    : table(t), options(opt), readahead(file, opt.readahead_size) {}
+
+            Table *const table;
+            const ReadOptions options;
+            Readahead readahead;
+        };
+
+        void DeleteTableIterState(void *arg1, void * /*arg2*/) {
+            delete reinterpret_cast<TableIterState *>(arg1);
+        }
+
+        // block cache的key: cache_id | file_number | offset, 都是fixed64.
+        // 以file_number | offset结尾, PersistentCache据此在重启之后仍然可以命中.
+        constexpr size_t kBlockCacheKeySize = 3 * 8;
+
+        Slice BlockCacheKey(uint64_t cache_id, uint64_t file_number, uint64_t offset, char *buf) {
+            EncodeFixed64(buf, cache_id);
+            EncodeFixed64(buf + 8, file_number);
+            EncodeFixed64(buf + 16, offset);
+            return Slice(buf, kBlockCacheKeySize);
+        }
+
+        void DeleteBlock(void *arg, void * /*ignored*/) {
+            delete reinterpret_cast<Block *>(arg);
+        }
+
+        void DeleteCachedBlock(const Slice & /*key*/, void *value) {
+            delete reinterpret_cast<Block *>(value);
+        }
+
+        void ReleaseBlock(void *arg, void *h) {
+            auto *cache = reinterpret_cast<Cache *>(arg);
+            auto *handle = reinterpret_cast<Cache::Handle *>(h);
+            cache->Release(handle);
+        }
+
+        // block被淘汰到二级缓存时保存解压之后的内容, 取回时不需要再解压.
+        void SaveBlockTo(void *value, std::string *out) {
+            const auto *block = reinterpret_cast<Block *>(value);
+            out->assign(block->data(), block->size());
+        }
+
+        void *CreateBlock(const Slice &data, size_t *charge) {
+            char *buf = new char[data.size()];
+            memcpy(buf, data.data(), data.size());
+            BlockContents contents;
+            contents.data = Slice(buf, data.size());
+            contents.cachable = true;
+            contents.heap_allocated = true;
+            auto *block = new Block(contents);
+            *charge = block->size();
+            return block;
+        }
+
+        const Cache::CacheItemHelper kBlockCacheHelper = {&SaveBlockTo, &CreateBlock, &DeleteCachedBlock};
+
+        // filter分区在block cache中保存为std::string.
+        void SaveFilterTo(void *value, std::string *out) {
+            *out = *reinterpret_cast<std::string *>(value);
+        }
+
+        void *CreateFilter(const Slice &data, size_t *charge) {
+            auto *filter = new std::string(data.data(), data.size());
+            *charge = filter->size();
+            return filter;
+        }
+
+        void DeleteCachedFilter(const Slice & /*key*/, void *value) {
+            delete reinterpret_cast<std::string *>(value);
+        }
+
+        const Cache::CacheItemHelper kFilterCacheHelper = {&SaveFilterTo, &CreateFilter, &DeleteCachedFilter};
+
+    }  // namespace
+
+    Status Table::Open(const Options &options, RandomAccessFile *file, uint64_t file_number, uint64_t size,
+                       Table **table) {
+        *table = nullptr;
+        if (size < Footer::kEncodedLength) {
+            return Status::Corruption("file is too short to be an sstable");
+        }
+
+        char footer_space[Footer::kEncodedLength];
+        Slice footer_input;
+        Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength, &footer_input, footer_space);
+        if (!s.IsOK()) return s;
+
+        Footer footer;
+        s = footer.DecodeFrom(&footer_input);
+        if (!s.IsOK()) return s;
+
+        // 读取index block
+        BlockContents index_block_contents;
+        ReadOptions opt;
+        if (options.paranoid_checks) {
+            opt.verify_checksums = true;
+        }
+        s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+
+        if (s.IsOK()) {
+            // 已经成功读取footer和index block, 可以开始提供服务了
+            auto *index_block = new Block(index_block_contents);
+            auto *rep = new Table::Rep;
+            rep->options = options;
+            rep->file = file;
+            rep->file_number = file_number;
+            rep->metaindex_handle = footer.metaindex_handle();
+            rep->index_block = index_block;
+            rep->index_partitioned = false;
+            rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+            rep->compression_dict = nullptr;
+            rep->filter_policy = nullptr;
+            rep->prefix_filter = false;
+            rep->filter_data = nullptr;
+            rep->filter = nullptr;
+            rep->has_full_filter = false;
+            *table = new Table(rep);
+            s = (*table)->ReadMeta(footer);
+            if (!s.IsOK()) {
+                delete *table;
+                *table = nullptr;
+            }
+        }
+
+        return s;
+    }
+
+    Status Table::ReadMeta(const Footer &footer) {
+        ReadOptions opt;
+        if (rep_->options.paranoid_checks) {
+            opt.verify_checksums = true;
+        }
+        BlockContents contents;
+        Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+        if (!s.IsOK()) {
+            // 无法确定index是否分区, 不能继续读取
+            return s;
+        }
+        auto *meta = new Block(contents);
+
+        Iterator *iter = meta->NewIterator(BytewiseComparator());
+        iter->Seek(kPartitionedIndexKey);
+        rep_->index_partitioned = iter->Valid() && iter->Key() == Slice(kPartitionedIndexKey);
+        s = iter->status();
+
+        // 没有字典无法解压data block, 读取字典出错时Open失败
+        if (s.IsOK()) {
+            iter->Seek(kCompressionDictKey);
+            if (iter->Valid() && iter->Key() == Slice(kCompressionDictKey)) {
+                Slice v = iter->Value();
+                BlockHandle dict_handle;
+                BlockContents dict_contents;
+                s = dict_handle.DecodeFrom(&v);
+                if (s.IsOK()) {
+                    s = ReadBlock(rep_->file, opt, dict_handle, &dict_contents);
+                }
+                if (s.IsOK()) {
+                    rep_->compression_dict = new port::ZstdDecompressionDict(dict_contents.data.data(),
+                                                                             dict_contents.data.size());
+                    if (dict_contents.heap_allocated) {
+                        delete[] dict_contents.data.data();
+                    }
+                }
+            }
+        }
+
+        // 读取filter出错时不影响正常的读取, 只是没有filter.
+        // 最底层的文件可能使用bottommost_filter_policy构建, 两种policy都尝试;
+        // 没有Name()对应的filter时再找只包含完整key的filter, 它不能用于前缀过滤.
+        const FilterPolicy *policies[] = {rep_->options.filter_policy, rep_->options.bottommost_filter_policy};
+        for (const FilterPolicy *policy : policies) {
+            if (!s.IsOK() || policy == nullptr) {
+                continue;
+            }
+            const char *names[] = {policy->Name(), policy->KeyOnlyName()};
+            for (const char *name : names) {
+                if (name == nullptr || rep_->filter_policy != nullptr) {
+                    continue;
+                }
+                std::string key = kFullFilterPrefix;
+                key.append(name);
+                iter->Seek(key);
+                const bool whole_file = iter->Valid() && iter->Key() == Slice(key);
+                if (!whole_file) {
+                    key = rep_->index_partitioned ? kPartitionedFilterPrefix : "filter.";
+                    key.append(name);
+                    iter->Seek(key);
+                    if (!iter->Valid() || iter->Key() != Slice(key)) {
+                        continue;
+                    }
+                }
+                rep_->filter_policy = policy;
+                rep_->prefix_filter = name == names[0] && policy->KeyOnlyName() != nullptr;
+                if (whole_file) {
+                    ReadFilter(iter->Value(), true);
+                } else if (rep_->index_partitioned) {
+                    ReadFilterPartitions();
+                } else {
+                    ReadFilter(iter->Value(), false);
+                }
+            }
+        }
+        delete iter;
+        delete meta;
+        return s;
+    }
+
+    void Table::ReadFilter(const Slice &filter_handle_value, bool whole_file) {
+        Slice v = filter_handle_value;
+        BlockHandle filter_handle;
+        if (!filter_handle.DecodeFrom(&v).IsOK()) {
+            return;
+        }
+
+        ReadOptions opt;
+        if (rep_->options.paranoid_checks) {
+            opt.verify_checksums = true;
+        }
+        BlockContents block;
+        if (!ReadBlock(rep_->file, opt, filter_handle, &block).IsOK()) {
+            return;
+        }
+        if (block.heap_allocated) {
+            rep_->filter_data = block.data.data();  // 析构时释放
+        }
+        if (whole_file) {
+            rep_->has_full_filter = true;
+            rep_->full_filter = block.data;
+        } else {
+            rep_->filter = new FilterBlockReader(rep_->filter_policy, block.data);
+        }
+    }
+
+    void Table::ReadFilterPartitions() {
+        Iterator *iter = rep_->index_block->NewIterator(rep_->options.comparator);
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            Slice input = iter->Value();
+            BlockHandle index_handle;
+            Rep::FilterPartition partition;
+            if (!index_handle.DecodeFrom(&input).IsOK() || !partition.handle.DecodeFrom(&input).IsOK() ||
+                !GetVarint64(&input, &partition.base)) {
+                break;
+            }
+            rep_->filter_partitions.push_back(partition);
+        }
+        if (iter->Valid() || !iter->status().IsOK()) {
+            // 有无法解析的项, 不使用filter
+            rep_->filter_partitions.clear();
+        }
+        delete iter;
+    }
+
+    Table::~Table() { delete rep_; }
+
+    // 把index_value(编码的BlockHandle)转换为对应data block的迭代器.
+    // 优先从block cache中读取, readahead不为nullptr时在读取文件之前更新预读状态.
+    Iterator *Table::BlockReader(Table *table, Readahead *readahead, const ReadOptions &options,
+                                 const Slice &index_value, Block **blockptr, bool high_priority,
+                                 bool cache_only) {
+        Cache *block_cache = table->rep_->options.block_cache;
+        if (blockptr != nullptr) {
+            *blockptr = nullptr;
+        }
+
+        BlockHandle handle;
+        Slice input = index_value;
+        Status s = handle.DecodeFrom(&input);
+        // 这里没有检查input中剩余的内容, 以便之后在index value中追加更多的信息
+        if (!s.IsOK()) {
+            return NewErrorIterator(s);
+        }
+
+        if (block_cache != nullptr) {
+            char cache_key_buffer[kBlockCacheKeySize];
+            const Slice key = BlockCacheKey(table->rep_->cache_id, table->rep_->file_number, handle.offset(),
+                                            cache_key_buffer);
+            Cache::Handle *cache_handle = block_cache->Lookup(key, &kBlockCacheHelper);
+            if (cache_handle != nullptr) {
+                auto *block = reinterpret_cast<Block *>(block_cache->Value(cache_handle));
+                Iterator *iter = block->NewIterator(table->rep_->options.comparator);
+                iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+                if (blockptr != nullptr) {
+                    *blockptr = block;
+                }
+                return iter;
+            }
+        }
+        if (cache_only) {
+            return nullptr;
+        }
+
+        if (readahead != nullptr) {
+            readahead->OnRead(handle.offset(), handle.size() + kBlockTrailerSize);
+        }
+        BlockContents contents;
+        s = ReadBlock(table->rep_->file, options, handle, &contents, table->rep_->compression_dict);
+        if (!s.IsOK()) {
+            return NewErrorIterator(s);
+        }
+        return NewBlockIterator(table, options, handle, contents, blockptr, high_priority);
+    }
+
+    Iterator *Table::NewBlockIterator(Table *table, const ReadOptions &options, const BlockHandle &handle,
+                                      const BlockContents &contents, Block **blockptr, bool high_priority) {
+        Cache *block_cache = table->rep_->options.block_cache;
+        auto *block = new Block(contents);
+        Cache::Handle *cache_handle = nullptr;
+        if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+            char cache_key_buffer[kBlockCacheKeySize];
+            const Slice key = BlockCacheKey(table->rep_->cache_id, table->rep_->file_number, handle.offset(),
+                                            cache_key_buffer);
+            cache_handle = block_cache->Insert(key, block, block->size(), &kBlockCacheHelper,
+                                               high_priority ? Cache::Priority::HIGH : Cache::Priority::LOW);
+        }
+
+        Iterator *iter = block->NewIterator(table->rep_->options.comparator);
+        if (cache_handle == nullptr) {
+            iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+        } else {
+            iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+        }
+        if (blockptr != nullptr) {
+            *blockptr = block;
+        }
+        return iter;
+    }
+
+    Iterator *Table::NewIterator(const ReadOptions &options) const {
+        return NewIterator(options, nullptr);
+    }
+
+    Iterator *Table::NewIterator(const ReadOptions &options, Arena *arena, const Slice *index_upper_bound) const {
+        auto *state = new TableIterState(const_cast<Table *>(this), options, rep_->file);
+        BlockFunction block_reader = [](void *arg, const ReadOptions &opt, const Slice &index_value) {
+            auto *st = reinterpret_cast<TableIterState *>(arg);
+            return BlockReader(st->table, &st->readahead, opt, index_value);
+        };
+        // prefix_same_as_start时, SeekForPrefix先用filter检查target的前缀
+        SeekFilterFunction seek_filter = nullptr;
+        if (options.prefix_same_as_start && rep_->prefix_filter &&
+            (rep_->has_full_filter || rep_->filter != nullptr || !rep_->filter_partitions.empty())) {
+            seek_filter = [](void *arg, const Slice &index_value, const Slice &target) -> bool {
+                const auto *st = reinterpret_cast<TableIterState *>(arg);
+                BlockHandle handle;
+                Slice input = index_value;
+                if (!handle.DecodeFrom(&input).IsOK()) {
+                    return true;
+                }
+                return st->table->FilterMayMatch(st->options, handle.offset(), target, true);
+            };
+        }
+        Iterator *iter = NewTwoLevelIterator(NewIndexIterator(options), block_reader, state, options, seek_filter,
+                                             arena, rep_->options.comparator, index_upper_bound);
+        iter->RegisterCleanup(&DeleteTableIterState, state, nullptr);
+        return iter;
+    }
+
+    Iterator *Table::NewIndexIterator(const ReadOptions &options) const {
+        Iterator *index_iter = rep_->index_block->NewIterator(rep_->options.comparator);
+        if (!rep_->index_partitioned) {
+            return index_iter;
+        }
+        BlockFunction partition_reader = [](void *arg, const ReadOptions &opt, const Slice &index_value) {
+            return BlockReader(reinterpret_cast<Table *>(arg), nullptr, opt, index_value, nullptr, true);
+        };
+        return NewTwoLevelIterator(index_iter, partition_reader, const_cast<Table *>(this), options);
+    }
+
+    bool Table::FilterMayMatch(const ReadOptions &options, uint64_t block_offset, const Slice &key,
+                               bool prefix) const {
+        if (prefix && !rep_->prefix_filter) {
+            return true;
+        }
+        if (rep_->has_full_filter) {
+            const Slice &filter = rep_->full_filter;
+            return prefix ? rep_->filter_policy->PrefixMayMatch(key, filter)
+                          : rep_->filter_policy->KeyMayMatch(key, filter);
+        }
+        FilterBlockReader *filter = rep_->filter;
+        if (filter != nullptr) {
+            return prefix ? filter->PrefixMayMatch(block_offset, key) : filter->KeyMayMatch(block_offset, key);
+        }
+
+        // 最后一个起始偏移 <= block_offset 的分区
+        const auto &partitions = rep_->filter_partitions;
+        auto it = std::upper_bound(partitions.begin(), partitions.end(), block_offset,
+                                   [](uint64_t offset, const Rep::FilterPartition &p) { return offset < p.base; });
+        if (it == partitions.begin()) {
+            return true;
+        }
+        --it;
+
+        Cache *block_cache = rep_->options.block_cache;
+        Cache::Handle *cache_handle = nullptr;
+        std::string *data = nullptr;
+        char cache_key_buffer[kBlockCacheKeySize];
+        const Slice cache_key = BlockCacheKey(rep_->cache_id, rep_->file_number, it->handle.offset(),
+                                              cache_key_buffer);
+        if (block_cache != nullptr) {
+            cache_handle = block_cache->Lookup(cache_key, &kFilterCacheHelper);
+            if (cache_handle != nullptr) {
+                data = reinterpret_cast<std::string *>(block_cache->Value(cache_handle));
+            }
+        }
+        if (data == nullptr) {
+            BlockContents contents;
+            if (!ReadBlock(rep_->file, options, it->handle, &contents).IsOK()) {
+                return true;
+            }
+            data = new std::string(contents.data.data(), contents.data.size());
+            if (contents.heap_allocated) {
+                delete[] contents.data.data();
+            }
+            if (block_cache != nullptr && options.fill_cache) {
+                cache_handle = block_cache->Insert(cache_key, data, data->size(), &kFilterCacheHelper,
+                                                   Cache::Priority::HIGH);
+            }
+        }
+
+        FilterBlockReader reader(rep_->filter_policy, *data);
+        const uint64_t offset = block_offset - it->base;
+        const bool result = prefix ? reader.PrefixMayMatch(offset, key) : reader.KeyMayMatch(offset, key);
+        if (cache_handle != nullptr) {
+            block_cache->Release(cache_handle);
+        } else {
+            delete data;
+        }
+        return result;
+    }
+
+    bool Table::BlockMayMatch(const ReadOptions &options, const Slice &index_value, const Slice &k) const {
+        if (rep_->has_full_filter) {
+            // 已经在InternalGet的入口检查过
+            return true;
+        }
+        Slice input = index_value;
+        BlockHandle handle;
+        return !handle.DecodeFrom(&input).IsOK() || FilterMayMatch(options, handle.offset(), k, false);
+    }
+
+    Status Table::InternalGet(const ReadOptions &options, const Slice &k, void *arg,
+                              bool (*handle_result)(void *, const Slice &, const Slice &),
+                              Iterator **pinned_block) {
+        Status s;
+        if (pinned_block != nullptr) {
+            *pinned_block = nullptr;
+        }
+        if (rep_->has_full_filter && !rep_->filter_policy->KeyMayMatch(k, rep_->full_filter)) {
+            // 整个文件的filter判定不存在, 不需要读取index
+            return s;
+        }
+        Iterator *iiter = NewIndexIterator(options);
+        iiter->Seek(k);
+        // filter判定不存在时不读取data block
+        if (iiter->Valid() && BlockMayMatch(options, iiter->Value(), k)) {
+            s = GetFromBlocks(options, k, arg, handle_result, iiter, nullptr, nullptr, pinned_block);
+        }
+        if (s.IsOK()) {
+            s = iiter->status();
+        }
+        delete iiter;
+        return s;
+    }
+
+    Status Table::GetFromBlocks(const ReadOptions &options, const Slice &k, void *arg,
+                                bool (*handle_result)(void *, const Slice &, const Slice &), Iterator *iiter,
+                                Iterator *block_iter, Block *block, Iterator **pinned_block) {
+        Status s;
+        bool first_block = true;
+        bool more = true;
+        while (more && iiter->Valid()) {
+            if (!first_block || block_iter == nullptr) {
+                block = nullptr;
+                block_iter = BlockReader(this, nullptr, options, iiter->Value(), &block);
+            }
+            if (first_block) {
+                if (block == nullptr) {
+                    block_iter->Seek(k);
+                } else if (!block->SeekForGet(block_iter, k)) {
+                    // hash索引判定user key不在这个block中. index key不小于k, 所以之后的block中也不会有
+                    more = false;
+                }
+                first_block = false;
+            } else {
+                // 同一个key的记录跨越了block
+                block_iter->SeekToFirst();
+            }
+            bool result_done = false;
+            for (; more && block_iter->Valid(); block_iter->Next()) {
+                more = (*handle_result)(arg, block_iter->Key(), block_iter->Value());
+                if (!more) {
+                    result_done = true;
+                    break;
+                }
+            }
+            s = block_iter->status();
+            if (result_done && s.IsOK() && pinned_block != nullptr) {
+                // 最后一个结果指向这个block, 交给调用方持有
+                *pinned_block = block_iter;
+                break;
+            }
+            delete block_iter;
+            if (!s.IsOK()) {
+                break;
+            }
+            iiter->Next();
+        }
+        return s;
+    }
+
+    void Table::MultiGet(const ReadOptions &options, const Slice *keys, size_t n, void *const *args,
+                         bool (*handle_result)(void *, const Slice &, const Slice &), Status *statuses) {
+        const Comparator *cmp = rep_->options.comparator;
+        Iterator *iiter = nullptr;
+        Iterator *block_iter = nullptr;     // iiter当前指向的data block, 第一次需要时才读取
+        Block *block = nullptr;
+        for (size_t i = 0; i < n; i++) {
+            const Slice &k = keys[i];
+            statuses[i] = Status::OK();
+            if (rep_->has_full_filter && !rep_->filter_policy->KeyMayMatch(k, rep_->full_filter)) {
+                continue;
+            }
+            // keys有序, 上一个key所在的block的index key >= k时k也落在这个block中, 不需要重新Seek
+            if (iiter == nullptr) {
+                iiter = NewIndexIterator(options);
+                iiter->Seek(k);
+            } else if (iiter->Valid() && cmp->Compare(k, iiter->Key()) > 0) {
+                iiter->Seek(k);
+                delete block_iter;
+                block_iter = nullptr;
+            }
+            if (!iiter->Valid()) {
+                statuses[i] = iiter->status();
+                continue;
+            }
+            if (!BlockMayMatch(options, iiter->Value(), k)) {
+                continue;
+            }
+            if (block_iter == nullptr) {
+                block = nullptr;
+                block_iter = BlockReader(this, nullptr, options, iiter->Value(), &block);
+            }
+
+            bool more = true;
+            if (block == nullptr) {
+                block_iter->Seek(k);
+            } else if (!block->SeekForGet(block_iter, k)) {
+                more = false;
+            }
+            for (; more && block_iter->Valid(); block_iter->Next()) {
+                more = (*handle_result)(args[i], block_iter->Key(), block_iter->Value());
+            }
+            Status s = block_iter->status();
+            if (s.IsOK() && more) {
+                // k在block的最后一条记录之后, 或者记录延续到了后面的block. 用单独的index迭代器
+                // 从下一个block继续, batch中的位置保持不变. 这种情况很少
+                Iterator *next = NewIndexIterator(options);
+                next->Seek(k);
+                if (next->Valid()) {
+                    next->Next();
+                }
+                s = GetFromBlocks(options, k, args[i], handle_result, next, nullptr, nullptr, nullptr);
+                if (s.IsOK()) {
+                    s = next->status();
+                }
+                delete next;
+            }
+            statuses[i] = s;
+        }
+        delete block_iter;
+        delete iiter;
+    }
+
+    namespace {
+
+        // 一次InternalGetAsync的状态, 在第一个data block读取完成之后释放.
+        struct AsyncGetState {
+            Table *table;
+            ReadOptions options;
+            std::string key;
+            void *arg;
+            bool (*handle_result)(void *, const Slice &, const Slice &);
+            Table::GetCallback callback;
+            Iterator *iiter;    // 指向第一个data block
+            BlockHandle handle;
+        };
+
+    }  // anonymous namespace
+
+    void Table::InternalGetAsync(const ReadOptions &options, const Slice &k, void *arg,
+                                 bool (*handle_result)(void *, const Slice &, const Slice &), GetCallback callback) {
+        if (rep_->has_full_filter && !rep_->filter_policy->KeyMayMatch(k, rep_->full_filter)) {
+            callback(arg, Status::OK());
+            return;
+        }
+        Iterator *iiter = NewIndexIterator(options);
+        iiter->Seek(k);
+        Status s;
+        if (!iiter->Valid() || !BlockMayMatch(options, iiter->Value(), k)) {
+            s = iiter->status();
+            delete iiter;
+            callback(arg, s);
+            return;
+        }
+
+        // 第一个data block已经在block cache中时直接在当前线程中完成
+        Block *block = nullptr;
+        Iterator *block_iter = BlockReader(this, nullptr, options, iiter->Value(), &block, false, true);
+        if (block_iter != nullptr) {
+            s = GetFromBlocks(options, k, arg, handle_result, iiter, block_iter, block, nullptr);
+            if (s.IsOK()) {
+                s = iiter->status();
+            }
+            delete iiter;
+            callback(arg, s);
+            return;
+        }
+
+        auto *state = new AsyncGetState{this, options, k.ToString(), arg, handle_result, callback, iiter,
+                                        BlockHandle()};
+        Slice input = iiter->Value();
+        s = state->handle.DecodeFrom(&input);
+        if (!s.IsOK()) {
+            delete iiter;
+            delete state;
+            callback(arg, s);
+            return;
+        }
+        ReadBlockAsync(rep_->file, options, state->handle, rep_->compression_dict, &Table::OnDataBlockRead, state);
+    }
+
+    void Table::OnDataBlockRead(void *arg, const Status &read_status, BlockContents *contents) {
+        auto *state = reinterpret_cast<AsyncGetState *>(arg);
+        Status s = read_status;
+        if (s.IsOK()) {
+            Block *block = nullptr;
+            Iterator *block_iter = NewBlockIterator(state->table, state->options, state->handle, *contents, &block,
+                                                    false);
+            // 记录跨越到后面的block时剩下的block同步读取, 这种情况很少
+            s = state->table->GetFromBlocks(state->options, state->key, state->arg, state->handle_result,
+                                            state->iiter, block_iter, block, nullptr);
+        }
+        if (s.IsOK()) {
+            s = state->iiter->status();
+        }
+        delete state->iiter;
+        GetCallback callback = state->callback;
+        void *callback_arg = state->arg;
+        delete state;
+        callback(callback_arg, s);
+    }
+
+    uint64_t Table::ApproximateOffsetOf(const Slice &key) const {
+        Iterator *index_iter = NewIndexIterator(ReadOptions());
+        index_iter->Seek(key);
+        uint64_t result;
+        if (index_iter->Valid()) {
+            BlockHandle handle;
+            Slice input = index_iter->Value();
+            Status s = handle.DecodeFrom(&input);
+            if (s.IsOK()) {
+                result = handle.offset();
+            } else {
+                // 无法解析index中的handle, 用metaindex block的偏移近似(接近文件末尾)
+                result = rep_->metaindex_handle.offset();
+            }
+        } else {
+            // key比文件中所有的key都大
+            result = rep_->metaindex_handle.offset();
+        }
+        delete index_iter;
+        return result;
+    }
+
+}
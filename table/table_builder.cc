@@ -0,0 +1,466 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "leveldb/table_builder.h"
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "port/port.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace leveldb {
+
+    // 训练字典前最多缓存的未压缩data block大小
+    static size_t DictTrainBytes(const Options &options) {
+        return options.compression_dict_train_bytes > 0 ? options.compression_dict_train_bytes
+                                                        : 100 * options.compression_max_dict_bytes;
+    }
+
+    // 每2KB一个filter(包括filter分区内部)时每个filter只有几十个key, XOR filter的固定开销让文件
+    // 比bloom filter更大, 只有整个文件一个filter时才使用bottommost_filter_policy.
+    static bool UseBottommostFilter(const Options &options, bool bottommost) {
+        return bottommost && options.bottommost_filter_policy != nullptr && options.whole_file_filter;
+    }
+
+    struct TableBuilder::Rep {
+        Rep(const Options &opt, WritableFile *f, bool bottommost)
+                : options(opt),
+                  index_block_options(opt),
+                  file(f),
+                  offset(0),
+                  data_block(&options, opt.data_block_hash_index),
+                  index_block(&index_block_options),
+                  partitioned(opt.partition_index_and_filters),
+                  index_partition(&index_block_options),
+                  partition_base(0),
+                  num_entries(0),
+                  closed(false),
+                  filter_policy(UseBottommostFilter(opt, bottommost) ? opt.bottommost_filter_policy
+                                                                     : opt.filter_policy),
+                  filter_block(filter_policy == nullptr || opt.whole_file_filter ? nullptr
+                                                                                 : new FilterBlockBuilder(filter_policy)),
+                  full_filter_block(filter_policy == nullptr || !opt.whole_file_filter
+                                    ? nullptr : new FullFilterBlockBuilder(filter_policy)),
+                  pending_index_entry(false),
+                  buffering(opt.compressionType == kZstdCompression && opt.compression_max_dict_bytes > 0),
+                  zstd_dict(nullptr) {
+            index_block_options.block_restart_interval = 1;
+        }
+
+        Options options;
+        Options index_block_options;
+        WritableFile *file;
+        uint64_t offset;
+        Status status;
+        BlockBuilder data_block;
+        BlockBuilder index_block;       // 分区时是顶层index
+        const bool partitioned;
+        BlockBuilder index_partition;
+        uint64_t partition_base;        // 当前分区中第一个data block的偏移
+        std::string last_key;
+        int64_t num_entries;
+        bool closed;    // 调用过Finish()或者Abandon()
+        const FilterPolicy *filter_policy;  // 构建时确定, 不受ChangeOptions()影响
+        FilterBlockBuilder *filter_block;   // 分区时只包含当前分区的key
+        FullFilterBlockBuilder *full_filter_block;  // whole_file_filter时代替filter_block
+
+        // 直到看到下一个data block的第一个key时才写入上一个block的index项,
+        // 这样index key可以取两者之间最短的key. 例如上一个block的最后一个key为"the quick brown fox",
+        // 下一个block的第一个key为"the who", index key可以用"the r".
+        //
+        // 不变式: 只有data_block为空时pending_index_entry才为true.
+        bool pending_index_entry;
+        BlockHandle pending_handle;     // 待写入index的handle
+
+        std::string compressed_output;
+
+        // 训练出字典之前data block只缓存在内存中, 此时不生成index项也不加入filter,
+        // 写入时再从缓存的block中解析出key.
+        bool buffering;
+        std::string buffered_blocks;            // 缓存的未压缩data block拼接在一起, 也是训练字典的样本
+        std::vector<size_t> buffered_lengths;
+        std::string compression_dict;           // 为空时不使用字典
+        port::ZstdCompressionDict *zstd_dict;   // 由compression_dict解析
+    };
+
+    TableBuilder::TableBuilder(const Options &options, WritableFile *file, bool bottommost)
+            : rep_(new Rep(options, file, bottommost)) {
+        if (rep_->filter_block != nullptr) {
+            rep_->filter_block->StartBlock(0);
+        }
+    }
+
+    TableBuilder::~TableBuilder() {
+        assert(rep_->closed);  // 调用方忘记调用Finish()
+        delete rep_->filter_block;
+        delete rep_->full_filter_block;
+        delete rep_->zstd_dict;
+        delete rep_;
+    }
+
+    Status TableBuilder::ChangeOptions(const Options &options) {
+        // 比较器决定了已经写入的记录的顺序, 不允许修改
+        if (options.comparator != rep_->options.comparator) {
+            return Status::InvalidArgument("changing comparator while building table");
+        }
+
+        // data_block和index_block持有指向rep_中options的指针, 直接修改即可生效
+        rep_->options = options;
+        rep_->index_block_options = options;
+        rep_->index_block_options.block_restart_interval = 1;
+        return Status::OK();
+    }
+
+    void TableBuilder::Add(const Slice &key, const Slice &value) {
+        Rep *r = rep_;
+        assert(!r->closed);
+        if (!ok()) return;
+        if (r->num_entries > 0) {
+            assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
+        }
+
+        if (r->pending_index_entry) {
+            assert(r->data_block.empty());
+            AddPendingIndexEntry(key);
+        }
+
+        if (!r->buffering) {
+            AddFilterKey(key);
+        }
+
+        r->last_key.assign(key.data(), key.size());
+        r->num_entries++;
+        r->data_block.Add(key, value);
+
+        const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
+        if (estimated_block_size >= r->options.block_size) {
+            Flush();
+        }
+    }
+
+    void TableBuilder::AddPendingIndexEntry(const Slice &next_key) {
+        Rep *r = rep_;
+        r->options.comparator->FindShortestSeparator(&r->last_key, next_key);
+        std::string handle_encoding;
+        r->pending_handle.EncodeTo(&handle_encoding);
+        if (!r->partitioned) {
+            r->index_block.Add(r->last_key, Slice(handle_encoding));
+        } else {
+            r->index_partition.Add(r->last_key, Slice(handle_encoding));
+            // 只在data block之间切分, 同一个data block的key都在同一个分区中
+            if (r->index_partition.CurrentSizeEstimate() >= r->options.metadata_block_size ||
+                (r->filter_block != nullptr &&
+                 r->filter_block->CurrentSizeEstimate() >= r->options.metadata_block_size)) {
+                FlushPartition();
+            }
+        }
+        r->pending_index_entry = false;
+    }
+
+    void TableBuilder::AddFilterKey(const Slice &key) {
+        Rep *r = rep_;
+        if (r->filter_block != nullptr) {
+            r->filter_block->AddKey(key);
+        }
+        if (r->full_filter_block != nullptr) {
+            r->full_filter_block->AddKey(key);
+        }
+    }
+
+    void TableBuilder::Flush() {
+        Rep *r = rep_;
+        assert(!r->closed);
+        if (!ok()) return;
+        if (r->data_block.empty()) return;
+        assert(!r->pending_index_entry);
+        if (r->buffering) {
+            const Slice raw = r->data_block.Finish();
+            r->buffered_blocks.append(raw.data(), raw.size());
+            r->buffered_lengths.push_back(raw.size());
+            r->data_block.Reset();
+            if (r->buffered_blocks.size() >= DictTrainBytes(r->options)) {
+                EnterUnbuffered();
+            }
+            return;
+        }
+        WriteDataBlock(r->data_block.Finish());
+        r->data_block.Reset();
+    }
+
+    void TableBuilder::WriteDataBlock(const Slice &raw) {
+        Rep *r = rep_;
+        WriteBlock(raw, &r->pending_handle, true);
+        if (ok()) {
+            r->pending_index_entry = true;
+            r->status = r->file->Flush();
+        }
+        if (r->filter_block != nullptr) {
+            r->filter_block->StartBlock(r->offset - r->partition_base);
+        }
+    }
+
+    void TableBuilder::EnterUnbuffered() {
+        Rep *r = rep_;
+        assert(r->buffering && !r->pending_index_entry);
+        r->buffering = false;
+        // 样本太少时训练会失败, 这时不使用字典
+        if (port::Zstd_TrainDictionary(r->buffered_blocks, r->buffered_lengths,
+                                       r->options.compression_max_dict_bytes, &r->compression_dict)) {
+            r->zstd_dict = new port::ZstdCompressionDict(r->compression_dict.data(), r->compression_dict.size(),
+                                                         r->options.compression_level);
+        }
+
+        // 按顺序写入缓存的block, 同时补上index项和filter
+        size_t start = 0;
+        for (size_t length : r->buffered_lengths) {
+            if (!ok()) break;
+            BlockContents contents;
+            contents.data = Slice(r->buffered_blocks.data() + start, length);
+            contents.cachable = false;
+            contents.heap_allocated = false;
+            start += length;
+
+            Block block(contents);
+            Iterator *iter = block.NewIterator(r->options.comparator);
+            iter->SeekToFirst();
+            if (r->pending_index_entry && iter->Valid()) {
+                AddPendingIndexEntry(iter->Key());
+            }
+            for (; iter->Valid(); iter->Next()) {
+                AddFilterKey(iter->Key());
+            }
+            iter->SeekToLast();
+            if (iter->Valid()) {
+                r->last_key.assign(iter->Key().data(), iter->Key().size());
+            }
+            delete iter;
+            WriteDataBlock(contents.data);
+        }
+        std::string().swap(r->buffered_blocks);
+        std::vector<size_t>().swap(r->buffered_lengths);
+    }
+
+    void TableBuilder::FlushPartition() {
+        Rep *r = rep_;
+        assert(r->partitioned && !r->index_partition.empty());
+        if (!ok()) return;
+        BlockHandle index_handle, filter_handle;
+        WriteBlock(&r->index_partition, &index_handle, true);
+        std::string handle_encoding;
+        index_handle.EncodeTo(&handle_encoding);
+        if (ok() && r->filter_block != nullptr) {
+            WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_handle);
+            delete r->filter_block;
+            r->filter_block = new FilterBlockBuilder(r->filter_policy);
+            filter_handle.EncodeTo(&handle_encoding);
+            PutVarint64(&handle_encoding, r->partition_base);
+        }
+        if (ok()) {
+            // r->last_key是分区中最后一个index key
+            r->index_block.Add(r->last_key, Slice(handle_encoding));
+        }
+        r->partition_base = r->offset;
+    }
+
+    void TableBuilder::WriteBlock(BlockBuilder *block, BlockHandle *handle, bool use_dict) {
+        WriteBlock(block->Finish(), handle, use_dict);
+        block->Reset();
+    }
+
+    void TableBuilder::WriteBlock(const Slice &raw, BlockHandle *handle, bool use_dict) {
+        // 文件中的格式: block_data | type(1字节) | crc32(fixed32)
+        assert(ok());
+        Rep *r = rep_;
+
+        Slice block_contents;
+        CompressionType type = r->options.compressionType;
+        switch (type) {
+            case kNoCompression:
+                block_contents = raw;
+                break;
+
+            case kSnappyCompression: {
+                std::string *compressed = &r->compressed_output;
+                if (port::Snappy_Compress(raw.data(), raw.size(), compressed) &&
+                    compressed->size() < raw.size() - (raw.size() / 8u)) {
+                    block_contents = *compressed;
+                } else {
+                    // 不支持snappy或者压缩率不到12.5%, 按原样保存
+                    block_contents = raw;
+                    type = kNoCompression;
+                }
+                break;
+            }
+
+            case kLZ4Compression:
+            case kZstdCompression: {
+                std::string *compressed = &r->compressed_output;
+                PutVarint32(compressed, static_cast<uint32_t>(raw.size()));
+                const int level = r->options.compression_level;
+                const bool compressed_ok =
+                        type == kLZ4Compression
+                        ? port::LZ4_Compress(level, raw.data(), raw.size(), compressed)
+                        : port::Zstd_Compress(level, raw.data(), raw.size(), compressed,
+                                              use_dict ? r->zstd_dict : nullptr);
+                if (compressed_ok && compressed->size() < raw.size() - (raw.size() / 8u)) {
+                    block_contents = *compressed;
+                } else {
+                    block_contents = raw;
+                    type = kNoCompression;
+                }
+                break;
+            }
+        }
+        WriteRawBlock(block_contents, type, handle);
+        r->compressed_output.clear();
+    }
+
+    void TableBuilder::WriteRawBlock(const Slice &block_contents, CompressionType type, BlockHandle *handle) {
+        Rep *r = rep_;
+        handle->set_offset(r->offset);
+        handle->set_size(block_contents.size());
+        r->status = r->file->Append(block_contents);
+        if (r->status.IsOK()) {
+            char trailer[kBlockTrailerSize];
+            trailer[0] = type;
+            uint32_t crc = crc32c::Value(block_contents.data(), block_contents.size());
+            crc = crc32c::Extend(crc, trailer, 1);  // crc同时覆盖block的类型
+            EncodeFixed32(trailer + 1, crc32c::Mask(crc));
+            r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
+            if (r->status.IsOK()) {
+                r->offset += block_contents.size() + kBlockTrailerSize;
+            }
+        }
+    }
+
+    Status TableBuilder::status() const { return rep_->status; }
+
+    Status TableBuilder::Finish() {
+        Rep *r = rep_;
+        Flush();
+        if (ok() && r->buffering) {
+            // 整个文件都没有达到训练字典的样本大小
+            EnterUnbuffered();
+        }
+        assert(!r->closed);
+        r->closed = true;
+
+        BlockHandle dict_handle, filter_block_handle, full_filter_handle, metaindex_block_handle, index_block_handle;
+
+        if (ok() && !r->compression_dict.empty()) {
+            WriteRawBlock(r->compression_dict, kNoCompression, &dict_handle);
+        }
+
+        if (ok() && r->full_filter_block != nullptr) {
+            WriteRawBlock(r->full_filter_block->Finish(), kNoCompression, &full_filter_handle);
+        }
+
+        if (r->partitioned) {
+            // 最后一个分区, filter随分区一起写入
+            if (ok() && r->pending_index_entry) {
+                r->options.comparator->FindShortSuccessor(&r->last_key);
+                std::string handle_encoding;
+                r->pending_handle.EncodeTo(&handle_encoding);
+                r->index_partition.Add(r->last_key, Slice(handle_encoding));
+                r->pending_index_entry = false;
+            }
+            if (!r->index_partition.empty()) {
+                FlushPartition();
+            }
+        } else if (ok() && r->filter_block != nullptr) {
+            // filter block
+            WriteRawBlock(r->filter_block->Finish(), kNoCompression, &filter_block_handle);
+        }
+
+        // metaindex block
+        if (ok()) {
+            Options meta_options = r->options;
+            meta_options.comparator = BytewiseComparator();
+            BlockBuilder meta_index_block(&meta_options);
+            if (!r->compression_dict.empty()) {
+                std::string handle_encoding;
+                dict_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(kCompressionDictKey, handle_encoding);
+            }
+            if (r->full_filter_block != nullptr) {
+                // metaindex的key按字节序加入: "compression.dict" < "fullfilter.Name" < "index.partitioned"
+                std::string key = kFullFilterPrefix;
+                key.append(r->filter_policy->Name());
+                std::string handle_encoding;
+                full_filter_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(key, handle_encoding);
+            }
+            if (r->partitioned) {
+                // 分区的位置都在顶层index中, 这两项只作为标记, value是空的handle. key按字节序加入
+                BlockHandle marker;
+                marker.set_offset(0);
+                marker.set_size(0);
+                std::string handle_encoding;
+                marker.EncodeTo(&handle_encoding);
+                meta_index_block.Add(kPartitionedIndexKey, handle_encoding);
+                if (r->filter_block != nullptr) {
+                    std::string key = kPartitionedFilterPrefix;
+                    key.append(r->filter_policy->Name());
+                    meta_index_block.Add(key, handle_encoding);
+                }
+            } else if (r->filter_block != nullptr) {
+                // "filter.Name" -> filter block的位置
+                std::string key = "filter.";
+                key.append(r->filter_policy->Name());
+                std::string handle_encoding;
+                filter_block_handle.EncodeTo(&handle_encoding);
+                meta_index_block.Add(key, handle_encoding);
+            }
+
+            WriteBlock(&meta_index_block, &metaindex_block_handle);
+        }
+
+        // index block
+        if (ok()) {
+            if (r->pending_index_entry) {
+                r->options.comparator->FindShortSuccessor(&r->last_key);
+                std::string handle_encoding;
+                r->pending_handle.EncodeTo(&handle_encoding);
+                r->index_block.Add(r->last_key, Slice(handle_encoding));
+                r->pending_index_entry = false;
+            }
+            WriteBlock(&r->index_block, &index_block_handle);
+        }
+
+        // footer
+        if (ok()) {
+            Footer footer;
+            footer.set_metaindex_handle(metaindex_block_handle);
+            footer.set_index_handle(index_block_handle);
+            std::string footer_encoding;
+            footer.EncodeTo(&footer_encoding);
+            r->status = r->file->Append(footer_encoding);
+            if (r->status.IsOK()) {
+                r->offset += footer_encoding.size();
+            }
+        }
+        return r->status;
+    }
+
+    void TableBuilder::Abandon() {
+        Rep *r = rep_;
+        assert(!r->closed);
+        r->closed = true;
+    }
+
+    uint64_t TableBuilder::NumEntries() const { return rep_->num_entries; }
+
+    uint64_t TableBuilder::FileSize() const { return rep_->offset + rep_->buffered_blocks.size(); }
+
+}
@@ -0,0 +1,218 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "table/two_level_iterator.h"
+
+#include <string>
+
+#include "leveldb/comparator.h"
+#include "leveldb/options.h"
+#include "table/iterator_wrapper.h"
+#include "util/arena.h"
+
+namespace leveldb {
+
+    namespace {
+
+        class TwoLevelIterator : public Iterator {
+        public:
+            TwoLevelIterator(Iterator *index_iter, BlockFunction block_function, void *arg,
+                             const ReadOptions &options, SeekFilterFunction seek_filter,
+                             const Comparator *comparator, const Slice *index_upper_bound);
+
+            ~TwoLevelIterator() override;
+
+            void Seek(const Slice &target) override { SeekImpl(target, false); }
+
+            void SeekForPrefix(const Slice &target) override { SeekImpl(target, true); }
+
+            void SeekToFirst() override;
+
+            void SeekToLast() override;
+
+            void Next() override;
+
+            void Prev() override;
+
+            bool Valid() const override { return data_iter_.Valid(); }
+
+            Slice Key() const override {
+                assert(Valid());
+                return data_iter_.Key();
+            }
+
+            Slice Value() const override {
+                assert(Valid());
+                return data_iter_.Value();
+            }
+
+            Status status() const override {
+                if (!index_iter_.status().IsOK()) {
+                    return index_iter_.status();
+                } else if (data_iter_.iter() != nullptr && !data_iter_.status().IsOK()) {
+                    return data_iter_.status();
+                } else {
+                    return status_;
+                }
+            }
+
+        private:
+            void SaveError(const Status &s) {
+                if (status_.IsOK() && !s.IsOK()) status_ = s;
+            }
+
+            // prefix为true时先用seek_filter_检查target, 并且对data block调用SeekForPrefix.
+            void SeekImpl(const Slice &target, bool prefix);
+
+            // 当前index key >= index_upper_bound_时, 之后的block中的key都在上界之外.
+            bool BeyondUpperBound() const {
+                return comparator_ != nullptr && index_iter_.Valid() &&
+                       comparator_->Compare(index_iter_.Key(), index_upper_bound_) >= 0;
+            }
+
+            void SkipEmptyDataBlocksForward();
+
+            void SkipEmptyDataBlocksBackward();
+
+            void SetDataIterator(Iterator *data_iter);
+
+            void InitDataBlock();
+
+            BlockFunction block_function_;
+            void *arg_;
+            const ReadOptions options_;
+            SeekFilterFunction seek_filter_;
+            const Comparator *const comparator_;    // 没有上界时为nullptr
+            const std::string index_upper_bound_;
+            Status status_;
+            IteratorWrapper index_iter_;
+            IteratorWrapper data_iter_;     // 可能为nullptr
+            // data_iter_不为nullptr时, 它对应的index value
+            std::string data_block_handle_;
+        };
+
+        TwoLevelIterator::TwoLevelIterator(Iterator *index_iter, BlockFunction block_function, void *arg,
+                                           const ReadOptions &options, SeekFilterFunction seek_filter,
+                                           const Comparator *comparator, const Slice *index_upper_bound)
+                : block_function_(block_function),
+                  arg_(arg),
+                  options_(options),
+                  seek_filter_(seek_filter),
+                  comparator_(index_upper_bound != nullptr ? comparator : nullptr),
+                  index_upper_bound_(index_upper_bound != nullptr ? index_upper_bound->ToString() : std::string()),
+                  index_iter_(index_iter),
+                  data_iter_(nullptr) {}
+
+        TwoLevelIterator::~TwoLevelIterator() = default;
+
+        void TwoLevelIterator::SeekImpl(const Slice &target, bool prefix) {
+            index_iter_.Seek(target);
+            if (prefix && seek_filter_ != nullptr && index_iter_.Valid() &&
+                !(*seek_filter_)(arg_, index_iter_.Value(), target)) {
+                // index key可能大于block中的最后一个key, 此时第一个 >= target 的key在下一个block中.
+                // 同一前缀的key是连续的, 两个block都不包含时后面也不会有
+                index_iter_.Next();
+                if (!index_iter_.Valid() || !(*seek_filter_)(arg_, index_iter_.Value(), target)) {
+                    SetDataIterator(nullptr);
+                    return;
+                }
+            }
+            InitDataBlock();
+            if (data_iter_.iter() != nullptr) {
+                if (prefix) {
+                    data_iter_.SeekForPrefix(target);
+                } else {
+                    data_iter_.Seek(target);
+                }
+            }
+            SkipEmptyDataBlocksForward();
+        }
+
+        void TwoLevelIterator::SeekToFirst() {
+            index_iter_.SeekToFirst();
+            InitDataBlock();
+            if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
+            SkipEmptyDataBlocksForward();
+        }
+
+        void TwoLevelIterator::SeekToLast() {
+            index_iter_.SeekToLast();
+            InitDataBlock();
+            if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+            SkipEmptyDataBlocksBackward();
+        }
+
+        void TwoLevelIterator::Next() {
+            assert(Valid());
+            data_iter_.Next();
+            SkipEmptyDataBlocksForward();
+        }
+
+        void TwoLevelIterator::Prev() {
+            assert(Valid());
+            data_iter_.Prev();
+            SkipEmptyDataBlocksBackward();
+        }
+
+        void TwoLevelIterator::SkipEmptyDataBlocksForward() {
+            while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
+                // 移动到下一个block
+                if (!index_iter_.Valid() || BeyondUpperBound()) {
+                    SetDataIterator(nullptr);
+                    return;
+                }
+                index_iter_.Next();
+                InitDataBlock();
+                if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
+            }
+        }
+
+        void TwoLevelIterator::SkipEmptyDataBlocksBackward() {
+            while (data_iter_.iter() == nullptr || !data_iter_.Valid()) {
+                // 移动到上一个block
+                if (!index_iter_.Valid()) {
+                    SetDataIterator(nullptr);
+                    return;
+                }
+                index_iter_.Prev();
+                InitDataBlock();
+                if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
+            }
+        }
+
+        void TwoLevelIterator::SetDataIterator(Iterator *data_iter) {
+            if (data_iter_.iter() != nullptr) SaveError(data_iter_.status());
+            data_iter_.Set(data_iter);
+        }
+
+        void TwoLevelIterator::InitDataBlock() {
+            if (!index_iter_.Valid()) {
+                SetDataIterator(nullptr);
+            } else {
+                Slice handle = index_iter_.Value();
+                if (data_iter_.iter() != nullptr && handle.compare(data_block_handle_) == 0) {
+                    // data_iter_已经指向这个block, 不需要重新打开
+                } else {
+                    Iterator *iter = (*block_function_)(arg_, options_, handle);
+                    data_block_handle_.assign(handle.data(), handle.size());
+                    SetDataIterator(iter);
+                }
+            }
+        }
+
+    }  // namespace
+
+    Iterator *NewTwoLevelIterator(Iterator *index_iter, BlockFunction block_function, void *arg,
+                                  const ReadOptions &options, SeekFilterFunction seek_filter, Arena *arena,
+                                  const Comparator *comparator, const Slice *index_upper_bound) {
+        if (arena != nullptr) {
+            char *mem = arena->AllocateAligned(sizeof(TwoLevelIterator));
+            return new(mem) TwoLevelIterator(index_iter, block_function, arg, options, seek_filter, comparator,
+                                             index_upper_bound);
+        }
+        return new TwoLevelIterator(index_iter, block_function, arg, options, seek_filter, comparator,
+                                    index_upper_bound);
+    }
+
+}
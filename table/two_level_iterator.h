@@ -0,0 +1,41 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_TWO_LEVEL_ITERATOR_H
+#define MY_LEVELDB_TWO_LEVEL_ITERATOR_H
+
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+    class Arena;
+    class Comparator;
+    struct ReadOptions;
+
+    // 把index_iter的value转换为对应的data block迭代器.
+    using BlockFunction = Iterator *(*)(void *arg, const ReadOptions &options, const Slice &index_value);
+
+    // SeekForPrefix时在打开data block之前调用, 返回false表示index_value对应的block中
+    // 不可能存在满足查找条件的key, 结果直接变为无效. Seek不调用.
+    using SeekFilterFunction = bool (*)(void *arg, const Slice &index_value, const Slice &target);
+
+    /**
+     * @brief 两层迭代器: index_iter的每个value指向一个data block, 由block_function打开.
+     * 接管index_iter的所有权, 析构时释放.
+     *
+     * seek_filter为nullptr时不过滤.
+     * arena不为nullptr时结果分配在arena中, 由持有者调用析构函数释放; 打开的data block
+     * 迭代器仍然分配在堆上.
+     * index_upper_bound不为nullptr时, 向后移动遇到按comparator >= index_upper_bound的index key
+     * 就停止, 不再打开之后的block. index key不小于它的block中的所有key, 小于之后block中的所有key,
+     * 所以index_upper_bound应当是上界之外最小的key. 内容会被拷贝.
+    */
+    Iterator *NewTwoLevelIterator(Iterator *index_iter, BlockFunction block_function, void *arg,
+                                  const ReadOptions &options, SeekFilterFunction seek_filter = nullptr,
+                                  Arena *arena = nullptr, const Comparator *comparator = nullptr,
+                                  const Slice *index_upper_bound = nullptr);
+
+}
+
+#endif //MY_LEVELDB_TWO_LEVEL_ITERATOR_H
@@ -10,9 +10,9 @@ namespace leveldb {
     static const int kBlockSize = 4096;
 
     Arena::Arena()
-            : alloc_ptr_(nullptr),
-              alloc_bytes_remaining_(0),
-              memory_usage_(0) {}
+            : alloc_ptr_(inline_block_),
+              alloc_bytes_remaining_(kInlineSize),
+              memory_usage_(kInlineSize) {}
 
     Arena::~Arena() {
         for (auto &block : blocks_) {
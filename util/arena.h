@@ -7,6 +7,7 @@
 
 #include <atomic>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -62,6 +63,11 @@ namespace leveldb {
         */
         char *AllocateNewBlock(size_t block_bytes);
 
+        // 最先分配的kInlineSize字节来自arena对象本身, 只分配少量内存的arena
+        // (例如ArenaWrappedDBIter中的迭代器树)不需要任何堆分配.
+        static constexpr size_t kInlineSize = 2048;
+
+        alignas(std::max_align_t) char inline_block_[kInlineSize];
         char *alloc_ptr_;
         size_t alloc_bytes_remaining_;
         std::vector<char *> blocks_;
@@ -0,0 +1,167 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#include "leveldb/filter_policy.h"
+
+#include "leveldb/slice.h"
+#include "port/port.h"
+#include "util/hash.h"
+
+#if LEVELDB_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace leveldb {
+
+    namespace {
+
+        // 每个key的所有probe都落在同一个64字节的块(cache line)中, 查询最多一次cache miss.
+        // 块内按16个little-endian的32位字寻址: probe的hash值最高4位选字, 接下来5位选字中的位.
+        //
+        // filter格式: 块(64字节 * n) | num_probes(1字节)
+        constexpr size_t kBytesPerLine = 64;
+        constexpr uint32_t kBitsPerLine = kBytesPerLine * 8;
+
+        // 第i个probe的hash为 h * kRemix^i, 与选块使用的h不相关.
+        constexpr uint32_t kRemix = 0x9e3779b9;
+        // kRemix^8, 每轮8个probe
+        constexpr uint32_t kRemixPow8 = 0xab25f4c1;
+
+        uint32_t BloomHash(const Slice &key) {
+            return Hash(key.data(), key.size(), 0xbc9f1d34);
+        }
+
+        // 每个块中的key数不均匀, 最优的probe数比普通bloom filter的bits_per_key * ln2少,
+        // 表中的值来自对误判率的数值估计.
+        int ChooseNumProbes(int bits_per_key) {
+            static const int kNumProbes[] = {1, 1, 1, 2, 3, 3, 4, 5, 5, 6, 6, 7, 8, 8, 8, 9, 9, 10, 10, 11, 11, 11};
+            constexpr int kTableSize = sizeof(kNumProbes) / sizeof(kNumProbes[0]);
+            if (bits_per_key < kTableSize) {
+                return kNumProbes[bits_per_key < 0 ? 0 : bits_per_key];
+            }
+            return bits_per_key / 2 > 24 ? 24 : bits_per_key / 2;
+        }
+
+        // h对应的块在filter中的偏移
+        inline size_t LineOffset(uint32_t h, uint32_t num_lines) {
+            // 把h均匀映射到[0, num_lines), 不需要除法
+            const uint32_t line = static_cast<uint32_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+            return static_cast<size_t>(line) * kBytesPerLine;
+        }
+
+        void AddHash(char *line, uint32_t h, int num_probes) {
+            uint32_t probe = h * kRemix;
+            for (int i = 0; i < num_probes; i++) {
+                const uint32_t bit = ((probe >> 28) << 5) | ((probe >> 23) & 31);
+                line[bit >> 3] |= static_cast<char>(1 << (bit & 7));
+                probe *= kRemix;
+            }
+        }
+
+#if LEVELDB_HAVE_AVX2
+        // 一次计算8个probe, 结果与HashMayMatch()的标量循环相同.
+        LEVELDB_TARGET("avx2")
+        bool HashMayMatchAVX2(const char *line, uint32_t h, int num_probes) {
+            uint32_t probe = h * kRemix;
+            // 乘以kRemix的0~7次方
+            const __m256i powers = _mm256_setr_epi32(0x00000001, static_cast<int>(0x9e3779b9),
+                                                     static_cast<int>(0xe35e67b1), 0x734297e9, 0x35fbe861,
+                                                     static_cast<int>(0xdeb7c719), 0x0448b211, 0x3459b749);
+            const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i *data = reinterpret_cast<const __m256i *>(line);
+            const __m256i lower = _mm256_loadu_si256(data);
+            const __m256i upper = _mm256_loadu_si256(data + 1);
+            int remaining = num_probes;
+            while (true) {
+                const __m256i hashes = _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(probe)), powers);
+                // 最高4位是字的编号, permutevar8x32只使用低3位, 最高位决定取前32字节还是后32字节
+                const __m256i words = _mm256_srli_epi32(hashes, 28);
+                const __m256i values = _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(lower, words),
+                                                          _mm256_permutevar8x32_epi32(upper, words),
+                                                          _mm256_srai_epi32(hashes, 31));
+                // 不足8个probe时, 多出的通道掩码为0
+                const __m256i enabled = _mm256_srli_epi32(
+                        _mm256_sub_epi32(lanes, _mm256_set1_epi32(remaining)), 31);
+                const __m256i bits = _mm256_srli_epi32(_mm256_slli_epi32(hashes, 4), 27);
+                const __m256i mask = _mm256_sllv_epi32(enabled, bits);
+                // (~values & mask) == 0
+                const bool match = _mm256_testc_si256(values, mask) != 0;
+                if (remaining <= 8 || !match) {
+                    return match;
+                }
+                probe *= kRemixPow8;
+                remaining -= 8;
+            }
+        }
+#endif  // LEVELDB_HAVE_AVX2
+
+        bool HashMayMatch(const char *line, uint32_t h, int num_probes) {
+#if LEVELDB_HAVE_AVX2
+            if (port::CPUHasAVX2()) {
+                return HashMayMatchAVX2(line, h, num_probes);
+            }
+#endif
+            uint32_t probe = h * kRemix;
+            for (int i = 0; i < num_probes; i++) {
+                const uint32_t bit = ((probe >> 28) << 5) | ((probe >> 23) & 31);
+                if ((line[bit >> 3] & (1 << (bit & 7))) == 0) {
+                    return false;
+                }
+                probe *= kRemix;
+            }
+            return true;
+        }
+
+        class BloomFilterPolicy : public FilterPolicy {
+        public:
+            explicit BloomFilterPolicy(int bits_per_key)
+                    : bits_per_key_(bits_per_key), num_probes_(ChooseNumProbes(bits_per_key)) {}
+
+            const char *Name() const override { return "leveldb.CacheLocalBloomFilter"; }
+
+            void CreateFilter(const Slice *keys, int n, std::string *dst) const override {
+                size_t bits = static_cast<size_t>(n) * bits_per_key_;
+                // n很小时误判率会很高, 至少使用一个块
+                size_t num_lines = (bits + kBitsPerLine - 1) / kBitsPerLine;
+                if (num_lines == 0) {
+                    num_lines = 1;
+                }
+                const size_t init_size = dst->size();
+                dst->resize(init_size + num_lines * kBytesPerLine, 0);
+                dst->push_back(static_cast<char>(num_probes_));
+                char *array = &(*dst)[init_size];
+                for (int i = 0; i < n; i++) {
+                    const uint32_t h = BloomHash(keys[i]);
+                    AddHash(array + LineOffset(h, static_cast<uint32_t>(num_lines)), h, num_probes_);
+                }
+            }
+
+            bool KeyMayMatch(const Slice &key, const Slice &filter) const override {
+                const size_t len = filter.size();
+                if (len < 2) {
+                    return false;
+                }
+                const size_t bytes = len - 1;
+                const int num_probes = static_cast<uint8_t>(filter[len - 1]);
+                if (bytes % kBytesPerLine != 0 || num_probes == 0 || num_probes > 30) {
+                    // 保留给以后的格式, 认为可能匹配
+                    return true;
+                }
+                const uint32_t h = BloomHash(key);
+                const size_t offset = LineOffset(h, static_cast<uint32_t>(bytes / kBytesPerLine));
+                return HashMayMatch(filter.data() + offset, h, num_probes);
+            }
+
+        private:
+            const size_t bits_per_key_;
+            const int num_probes_;
+        };
+
+    }  // namespace
+
+    const FilterPolicy *NewBloomFilterPolicy(int bits_per_key) {
+        return new BloomFilterPolicy(bits_per_key);
+    }
+
+}
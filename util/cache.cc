@@ -4,21 +4,594 @@
 
 #include "leveldb/cache.h"
 
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "leveldb/secondary_cache.h"
+#include "port/port.h"
+#include "util/frequency_sketch.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
-    Cache::~Cache() {
+    Cache::~Cache() {}
 
-    }
+    namespace {
 
-    void Cache::LRU_Remove(Cache::Handle *e) {
+        // 条目同时位于hash表和两个链表之一:
+        // - in_use_: 被外部引用(refs >= 2), 没有顺序.
+        // - lru_: 只被cache引用(refs == 1), 按访问时间排序, 可以被淘汰.
+        // 被淘汰/Erase/替换但仍被外部引用的条目不再属于cache, 不在任何链表中, in_cache为false.
+        // 开启TinyLFU准入时, 新条目先进入window_, 离开window时才与lru_中的条目竞争.
+        // 开启优先级时, 没有被引用的高优先级条目位于high_pri_lru_, 只在lru_/window_淘汰完后才被淘汰.
+        struct LRUHandle {
+            void *value;
+            void (*deleter)(const Slice &, void *value);
+            const Cache::CacheItemHelper *helper;   // 不为nullptr时淘汰后可以转存到二级缓存
+            LRUHandle *next_hash;
+            LRUHandle *next;
+            LRUHandle *prev;
+            size_t charge;
+            size_t key_length;
+            bool in_cache;
+            bool in_window;
+            bool is_high_pri;
+            bool in_high_pri_pool;  // 位于high_pri_lru_中
+            uint32_t refs;
+            uint32_t hash;
+            char key_data[1];   // key的起始位置
 
-    }
+            Slice key() const {
+                // next == this只会出现在链表头, 链表头没有key
+                assert(next != this);
+                return {key_data, key_length};
+            }
+        };
+
+        // 拉链法的hash表, 桶的数量随元素数量翻倍, 保证平均链长<=1.
+        // 比std::unordered_map省一次分配, 并且next_hash直接存在条目里.
+        class HandleTable {
+        public:
+            HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
+
+            ~HandleTable() { delete[] list_; }
+
+            LRUHandle *Lookup(const Slice &key, uint32_t hash) {
+                return *FindPointer(key, hash);
+            }
+
+            // 返回被替换的旧条目, 没有则返回nullptr.
+            LRUHandle *Insert(LRUHandle *h) {
+                LRUHandle **ptr = FindPointer(h->key(), h->hash);
+                LRUHandle *old = *ptr;
+                h->next_hash = (old == nullptr ? nullptr : old->next_hash);
+                *ptr = h;
+                if (old == nullptr) {
+                    ++elems_;
+                    if (elems_ > length_) {
+                        Resize();
+                    }
+                }
+                return old;
+            }
+
+            LRUHandle *Remove(const Slice &key, uint32_t hash) {
+                LRUHandle **ptr = FindPointer(key, hash);
+                LRUHandle *result = *ptr;
+                if (result != nullptr) {
+                    *ptr = result->next_hash;
+                    --elems_;
+                }
+                return result;
+            }
+
+        private:
+            // 返回指向匹配条目的指针, 没有匹配时指向链尾的nullptr.
+            LRUHandle **FindPointer(const Slice &key, uint32_t hash) {
+                LRUHandle **ptr = &list_[hash & (length_ - 1)];
+                while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
+                    ptr = &(*ptr)->next_hash;
+                }
+                return ptr;
+            }
+
+            void Resize() {
+                uint32_t new_length = 4;
+                while (new_length < elems_) {
+                    new_length *= 2;
+                }
+                auto **new_list = new LRUHandle *[new_length];
+                memset(new_list, 0, sizeof(new_list[0]) * new_length);
+                uint32_t count = 0;
+                for (uint32_t i = 0; i < length_; i++) {
+                    LRUHandle *h = list_[i];
+                    while (h != nullptr) {
+                        LRUHandle *next = h->next_hash;
+                        LRUHandle **ptr = &new_list[h->hash & (new_length - 1)];
+                        h->next_hash = *ptr;
+                        *ptr = h;
+                        h = next;
+                        count++;
+                    }
+                }
+                assert(elems_ == count);
+                delete[] list_;
+                list_ = new_list;
+                length_ = new_length;
+            }
+
+            uint32_t length_;
+            uint32_t elems_;
+            LRUHandle **list_;
+        };
+
+        // 一个shard.
+        class LRUCache {
+        public:
+            LRUCache();
+
+            ~LRUCache();
+
+            void SetCapacity(size_t capacity) { capacity_ = capacity; }
+
+            // 开启W-TinyLFU准入, 必须在SetCapacity之后调用.
+            void EnableAdmission(size_t estimated_entry_charge);
+
+            void SetSecondaryCache(SecondaryCache *secondary) { secondary_ = secondary; }
+
+            // 必须在SetCapacity之后调用.
+            void SetHighPriPoolRatio(double ratio) {
+                high_pri_capacity_ = static_cast<size_t>(static_cast<double>(capacity_) * ratio);
+            }
+
+            Cache::Handle *Insert(const Slice &key, uint32_t hash, void *value, size_t charge,
+                                  void (*deleter)(const Slice &key, void *value),
+                                  const Cache::CacheItemHelper *helper, Cache::Priority priority);
+
+            Cache::Handle *Lookup(const Slice &key, uint32_t hash);
+
+            void Release(Cache::Handle *handle);
+
+            void Erase(const Slice &key, uint32_t hash);
+
+            void Prune();
+
+            size_t TotalCharge() const {
+                MutexLock l(&mutex_);
+                return usage_;
+            }
+
+        private:
+            void LRU_Remove(LRUHandle *e);
+
+            void LRU_Append(LRUHandle *list, LRUHandle *e);
+
+            // 把没有被外部引用的e放进所属的链表.
+            void LRU_Insert(LRUHandle *e);
+
+            // 高优先级池超出容量时, 把最旧的条目降级到lru_.
+            void MaintainPoolSize();
+
+            void Ref(LRUHandle *e);
+
+            void Unref(LRUHandle *e);
+
+            bool FinishErase(LRUHandle *e);
+
+            // 因容量不足淘汰e(已经从hash表中移除). 可以转存的条目先放进spilled,
+            // 在锁外序列化写入二级缓存后再释放, 其余的直接FinishErase.
+            void Evict(LRUHandle *e, std::vector<LRUHandle *> *spilled);
+
+            void SpillToSecondary(const std::vector<LRUHandle *> &spilled);
+
+            // 把window中超出的条目移入主区, 频率不高于主区淘汰对象的条目直接淘汰.
+            void DrainWindow(std::vector<LRUHandle *> *spilled);
+
+            size_t capacity_;
+
+            mutable port::Mutex mutex_;
+            size_t usage_;
+
+            // lru_.prev是最新的, lru_.next是最旧的
+            LRUHandle lru_;
+            LRUHandle in_use_;
+            LRUHandle window_;
+            LRUHandle high_pri_lru_;
+
+            size_t high_pri_capacity_;
+            size_t high_pri_usage_;
+
+            HandleTable table_;
+
+            // 只在开启准入时使用
+            std::unique_ptr<FrequencySketch> sketch_;
+            size_t window_capacity_;
+            size_t window_usage_;
 
-    void Cache::LRU_Append(Cache::Handle *e) {
+            SecondaryCache *secondary_;
+        };
 
+        LRUCache::LRUCache()
+                : capacity_(0), usage_(0), high_pri_capacity_(0), high_pri_usage_(0),
+                  window_capacity_(0), window_usage_(0), secondary_(nullptr) {
+            lru_.next = &lru_;
+            lru_.prev = &lru_;
+            in_use_.next = &in_use_;
+            in_use_.prev = &in_use_;
+            window_.next = &window_;
+            window_.prev = &window_;
+            high_pri_lru_.next = &high_pri_lru_;
+            high_pri_lru_.prev = &high_pri_lru_;
+        }
+
+        void LRUCache::EnableAdmission(size_t estimated_entry_charge) {
+            // window占容量的1%, 吸收突发的新条目, 其余为主区
+            window_capacity_ = capacity_ / 100;
+            sketch_.reset(new FrequencySketch(capacity_ / (estimated_entry_charge > 0 ? estimated_entry_charge : 1)));
+        }
+
+        LRUCache::~LRUCache() {
+            assert(in_use_.next == &in_use_);  // 销毁时不能有未Release的handle
+            for (LRUHandle *list : {&lru_, &window_, &high_pri_lru_}) {
+                for (LRUHandle *e = list->next; e != list;) {
+                    LRUHandle *next = e->next;
+                    assert(e->in_cache);
+                    e->in_cache = false;
+                    assert(e->refs == 1);
+                    Unref(e);
+                    e = next;
+                }
+            }
+        }
+
+        void LRUCache::Ref(LRUHandle *e) {
+            if (e->refs == 1 && e->in_cache) {
+                // 从lru_移到in_use_
+                LRU_Remove(e);
+                LRU_Append(&in_use_, e);
+            }
+            e->refs++;
+        }
+
+        void LRUCache::Unref(LRUHandle *e) {
+            assert(e->refs > 0);
+            e->refs--;
+            if (e->refs == 0) {
+                assert(!e->in_cache);
+                (*e->deleter)(e->key(), e->value);
+                free(e);
+            } else if (e->in_cache && e->refs == 1) {
+                // 不再被外部引用, 移回所属的链表
+                LRU_Remove(e);
+                LRU_Insert(e);
+            }
+        }
+
+        void LRUCache::LRU_Remove(LRUHandle *e) {
+            e->next->prev = e->prev;
+            e->prev->next = e->next;
+            if (e->in_high_pri_pool) {
+                assert(high_pri_usage_ >= e->charge);
+                high_pri_usage_ -= e->charge;
+                e->in_high_pri_pool = false;
+            }
+        }
+
+        void LRUCache::LRU_Insert(LRUHandle *e) {
+            if (e->in_window) {
+                LRU_Append(&window_, e);
+            } else if (e->is_high_pri && high_pri_capacity_ > 0) {
+                LRU_Append(&high_pri_lru_, e);
+                e->in_high_pri_pool = true;
+                high_pri_usage_ += e->charge;
+                MaintainPoolSize();
+            } else {
+                LRU_Append(&lru_, e);
+            }
+        }
+
+        void LRUCache::MaintainPoolSize() {
+            while (high_pri_usage_ > high_pri_capacity_ && high_pri_lru_.next != &high_pri_lru_) {
+                LRUHandle *e = high_pri_lru_.next;
+                LRU_Remove(e);
+                // 作为lru_中最新的条目, 仍然比低优先级条目晚淘汰
+                LRU_Append(&lru_, e);
+            }
+        }
+
+        void LRUCache::LRU_Append(LRUHandle *list, LRUHandle *e) {
+            // 插入到list之前, 即成为最新的条目
+            e->next = list;
+            e->prev = list->prev;
+            e->prev->next = e;
+            e->next->prev = e;
+        }
+
+        Cache::Handle *LRUCache::Lookup(const Slice &key, uint32_t hash) {
+            MutexLock l(&mutex_);
+            if (sketch_ != nullptr) {
+                // 未命中也计数, 反复被请求的新条目才能在准入时胜出
+                sketch_->Increment(hash);
+            }
+            LRUHandle *e = table_.Lookup(key, hash);
+            if (e != nullptr) {
+                Ref(e);
+            }
+            return reinterpret_cast<Cache::Handle *>(e);
+        }
+
+        void LRUCache::Release(Cache::Handle *handle) {
+            MutexLock l(&mutex_);
+            Unref(reinterpret_cast<LRUHandle *>(handle));
+        }
+
+        Cache::Handle *LRUCache::Insert(const Slice &key, uint32_t hash, void *value, size_t charge,
+                                        void (*deleter)(const Slice &key, void *value),
+                                        const Cache::CacheItemHelper *helper, Cache::Priority priority) {
+            std::vector<LRUHandle *> spilled;
+            auto *e = reinterpret_cast<LRUHandle *>(malloc(sizeof(LRUHandle) - 1 + key.size()));
+            e->value = value;
+            e->deleter = deleter;
+            e->helper = helper;
+            e->charge = charge;
+            e->key_length = key.size();
+            e->hash = hash;
+            e->in_cache = false;
+            e->is_high_pri = priority == Cache::Priority::HIGH;
+            e->in_high_pri_pool = false;
+            // 高优先级条目不经过准入window
+            e->in_window = sketch_ != nullptr && !e->is_high_pri;
+            e->refs = 1;  // 返回给调用方的handle
+            memcpy(e->key_data, key.data(), key.size());
+
+            mutex_.Lock();
+            if (capacity_ > 0) {
+                e->refs++;  // cache自身的引用
+                e->in_cache = true;
+                LRU_Append(&in_use_, e);
+                usage_ += charge;
+                if (e->in_window) {
+                    window_usage_ += charge;
+                }
+                FinishErase(table_.Insert(e));
+                if (sketch_ != nullptr) {
+                    DrainWindow(&spilled);
+                }
+            } else {
+                // capacity_ == 0表示关闭缓存, 条目只在调用方Release之前存在
+                e->next = nullptr;
+            }
+            for (LRUHandle *list : {&lru_, &window_, &high_pri_lru_}) {
+                while (usage_ > capacity_ && list->next != list) {
+                    LRUHandle *old = list->next;
+                    assert(old->refs == 1);
+                    LRUHandle *removed = table_.Remove(old->key(), old->hash);
+                    assert(removed == old);
+                    Evict(removed, &spilled);
+                }
+            }
+            mutex_.Unlock();
+
+            if (!spilled.empty()) {
+                SpillToSecondary(spilled);
+            }
+            return reinterpret_cast<Cache::Handle *>(e);
+        }
+
+        void LRUCache::Evict(LRUHandle *e, std::vector<LRUHandle *> *spilled) {
+            if (secondary_ == nullptr || e->helper == nullptr) {
+                FinishErase(e);
+                return;
+            }
+            assert(e->in_cache && e->refs == 1);
+            LRU_Remove(e);
+            e->in_cache = false;
+            usage_ -= e->charge;
+            if (e->in_window) {
+                window_usage_ -= e->charge;
+            }
+            e->refs = 0;
+            spilled->push_back(e);
+        }
+
+        void LRUCache::SpillToSecondary(const std::vector<LRUHandle *> &spilled) {
+            std::string data;
+            for (LRUHandle *e : spilled) {
+                data.clear();
+                e->helper->save_to(e->value, &data);
+                secondary_->Insert(e->key(), data);
+                (*e->deleter)(e->key(), e->value);
+                free(e);
+            }
+        }
+
+        void LRUCache::DrainWindow(std::vector<LRUHandle *> *spilled) {
+            const size_t main_capacity = capacity_ - window_capacity_;
+            while (window_usage_ > window_capacity_ && window_.next != &window_) {
+                LRUHandle *candidate = window_.next;
+                bool admit = true;
+                while (usage_ - window_usage_ + candidate->charge > main_capacity && lru_.next != &lru_) {
+                    LRUHandle *victim = lru_.next;
+                    if (sketch_->Estimate(candidate->hash) <= sketch_->Estimate(victim->hash)) {
+                        admit = false;
+                        break;
+                    }
+                    Evict(table_.Remove(victim->key(), victim->hash), spilled);
+                }
+                if (admit) {
+                    LRU_Remove(candidate);
+                    candidate->in_window = false;
+                    window_usage_ -= candidate->charge;
+                    LRU_Append(&lru_, candidate);
+                } else {
+                    Evict(table_.Remove(candidate->key(), candidate->hash), spilled);
+                }
+            }
+        }
+
+        // e已经从hash表中移除, 把它从cache中摘掉. e为nullptr时返回false.
+        bool LRUCache::FinishErase(LRUHandle *e) {
+            if (e != nullptr) {
+                assert(e->in_cache);
+                LRU_Remove(e);
+                e->in_cache = false;
+                usage_ -= e->charge;
+                if (e->in_window) {
+                    window_usage_ -= e->charge;
+                }
+                Unref(e);
+            }
+            return e != nullptr;
+        }
+
+        void LRUCache::Erase(const Slice &key, uint32_t hash) {
+            MutexLock l(&mutex_);
+            FinishErase(table_.Remove(key, hash));
+        }
+
+        void LRUCache::Prune() {
+            MutexLock l(&mutex_);
+            for (LRUHandle *list : {&lru_, &window_, &high_pri_lru_}) {
+                while (list->next != list) {
+                    LRUHandle *e = list->next;
+                    assert(e->refs == 1);
+                    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+                    if (!erased) {
+                        assert(erased);
+                    }
+                }
+            }
+        }
+
+        static const int kNumShardBits = 4;
+        static const int kNumShards = 1 << kNumShardBits;
+
+        // 用hash的高位选择shard, 低位留给shard内部的hash表选桶, 两者互不相关.
+        class ShardedLRUCache : public Cache {
+        public:
+            explicit ShardedLRUCache(const LRUCacheOptions &options)
+                    : secondary_(options.secondary_cache), last_id_(0) {
+                const size_t per_shard = (options.capacity + (kNumShards - 1)) / kNumShards;
+                for (auto &s : shard_) {
+                    s.SetCapacity(per_shard);
+                    s.SetHighPriPoolRatio(options.high_pri_pool_ratio);
+                    s.SetSecondaryCache(options.secondary_cache);
+                    if (options.tiny_lfu_estimated_entry_charge > 0) {
+                        s.EnableAdmission(options.tiny_lfu_estimated_entry_charge);
+                    }
+                }
+            }
+
+            ~ShardedLRUCache() override = default;
+
+            Handle *Insert(const Slice &key, void *value, size_t charge,
+                           void (*deleter)(const Slice &key, void *value),
+                           Priority priority = Priority::LOW) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, nullptr, priority);
+            }
+
+            Handle *Insert(const Slice &key, void *value, size_t charge, const CacheItemHelper *helper,
+                           Priority priority = Priority::LOW) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Insert(key, hash, value, charge, helper->deleter, helper, priority);
+            }
+
+            Handle *Lookup(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Lookup(key, hash);
+            }
+
+            Handle *Lookup(const Slice &key, const CacheItemHelper *helper) override {
+                Handle *handle = Lookup(key);
+                if (handle == nullptr && secondary_ != nullptr && helper != nullptr) {
+                    std::string data;
+                    if (secondary_->Lookup(key, &data)) {
+                        size_t charge = 0;
+                        void *value = helper->create(data, &charge);
+                        if (value != nullptr) {
+                            handle = Insert(key, value, charge, helper);
+                        }
+                    }
+                }
+                return handle;
+            }
+
+            void Release(Handle *handle) override {
+                auto *h = reinterpret_cast<LRUHandle *>(handle);
+                shard_[Shard(h->hash)].Release(handle);
+            }
+
+            void Erase(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                shard_[Shard(hash)].Erase(key, hash);
+                if (secondary_ != nullptr) {
+                    secondary_->Erase(key);
+                }
+            }
+
+            void *Value(Handle *handle) override {
+                return reinterpret_cast<LRUHandle *>(handle)->value;
+            }
+
+            uint64_t NewId() override {
+                MutexLock l(&id_mutex_);
+                return ++(last_id_);
+            }
+
+            void Prune() override {
+                for (auto &s : shard_) {
+                    s.Prune();
+                }
+            }
+
+            size_t TotalCharge() const override {
+                size_t total = 0;
+                for (const auto &s : shard_) {
+                    total += s.TotalCharge();
+                }
+                return total;
+            }
+
+        private:
+            static inline uint32_t HashSlice(const Slice &s) {
+                return Hash(s.data(), s.size(), 0);
+            }
+
+            static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+            LRUCache shard_[kNumShards];
+            SecondaryCache *const secondary_;
+            port::Mutex id_mutex_;
+            uint64_t last_id_;
+        };
+
+    }  // namespace
+
+    Cache *NewLRUCache(const LRUCacheOptions &options) { return new ShardedLRUCache(options); }
+
+    Cache *NewLRUCache(size_t capacity) {
+        LRUCacheOptions options;
+        options.capacity = capacity;
+        return NewLRUCache(options);
     }
 
-    void Cache::Unref(Cache::Handle *e) {
+    Cache *NewLRUCache(size_t capacity, SecondaryCache *secondary) {
+        LRUCacheOptions options;
+        options.capacity = capacity;
+        options.secondary_cache = secondary;
+        return NewLRUCache(options);
+    }
 
+    Cache *NewTinyLFUCache(size_t capacity, size_t estimated_entry_charge) {
+        LRUCacheOptions options;
+        options.capacity = capacity;
+        options.tiny_lfu_estimated_entry_charge = estimated_entry_charge > 0 ? estimated_entry_charge : 1;
+        return NewLRUCache(options);
     }
-}
\ No newline at end of file
+
+}
@@ -0,0 +1,393 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+    namespace {
+
+        // 每个slot的meta是一个64位的原子变量:
+        //   bit 0-31  外部引用计数
+        //   bit 32    usage, CLOCK的访问位
+        //   bit 62-63 状态
+        // Lookup只对命中的slot做一次CAS(引用计数+1并设置usage), Release做一次fetch_sub,
+        // 不加锁, 除了条目自身所在的cache line之外不写任何共享数据.
+        // Insert/Erase/淘汰修改slot的内容, 由shard的mutex串行化.
+        const uint64_t kRefMask = 0xffffffffu;
+        const uint64_t kUsageBit = uint64_t{1} << 32;
+        const int kStateShift = 62;
+
+        enum SlotState : uint64_t {
+            kEmpty = 0,
+            kConstruction = 1,  // 被持有mutex的写者独占, 读者不能获取引用
+            kVisible = 2,       // 在cache中, 可以被Lookup到
+            kInvisible = 3,     // 已被Erase/替换, 但仍被引用, 最后一个引用释放时回收
+        };
+
+        inline SlotState StateOf(uint64_t meta) { return static_cast<SlotState>(meta >> kStateShift); }
+
+        inline uint64_t RefsOf(uint64_t meta) { return meta & kRefMask; }
+
+        inline uint64_t MakeMeta(SlotState state, uint64_t refs) {
+            return (static_cast<uint64_t>(state) << kStateShift) | refs;
+        }
+
+        // 独占一个cache line, 避免不同条目的引用计数互相干扰.
+        struct alignas(64) ClockHandle {
+            std::atomic<uint64_t> meta{0};
+            std::atomic<uint32_t> hash{0};
+            // 探测路径经过这个slot并且放在它后面的条目数量, 为0时Lookup可以在这里停止.
+            std::atomic<uint32_t> displacements{0};
+
+            // 下面的字段只在持有mutex并且slot处于kConstruction时修改
+            void *value = nullptr;
+            void (*deleter)(const Slice &, void *value) = nullptr;
+            size_t charge = 0;
+            char *key_data = nullptr;
+            size_t key_length = 0;
+            bool detached = false;  // 没有放进表中的条目, 只在Release之前存在
+
+            Slice key() const { return {key_data, key_length}; }
+        };
+
+        // 开放寻址(线性探测)的固定大小hash表 + CLOCK淘汰.
+        class ClockCacheShard {
+        public:
+            ClockCacheShard() = default;
+
+            ~ClockCacheShard();
+
+            void Init(size_t capacity, size_t estimated_entry_charge);
+
+            Cache::Handle *Insert(const Slice &key, uint32_t hash, void *value, size_t charge,
+                                  void (*deleter)(const Slice &key, void *value), Cache::Priority priority);
+
+            Cache::Handle *Lookup(const Slice &key, uint32_t hash);
+
+            void Release(Cache::Handle *handle);
+
+            void Erase(const Slice &key, uint32_t hash);
+
+            void Prune();
+
+            size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+
+        private:
+            ClockHandle *Slot(uint32_t hash, size_t probe) const {
+                return &table_[(hash + probe) & mask_];
+            }
+
+            // 只在持有mutex时调用, 返回处于kVisible的匹配slot.
+            ClockHandle *FindVisible(const Slice &key, uint32_t hash);
+
+            // 把slot置为kInvisible, 没有引用时直接回收.
+            void MakeInvisible(ClockHandle *h);
+
+            // 尝试独占一个没有引用的slot, state为它当前应处的状态.
+            static bool TryExclusive(ClockHandle *h, SlotState state, bool ignore_usage);
+
+            // slot必须处于kConstruction, 调用deleter并归还slot.
+            void FreeSlot(ClockHandle *h);
+
+            // 推进时钟指针直到腾出charge的容量并且有空闲的slot, 至多转两圈.
+            void EvictFor(size_t charge);
+
+            port::Mutex mutex_;
+            ClockHandle *table_ = nullptr;
+            size_t table_size_ = 0;
+            size_t mask_ = 0;
+            size_t occupancy_limit_ = 0;
+            size_t capacity_ = 0;
+            size_t occupancy_ = 0;          // 非kEmpty的slot数量, 受mutex保护
+            size_t clock_hand_ = 0;         // 受mutex保护
+            std::atomic<size_t> usage_{0};
+        };
+
+        void ClockCacheShard::Init(size_t capacity, size_t estimated_entry_charge) {
+            capacity_ = capacity;
+            size_t entries = capacity / (estimated_entry_charge > 0 ? estimated_entry_charge : 1);
+            // 负载因子不超过0.7, 保证探测路径足够短
+            size_t want = entries * 10 / 7 + 1;
+            table_size_ = 16;
+            while (table_size_ < want) {
+                table_size_ *= 2;
+            }
+            mask_ = table_size_ - 1;
+            occupancy_limit_ = table_size_ - table_size_ / 8;
+            table_ = new ClockHandle[table_size_];
+        }
+
+        ClockCacheShard::~ClockCacheShard() {
+            for (size_t i = 0; i < table_size_; i++) {
+                ClockHandle *h = &table_[i];
+                if (StateOf(h->meta.load(std::memory_order_relaxed)) != kEmpty) {
+                    assert(RefsOf(h->meta.load(std::memory_order_relaxed)) == 0);  // 不能有未Release的handle
+                    (*h->deleter)(h->key(), h->value);
+                    delete[] h->key_data;
+                }
+            }
+            delete[] table_;
+        }
+
+        Cache::Handle *ClockCacheShard::Lookup(const Slice &key, uint32_t hash) {
+            for (size_t probe = 0; probe < table_size_; probe++) {
+                ClockHandle *h = Slot(hash, probe);
+                if (h->hash.load(std::memory_order_relaxed) == hash) {
+                    uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                    while (StateOf(meta) == kVisible) {
+                        if (h->meta.compare_exchange_weak(meta, (meta + 1) | kUsageBit,
+                                                          std::memory_order_acquire,
+                                                          std::memory_order_relaxed)) {
+                            // 持有引用后slot的内容不会再变化, 可以安全地比较key
+                            if (h->key() == key) {
+                                return reinterpret_cast<Cache::Handle *>(h);
+                            }
+                            Release(reinterpret_cast<Cache::Handle *>(h));
+                            break;
+                        }
+                    }
+                }
+                if (h->displacements.load(std::memory_order_relaxed) == 0) {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        void ClockCacheShard::Release(Cache::Handle *handle) {
+            auto *h = reinterpret_cast<ClockHandle *>(handle);
+            if (h->detached) {
+                (*h->deleter)(h->key(), h->value);
+                delete[] h->key_data;
+                delete h;
+                return;
+            }
+            const uint64_t old = h->meta.fetch_sub(1, std::memory_order_release);
+            assert(RefsOf(old) > 0);
+            if (StateOf(old) == kInvisible && RefsOf(old) == 1) {
+                // 最后一个引用, 回收已经被移出cache的条目
+                MutexLock l(&mutex_);
+                if (TryExclusive(h, kInvisible, true)) {
+                    FreeSlot(h);
+                }
+            }
+        }
+
+        bool ClockCacheShard::TryExclusive(ClockHandle *h, SlotState state, bool ignore_usage) {
+            uint64_t meta = h->meta.load(std::memory_order_acquire);
+            if (StateOf(meta) != state || RefsOf(meta) != 0 || (!ignore_usage && (meta & kUsageBit) != 0)) {
+                return false;
+            }
+            return h->meta.compare_exchange_strong(meta, MakeMeta(kConstruction, 0), std::memory_order_acquire);
+        }
+
+        void ClockCacheShard::FreeSlot(ClockHandle *h) {
+            const uint32_t hash = h->hash.load(std::memory_order_relaxed);
+            for (size_t probe = 0; Slot(hash, probe) != h; probe++) {
+                Slot(hash, probe)->displacements.fetch_sub(1, std::memory_order_relaxed);
+            }
+            (*h->deleter)(h->key(), h->value);
+            delete[] h->key_data;
+            h->key_data = nullptr;
+            usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+            occupancy_--;
+            h->meta.store(MakeMeta(kEmpty, 0), std::memory_order_release);
+        }
+
+        ClockHandle *ClockCacheShard::FindVisible(const Slice &key, uint32_t hash) {
+            for (size_t probe = 0; probe < table_size_; probe++) {
+                ClockHandle *h = Slot(hash, probe);
+                if (StateOf(h->meta.load(std::memory_order_acquire)) == kVisible &&
+                    h->hash.load(std::memory_order_relaxed) == hash && h->key() == key) {
+                    return h;
+                }
+                if (h->displacements.load(std::memory_order_relaxed) == 0) {
+                    break;
+                }
+            }
+            return nullptr;
+        }
+
+        void ClockCacheShard::MakeInvisible(ClockHandle *h) {
+            uint64_t meta = h->meta.load(std::memory_order_relaxed);
+            while (!h->meta.compare_exchange_weak(meta, MakeMeta(kInvisible, RefsOf(meta)),
+                                                  std::memory_order_acq_rel)) {
+            }
+            if (TryExclusive(h, kInvisible, true)) {
+                FreeSlot(h);
+            }
+        }
+
+        void ClockCacheShard::EvictFor(size_t charge) {
+            const size_t max_steps = 2 * table_size_;
+            for (size_t step = 0; step < max_steps; step++) {
+                if (usage_.load(std::memory_order_relaxed) + charge <= capacity_ && occupancy_ < occupancy_limit_) {
+                    return;
+                }
+                ClockHandle *h = &table_[clock_hand_++ & mask_];
+                uint64_t meta = h->meta.load(std::memory_order_relaxed);
+                if (StateOf(meta) != kVisible || RefsOf(meta) != 0) {
+                    continue;
+                }
+                if ((meta & kUsageBit) != 0) {
+                    // 第二次机会
+                    h->meta.compare_exchange_strong(meta, meta & ~kUsageBit, std::memory_order_relaxed);
+                } else if (TryExclusive(h, kVisible, false)) {
+                    FreeSlot(h);
+                }
+            }
+        }
+
+        Cache::Handle *ClockCacheShard::Insert(const Slice &key, uint32_t hash, void *value, size_t charge,
+                                               void (*deleter)(const Slice &key, void *value),
+                                               Cache::Priority priority) {
+            char *key_data = new char[key.size()];
+            memcpy(key_data, key.data(), key.size());
+
+            MutexLock l(&mutex_);
+            ClockHandle *old = FindVisible(key, hash);
+            if (old != nullptr) {
+                MakeInvisible(old);
+            }
+            EvictFor(charge);
+
+            // 所有条目都被引用时允许暂时超过容量, 与LRU一致; 只有slot用完时才不放进表中
+            ClockHandle *h = nullptr;
+            if (occupancy_ < table_size_ && capacity_ > 0) {
+                size_t probe = 0;
+                for (; probe < table_size_; probe++) {
+                    if (StateOf(Slot(hash, probe)->meta.load(std::memory_order_acquire)) == kEmpty) {
+                        break;
+                    }
+                }
+                h = Slot(hash, probe);
+                for (size_t i = 0; i < probe; i++) {
+                    Slot(hash, i)->displacements.fetch_add(1, std::memory_order_relaxed);
+                }
+                occupancy_++;
+                usage_.fetch_add(charge, std::memory_order_relaxed);
+            } else {
+                h = new ClockHandle;
+                h->detached = true;
+            }
+            h->value = value;
+            h->deleter = deleter;
+            h->charge = charge;
+            h->key_data = key_data;
+            h->key_length = key.size();
+            h->hash.store(hash, std::memory_order_relaxed);
+            // 发布, 之后读者才能看到上面写入的内容. 返回的handle持有一个引用.
+            // 高优先级条目插入时就带上访问位, 比普通条目多撑过一轮扫描
+            uint64_t meta = MakeMeta(kVisible, 1);
+            if (priority == Cache::Priority::HIGH) {
+                meta |= kUsageBit;
+            }
+            h->meta.store(meta, std::memory_order_release);
+            return reinterpret_cast<Cache::Handle *>(h);
+        }
+
+        void ClockCacheShard::Erase(const Slice &key, uint32_t hash) {
+            MutexLock l(&mutex_);
+            ClockHandle *h = FindVisible(key, hash);
+            if (h != nullptr) {
+                MakeInvisible(h);
+            }
+        }
+
+        void ClockCacheShard::Prune() {
+            MutexLock l(&mutex_);
+            for (size_t i = 0; i < table_size_; i++) {
+                if (TryExclusive(&table_[i], kVisible, true)) {
+                    FreeSlot(&table_[i]);
+                }
+            }
+        }
+
+        static const int kNumShardBits = 4;
+        static const int kNumShards = 1 << kNumShardBits;
+
+        class ClockCache : public Cache {
+        public:
+            ClockCache(size_t capacity, size_t estimated_entry_charge) {
+                const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+                for (auto &s : shard_) {
+                    s.Init(per_shard, estimated_entry_charge);
+                }
+            }
+
+            ~ClockCache() override = default;
+
+            using Cache::Insert;
+            using Cache::Lookup;
+
+            Handle *Insert(const Slice &key, void *value, size_t charge,
+                           void (*deleter)(const Slice &key, void *value),
+                           Priority priority = Priority::LOW) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter, priority);
+            }
+
+            Handle *Lookup(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                return shard_[Shard(hash)].Lookup(key, hash);
+            }
+
+            void Release(Handle *handle) override {
+                auto *h = reinterpret_cast<ClockHandle *>(handle);
+                shard_[Shard(h->hash.load(std::memory_order_relaxed))].Release(handle);
+            }
+
+            void Erase(const Slice &key) override {
+                const uint32_t hash = HashSlice(key);
+                shard_[Shard(hash)].Erase(key, hash);
+            }
+
+            void *Value(Handle *handle) override {
+                return reinterpret_cast<ClockHandle *>(handle)->value;
+            }
+
+            uint64_t NewId() override {
+                return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+            }
+
+            void Prune() override {
+                for (auto &s : shard_) {
+                    s.Prune();
+                }
+            }
+
+            size_t TotalCharge() const override {
+                size_t total = 0;
+                for (const auto &s : shard_) {
+                    total += s.TotalCharge();
+                }
+                return total;
+            }
+
+        private:
+            static inline uint32_t HashSlice(const Slice &s) {
+                return Hash(s.data(), s.size(), 0);
+            }
+
+            static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+            ClockCacheShard shard_[kNumShards];
+            std::atomic<uint64_t> last_id_{0};
+        };
+
+    }  // namespace
+
+    Cache *NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+        return new ClockCache(capacity, estimated_entry_charge);
+    }
+
+}
@@ -73,7 +73,7 @@ namespace leveldb {
     static inline char *EncodeVarint64(char *dst, uint64_t v) {
         static constexpr int B = 128;
         auto *ptr = reinterpret_cast<uint8_t *>(dst);
-        while (v > B) {
+        while (v >= B) {
             *(ptr++) = v | B;
             v >>= 7;
         }
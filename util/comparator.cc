@@ -8,6 +8,10 @@
 
 namespace leveldb {
 
+    Slice Comparator::OrderedBytes(const Slice &key) const {
+        return key;
+    }
+
     namespace {
 
         class BytewiseComparatorImpl : public Comparator {
@@ -56,6 +60,8 @@ namespace leveldb {
                 }
                 // *key is a run of 0xffs.  Leave it alone.
             }
+
+            bool HasOrderedBytes() const override { return true; }
         };
     }  // namespace
 
@@ -0,0 +1,157 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include <atomic>
+#include <memory>
+
+#include "leveldb/cache.h"
+#include "leveldb/secondary_cache.h"
+#include "port/port.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    SecondaryCache::~SecondaryCache() = default;
+
+    namespace {
+
+        // 条目格式: type(1字节) | data, type为kNoCompression时data是原始数据,
+        // kLZ4Compression和kZstdCompression的data与sstable中的block相同, 以压缩前的大小(varint32)开头.
+        class CompressedSecondaryCache : public SecondaryCache {
+        public:
+            CompressedSecondaryCache(size_t capacity, CompressionType compression, int level)
+                    : cache_(NewLRUCache(capacity)), capacity_(capacity),
+                      compression_(CompressionTypeSupported(compression) ? compression : kNoCompression),
+                      level_(level) {}
+
+            ~CompressedSecondaryCache() override = default;
+
+            const char *Name() const override { return "leveldb.CompressedSecondaryCache"; }
+
+            void Insert(const Slice &key, const Slice &data) override {
+                auto *entry = new std::string;
+                entry->push_back(static_cast<char>(kNoCompression));
+                std::string &compressed = compressed_scratch();
+                compressed.clear();
+                bool ok = false;
+                switch (compression_) {
+                    case kNoCompression:
+                        break;
+                    case kSnappyCompression:
+                        ok = port::Snappy_Compress(data.data(), data.size(), &compressed);
+                        break;
+                    case kLZ4Compression:
+                        PutVarint32(&compressed, static_cast<uint32_t>(data.size()));
+                        ok = port::LZ4_Compress(level_, data.data(), data.size(), &compressed);
+                        break;
+                    case kZstdCompression:
+                        PutVarint32(&compressed, static_cast<uint32_t>(data.size()));
+                        ok = port::Zstd_Compress(level_, data.data(), data.size(), &compressed);
+                        break;
+                }
+                if (ok && compressed.size() < data.size() - (data.size() / 8u)) {
+                    (*entry)[0] = static_cast<char>(compression_);
+                    entry->append(compressed);
+                } else {
+                    entry->append(data.data(), data.size());
+                }
+                inserts_.fetch_add(1, std::memory_order_relaxed);
+                cache_->Release(cache_->Insert(key, entry, entry->size(), &DeleteEntry));
+            }
+
+            bool Lookup(const Slice &key, std::string *data) override {
+                Cache::Handle *handle = cache_->Lookup(key);
+                if (handle == nullptr) {
+                    misses_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                const std::string *entry = reinterpret_cast<std::string *>(cache_->Value(handle));
+                bool ok = Decode(*entry, data);
+                cache_->Release(handle);
+                // 数据将被提升到主cache, 不再保留
+                cache_->Erase(key);
+                if (ok) {
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    misses_.fetch_add(1, std::memory_order_relaxed);
+                }
+                return ok;
+            }
+
+            void Erase(const Slice &key) override { cache_->Erase(key); }
+
+            Stats GetStats() const override {
+                Stats stats;
+                stats.hits = hits_.load(std::memory_order_relaxed);
+                stats.misses = misses_.load(std::memory_order_relaxed);
+                stats.inserts = inserts_.load(std::memory_order_relaxed);
+                stats.usage = cache_->TotalCharge();
+                stats.capacity = capacity_;
+                stats.compression = compression_;
+                return stats;
+            }
+
+        private:
+            static void DeleteEntry(const Slice &, void *value) {
+                delete reinterpret_cast<std::string *>(value);
+            }
+
+            // 每个线程复用一个压缩buffer, 避免每次插入都分配
+            static std::string &compressed_scratch() {
+                static thread_local std::string scratch;
+                return scratch;
+            }
+
+            static bool Decode(const std::string &entry, std::string *data) {
+                if (entry.empty()) {
+                    return false;
+                }
+                const char *input = entry.data() + 1;
+                const size_t n = entry.size() - 1;
+                switch (static_cast<CompressionType>(entry[0])) {
+                    case kNoCompression:
+                        data->assign(input, n);
+                        return true;
+                    case kSnappyCompression: {
+                        size_t ulength;
+                        if (!port::Snappy_GetUncompressedLength(input, n, &ulength)) {
+                            return false;
+                        }
+                        data->resize(ulength);
+                        return port::Snappy_Uncompress(input, n, &(*data)[0]);
+                    }
+                    case kLZ4Compression:
+                    case kZstdCompression: {
+                        uint32_t ulength;
+                        const char *p = GetVarint32Ptr(input, input + n, &ulength);
+                        if (p == nullptr) {
+                            return false;
+                        }
+                        const size_t length = input + n - p;
+                        data->resize(ulength);
+                        return static_cast<CompressionType>(entry[0]) == kLZ4Compression
+                               ? port::LZ4_Uncompress(p, length, &(*data)[0], ulength)
+                               : port::Zstd_Uncompress(p, length, &(*data)[0], ulength);
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            std::unique_ptr<Cache> cache_;
+            const size_t capacity_;
+            const CompressionType compression_;
+            const int level_;
+            std::atomic<uint64_t> hits_{0};
+            std::atomic<uint64_t> misses_{0};
+            std::atomic<uint64_t> inserts_{0};
+        };
+
+    }  // namespace
+
+    SecondaryCache *NewCompressedSecondaryCache(size_t capacity, CompressionType compression, int level) {
+        return new CompressedSecondaryCache(capacity, compression, level);
+    }
+
+}
@@ -0,0 +1,100 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#ifndef MY_LEVELDB_DYNAMIC_BLOOM_H
+#define MY_LEVELDB_DYNAMIC_BLOOM_H
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#include "leveldb/slice.h"
+#include "util/arena.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+    /**
+     * @brief 内存中可以边写边读的bloom filter, 用于memtable的前缀过滤.
+     *
+     * 位数组按64字节(一个cache line)分块, 同一个key的所有probe都落在同一个块内,
+     * 一次查询最多一次cache miss. 内存从arena中分配, 随memtable一起释放.
+     *
+     * 与memtable相同: 写入需要外部同步(单个writer), 读取不需要加锁.
+    */
+    class DynamicBloom {
+    public:
+        // total_bits向上取整到512的倍数.
+        DynamicBloom(Arena *arena, uint32_t total_bits, int num_probes = 6)
+                : num_blocks_((total_bits + kBitsPerBlock - 1) / kBitsPerBlock),
+                  num_probes_(num_probes) {
+            if (num_blocks_ == 0) {
+                num_blocks_ = 1;
+            }
+            const size_t words = static_cast<size_t>(num_blocks_) * kWordsPerBlock;
+            char *raw = arena->AllocateAligned(words * sizeof(std::atomic<uint64_t>));
+            data_ = reinterpret_cast<std::atomic<uint64_t> *>(raw);
+            for (size_t i = 0; i < words; ++i) {
+                new(&data_[i]) std::atomic<uint64_t>(0);
+            }
+        }
+
+        DynamicBloom(const DynamicBloom &) = delete;
+        DynamicBloom &operator=(const DynamicBloom &) = delete;
+
+        void Add(const Slice &key) { AddHash(BloomHash(key)); }
+
+        bool MayContain(const Slice &key) const { return MayContainHash(BloomHash(key)); }
+
+        void AddHash(uint32_t h) {
+            std::atomic<uint64_t> *block = BlockFor(h);
+            uint32_t pos = h * kRemix;
+            const uint32_t delta = (pos >> 17) | (pos << 15);
+            for (int i = 0; i < num_probes_; ++i) {
+                const uint32_t bit = pos & (kBitsPerBlock - 1);
+                std::atomic<uint64_t> &word = block[bit >> 6];
+                // 只有一个writer, 不需要fetch_or
+                word.store(word.load(std::memory_order_relaxed) | (uint64_t{1} << (bit & 63)),
+                           std::memory_order_relaxed);
+                pos += delta;
+            }
+        }
+
+        bool MayContainHash(uint32_t h) const {
+            const std::atomic<uint64_t> *block = BlockFor(h);
+            uint32_t pos = h * kRemix;
+            const uint32_t delta = (pos >> 17) | (pos << 15);
+            for (int i = 0; i < num_probes_; ++i) {
+                const uint32_t bit = pos & (kBitsPerBlock - 1);
+                if ((block[bit >> 6].load(std::memory_order_relaxed) & (uint64_t{1} << (bit & 63))) == 0) {
+                    return false;
+                }
+                pos += delta;
+            }
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t kBitsPerBlock = 512;
+        static constexpr uint32_t kWordsPerBlock = kBitsPerBlock / 64;
+        // 块内的probe与选块使用的位不相关
+        static constexpr uint32_t kRemix = 0x9e3779b9;
+
+        static uint32_t BloomHash(const Slice &key) {
+            return Hash(key.data(), key.size(), 0xbc9f1d34);
+        }
+
+        std::atomic<uint64_t> *BlockFor(uint32_t h) const {
+            const uint32_t block = static_cast<uint32_t>((static_cast<uint64_t>(h) * num_blocks_) >> 32);
+            return data_ + static_cast<size_t>(block) * kWordsPerBlock;
+        }
+
+        uint32_t num_blocks_;
+        const int num_probes_;
+        std::atomic<uint64_t> *data_;
+    };
+
+}
+
+#endif //MY_LEVELDB_DYNAMIC_BLOOM_H
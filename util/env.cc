@@ -36,6 +36,23 @@ namespace leveldb {
         return RemoveFile(fname);
     }
 
+    void Env::ScheduleIO(void (*func)(void *), void *arg) {
+        func(arg);
+    }
+
+    void Env::SetIOThreads(int /*num*/) {}
+
+    void RandomAccessFile::ReadAsync(uint64_t offset, size_t n, char *scratch, ReadCallback callback,
+                                     void *arg) const {
+        Slice result;
+        Status s = Read(offset, n, &result, scratch);
+        callback(arg, s, result);
+    }
+
+    Status RandomAccessFile::Prefetch(uint64_t /*offset*/, size_t /*n*/) const {
+        return Status::OK();
+    }
+
     static Status DoWriteStringToFile(Env *env, const Slice &data, const std::string &fname, bool should_sync) {
         WritableFile *wf = nullptr;
         Status s = env->NewWritableFile(fname, &wf);
@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -51,6 +52,9 @@ namespace leveldb {
 
         constexpr const size_t kWritableFileBufferSize = 65536;
 
+        // 异步读I/O线程池默认的线程数, 可以通过Env::SetIOThreads增加.
+        constexpr const int kDefaultIOThreads = 4;
+
         Status PosixError(const std::string &context, int errno_number) {
             if (errno_number == ENOENT) {
                 return Status::NotFound(context, std::strerror(errno_number));
@@ -85,6 +89,30 @@ namespace leveldb {
             std::atomic<int> acquires_allowed_;
         };
 
+        // 一次提交给I/O线程池的异步读请求.
+        struct AsyncReadRequest {
+            const RandomAccessFile *file;
+            uint64_t offset;
+            size_t n;
+            char *scratch;
+            RandomAccessFile::ReadCallback callback;
+            void *arg;
+        };
+
+        void DoAsyncRead(void *arg) {
+            auto *request = reinterpret_cast<AsyncReadRequest *>(arg);
+            Slice result;
+            Status status = request->file->Read(request->offset, request->n, &result, request->scratch);
+            request->callback(request->arg, status, result);
+            delete request;
+        }
+
+        void SubmitAsyncRead(Env *io_env, const RandomAccessFile *file, uint64_t offset, size_t n, char *scratch,
+                             RandomAccessFile::ReadCallback callback, void *arg) {
+            auto *request = new AsyncReadRequest{file, offset, n, scratch, callback, arg};
+            io_env->ScheduleIO(&DoAsyncRead, request);
+        }
+
         class PosixSequentialFile final : public SequentialFile {
         public:
             PosixSequentialFile(std::string filename, int fd)
@@ -127,10 +155,11 @@ namespace leveldb {
         class PosixRandomAccessFile final : public RandomAccessFile {
         public:
 
-            PosixRandomAccessFile(std::string filename, int fd, Limiter *fd_limiter)
+            PosixRandomAccessFile(std::string filename, int fd, Limiter *fd_limiter, Env *io_env)
                     : has_permanent_fd_(fd_limiter->Acquire()),
                       fd_(has_permanent_fd_ ? fd : -1),
                       fd_limiter_(fd_limiter),
+                      io_env_(io_env),
                       filename_(std::move(filename)) {
                 if (!has_permanent_fd_) {
                     assert(fd_ == -1);
@@ -172,22 +201,59 @@ namespace leveldb {
                 return status;
             }
 
+            // pread在I/O线程池中执行, 调用线程不会被阻塞.
+            void ReadAsync(uint64_t offset, size_t n, char *scratch, ReadCallback callback,
+                           void *arg) const override {
+                SubmitAsyncRead(io_env_, this, offset, n, scratch, callback, arg);
+            }
+
+            // 由内核异步地把数据读入page cache. page cache属于文件本身,
+            // 使用临时fd提示同样有效.
+            Status Prefetch(uint64_t offset, size_t n) const override {
+#if defined(POSIX_FADV_WILLNEED)
+                int fd = fd_;
+                if (!has_permanent_fd_) {
+                    fd = ::open(filename_.c_str(), O_RDONLY | kOpenBaseFlags);
+                    if (fd < 0) {
+                        return PosixError(filename_, errno);
+                    }
+                }
+
+                Status status;
+                int ret = ::posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(n),
+                                          POSIX_FADV_WILLNEED);
+                if (ret != 0) {
+                    status = PosixError(filename_, ret);
+                }
+
+                if (!has_permanent_fd_) {
+                    ::close(fd);
+                }
+                return status;
+#else
+                return Status::OK();
+#endif
+            }
+
         private:
-            const int fd_;
-            const std::string filename_;
             // 是否是永久的fd, 相反的则为临时fd 临时的fd在read时才open/close
-            // 是永久or临时取决于Limiter
+            // 是永久or临时取决于Limiter. fd_的初始化依赖它, 必须声明在fd_之前.
             const bool has_permanent_fd_;
+            const int fd_;
             Limiter *const fd_limiter_;
+            Env *const io_env_;
+            const std::string filename_;
         };
 
 
         class PosixMmapReadableFile final : public RandomAccessFile {
         public:
-            PosixMmapReadableFile(std::string filename, char *mmap_base, size_t length, Limiter *mmap_limiter)
+            PosixMmapReadableFile(std::string filename, char *mmap_base, size_t length, Limiter *mmap_limiter,
+                                  Env *io_env)
                     : mmap_base_(mmap_base),
                       length_(length),
                       mmap_limiter_(mmap_limiter),
+                      io_env_(io_env),
                       filename_(std::move(filename)) {
             }
 
@@ -206,10 +272,32 @@ namespace leveldb {
                 return Status::OK();
             }
 
+            // 冷数据上的缺页同样会阻塞, 也放到I/O线程池中.
+            void ReadAsync(uint64_t offset, size_t n, char *scratch, ReadCallback callback,
+                           void *arg) const override {
+                SubmitAsyncRead(io_env_, this, offset, n, scratch, callback, arg);
+            }
+
+            Status Prefetch(uint64_t offset, size_t n) const override {
+                if (offset >= length_) {
+                    return Status::OK();
+                }
+                n = std::min<uint64_t>(n, length_ - offset);
+                // madvise要求起始地址按页对齐
+                static const uintptr_t kPageSize = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+                auto start = reinterpret_cast<uintptr_t>(mmap_base_ + offset);
+                uintptr_t aligned = start & ~(kPageSize - 1);
+                if (::madvise(reinterpret_cast<void *>(aligned), n + (start - aligned), MADV_WILLNEED) != 0) {
+                    return PosixError(filename_, errno);
+                }
+                return Status::OK();
+            }
+
         private:
             char *const mmap_base_;
             const size_t length_;
             Limiter *const mmap_limiter_;
+            Env *const io_env_;
             const std::string filename_;
         };
 
@@ -364,7 +452,7 @@ namespace leveldb {
 #if HAVE_FDATASYNC
                 bool sync_success = ::fdatasync(fd) == 0;
 #else
-                bool sync_success = ::fsync(fd);
+                bool sync_success = ::fsync(fd) == 0;
 #endif
                 if (sync_success) {
                     return Status::OK();
@@ -480,7 +568,7 @@ namespace leveldb {
 
                 // 优先使用mmap
                 if (!mmap_limiter_.Acquire()) {
-                    *result = new PosixRandomAccessFile(fname, fd, &fd_limiter_);
+                    *result = new PosixRandomAccessFile(fname, fd, &fd_limiter_, this);
                     return Status::OK();
                 }
 
@@ -491,7 +579,7 @@ namespace leveldb {
                     void *mmap_base = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
                     if (mmap_base != MAP_FAILED) {
                         *result = new PosixMmapReadableFile(fname, reinterpret_cast<char *>(mmap_base), file_size,
-                                                            &mmap_limiter_);
+                                                            &mmap_limiter_, this);
                     } else {
                         status = PosixError(fname, errno);
                     }
@@ -621,6 +709,10 @@ namespace leveldb {
 
             void Schedule(void (*func)(void *), void *arg) override;
 
+            void ScheduleIO(void (*func)(void *), void *arg) override;
+
+            void SetIOThreads(int num) override;
+
             void StartThread(void (*func)(void *), void *arg) override {
                 std::thread thr(func, arg);
                 thr.detach();
@@ -652,6 +744,15 @@ namespace leveldb {
                 env->BackgroundThreadMain();
             }
 
+            void IOThreadMain();
+
+            // 启动I/O线程直到达到io_threads_个. REQUIRES: 持有io_work_mutex_
+            void StartIOThreads();
+
+            static void IOThreadEntryPoint(PosixEnv *env) {
+                env->IOThreadMain();
+            }
+
             struct BackgroundWorkItem {
                 explicit BackgroundWorkItem(void (*func)(void *arg), void *a)
                         : function(func), arg(a) {}
@@ -666,6 +767,13 @@ namespace leveldb {
             bool started_background_thread_;                            // guarded by background_work_mutex_
             std::queue<BackgroundWorkItem> background_work_queue_;      // guarded by background_work_mutex_
 
+            port::Mutex io_work_mutex_;
+            port::CondVar io_work_cv_;                                  // guarded by io_work_mutex_
+            bool started_io_threads_;                                   // guarded by io_work_mutex_
+            int io_threads_;                                            // guarded by io_work_mutex_
+            int num_io_threads_;                                        // guarded by io_work_mutex_
+            std::queue<BackgroundWorkItem> io_work_queue_;              // guarded by io_work_mutex_
+
             PosixLockTable locks_;   // Thread-safe
             Limiter mmap_limiter_;  // Thread-safe
             Limiter fd_limiter_;    // Thread-safe
@@ -694,6 +802,10 @@ namespace leveldb {
         PosixEnv::PosixEnv()
                 : background_work_cv_(&background_work_mutex_),
                   started_background_thread_(false),
+                  io_work_cv_(&io_work_mutex_),
+                  started_io_threads_(false),
+                  io_threads_(kDefaultIOThreads),
+                  num_io_threads_(0),
                   mmap_limiter_(MaxMmaps()),
                   fd_limiter_(MaxOpenFiles()) {}
 
@@ -730,6 +842,52 @@ namespace leveldb {
         }
 
 
+        void PosixEnv::ScheduleIO(void (*func)(void *), void *arg) {
+            io_work_mutex_.Lock();
+
+            if (!started_io_threads_) {
+                started_io_threads_ = true;
+                StartIOThreads();
+            }
+
+            io_work_queue_.emplace(func, arg);
+            io_work_mutex_.Unlock();
+            io_work_cv_.Signal();
+        }
+
+        void PosixEnv::SetIOThreads(int num) {
+            MutexLock l(&io_work_mutex_);
+            if (num > io_threads_) {
+                io_threads_ = num;
+                // 还没有提交过I/O任务时等到第一次ScheduleIO再启动
+                if (started_io_threads_) {
+                    StartIOThreads();
+                }
+            }
+        }
+
+        void PosixEnv::StartIOThreads() {
+            for (; num_io_threads_ < io_threads_; ++num_io_threads_) {
+                std::thread io_thread(&IOThreadEntryPoint, this);
+                io_thread.detach();
+            }
+        }
+
+        void PosixEnv::IOThreadMain() {
+            for (;;) {
+                io_work_mutex_.Lock();
+                while (io_work_queue_.empty()) {
+                    io_work_cv_.Wait();
+                }
+                auto func = io_work_queue_.front().function;
+                auto arg = io_work_queue_.front().arg;
+                io_work_queue_.pop();
+
+                io_work_mutex_.Unlock();
+                func(arg);
+            }
+        }
+
     } // end of namespace {
 
     Env *Env::Default() {
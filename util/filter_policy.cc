@@ -0,0 +1,11 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#include "leveldb/filter_policy.h"
+
+namespace leveldb {
+
+    FilterPolicy::~FilterPolicy() = default;
+
+}
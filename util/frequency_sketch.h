@@ -0,0 +1,98 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#ifndef MY_LEVELDB_FREQUENCY_SKETCH_H
+#define MY_LEVELDB_FREQUENCY_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace leveldb {
+
+    /**
+     * @brief 近似统计访问频率的count-min sketch, 用于TinyLFU的准入判断.
+     *
+     * 每个计数器4位(最大15), 16个计数器打包在一个uint64_t中, 一个key的4个计数器
+     * 位于同一个word内, 估计值取4个计数器的最小值.
+     * 累计的Increment次数达到10倍容量时所有计数器减半(aging), 让旧的热点逐渐冷却.
+     *
+     * 不是线程安全的, 由调用方加锁.
+    */
+    class FrequencySketch {
+    public:
+        // expected_entries: cache中大约能容纳的条目数量.
+        explicit FrequencySketch(size_t expected_entries) : additions_(0) {
+            size_t words = 1;
+            while (words < expected_entries / 4 + 1) {
+                words *= 2;
+            }
+            table_.assign(words, 0);
+            mask_ = words - 1;
+            sample_size_ = 10 * (expected_entries > 0 ? expected_entries : 1);
+        }
+
+        FrequencySketch(const FrequencySketch &) = delete;
+        FrequencySketch &operator=(const FrequencySketch &) = delete;
+
+        void Increment(uint32_t hash) {
+            uint64_t &word = table_[Index(hash)];
+            bool added = false;
+            for (int i = 0; i < 4; i++) {
+                const int shift = CounterShift(hash, i);
+                if (((word >> shift) & 0xf) < 0xf) {
+                    word += uint64_t{1} << shift;
+                    added = true;
+                }
+            }
+            if (added && ++additions_ >= sample_size_) {
+                Reset();
+            }
+        }
+
+        int Estimate(uint32_t hash) const {
+            const uint64_t word = table_[Index(hash)];
+            int result = 0xf;
+            for (int i = 0; i < 4; i++) {
+                const int count = static_cast<int>((word >> CounterShift(hash, i)) & 0xf);
+                if (count < result) {
+                    result = count;
+                }
+            }
+            return result;
+        }
+
+    private:
+        size_t Index(uint32_t hash) const {
+            return static_cast<size_t>(Rehash(hash)) & mask_;
+        }
+
+        // 第i个计数器在word中的位置, 4组各占4个计数器, 互不重叠.
+        static int CounterShift(uint32_t hash, int i) {
+            const uint32_t h = hash >> (8 * i);
+            return (i * 4 + static_cast<int>(h & 3)) * 4;
+        }
+
+        static uint32_t Rehash(uint32_t x) {
+            x = ((x >> 16) ^ x) * 0x45d9f3b;
+            x = ((x >> 16) ^ x) * 0x45d9f3b;
+            return (x >> 16) ^ x;
+        }
+
+        void Reset() {
+            for (uint64_t &word : table_) {
+                word = (word >> 1) & 0x7777777777777777ULL;
+            }
+            additions_ /= 2;
+        }
+
+        std::vector<uint64_t> table_;
+        size_t mask_;
+        size_t sample_size_;
+        size_t additions_;
+    };
+
+}
+
+#endif //MY_LEVELDB_FREQUENCY_SKETCH_H
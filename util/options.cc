@@ -5,10 +5,37 @@
 #include "leveldb/options.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 
 namespace leveldb {
     Options::Options()
             : comparator(BytewiseComparator()), env(Env::Default()) {
         // fixme
     }
+
+    bool CompressionTypeSupported(CompressionType type) {
+        switch (type) {
+            case kNoCompression:
+                return true;
+            case kSnappyCompression:
+#if HAVE_SNAPPY
+                return true;
+#else
+                return false;
+#endif  // HAVE_SNAPPY
+            case kLZ4Compression:
+#if HAVE_LZ4
+                return true;
+#else
+                return false;
+#endif  // HAVE_LZ4
+            case kZstdCompression:
+#if HAVE_ZSTD
+                return true;
+#else
+                return false;
+#endif  // HAVE_ZSTD
+        }
+        return false;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,496 @@
+//
+// Created by kuiper on 2021/3/11.
+//
+
+#include "leveldb/persistent_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+    namespace {
+
+        // 段文件格式: magic(fixed32) | db_id的长度(fixed32) | db_id | 记录...
+        // 记录格式:
+        //   masked crc32c(fixed32) | file_number(fixed64) | offset(fixed64) | size(fixed32) | data
+        // crc覆盖crc之后的所有内容. offset为kFileTombstone的记录表示EraseFile(file_number), 没有data.
+        const uint32_t kSegmentMagic = 0x70636368;
+        const size_t kRecordHeaderSize = 4 + 8 + 8 + 4;
+        const uint64_t kFileTombstone = ~static_cast<uint64_t>(0);
+        // 等待落盘的段超过这个数量时丢弃新的Insert, Insert不等待磁盘
+        const int kMaxPendingSeals = 2;
+
+        using BlockId = std::pair<uint64_t, uint64_t>;  // (file_number, block offset)
+
+        std::string SegmentFileName(const std::string &dir, uint64_t number) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "/%06llu.pcache", static_cast<unsigned long long>(number));
+            return dir + buf;
+        }
+
+        bool ParseSegmentFileName(const std::string &fname, uint64_t *number) {
+            const std::string suffix = ".pcache";
+            if (fname.size() <= suffix.size() ||
+                fname.compare(fname.size() - suffix.size(), suffix.size(), suffix) != 0) {
+                return false;
+            }
+            uint64_t n = 0;
+            for (size_t i = 0; i < fname.size() - suffix.size(); i++) {
+                if (fname[i] < '0' || fname[i] > '9') {
+                    return false;
+                }
+                n = n * 10 + (fname[i] - '0');
+            }
+            *number = n;
+            return true;
+        }
+
+        bool ParseBlockKey(const Slice &key, BlockId *id) {
+            if (key.size() < 16) {
+                return false;
+            }
+            const char *p = key.data() + key.size() - 16;
+            id->first = DecodeFixed64(p);
+            id->second = DecodeFixed64(p + 8);
+            return true;
+        }
+
+        class PersistentCacheImpl : public PersistentCache {
+        public:
+            PersistentCacheImpl(Env *env, std::string dir, const std::string &db_id, size_t capacity)
+                    : env_(env),
+                      dir_(std::move(dir)),
+                      capacity_(capacity),
+                      segment_size_(std::min<size_t>(std::max<size_t>(capacity / 16, 64 << 10), 16 << 20)),
+                      seals_done_(&mutex_),
+                      active_number_(0),
+                      total_size_(0),
+                      pending_seals_(0) {
+                PutFixed32(&segment_header_, kSegmentMagic);
+                PutFixed32(&segment_header_, static_cast<uint32_t>(db_id.size()));
+                segment_header_.append(db_id);
+            }
+
+            ~PersistentCacheImpl() override {
+                MutexLock l(&mutex_);
+                SealActiveSegment();
+                while (pending_seals_ > 0) {
+                    seals_done_.Wait();
+                }
+            }
+
+            // 扫描已有的段文件重建索引.
+            Status Recover();
+
+            const char *Name() const override { return "leveldb.PersistentCache"; }
+
+            void Insert(const Slice &key, const Slice &data) override;
+
+            bool Lookup(const Slice &key, std::string *data) override;
+
+            void Erase(const Slice &key) override {
+                BlockId id;
+                if (ParseBlockKey(key, &id)) {
+                    MutexLock l(&mutex_);
+                    index_.erase(id);
+                }
+            }
+
+            void EraseFile(uint64_t file_number) override {
+                MutexLock l(&mutex_);
+                EraseFileFromIndex(file_number);
+                // 重启时重放, 之前的段中这个文件的block不会再被加入索引
+                AppendRecord(BlockId(file_number, kFileTombstone), Slice());
+            }
+
+            Stats GetStats() const override {
+                Stats stats;
+                stats.hits = hits_.load(std::memory_order_relaxed);
+                stats.misses = misses_.load(std::memory_order_relaxed);
+                stats.inserts = inserts_.load(std::memory_order_relaxed);
+                MutexLock l(&mutex_);
+                stats.usage = total_size_;
+                stats.capacity = capacity_;
+                return stats;
+            }
+
+        private:
+            struct Location {
+                uint64_t segment;
+                uint64_t offset;    // 记录在段中的起始位置
+                uint32_t size;      // data的长度
+            };
+
+            struct Segment {
+                uint64_t size = 0;
+                std::shared_ptr<RandomAccessFile> file;     // 落盘之前为nullptr
+                std::shared_ptr<const std::string> buffer;  // 正在后台落盘的段的内容
+                std::vector<BlockId> blocks;                // 写入过这个段的block, 删除段时清理索引
+            };
+
+            struct SealTask {
+                PersistentCacheImpl *cache;
+                uint64_t number;
+                std::shared_ptr<const std::string> contents;
+            };
+
+            Status RecoverSegment(uint64_t number);
+
+            void StartActiveSegment(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            void AppendRecord(const BlockId &id, const Slice &data) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            void EraseFileFromIndex(uint64_t file_number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            // 开始一个新的活跃段, 旧的活跃段交给后台线程写成文件.
+            void SealActiveSegment() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            static void BGWriteSegment(void *arg);
+
+            // 在后台线程中执行, 不持有锁.
+            void WriteSegment(uint64_t number, const std::string &contents);
+
+            void DropSegment(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            // 超出容量时从最旧的段开始删除, 活跃段不会被删除.
+            void MaybeDropOldSegments() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+            static bool DecodeRecord(const Slice &record, BlockId *id, Slice *data);
+
+            Env *const env_;
+            const std::string dir_;
+            const size_t capacity_;
+            const size_t segment_size_;
+            std::string segment_header_;    // 构造之后不变
+
+            mutable port::Mutex mutex_;
+            port::CondVar seals_done_;
+            std::map<BlockId, Location> index_ GUARDED_BY(mutex_);
+            std::map<uint64_t, Segment> segments_ GUARDED_BY(mutex_);   // 旧 -> 新
+            uint64_t active_number_ GUARDED_BY(mutex_);
+            std::string active_buf_ GUARDED_BY(mutex_);
+            size_t total_size_ GUARDED_BY(mutex_);
+            int pending_seals_ GUARDED_BY(mutex_);
+
+            std::atomic<uint64_t> hits_{0};
+            std::atomic<uint64_t> misses_{0};
+            std::atomic<uint64_t> inserts_{0};
+        };
+
+        bool PersistentCacheImpl::DecodeRecord(const Slice &record, BlockId *id, Slice *data) {
+            if (record.size() < kRecordHeaderSize) {
+                return false;
+            }
+            const char *p = record.data();
+            const uint32_t size = DecodeFixed32(p + 20);
+            if (record.size() < kRecordHeaderSize + size) {
+                return false;
+            }
+            const uint32_t expected = crc32c::Unmask(DecodeFixed32(p));
+            if (crc32c::Value(p + 4, kRecordHeaderSize - 4 + size) != expected) {
+                return false;
+            }
+            id->first = DecodeFixed64(p + 4);
+            id->second = DecodeFixed64(p + 12);
+            *data = Slice(p + kRecordHeaderSize, size);
+            return true;
+        }
+
+        Status PersistentCacheImpl::Recover() {
+            env_->CreateDir(dir_);  // 已存在时忽略错误
+            std::vector<std::string> children;
+            Status s = env_->GetChildren(dir_, &children);
+            if (!s.IsOK()) {
+                return s;
+            }
+            std::vector<uint64_t> numbers;
+            uint64_t number;
+            for (const std::string &child : children) {
+                if (ParseSegmentFileName(child, &number)) {
+                    numbers.push_back(number);
+                }
+            }
+            std::sort(numbers.begin(), numbers.end());
+
+            MutexLock l(&mutex_);
+            for (uint64_t n : numbers) {
+                if (!RecoverSegment(n).IsOK()) {
+                    // 损坏的段直接丢弃, 不影响其它段
+                    env_->RemoveFile(SegmentFileName(dir_, n));
+                }
+            }
+            StartActiveSegment(numbers.empty() ? 1 : numbers.back() + 1);
+            MaybeDropOldSegments();
+            return Status::OK();
+        }
+
+        Status PersistentCacheImpl::RecoverSegment(uint64_t number) {
+            const std::string fname = SegmentFileName(dir_, number);
+            uint64_t file_size;
+            Status s = env_->GetFileSize(fname, &file_size);
+            if (!s.IsOK()) {
+                return s;
+            }
+            RandomAccessFile *file;
+            s = env_->NewRandomAccessFile(fname, &file);
+            if (!s.IsOK()) {
+                return s;
+            }
+            std::unique_ptr<RandomAccessFile> guard(file);
+
+            // 其它DB(或者旧版本)写的段不可信, 它们的file number与这个DB无关
+            std::string scratch(segment_header_.size(), '\0');
+            Slice result;
+            s = file->Read(0, scratch.size(), &result, &scratch[0]);
+            if (!s.IsOK()) {
+                return s;
+            }
+            if (result != Slice(segment_header_)) {
+                return Status::Corruption(fname, "segment belongs to another db");
+            }
+
+            Segment &segment = segments_[number];
+            segment.file.reset(guard.release());
+            segment.size = file_size;
+
+            uint64_t offset = segment_header_.size();
+            while (offset + kRecordHeaderSize <= file_size) {
+                char header[kRecordHeaderSize];
+                Slice result;
+                s = file->Read(offset, kRecordHeaderSize, &result, header);
+                if (!s.IsOK() || result.size() != kRecordHeaderSize) {
+                    break;
+                }
+                const uint32_t size = DecodeFixed32(result.data() + 20);
+                scratch.resize(kRecordHeaderSize + size);
+                s = file->Read(offset, scratch.size(), &result, &scratch[0]);
+                BlockId id;
+                Slice data;
+                if (!s.IsOK() || !DecodeRecord(result, &id, &data)) {
+                    // 尾部不完整的记录, 之后的内容都不可信
+                    break;
+                }
+                if (id.second == kFileTombstone) {
+                    EraseFileFromIndex(id.first);
+                } else {
+                    index_[id] = Location{number, offset, size};
+                    segment.blocks.push_back(id);
+                }
+                offset += kRecordHeaderSize + size;
+            }
+            total_size_ += file_size;
+            return Status::OK();
+        }
+
+        void PersistentCacheImpl::Insert(const Slice &key, const Slice &data) {
+            BlockId id;
+            if (!ParseBlockKey(key, &id)) {
+                return;
+            }
+            MutexLock l(&mutex_);
+            if (index_.find(id) != index_.end()) {
+                // sstable不可变, 同一个block的内容不会变化
+                return;
+            }
+            const size_t record_size = kRecordHeaderSize + data.size();
+            if (active_buf_.size() > segment_header_.size() && active_buf_.size() + record_size > segment_size_) {
+                if (pending_seals_ >= kMaxPendingSeals) {
+                    // 磁盘跟不上, 放弃这个block
+                    return;
+                }
+                SealActiveSegment();
+            }
+            AppendRecord(id, data);
+            inserts_.fetch_add(1, std::memory_order_relaxed);
+            MaybeDropOldSegments();
+        }
+
+        void PersistentCacheImpl::StartActiveSegment(uint64_t number) {
+            active_number_ = number;
+            active_buf_ = segment_header_;
+            segments_[number].size = segment_header_.size();
+            total_size_ += segment_header_.size();
+        }
+
+        void PersistentCacheImpl::AppendRecord(const BlockId &id, const Slice &data) {
+            const size_t record_size = kRecordHeaderSize + data.size();
+            const uint64_t offset = active_buf_.size();
+            char header[kRecordHeaderSize];
+            EncodeFixed64(header + 4, id.first);
+            EncodeFixed64(header + 12, id.second);
+            EncodeFixed32(header + 20, static_cast<uint32_t>(data.size()));
+            uint32_t crc = crc32c::Value(header + 4, kRecordHeaderSize - 4);
+            crc = crc32c::Extend(crc, data.data(), data.size());
+            EncodeFixed32(header, crc32c::Mask(crc));
+            active_buf_.append(header, kRecordHeaderSize);
+            active_buf_.append(data.data(), data.size());
+
+            Segment &segment = segments_[active_number_];
+            segment.size += record_size;
+            total_size_ += record_size;
+            if (id.second != kFileTombstone) {
+                segment.blocks.push_back(id);
+                index_[id] = Location{active_number_, offset, static_cast<uint32_t>(data.size())};
+            }
+        }
+
+        void PersistentCacheImpl::EraseFileFromIndex(uint64_t file_number) {
+            auto it = index_.lower_bound(BlockId(file_number, 0));
+            while (it != index_.end() && it->first.first == file_number) {
+                it = index_.erase(it);
+            }
+        }
+
+        bool PersistentCacheImpl::Lookup(const Slice &key, std::string *data) {
+            BlockId id;
+            if (!ParseBlockKey(key, &id)) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            std::shared_ptr<RandomAccessFile> file;
+            std::shared_ptr<const std::string> buffer;
+            Location loc{};
+            {
+                MutexLock l(&mutex_);
+                auto it = index_.find(id);
+                if (it == index_.end()) {
+                    misses_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                loc = it->second;
+                if (loc.segment == active_number_) {
+                    data->assign(active_buf_.data() + loc.offset + kRecordHeaderSize, loc.size);
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                const Segment &segment = segments_[loc.segment];
+                file = segment.file;
+                buffer = segment.buffer;
+            }
+
+            // 在锁外读盘, 段即使被并发删除, 打开的文件也仍然可读
+            std::string scratch(kRecordHeaderSize + loc.size, '\0');
+            Slice result;
+            Status s;
+            if (file != nullptr) {
+                s = file->Read(loc.offset, scratch.size(), &result, &scratch[0]);
+            } else {
+                result = Slice(buffer->data() + loc.offset, scratch.size());
+            }
+            BlockId found;
+            Slice payload;
+            if (!s.IsOK() || !DecodeRecord(result, &found, &payload) || found != id) {
+                misses_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            data->assign(payload.data(), payload.size());
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void PersistentCacheImpl::SealActiveSegment() {
+            if (active_buf_.size() <= segment_header_.size()) {
+                return;
+            }
+            const uint64_t number = active_number_;
+            auto contents = std::make_shared<const std::string>(std::move(active_buf_));
+            segments_[number].buffer = contents;
+            StartActiveSegment(number + 1);
+            pending_seals_++;
+            env_->Schedule(&PersistentCacheImpl::BGWriteSegment, new SealTask{this, number, std::move(contents)});
+        }
+
+        void PersistentCacheImpl::BGWriteSegment(void *arg) {
+            std::unique_ptr<SealTask> task(reinterpret_cast<SealTask *>(arg));
+            task->cache->WriteSegment(task->number, *task->contents);
+        }
+
+        void PersistentCacheImpl::WriteSegment(uint64_t number, const std::string &contents) {
+            const std::string fname = SegmentFileName(dir_, number);
+            WritableFile *writer;
+            Status s = env_->NewWritableFile(fname, &writer);
+            if (s.IsOK()) {
+                s = writer->Append(contents);
+                if (s.IsOK()) {
+                    s = writer->Sync();
+                }
+                Status close = writer->Close();
+                if (s.IsOK()) {
+                    s = close;
+                }
+                delete writer;
+            }
+            RandomAccessFile *file = nullptr;
+            if (s.IsOK()) {
+                s = env_->NewRandomAccessFile(fname, &file);
+            }
+
+            MutexLock l(&mutex_);
+            auto it = segments_.find(number);
+            if (it == segments_.end()) {
+                // 落盘期间超出容量被删除了
+                delete file;
+                env_->RemoveFile(fname);
+            } else if (s.IsOK()) {
+                it->second.file.reset(file);
+                it->second.buffer.reset();
+            } else {
+                // 写盘失败, 这一段的数据直接丢弃
+                DropSegment(number);
+            }
+            pending_seals_--;
+            seals_done_.SignalAll();
+        }
+
+        void PersistentCacheImpl::DropSegment(uint64_t number) {
+            auto it = segments_.find(number);
+            if (it == segments_.end()) {
+                return;
+            }
+            for (const BlockId &id : it->second.blocks) {
+                auto pos = index_.find(id);
+                if (pos != index_.end() && pos->second.segment == number) {
+                    index_.erase(pos);
+                }
+            }
+            total_size_ -= it->second.size;
+            segments_.erase(it);
+            env_->RemoveFile(SegmentFileName(dir_, number));
+        }
+
+        void PersistentCacheImpl::MaybeDropOldSegments() {
+            while (total_size_ > capacity_ && segments_.begin()->first != active_number_) {
+                DropSegment(segments_.begin()->first);
+            }
+        }
+
+    }  // namespace
+
+    Status NewPersistentCache(Env *env, const std::string &dir, const std::string &db_id, size_t capacity,
+                              PersistentCache **result) {
+        *result = nullptr;
+        auto *cache = new PersistentCacheImpl(env, dir, db_id, capacity);
+        Status s = cache->Recover();
+        if (s.IsOK()) {
+            *result = cache;
+        } else {
+            delete cache;
+        }
+        return s;
+    }
+
+}
@@ -0,0 +1,41 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#include "leveldb/slice_transform.h"
+
+#include <string>
+
+namespace leveldb {
+
+    namespace {
+
+        class FixedPrefixTransform : public SliceTransform {
+        public:
+            explicit FixedPrefixTransform(size_t prefix_len)
+                    : prefix_len_(prefix_len),
+                      name_("leveldb.FixedPrefix." + std::to_string(prefix_len)) {}
+
+            const char *Name() const override { return name_.c_str(); }
+
+            Slice Transform(const Slice &key) const override {
+                assert(InDomain(key));
+                return Slice(key.data(), prefix_len_);
+            }
+
+            bool InDomain(const Slice &key) const override {
+                return key.size() >= prefix_len_;
+            }
+
+        private:
+            const size_t prefix_len_;
+            const std::string name_;
+        };
+
+    }  // namespace
+
+    const SliceTransform *NewFixedPrefixTransform(size_t prefix_len) {
+        return new FixedPrefixTransform(prefix_len);
+    }
+
+}
@@ -4,6 +4,8 @@
 
 #include "leveldb/status.h"
 #include <algorithm>
+#include <cstdio>
+#include <cstring>
 
 namespace leveldb {
 
@@ -38,8 +40,8 @@ namespace leveldb {
     }
 
     Status &Status::operator=(const Status &rhs) {
-        // Clang tidy
-        if (this == &rhs && state_ != rhs.state_) {
+        // 自赋值或者共享同一个state_时不需要拷贝
+        if (this != &rhs && state_ != rhs.state_) {
             delete[] state_;
             state_ = (rhs.state_ == nullptr) ? nullptr : CopyState(rhs.state_);
         }
@@ -82,7 +84,7 @@ namespace leveldb {
                 type = "IO error: ";
                 break;
             default:
-                std::snprintf(tmp, sizeof(tm), "Unknown code(%d): ", static_cast<int>(code()));
+                std::snprintf(tmp, sizeof(tmp), "Unknown code(%d): ", static_cast<int>(code()));
                 type = tmp;
                 break;
         }
@@ -0,0 +1,250 @@
+//
+// Created by kuiper on 2021/3/10.
+//
+
+#include "leveldb/filter_policy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+    namespace {
+
+        // 3-wise binary fuse filter (XOR filter的改进版本).
+        // 数组分成长度为2的幂的segment, 每个key对应连续3个segment中各一个位置, 3个位置上的指纹异或
+        // 等于key的指纹. 构建时不断摘掉只被一个key使用的位置(peeling), 再按相反的顺序填写指纹.
+        // 每个key约占1.125 * fingerprint_bits位, fingerprint_bits位的误判率是2^-fingerprint_bits;
+        // 同样误判率的bloom filter需要约1.44 * fingerprint_bits位.
+        //
+        // filter格式: 指纹(按位紧密排列) | seed(fixed32) | segment_count(fixed32)
+        //            | segment_length_bits(1字节) | fingerprint_bits(1字节)
+        constexpr size_t kTrailerSize = 10;
+        constexpr int kMaxFingerprintBits = 16;
+        constexpr uint32_t kMaxSegmentLengthBits = 18;
+        // 去重之后构建失败的概率很小, 每次失败换一个seed重试
+        constexpr int kMaxAttempts = 100;
+
+        // 与Hash()相同的结构, 每次处理8个字节, 得到64位的hash.
+        uint64_t XorHash(const Slice &key) {
+            const uint64_t m = 0xc6a4a7935bd1e995ull;
+            const char *data = key.data();
+            const char *limit = data + key.size();
+            uint64_t h = 0x2f0e1eb5ull ^ (key.size() * m);
+            while (data + 8 <= limit) {
+                uint64_t w = DecodeFixed64(data);
+                data += 8;
+                w *= m;
+                w ^= w >> 47;
+                w *= m;
+                h ^= w;
+                h *= m;
+            }
+            uint64_t w = 0;
+            for (int i = static_cast<int>(limit - data) - 1; i >= 0; i--) {
+                w = (w << 8) | static_cast<uint8_t>(data[i]);
+            }
+            h ^= w;
+            h *= m;
+            h ^= h >> 47;
+            h *= m;
+            h ^= h >> 47;
+            return h;
+        }
+
+        inline uint64_t Mix(uint64_t h, uint32_t seed) {
+            h += seed;
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        inline uint32_t Fingerprint(uint64_t h, uint32_t mask) {
+            return static_cast<uint32_t>(h ^ (h >> 32)) & mask;
+        }
+
+        struct Layout {
+            uint32_t segment_length_bits;
+            uint32_t segment_count;
+
+            uint32_t segment_length() const { return 1u << segment_length_bits; }
+
+            uint32_t array_length() const { return (segment_count + 2) << segment_length_bits; }
+
+            // h对应的3个位置, 分别在第s, s+1, s+2个segment中
+            void Positions(uint64_t h, uint32_t pos[3]) const {
+                const uint64_t range = static_cast<uint64_t>(segment_count) << segment_length_bits;
+                const uint32_t mask = segment_length() - 1;
+                // (h * range) >> 64, range < 2^32
+                const uint64_t high = (h >> 32) * range + (((h & 0xffffffffull) * range) >> 32);
+                pos[0] = static_cast<uint32_t>(high >> 32);
+                pos[1] = (pos[0] + segment_length()) ^ (static_cast<uint32_t>(h >> 18) & mask);
+                pos[2] = (pos[0] + 2 * segment_length()) ^ (static_cast<uint32_t>(h) & mask);
+            }
+        };
+
+        // 参数取自binary fuse filter的论文: key少时segment短, 需要的额外空间比例大.
+        Layout ChooseLayout(size_t n) {
+            Layout layout;
+            const double size = static_cast<double>(n);
+            uint32_t bits = n <= 1 ? 2 : static_cast<uint32_t>(std::floor(std::log(size) / std::log(3.33) + 2.25));
+            layout.segment_length_bits = std::min(bits, kMaxSegmentLengthBits);
+            const double factor = n <= 1 ? 0 : std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log(size));
+            const auto capacity = static_cast<uint64_t>(std::round(size * factor));
+            const uint64_t segments = (capacity + layout.segment_length() - 1) >> layout.segment_length_bits;
+            layout.segment_count = segments <= 2 ? 1 : static_cast<uint32_t>(segments - 2);
+            return layout;
+        }
+
+        // 把hashes放进layout, 成功时order中是摘除顺序的(hash, 位置).
+        bool Peel(const std::vector<uint64_t> &hashes, const Layout &layout, uint32_t seed,
+                  std::vector<std::pair<uint64_t, uint32_t>> *order) {
+            const uint32_t m = layout.array_length();
+            std::vector<uint8_t> count(m, 0);
+            std::vector<uint64_t> xors(m, 0);
+            uint32_t pos[3];
+            for (uint64_t base : hashes) {
+                const uint64_t h = Mix(base, seed);
+                layout.Positions(h, pos);
+                for (uint32_t p : pos) {
+                    if (count[p] == 255) {
+                        return false;
+                    }
+                    count[p]++;
+                    xors[p] ^= h;
+                }
+            }
+
+            std::vector<uint32_t> alone;
+            for (uint32_t i = 0; i < m; i++) {
+                if (count[i] == 1) {
+                    alone.push_back(i);
+                }
+            }
+            order->clear();
+            while (!alone.empty()) {
+                const uint32_t i = alone.back();
+                alone.pop_back();
+                if (count[i] != 1) {
+                    continue;
+                }
+                const uint64_t h = xors[i];
+                order->emplace_back(h, i);
+                layout.Positions(h, pos);
+                for (uint32_t p : pos) {
+                    count[p]--;
+                    xors[p] ^= h;
+                    if (count[p] == 1) {
+                        alone.push_back(p);
+                    }
+                }
+            }
+            return order->size() == hashes.size();
+        }
+
+        class XorFilterPolicy : public FilterPolicy {
+        public:
+            // 与bloom filter每key bits_per_key位的误判率相当: 0.6185^bits_per_key ~= 2^(-0.69 * bits_per_key)
+            explicit XorFilterPolicy(int bits_per_key)
+                    : fingerprint_bits_(std::max(1, std::min(kMaxFingerprintBits, (2 * bits_per_key + 1) / 3))) {}
+
+            const char *Name() const override { return "leveldb.BinaryFuseFilter"; }
+
+            void CreateFilter(const Slice *keys, int n, std::string *dst) const override {
+                std::vector<uint64_t> hashes(n);
+                for (int i = 0; i < n; i++) {
+                    hashes[i] = XorHash(keys[i]);
+                }
+                // 重复的key(例如同一个user key的多个版本)无法peeling
+                std::sort(hashes.begin(), hashes.end());
+                hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+                const Layout layout = ChooseLayout(hashes.size());
+                std::vector<std::pair<uint64_t, uint32_t>> order;
+                uint32_t seed = 0;
+                bool ok = false;
+                for (int attempt = 0; attempt < kMaxAttempts && !ok; attempt++) {
+                    seed = static_cast<uint32_t>(attempt) * 0x9e3779b9u;
+                    ok = Peel(hashes, layout, seed, &order);
+                }
+
+                const uint32_t m = layout.array_length();
+                const uint32_t mask = (1u << fingerprint_bits_) - 1;
+                std::vector<uint16_t> fingerprints(m, 0);
+                uint32_t pos[3];
+                // 后摘掉的key的位置先确定, 摘掉一个key时它的位置只被它自己使用
+                for (auto it = order.rbegin(); ok && it != order.rend(); ++it) {
+                    layout.Positions(it->first, pos);
+                    fingerprints[it->second] = static_cast<uint16_t>(
+                            Fingerprint(it->first, mask) ^ fingerprints[pos[0]] ^ fingerprints[pos[1]] ^
+                            fingerprints[pos[2]]);
+                }
+
+                const size_t init_size = dst->size();
+                const uint64_t bits = static_cast<uint64_t>(m) * fingerprint_bits_;
+                dst->resize(init_size + (bits + 7) / 8, 0);
+                auto *array = reinterpret_cast<uint8_t *>(&(*dst)[init_size]);
+                for (uint32_t i = 0; ok && i < m; i++) {
+                    const uint64_t bit = static_cast<uint64_t>(i) * fingerprint_bits_;
+                    const uint32_t value = static_cast<uint32_t>(fingerprints[i]) << (bit & 7);
+                    for (int b = 0; b < 3 && (value >> (8 * b)) != 0; b++) {
+                        array[(bit >> 3) + b] |= static_cast<uint8_t>(value >> (8 * b));
+                    }
+                }
+                PutFixed32(dst, seed);
+                PutFixed32(dst, layout.segment_count);
+                dst->push_back(static_cast<char>(layout.segment_length_bits));
+                // 构建失败时fingerprint_bits为0, 所有key都可能匹配
+                dst->push_back(static_cast<char>(ok ? fingerprint_bits_ : 0));
+            }
+
+            bool KeyMayMatch(const Slice &key, const Slice &filter) const override {
+                const size_t len = filter.size();
+                if (len < kTrailerSize) {
+                    return false;
+                }
+                const char *trailer = filter.data() + len - kTrailerSize;
+                Layout layout;
+                const uint32_t seed = DecodeFixed32(trailer);
+                layout.segment_count = DecodeFixed32(trailer + 4);
+                layout.segment_length_bits = static_cast<uint8_t>(trailer[8]);
+                const int fingerprint_bits = static_cast<uint8_t>(trailer[9]);
+                if (fingerprint_bits == 0 || fingerprint_bits > kMaxFingerprintBits ||
+                    layout.segment_length_bits > kMaxSegmentLengthBits || layout.segment_count == 0 ||
+                    (static_cast<uint64_t>(layout.array_length()) * fingerprint_bits + 7) / 8 !=
+                    len - kTrailerSize) {
+                    // 构建失败或者是以后的格式, 认为可能匹配
+                    return true;
+                }
+
+                const uint64_t h = Mix(XorHash(key), seed);
+                uint32_t pos[3];
+                layout.Positions(h, pos);
+                const uint32_t mask = (1u << fingerprint_bits) - 1;
+                uint32_t f = Fingerprint(h, mask);
+                for (uint32_t p : pos) {
+                    // 一个指纹最多跨3个字节, 数组之后还有trailer, 读4个字节不会越界
+                    const uint64_t bit = static_cast<uint64_t>(p) * fingerprint_bits;
+                    f ^= (DecodeFixed32(filter.data() + (bit >> 3)) >> (bit & 7)) & mask;
+                }
+                return f == 0;
+            }
+
+        private:
+            const int fingerprint_bits_;
+        };
+
+    }  // namespace
+
+    const FilterPolicy *NewXorFilterPolicy(int bits_per_key) {
+        return new XorFilterPolicy(bits_per_key);
+    }
+
+}